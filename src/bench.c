@@ -0,0 +1,629 @@
+// Headless benchmark of the renderer.
+//
+// Renders a fixed, deterministic sequence of frames of the demo scene (the rotation angle of frame `i` is
+// `i / frames * 2pi`, camera never moves), or the frames of a log recorded with `demo --record` (see replay.h) with the
+// toggles of the GUI they were recorded with (shadows, colors, only redrawing what changed, the resolution), timing
+// each stage of the pipeline separately, and prints the results in a machine-readable format (CSV or JSON) for tracking
+// regressions across versions.
+//
+// Usage: bench [--frames N] [--warmup N] [--width N] [--height N] [--shader NAME|INDEX] [--layout linear|tiled]
+//              [--msaa 1|4|8] [--spans] [--colors] [--format csv|json] [--per-frame] [--trace PATH] [--replay PATH]
+//
+// The kernels are dispatched to the best instruction set of the CPU, set `RENDER_ISA` to benchmark another one (see
+// dispatch.h).
+
+#include <time.h>
+#include <strings.h>
+
+#include "common.h"
+#include "linear_alg.h"
+#include "teapot.h"
+#include "cube.h"
+#include "demo.h"
+#include "dispatch.h"
+#include "render.h"
+#include "frame.h"
+#include "scene.h"
+#include "resolution.h"
+#include "shaders.h"
+#include "trace.h"
+#include "replay.h"
+
+typedef enum output_format {
+  OUTPUT_FORMAT_CSV,
+  OUTPUT_FORMAT_JSON,
+} OutputFormat;
+
+typedef struct bench_options {
+  usize frames;
+  usize warmup;
+  usize width;
+  usize height;
+  ShaderKind shader_kind;
+  /// Of the depth and frame buffers, tiled ones are detiled before the shading stage, like for presenting them.
+  RenderLayout layout;
+  /// Samples per pixel of multisample anti-aliasing, 1 for none. The colors are resolved in the shading stage.
+  usize samples;
+  /// Draw with a draw span callback instead of the draw pixel callback, see `rasterize_triangle_spans`.
+  bool spans;
+  /// Draw the vertex colors of the meshes too (see color.h), composed with the light levels in the shading stage. With
+  /// `replay_path`, whether any frame of the log does.
+  bool colors;
+  OutputFormat format;
+  /// Print one record per frame instead of a summary.
+  bool per_frame;
+  /// Write a timeline of the measured frames to this path, see trace.h.
+  const char *trace_path;
+  /// Render the frames of this log instead, `frames`, `shader_kind` and the toggles (see `FrameToggles`) are then taken
+  /// from the log. Without it, every frame is redrawn whole, without shadows, with `colors`.
+  const char *replay_path;
+} BenchOptions;
+
+/// Timings of one frame, in nanoseconds.
+typedef struct frame_timings {
+  u64 clear_ns;
+  u64 transform_ns;
+  u64 raster_ns;
+  u64 shade_ns;
+  u64 total_ns;
+  usize triangles;
+  usize fragments;
+  /// Only valid if compiled with `RENDER_STATS`.
+  RenderStats stats;
+} FrameTimings;
+
+/// Plays the role of `GuiPainter` but without a window.
+typedef struct bench_painter {
+  /// The colors are only allocated if a frame draws them, the shadow map if a frame has shadows, which is drawn in the
+  /// raster stage.
+  FrameTargets frame;
+  /// Only with colors, the vertex colors of the teapot and the cube, see `demo_vertex_colors`.
+  f32 *teapot_colors;
+  f32 *cube_colors;
+  /// The objects, for where they are redrawn (see `scene_dirty_rect`) and for casting shadows.
+  Mesh teapot_mesh;
+  Mesh cube_mesh;
+  Scene scene;
+  usize teapot_id;
+  usize cube_id;
+  /// Number of pixels drawn by the draw pixel (or span) callback.
+  usize fragments;
+} BenchPainter;
+
+static inline u64 now_ns() {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (u64)t.tv_sec * 1000000000 + (u64)t.tv_nsec;
+}
+
+static void bench_draw_pixel_callback(void *cx_,
+                                      usize width,
+                                      usize height,
+                                      usize x,
+                                      usize y,
+                                      f32 z,
+                                      u8 light_level,
+                                      u8 coverage,
+                                      const Varyings *varyings) {
+  BenchPainter *cx = cx_;
+  frame_targets_draw_pixel(&cx->frame, x, y, light_level, coverage, varyings);
+  ++cx->fragments;
+}
+
+static void bench_draw_span_callback(void *cx_,
+                                     usize width,
+                                     usize height,
+                                     usize y,
+                                     usize x_begin,
+                                     usize x_end,
+                                     const f32 *depths,
+                                     u8 light_level,
+                                     const u8 *coverage,
+                                     const Varyings *varyings) {
+  BenchPainter *cx = cx_;
+  frame_targets_draw_span(&cx->frame, y, x_begin, x_end, depths, light_level, coverage, varyings);
+  cx->fragments += x_end - x_begin;
+}
+
+[[gnu::noreturn]] static void usage_exit(const char *argv0) {
+  fprintf(stderr,
+          "Usage: %s [--frames N] [--warmup N] [--width N] [--height N] [--shader NAME|INDEX] [--layout linear|tiled] "
+          "[--msaa 1|4|8] [--spans] [--colors] [--format csv|json] [--per-frame] [--trace PATH] [--replay PATH]\n",
+          argv0);
+  exit(1);
+}
+
+static usize parse_usize_arg(const char *argv0, const char *arg) {
+  char *end;
+  unsigned long long x = strtoull(arg, &end, 10);
+  if (*arg == '\0' || *end != '\0')
+    usage_exit(argv0);
+  return (usize)x;
+}
+
+static ShaderKind parse_shader_arg(const char *argv0, const char *arg) {
+  for (ShaderKind kind = SHADER_KIND_DEFAULT; kind <= SHADER_KIND_HIGHLIGHT_ONLY; ++kind) {
+    if (strcasecmp(arg, shader_name(kind)) == 0)
+      return kind;
+  }
+  usize index = parse_usize_arg(argv0, arg);
+  if (index > SHADER_KIND_HIGHLIGHT_ONLY)
+    usage_exit(argv0);
+  return (ShaderKind)index;
+}
+
+static BenchOptions parse_options(i32 argc, char **argv) {
+  BenchOptions options = {
+      .frames = 360,
+      .warmup = 10,
+      .width = 800,
+      .height = 800,
+      .shader_kind = SHADER_KIND_DEFAULT,
+      .layout = RENDER_LAYOUT_LINEAR,
+      .samples = 1,
+      .spans = false,
+      .colors = false,
+      .format = OUTPUT_FORMAT_CSV,
+      .per_frame = false,
+      .trace_path = NULL,
+      .replay_path = NULL,
+  };
+  for (i32 i = 1; i < argc; ++i) {
+    const char *arg = argv[i];
+    bool has_value = i + 1 < argc;
+    if (strcmp(arg, "--per-frame") == 0) {
+      options.per_frame = true;
+    } else if (strcmp(arg, "--spans") == 0) {
+      options.spans = true;
+    } else if (strcmp(arg, "--colors") == 0) {
+      options.colors = true;
+    } else if (strcmp(arg, "--frames") == 0 && has_value) {
+      options.frames = parse_usize_arg(argv[0], argv[++i]);
+    } else if (strcmp(arg, "--warmup") == 0 && has_value) {
+      options.warmup = parse_usize_arg(argv[0], argv[++i]);
+    } else if (strcmp(arg, "--width") == 0 && has_value) {
+      options.width = parse_usize_arg(argv[0], argv[++i]);
+    } else if (strcmp(arg, "--height") == 0 && has_value) {
+      options.height = parse_usize_arg(argv[0], argv[++i]);
+    } else if (strcmp(arg, "--shader") == 0 && has_value) {
+      options.shader_kind = parse_shader_arg(argv[0], argv[++i]);
+    } else if (strcmp(arg, "--replay") == 0 && has_value) {
+      options.replay_path = argv[++i];
+    } else if (strcmp(arg, "--trace") == 0 && has_value) {
+      options.trace_path = argv[++i];
+    } else if (strcmp(arg, "--layout") == 0 && has_value) {
+      const char *layout = argv[++i];
+      if (strcmp(layout, "linear") == 0)
+        options.layout = RENDER_LAYOUT_LINEAR;
+      else if (strcmp(layout, "tiled") == 0)
+        options.layout = RENDER_LAYOUT_TILED;
+      else
+        usage_exit(argv[0]);
+    } else if (strcmp(arg, "--msaa") == 0 && has_value) {
+      options.samples = parse_usize_arg(argv[0], argv[++i]);
+      if (options.samples != 1 && options.samples != 4 && options.samples != 8)
+        usage_exit(argv[0]);
+    } else if (strcmp(arg, "--format") == 0 && has_value) {
+      const char *format = argv[++i];
+      if (strcmp(format, "csv") == 0)
+        options.format = OUTPUT_FORMAT_CSV;
+      else if (strcmp(format, "json") == 0)
+        options.format = OUTPUT_FORMAT_JSON;
+      else
+        usage_exit(argv[0]);
+    } else {
+      usage_exit(argv[0]);
+    }
+  }
+  if (options.frames == 0 || options.width == 0 || options.height == 0)
+    usage_exit(argv[0]);
+  return options;
+}
+
+/// Append the triangles of an object to `triangles`, in the same order `draw_object` would draw them. `colors`, if
+/// not `NULL`, are the vertex colors of the object (see color.h).
+static usize project_object(Renderer *renderer,
+                            const Vec3 *vertices,
+                            usize vertices_len,
+                            const usize *indices,
+                            usize indices_len,
+                            const f32 *colors,
+                            Mat4x4 m,
+                            ProjectedTriangle *triangles) {
+  ArenaMark mark = arena_mark(&renderer->arena);
+  Vec3 *world = arena_alloc(&renderer->arena, Vec3, vertices_len);
+  Vec3 *projected = arena_alloc(&renderer->arena, Vec3, vertices_len);
+  project_vertices(renderer, vertices, vertices_len, m, world, projected);
+  for (usize i = 0; i < indices_len; i += 3) {
+    triangles[i / 3] = assemble_triangle(renderer, world, projected, indices[i + 0], indices[i + 1], indices[i + 2]);
+    if (colors != NULL)
+      triangle_set_attributes(
+          &triangles[i / 3], colors, COLOR_VARYINGS, indices[i + 0], indices[i + 1], indices[i + 2]);
+  }
+  arena_restore(&renderer->arena, mark);
+  return indices_len / 3;
+}
+
+/// Append the triangles of an object to `triangles`, in the same order `draw_object_indexless` would draw them.
+/// `colors` as `project_object`.
+static usize project_object_indexless(Renderer *renderer,
+                                      const Vec3 *vertices,
+                                      usize vertices_len,
+                                      const f32 *colors,
+                                      Mat4x4 m,
+                                      ProjectedTriangle *triangles) {
+  ArenaMark mark = arena_mark(&renderer->arena);
+  Vec3 *world = arena_alloc(&renderer->arena, Vec3, vertices_len);
+  Vec3 *projected = arena_alloc(&renderer->arena, Vec3, vertices_len);
+  project_vertices(renderer, vertices, vertices_len, m, world, projected);
+  for (usize i = 0; i < vertices_len; i += 3) {
+    triangles[i / 3] = assemble_triangle(renderer, world, projected, i + 0, i + 1, i + 2);
+    if (colors != NULL)
+      triangle_set_attributes(&triangles[i / 3], colors, COLOR_VARYINGS, i + 0, i + 1, i + 2);
+  }
+  arena_restore(&renderer->arena, mark);
+  return vertices_len / 3;
+}
+
+/// Render one frame of the sequence, at the renderer's resolution, with the toggles already set on `painter->frame`.
+static FrameTimings bench_frame(const BenchOptions *options,
+                                Renderer *renderer,
+                                BenchPainter *painter,
+                                Mat4x4 transform,
+                                ShaderKind shader_kind,
+                                bool redraw_all) {
+  TRACE_SCOPE("frame");
+  FrameTimings timings = {0};
+  FrameTargets *frame = &painter->frame;
+  painter->fragments = 0;
+
+  u64 t0 = now_ns();
+  // Only what changed since the last frame is cleared and redrawn, like in the GUI.
+  if (memcmp(&painter->scene.objects[painter->teapot_id].instance.m, &transform, sizeof(Mat4x4)) != 0) {
+    scene_set_transform(&painter->scene, painter->teapot_id, transform);
+    scene_set_transform(&painter->scene, painter->cube_id, transform);
+  }
+  renderer->scissor =
+      frame_targets_redrawn_rect(frame, renderer, scene_dirty_rect(&painter->scene, renderer), redraw_all);
+  renderer_clear_frame(renderer);
+  frame_targets_clear(frame, renderer);
+
+  u64 t1 = now_ns();
+  // Until the next frame, like everything else in the renderer's arena.
+  ProjectedTriangle *triangles =
+      arena_alloc(&renderer->arena, ProjectedTriangle, ARR_LEN(teapot) / 3 + ARR_LEN(cube_indices) / 3);
+  usize triangles_len = 0;
+  {
+    TRACE_SCOPE("transform");
+    triangles_len += project_object_indexless(renderer,
+                                              ARR_ARG(teapot),
+                                              frame->colors ? painter->teapot_colors : NULL,
+                                              transform,
+                                              &triangles[triangles_len]);
+    triangles_len += project_object(renderer,
+                                    ARR_ARG(cube_vertices),
+                                    ARR_ARG(cube_indices),
+                                    frame->colors ? painter->cube_colors : NULL,
+                                    transform,
+                                    &triangles[triangles_len]);
+  }
+
+  u64 t2 = now_ns();
+  {
+    TRACE_SCOPE("raster");
+    const Mesh *casters[] = {&painter->teapot_mesh, &painter->cube_mesh};
+    frame_targets_draw_shadow_map(frame, renderer->light, casters, (Mat4x4[]){transform, transform}, ARR_LEN(casters));
+    for (usize j = 0; j < triangles_len && options->spans; ++j) {
+      rasterize_triangle_spans(renderer, triangles[j], bench_draw_span_callback);
+    }
+    for (usize j = 0; j < triangles_len && !options->spans; ++j) {
+      rasterize_triangle(renderer, triangles[j], bench_draw_pixel_callback);
+    }
+  }
+
+  u64 t3 = now_ns();
+  {
+    TRACE_SCOPE("shade");
+    frame_targets_shade(frame, renderer, shader_kind);
+  }
+
+  u64 t4 = now_ns();
+  timings.clear_ns = t1 - t0;
+  timings.transform_ns = t2 - t1;
+  timings.raster_ns = t3 - t2;
+  timings.shade_ns = t4 - t3;
+  timings.total_ns = t4 - t0;
+  timings.triangles = triangles_len;
+  timings.fragments = painter->fragments;
+  renderer_stats(renderer, &timings.stats);
+  return timings;
+}
+
+static i32 compare_u64(const void *x_, const void *y_) {
+  u64 x = *(const u64 *)x_;
+  u64 y = *(const u64 *)y_;
+  return (x > y) - (x < y);
+}
+
+/// Nearest-rank percentile of a sorted array.
+static u64 percentile(const u64 *sorted, usize len, f64 p) {
+  usize rank = (usize)ceil(p / 100.0 * (f64)len);
+  return sorted[rank == 0 ? 0 : rank - 1];
+}
+
+/// Print the pipeline statistics as CSV columns or JSON fields, or nothing if they are not collected.
+static void print_stats(const BenchOptions *options, const RenderStats *stats, f64 n) {
+  if (!render_stats_enabled())
+    return;
+  if (options->format == OUTPUT_FORMAT_CSV)
+    printf(",%.0f,%.0f,%.0f,%.0f,%.0f,%.0f,%.0f,%.0f,%.0f,%.3f",
+           (f64)stats->objects_culled / n,
+           (f64)stats->objects_occluded / n,
+           (f64)stats->triangles_submitted / n,
+           (f64)stats->triangles_culled / n,
+           (f64)stats->triangles_rasterized / n,
+           (f64)stats->pixels_tested / n,
+           (f64)stats->depth_test_passes / n,
+           (f64)stats->pixels_covered / n,
+           (f64)stats->callback_invocations / n,
+           render_stats_overdraw(stats));
+  else
+    printf(", \"stats\": {\"objects_culled\": %.0f, \"objects_occluded\": %.0f, \"triangles_submitted\": %.0f, "
+           "\"triangles_culled\": %.0f, \"triangles_rasterized\": %.0f, \"pixels_tested\": %.0f, "
+           "\"depth_test_passes\": %.0f, \"pixels_covered\": %.0f, \"callback_invocations\": %.0f, \"overdraw\": %.3f}",
+           (f64)stats->objects_culled / n,
+           (f64)stats->objects_occluded / n,
+           (f64)stats->triangles_submitted / n,
+           (f64)stats->triangles_culled / n,
+           (f64)stats->triangles_rasterized / n,
+           (f64)stats->pixels_tested / n,
+           (f64)stats->depth_test_passes / n,
+           (f64)stats->pixels_covered / n,
+           (f64)stats->callback_invocations / n,
+           render_stats_overdraw(stats));
+}
+
+/// CSV header of the columns printed by `print_stats`.
+static const char *stats_csv_header() {
+  if (!render_stats_enabled())
+    return "";
+  return ",objects_culled,objects_occluded,triangles_submitted,triangles_culled,triangles_rasterized,pixels_tested,"
+         "depth_test_passes,pixels_covered,callback_invocations,overdraw";
+}
+
+static void print_per_frame(const BenchOptions *options, const FrameTimings *timings) {
+  if (options->format == OUTPUT_FORMAT_CSV)
+    printf("frame,clear_ns,transform_ns,raster_ns,shade_ns,total_ns,triangles,fragments%s\n", stats_csv_header());
+  else
+    printf("[\n");
+  for (usize i = 0; i < options->frames; ++i) {
+    const FrameTimings *t = &timings[i];
+    if (options->format == OUTPUT_FORMAT_CSV)
+      printf("%zu,%llu,%llu,%llu,%llu,%llu,%zu,%zu",
+             i,
+             (unsigned long long)t->clear_ns,
+             (unsigned long long)t->transform_ns,
+             (unsigned long long)t->raster_ns,
+             (unsigned long long)t->shade_ns,
+             (unsigned long long)t->total_ns,
+             t->triangles,
+             t->fragments);
+    else
+      printf("  {\"frame\": %zu, \"clear_ns\": %llu, \"transform_ns\": %llu, \"raster_ns\": %llu, \"shade_ns\": %llu, "
+             "\"total_ns\": %llu, \"triangles\": %zu, \"fragments\": %zu",
+             i,
+             (unsigned long long)t->clear_ns,
+             (unsigned long long)t->transform_ns,
+             (unsigned long long)t->raster_ns,
+             (unsigned long long)t->shade_ns,
+             (unsigned long long)t->total_ns,
+             t->triangles,
+             t->fragments);
+    print_stats(options, &t->stats, 1);
+    if (options->format == OUTPUT_FORMAT_CSV)
+      printf("\n");
+    else
+      printf("}%s\n", i + 1 == options->frames ? "" : ",");
+  }
+  if (options->format == OUTPUT_FORMAT_JSON)
+    printf("]\n");
+}
+
+/// The shader column of the summary.
+static const char *shader_label(const BenchOptions *options) {
+  // Replays may switch shaders from frame to frame.
+  return options->replay_path != NULL ? "REPLAY" : shader_name(options->shader_kind);
+}
+
+static const char *layout_name(RenderLayout layout) {
+  return layout == RENDER_LAYOUT_TILED ? "tiled" : "linear";
+}
+
+static void print_summary(const BenchOptions *options, const FrameTimings *timings) {
+  usize frames = options->frames;
+  u64 clear_ns = 0, transform_ns = 0, raster_ns = 0, shade_ns = 0, total_ns = 0;
+  usize triangles = 0, fragments = 0;
+  RenderStats stats = {0};
+  u64 *frame_ns = xalloc(u64, frames);
+  for (usize i = 0; i < frames; ++i) {
+    clear_ns += timings[i].clear_ns;
+    transform_ns += timings[i].transform_ns;
+    raster_ns += timings[i].raster_ns;
+    shade_ns += timings[i].shade_ns;
+    total_ns += timings[i].total_ns;
+    triangles += timings[i].triangles;
+    fragments += timings[i].fragments;
+    render_stats_add(&stats, &timings[i].stats);
+    frame_ns[i] = timings[i].total_ns;
+  }
+  qsort(frame_ns, frames, sizeof(u64), compare_u64);
+  f64 n = (f64)frames;
+  // Triangles go through both the transform and the raster stage, fragments are only produced by the raster stage.
+  f64 triangles_per_sec = (f64)triangles / ((f64)(transform_ns + raster_ns) / 1e9);
+  f64 fragments_per_sec = (f64)fragments / ((f64)raster_ns / 1e9);
+
+  if (options->format == OUTPUT_FORMAT_CSV) {
+    printf("width,height,shader,isa,layout,msaa,frames,clear_ns,transform_ns,raster_ns,shade_ns,frame_min_ns,"
+           "frame_median_ns,frame_p99_ns,frame_mean_ns,triangles_per_sec,fragments_per_sec%s\n",
+           stats_csv_header());
+    printf("%zu,%zu,%s,%s,%s,%zu,%zu,%.0f,%.0f,%.0f,%.0f,%llu,%llu,%llu,%.0f,%.0f,%.0f",
+           options->width,
+           options->height,
+           shader_label(options),
+           isa_name(kernels.isa),
+           layout_name(options->layout),
+           options->samples,
+           frames,
+           (f64)clear_ns / n,
+           (f64)transform_ns / n,
+           (f64)raster_ns / n,
+           (f64)shade_ns / n,
+           (unsigned long long)frame_ns[0],
+           (unsigned long long)percentile(frame_ns, frames, 50),
+           (unsigned long long)percentile(frame_ns, frames, 99),
+           (f64)total_ns / n,
+           triangles_per_sec,
+           fragments_per_sec);
+    print_stats(options, &stats, n);
+    printf("\n");
+  } else {
+    printf("{\n");
+    printf("  \"width\": %zu,\n", options->width);
+    printf("  \"height\": %zu,\n", options->height);
+    printf("  \"shader\": \"%s\",\n", shader_label(options));
+    printf("  \"isa\": \"%s\",\n", isa_name(kernels.isa));
+    printf("  \"layout\": \"%s\",\n", layout_name(options->layout));
+    printf("  \"msaa\": %zu,\n", options->samples);
+    printf("  \"frames\": %zu,\n", frames);
+    printf("  \"stages_mean_ns\": {\"clear\": %.0f, \"transform\": %.0f, \"raster\": %.0f, \"shade\": %.0f},\n",
+           (f64)clear_ns / n,
+           (f64)transform_ns / n,
+           (f64)raster_ns / n,
+           (f64)shade_ns / n);
+    printf("  \"frame_ns\": {\"min\": %llu, \"median\": %llu, \"p99\": %llu, \"mean\": %.0f},\n",
+           (unsigned long long)frame_ns[0],
+           (unsigned long long)percentile(frame_ns, frames, 50),
+           (unsigned long long)percentile(frame_ns, frames, 99),
+           (f64)total_ns / n);
+    printf("  \"triangles_per_sec\": %.0f,\n", triangles_per_sec);
+    printf("  \"fragments_per_sec\": %.0f", fragments_per_sec);
+    print_stats(options, &stats, n);
+    printf("\n}\n");
+  }
+  xfree(frame_ns);
+}
+
+i32 main(i32 argc, char **argv) {
+  BenchOptions options = parse_options(argc, argv);
+  // The demo's.
+  const usize shadow_map_size = 1024;
+  FrameLog log = {0};
+  // Whether any frame has shadows, for allocating the shadow map.
+  bool shadows = false;
+  if (options.replay_path != NULL) {
+    ASSERT_PRINTF(load_frame_log(options.replay_path, &log), "Cannot load %s\n", options.replay_path);
+    ASSERT_PRINTF(log.len != 0, "%s has no frames\n", options.replay_path);
+    options.frames = log.len;
+    options.colors = false;
+    for (usize i = 0; i < log.len; ++i) {
+      options.colors |= log.frames[i].toggles.colors;
+      shadows |= log.frames[i].toggles.shadows;
+    }
+  }
+
+  Renderer renderer = new_renderer(options.width, options.height, demo_camera(), demo_light());
+  renderer.layout = options.layout;
+  renderer_set_samples(&renderer, options.samples);
+  BenchPainter painter = {
+      .frame = new_frame_targets(options.width,
+                                 options.height,
+                                 options.layout,
+                                 options.samples,
+                                 options.colors,
+                                 shadows ? shadow_map_size : 0),
+      .teapot_mesh = new_mesh(ARR_ARG(teapot), NULL, 0),
+      .cube_mesh = new_mesh(ARR_ARG(cube_vertices), ARR_ARG(cube_indices)),
+      .scene = new_scene(),
+      .fragments = 0,
+  };
+  Mat4x4 base_transform = demo_base_transform();
+  painter.teapot_id = scene_add_object(&painter.scene, &painter.teapot_mesh, new_instance(&renderer, base_transform));
+  painter.cube_id = scene_add_object(&painter.scene, &painter.cube_mesh, new_instance(&renderer, base_transform));
+  if (options.colors) {
+    painter.teapot_colors = xalloc(f32, ARR_LEN(teapot) * COLOR_VARYINGS);
+    demo_vertex_colors(ARR_ARG(teapot), painter.teapot_colors);
+    painter.cube_colors = xalloc(f32, ARR_LEN(cube_vertices) * COLOR_VARYINGS);
+    demo_vertex_colors(ARR_ARG(cube_vertices), painter.cube_colors);
+  }
+  renderer.draw_pixel_callback_cx = &painter;
+  FrameTimings *timings = xalloc(FrameTimings, options.frames);
+
+#ifdef DEBUG
+  bool shadows_drawn = false;
+#endif
+  // Warmup frames are the first frames of the sequence rendered an extra time.
+  for (usize i = 0; i < options.warmup + options.frames; ++i) {
+    usize frame = i < options.warmup ? i % options.frames : i - options.warmup;
+    Mat4x4 rotation;
+    ShaderKind shader_kind = options.shader_kind;
+    FrameToggles toggles = {
+        .shadows = false,
+        .shadow_filter = SHADOW_FILTER_PCF_2X2,
+        .colors = options.colors,
+        .redraw_all = true,
+        .dynamic_resolution = false,
+        .resolution_scale = 1,
+    };
+    if (options.replay_path != NULL) {
+      apply_frame_input(&log.frames[frame], &renderer, &shader_kind, &toggles);
+      rotation = demo_rotation_for_time(log.frames[frame].time_ms);
+      f32 scale = toggles.dynamic_resolution ? toggles.resolution_scale : 1;
+      usize width = resolution_scale_size(scale, options.width);
+      usize height = resolution_scale_size(scale, options.height);
+      if (width != renderer.width || height != renderer.height)
+        renderer_set_resolution(&renderer, width, height);
+    } else {
+      rotation = demo_rotation((f32)frame / (f32)options.frames * 2.0f * (f32)M_PI);
+    }
+    frame_targets_set_colors(&painter.frame, toggles.colors);
+    frame_targets_set_shadows(&painter.frame, toggles.shadows, toggles.shadow_filter);
+    trace_set_enabled(options.trace_path != NULL && i >= options.warmup);
+    Mat4x4 transform = mul4x4(rotation, base_transform);
+#ifdef DEBUG
+    usize allocations = heap_allocations();
+#endif
+    FrameTimings t = bench_frame(&options, &renderer, &painter, transform, shader_kind, toggles.redraw_all);
+    if (i >= options.warmup)
+      timings[frame] = t;
+#ifdef DEBUG
+    // The arena has grown to what a frame needs after the first one, the first traced frame allocates the trace buffer,
+    // and the first frame with shadows grows the shadow map's arena.
+    bool first_shadows = toggles.shadows && !shadows_drawn;
+    shadows_drawn |= toggles.shadows;
+    if (i >= 2 && i != options.warmup && !first_shadows)
+      ASSERT_PRINTF(heap_allocations() == allocations, "Frame %zu allocated from the heap\n", i);
+#endif
+  }
+  trace_set_enabled(false);
+  if (options.trace_path != NULL && !trace_flush(options.trace_path))
+    fprintf(stderr,
+            "Cannot write trace to %s (tracing is compiled out of release builds unless built with TRACE=1)\n",
+            options.trace_path);
+
+  if (options.per_frame)
+    print_per_frame(&options, timings);
+  else
+    print_summary(&options, timings);
+
+  xfree(timings);
+  free_frame_targets(painter.frame);
+  free_scene(painter.scene);
+  if (options.colors) {
+    xfree(painter.teapot_colors);
+    xfree(painter.cube_colors);
+  }
+  free_renderer(renderer);
+  if (options.replay_path != NULL)
+    free_frame_log(log);
+  return 0;
+}
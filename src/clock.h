@@ -0,0 +1,72 @@
+#pragma once
+
+#include "common.h"
+
+#include <time.h>
+
+typedef enum frame_clock_kind {
+  /// Follows the wall clock.
+  FRAME_CLOCK_REALTIME,
+  /// Advances by a fixed step every frame regardless of how long the frame actually took, so that every run renders
+  /// the same sequence of frames.
+  FRAME_CLOCK_FIXED_STEP,
+} FrameClockKind;
+
+/// Source of time for everything that animates, ticked once per frame.
+typedef struct frame_clock {
+  FrameClockKind kind;
+  /// Time of the current frame, in milliseconds since the clock was created.
+  u64 now_ms;
+  /// Time between the previous frame and the current one, in seconds.
+  f32 delta_s;
+  /// Only for `FRAME_CLOCK_FIXED_STEP`.
+  u64 step_ms;
+  /// Only for `FRAME_CLOCK_REALTIME`, monotonic time at which the clock was created.
+  u64 start_ms;
+} FrameClock;
+
+static inline u64 monotonic_ns() {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (u64)(t.tv_sec) * 1000000000 + (u64)t.tv_nsec;
+}
+
+static inline u64 monotonic_ms() {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (u64)(t.tv_sec) * 1000 + (u64)(t.tv_nsec / 1000000);
+}
+
+static inline FrameClock new_realtime_clock() {
+  return (FrameClock){
+      .kind = FRAME_CLOCK_REALTIME,
+      .now_ms = 0,
+      .delta_s = 0,
+      .step_ms = 0,
+      .start_ms = monotonic_ms(),
+  };
+}
+
+static inline FrameClock new_fixed_step_clock(u64 step_ms) {
+  return (FrameClock){
+      .kind = FRAME_CLOCK_FIXED_STEP,
+      .now_ms = 0,
+      .delta_s = 0,
+      .step_ms = step_ms,
+      .start_ms = 0,
+  };
+}
+
+/// Advance the clock to the next frame.
+static inline void frame_clock_tick(FrameClock *clock) {
+  u64 prev_ms = clock->now_ms;
+  switch (clock->kind) {
+  case FRAME_CLOCK_REALTIME:
+    clock->now_ms = monotonic_ms() - clock->start_ms;
+    break;
+  case FRAME_CLOCK_FIXED_STEP:
+    clock->now_ms += clock->step_ms;
+    break;
+  }
+  clock->delta_s = (f32)(clock->now_ms - prev_ms) / 1000.f;
+}
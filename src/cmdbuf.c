@@ -0,0 +1,293 @@
+#include "cmdbuf.h"
+
+#include <pthread.h>
+
+#include "trace.h"
+
+#define CMDBUF_INITIAL_CAPACITY 16
+
+CommandBuffer new_command_buffer() {
+  usize capacity = CMDBUF_INITIAL_CAPACITY;
+  return (CommandBuffer){
+      .commands = xalloc(DrawCommand, capacity),
+      .commands_len = 0,
+      .commands_capacity = capacity,
+      .matrices = xalloc(Mat4x4, capacity),
+      .matrices_len = 0,
+      .matrices_capacity = capacity,
+  };
+}
+
+void free_command_buffer(CommandBuffer cmdbuf) {
+  xfree(cmdbuf.commands);
+  xfree(cmdbuf.matrices);
+}
+
+void cmdbuf_reset(CommandBuffer *cmdbuf) {
+  cmdbuf->commands_len = 0;
+  cmdbuf->matrices_len = 0;
+}
+
+void cmdbuf_draw(CommandBuffer *cmdbuf, const Mesh *mesh, Instance instance) {
+  // Draws with the same model matrix (e.g. the parts of an object) are usually recorded one after the other.
+  if (cmdbuf->matrices_len == 0 ||
+      memcmp(&cmdbuf->matrices[cmdbuf->matrices_len - 1], &instance.m, sizeof(Mat4x4)) != 0) {
+    if (cmdbuf->matrices_len == cmdbuf->matrices_capacity) {
+      cmdbuf->matrices_capacity *= 2;
+      cmdbuf->matrices = xrealloc(cmdbuf->matrices, Mat4x4, cmdbuf->matrices_capacity);
+    }
+    cmdbuf->matrices[cmdbuf->matrices_len++] = instance.m;
+  }
+  if (cmdbuf->commands_len == cmdbuf->commands_capacity) {
+    cmdbuf->commands_capacity *= 2;
+    ASSERT(cmdbuf->commands_capacity <= UINT32_MAX);
+    cmdbuf->commands = xrealloc(cmdbuf->commands, DrawCommand, cmdbuf->commands_capacity);
+  }
+  cmdbuf->commands[cmdbuf->commands_len++] = (DrawCommand){
+      .mesh = mesh,
+      .light = instance.light,
+      .matrix = (u32)(cmdbuf->matrices_len - 1),
+      .ambient = instance.ambient,
+  };
+}
+
+static i32 compare_by_state(const void *x_, const void *y_) {
+  const CmdSortKey *x = x_;
+  const CmdSortKey *y = y_;
+  uintptr_t x_mesh = (uintptr_t)x->mesh;
+  uintptr_t y_mesh = (uintptr_t)y->mesh;
+  if (x_mesh != y_mesh)
+    return (x_mesh > y_mesh) - (x_mesh < y_mesh);
+  return (x->command > y->command) - (x->command < y->command);
+}
+
+static i32 compare_front_to_back(const void *x_, const void *y_) {
+  const CmdSortKey *x = x_;
+  const CmdSortKey *y = y_;
+  if (x->depth != y->depth)
+    return (x->depth > y->depth) - (x->depth < y->depth);
+  return (x->command > y->command) - (x->command < y->command);
+}
+
+/// The draws of a command buffer in the order they are executed, valid until the arena they were allocated from is
+/// restored.
+typedef struct cmd_batches {
+  /// LEN: commands_len of the command buffer.
+  Instance *instances;
+  /// LEN: batches_len.
+  CmdBatch *batches;
+  usize batches_len;
+} CmdBatches;
+
+/// Sort the draws and group them into batches.
+static CmdBatches build_batches(Renderer *renderer, const CommandBuffer *cmdbuf, CmdSort sort) {
+  TRACE_SCOPE("build_batches");
+  usize len = cmdbuf->commands_len;
+  CmdSortKey *keys = arena_alloc(&renderer->arena, CmdSortKey, len);
+  CmdBatches batches = {
+      .instances = arena_alloc(&renderer->arena, Instance, len),
+      .batches = arena_alloc(&renderer->arena, CmdBatch, len),
+      .batches_len = 0,
+  };
+  Mat4x4 world_to_camera = world_to_camera_matrix(renderer);
+  for (usize i = 0; i < len; ++i) {
+    const DrawCommand *command = &cmdbuf->commands[i];
+    f32 depth = 0;
+    if (sort == CMD_SORT_FRONT_TO_BACK) {
+      Vec3 center = transform(cmdbuf->matrices[command->matrix], command->mesh->center);
+      depth = transform(world_to_camera, center).get[2];
+      // NaN would make the order inconsistent.
+      if (isnan(depth))
+        depth = INFINITY;
+    }
+    keys[i] = (CmdSortKey){.mesh = command->mesh, .depth = depth, .command = (u32)i};
+  }
+  if (sort == CMD_SORT_STATE)
+    qsort(keys, len, sizeof(CmdSortKey), compare_by_state);
+  else if (sort == CMD_SORT_FRONT_TO_BACK)
+    qsort(keys, len, sizeof(CmdSortKey), compare_front_to_back);
+  for (usize i = 0; i < len; ++i) {
+    const DrawCommand *command = &cmdbuf->commands[keys[i].command];
+    batches.instances[i] = (Instance){
+        .m = cmdbuf->matrices[command->matrix],
+        .light = command->light,
+        .ambient = command->ambient,
+    };
+    if (batches.batches_len == 0 || batches.batches[batches.batches_len - 1].mesh != command->mesh)
+      batches.batches[batches.batches_len++] = (CmdBatch){.mesh = command->mesh, .first = (u32)i, .len = 0};
+    batches.batches[batches.batches_len - 1].len++;
+  }
+  return batches;
+}
+
+static void execute_batches(Renderer *renderer,
+                            const CmdBatches *batches,
+                            rasterize_triangle_callback_t rasterize_triangle) {
+  for (usize i = 0; i < batches->batches_len; ++i) {
+    const CmdBatch *batch = &batches->batches[i];
+    draw_object_instanced(renderer, batch->mesh, &batches->instances[batch->first], batch->len, rasterize_triangle);
+  }
+}
+
+typedef struct cmd_job {
+  Renderer *worker;
+  const CmdBatches *batches;
+  rasterize_triangle_callback_t *rasterize_triangle;
+} CmdJob;
+
+static void run_job(const CmdJob *job) {
+  TRACE_SCOPE("cmdbuf_band");
+  execute_batches(job->worker, job->batches, job->rasterize_triangle);
+}
+
+struct cmd_pool {
+  pthread_mutex_t mutex;
+  /// Signaled when a submit has jobs for the threads, or they should quit.
+  pthread_cond_t start;
+  /// Signaled when the last thread finished its job.
+  pthread_cond_t done;
+  /// Incremented by every submit.
+  u64 generation;
+  /// Threads that haven't finished their job of the current submit.
+  usize pending;
+  bool quit;
+  /// Of the current submit, `jobs[i]` for thread `i`. Thread 0 is the one calling `cmdbuf_submit`.
+  CmdJob jobs[CMD_MAX_THREADS];
+  pthread_t threads[CMD_MAX_THREADS];
+  /// Whether `threads[i]` is running, the jobs of the others are done by the thread calling `cmdbuf_submit`.
+  bool started[CMD_MAX_THREADS];
+  /// Argument of thread `i`.
+  struct cmd_thread_arg {
+    CmdPool *pool;
+    usize index;
+  } args[CMD_MAX_THREADS];
+};
+
+static void *run_thread(void *arg_) {
+  struct cmd_thread_arg *arg = arg_;
+  CmdPool *pool = arg->pool;
+  u64 generation = 0;
+  pthread_mutex_lock(&pool->mutex);
+  while (true) {
+    while (!pool->quit && pool->generation == generation) {
+      pthread_cond_wait(&pool->start, &pool->mutex);
+    }
+    if (pool->quit)
+      break;
+    generation = pool->generation;
+    pthread_mutex_unlock(&pool->mutex);
+    run_job(&pool->jobs[arg->index]);
+    pthread_mutex_lock(&pool->mutex);
+    if (--pool->pending == 0)
+      pthread_cond_signal(&pool->done);
+  }
+  pthread_mutex_unlock(&pool->mutex);
+  return NULL;
+}
+
+CmdExecutor new_cmd_executor(usize threads_len) {
+  ASSERT(threads_len >= 1 && threads_len <= CMD_MAX_THREADS);
+  CmdExecutor executor = {
+      .threads_len = threads_len,
+      .workers = xalloc(Renderer, threads_len),
+      .pool = NULL,
+  };
+  for (usize i = 0; i < threads_len; ++i) {
+    executor.workers[i] = (Renderer){.arena = new_arena(RENDERER_ARENA_CAPACITY)};
+  }
+  if (threads_len == 1)
+    return executor;
+  CmdPool *pool = xalloc(CmdPool, 1);
+  pthread_mutex_init(&pool->mutex, NULL);
+  pthread_cond_init(&pool->start, NULL);
+  pthread_cond_init(&pool->done, NULL);
+  pool->generation = 0;
+  pool->pending = 0;
+  pool->quit = false;
+  pool->started[0] = false;
+  for (usize i = 1; i < threads_len; ++i) {
+    pool->args[i] = (struct cmd_thread_arg){.pool = pool, .index = i};
+    pool->started[i] = pthread_create(&pool->threads[i], NULL, run_thread, &pool->args[i]) == 0;
+  }
+  executor.pool = pool;
+  return executor;
+}
+
+void free_cmd_executor(CmdExecutor executor) {
+  CmdPool *pool = executor.pool;
+  if (pool != NULL) {
+    pthread_mutex_lock(&pool->mutex);
+    pool->quit = true;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->mutex);
+    for (usize i = 1; i < executor.threads_len; ++i) {
+      if (pool->started[i])
+        pthread_join(pool->threads[i], NULL);
+    }
+    pthread_cond_destroy(&pool->done);
+    pthread_cond_destroy(&pool->start);
+    pthread_mutex_destroy(&pool->mutex);
+    xfree(pool);
+  }
+  // The workers don't own their depth buffer, only their arena.
+  for (usize i = 0; i < executor.threads_len; ++i) {
+    free_arena(executor.workers[i].arena);
+  }
+  xfree(executor.workers);
+}
+
+void cmdbuf_submit(Renderer *renderer,
+                   CommandBuffer *cmdbuf,
+                   CmdSort sort,
+                   CmdExecutor *executor,
+                   rasterize_triangle_callback_t rasterize_triangle) {
+  TRACE_SCOPE("cmdbuf_submit");
+  ArenaMark mark = arena_mark(&renderer->arena);
+  CmdBatches batches = build_batches(renderer, cmdbuf, sort);
+  if (executor == NULL || executor->pool == NULL) {
+    execute_batches(renderer, &batches, rasterize_triangle);
+    arena_restore(&renderer->arena, mark);
+    return;
+  }
+  // Every worker is the renderer with its own arena and statistics, drawing an equal band of rows.
+  CmdPool *pool = executor->pool;
+  ScreenRect scissor = renderer->scissor;
+  usize threads_len = executor->threads_len;
+  usize rows = scissor.max_y - scissor.min_y;
+  for (usize i = 0; i < threads_len; ++i) {
+    Renderer *worker = &executor->workers[i];
+    Arena arena = worker->arena;
+    *worker = *renderer;
+    worker->arena = arena;
+    arena_reset(&worker->arena);
+    worker->scissor.min_y = scissor.min_y + rows * i / threads_len;
+    worker->scissor.max_y = scissor.min_y + rows * (i + 1) / threads_len;
+#ifdef RENDER_STATS
+    worker->stats = (RenderStats){0};
+#endif
+    pool->jobs[i] = (CmdJob){.worker = worker, .batches = &batches, .rasterize_triangle = rasterize_triangle};
+  }
+  pthread_mutex_lock(&pool->mutex);
+  pool->pending = 0;
+  for (usize i = 1; i < threads_len; ++i) {
+    pool->pending += pool->started[i];
+  }
+  pool->generation++;
+  pthread_cond_broadcast(&pool->start);
+  pthread_mutex_unlock(&pool->mutex);
+  for (usize i = 0; i < threads_len; ++i) {
+    if (!pool->started[i])
+      run_job(&pool->jobs[i]);
+  }
+  pthread_mutex_lock(&pool->mutex);
+  while (pool->pending != 0) {
+    pthread_cond_wait(&pool->done, &pool->mutex);
+  }
+  pthread_mutex_unlock(&pool->mutex);
+#ifdef RENDER_STATS
+  for (usize i = 0; i < threads_len; ++i) {
+    render_stats_add(&renderer->stats, &executor->workers[i].stats);
+  }
+#endif
+  arena_restore(&renderer->arena, mark);
+}
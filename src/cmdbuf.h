@@ -0,0 +1,125 @@
+#pragma once
+
+#include "common.h"
+#include "linear_alg.h"
+#include "mesh.h"
+#include "render.h"
+
+// Command buffers: draw calls recorded into a buffer and executed later, instead of as they are made.
+//
+// Recording a draw only appends a few words to the buffer: the mesh, the shading state and the index of its model
+// matrix in a table, where consecutive draws with the same model matrix share one entry. `cmdbuf_submit` puts the draws
+// in order (as recorded, grouped by mesh or front to back), merges consecutive draws of the same mesh into one
+// instanced draw and executes them, either on the calling thread or split between the threads of a `CmdExecutor`, each
+// drawing a band of rows of the screen. Submitting doesn't consume the buffer, so the one of static content can be
+// recorded once and submitted every frame.
+//
+// Example:
+//
+// ```
+// CommandBuffer cmdbuf = new_command_buffer();
+// CmdExecutor executor = new_cmd_executor(4);
+// while (...) {
+//   cmdbuf_reset(&cmdbuf);
+//   cmdbuf_draw(&cmdbuf, &teapot_mesh, new_instance(&renderer, m));
+//   cmdbuf_draw(&cmdbuf, &cube_mesh, new_instance(&renderer, m));
+//   cmdbuf_submit(&renderer, &cmdbuf, CMD_SORT_STATE, &executor, rasterize_triangle_gui);
+// }
+// free_cmd_executor(executor);
+// free_command_buffer(cmdbuf);
+// ```
+
+/// Max number of threads of a `CmdExecutor`.
+#define CMD_MAX_THREADS 64
+
+typedef enum cmd_sort {
+  /// In the order they were recorded.
+  CMD_SORT_NONE,
+  /// Grouped by mesh (in the order they were recorded otherwise), so that all draws of a mesh are merged.
+  CMD_SORT_STATE,
+  /// Nearest first by the center of the mesh, so that the depth test rejects more of the pixels behind them before the
+  /// draw pixel callback.
+  CMD_SORT_FRONT_TO_BACK,
+} CmdSort;
+
+typedef struct draw_command {
+  /// Not owned.
+  const Mesh *mesh;
+  /// See `Instance`.
+  Vec3 light;
+  /// Index of the model matrix in `CommandBuffer::matrices`.
+  u32 matrix;
+  /// See `Instance`.
+  u8 ambient;
+} DrawCommand;
+
+typedef struct cmd_sort_key {
+  const Mesh *mesh;
+  /// Only for `CMD_SORT_FRONT_TO_BACK`.
+  f32 depth;
+  /// Index in `CommandBuffer::commands`, draws that compare equal otherwise stay in the order they were recorded.
+  u32 command;
+} CmdSortKey;
+
+/// Draws of the same mesh, executed with one `draw_object_instanced`.
+typedef struct cmd_batch {
+  const Mesh *mesh;
+  /// Index of the first instance in the instances of the draws in the order they are executed.
+  u32 first;
+  u32 len;
+} CmdBatch;
+
+/// SAFETY: Only use new_command_buffer to construct this.
+typedef struct command_buffer {
+  /// LEN: commands_len, CAP: commands_capacity.
+  DrawCommand *commands;
+  usize commands_len;
+  usize commands_capacity;
+  /// LEN: matrices_len, CAP: matrices_capacity.
+  Mat4x4 *matrices;
+  usize matrices_len;
+  usize matrices_capacity;
+} CommandBuffer;
+
+CommandBuffer new_command_buffer();
+
+void free_command_buffer(CommandBuffer cmdbuf);
+
+/// Remove all draws, keeping the memory for recording the next ones.
+void cmdbuf_reset(CommandBuffer *cmdbuf);
+
+/// Record a draw of `mesh`, which must stay alive (and unchanged) while the buffer is submitted.
+void cmdbuf_draw(CommandBuffer *cmdbuf, const Mesh *mesh, Instance instance);
+
+/// The threads of a `CmdExecutor` and what they share.
+typedef struct cmd_pool CmdPool;
+
+/// SAFETY: Only use new_cmd_executor to construct this.
+typedef struct cmd_executor {
+  usize threads_len;
+  /// One per thread, copies of the renderer submitted to, drawing into its depth buffer within their own band of rows.
+  /// Each keeps its own arena between submits.
+  /// LEN: threads_len.
+  Renderer *workers;
+  /// `NULL` if `threads_len` is 1.
+  CmdPool *pool;
+} CmdExecutor;
+
+/// An executor drawing with `threads_len` threads, including the one calling `cmdbuf_submit`. The other threads are
+/// started here and wait for the submits until `free_cmd_executor`.
+CmdExecutor new_cmd_executor(usize threads_len);
+
+void free_cmd_executor(CmdExecutor executor);
+
+/// Execute the draws of a command buffer, in the order given by `sort`. Its scratch space comes from the arena of the
+/// renderer.
+/// `executor` may be `NULL` to draw on the calling thread only. Otherwise every thread draws the pixels of its band of
+/// rows of the renderer's scissor, calling `rasterize_triangle`, and so the draw pixel callback, concurrently with the
+/// others; it's only safe if the callback writes nothing but the pixel it is called for. The object and triangle
+/// counters of `RenderStats` then count once per thread, the pixel counters once.
+/// `rasterize_triangle` is e.g. `rasterize_triangle_xxx` of `DEF_DRAW_FUNCTIONS`.
+void cmdbuf_submit(Renderer *renderer,
+                   CommandBuffer *cmdbuf,
+                   CmdSort sort,
+                   CmdExecutor *executor,
+                   rasterize_triangle_callback_t rasterize_triangle);
@@ -0,0 +1,30 @@
+#include "color.h"
+
+#include "dispatch.h"
+#include "trace.h"
+
+void compose_rgba8_rect(ScreenRect rect,
+                        const u8 *levels,
+                        usize levels_stride,
+                        const Rgba8 *albedo,
+                        usize albedo_stride,
+                        Rgba8 *out,
+                        usize out_stride) {
+  TRACE_SCOPE("compose_rgba8_rect");
+  if (screen_rect_is_empty(rect))
+    return;
+  for (usize y = rect.min_y; y < rect.max_y; ++y) {
+    kernels.compose_rgba8_row(&levels[y * levels_stride + rect.min_x],
+                              &albedo[y * albedo_stride + rect.min_x],
+                              rect.max_x - rect.min_x,
+                              &out[y * out_stride + rect.min_x]);
+  }
+}
+
+void pack_rgb8_row(const Rgba8 *pixels, usize len, u8 *out) {
+  for (usize i = 0; i < len; ++i) {
+    out[i * 3 + 0] = (u8)pixels[i];
+    out[i * 3 + 1] = (u8)(pixels[i] >> 8);
+    out[i * 3 + 2] = (u8)(pixels[i] >> 16);
+  }
+}
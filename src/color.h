@@ -0,0 +1,114 @@
+#pragma once
+
+#include "common.h"
+#include "math_helpers.h"
+#include "render.h"
+
+// Colors: an RGBA8 target drawn alongside the frame buffer of light levels, for meshes with vertex colors.
+//
+// Everything that works on light levels (lighting, multisampling, shadows, textures, the shaders) keeps working on
+// them: the draw pixel callback writes the color of a pixel into a buffer of its own (its albedo, opaque white for
+// meshes without colors), and once the frame is shaded `compose_rgba8_rect` scales every albedo by the shaded light
+// level of its pixel, four channels at a time, into packed pixels in the byte order of raylib's
+// `PIXELFORMAT_UNCOMPRESSED_R8G8B8A8`, ready to be uploaded or exported (see `pack_rgb8_row`).
+//
+// Vertex colors are the first `COLOR_VARYINGS` attributes of a mesh (see `mesh_set_attributes`): R, G and B in 0..255,
+// interpolated perspective-correctly like any other attribute. The albedo isn't multisampled, a pixel on an edge takes
+// the color of the last triangle drawn in it.
+//
+// Example:
+//
+// ```
+// Rgba8 *albedo = alloc_render_target(sizeof(Rgba8) * stride * height);
+// void my_draw_pixel_callback(...) {
+//   // ...
+//   cx->albedo[y * stride + x] = rgba8_from_varyings(varyings);
+// }
+// while (...) {
+//   rgba8_fill(albedo, RGBA8_WHITE, stride * height);
+//   // draw and shade...
+//   compose_rgba8_rect(rect, shaded_buffer, stride, albedo, stride, out, stride);
+// }
+// free_render_target(albedo);
+// ```
+
+/// A color with 8 bits per channel, R in the lowest byte and A in the highest, so that it is laid out R, G, B, A in
+/// memory on little-endian targets.
+typedef u32 Rgba8;
+
+/// Number of attributes that make up a vertex color: R, G, B.
+#define COLOR_VARYINGS 3
+
+#define RGBA8_WHITE ((Rgba8)0xffffffff)
+
+static inline Rgba8 rgba8(u8 r, u8 g, u8 b, u8 a) {
+  return (Rgba8)r | ((Rgba8)g << 8) | ((Rgba8)b << 16) | ((Rgba8)a << 24);
+}
+
+/// `color` with R, G and B multiplied by `level` / 255, rounded to nearest, and alpha kept. R and B are scaled together
+/// in the two halves of a `u32`, the same operations as the compose kernel does on vectors (see dispatch.h).
+static inline Rgba8 rgba8_scale(Rgba8 color, u8 level) {
+  // x / 255 rounded is (x + 128 + ((x + 128) >> 8)) >> 8 for every x up to 255 * 255, which leaves no carry between
+  // the channels.
+  u32 rb = (color & 0x00ff00ff) * level + 0x00800080;
+  u32 g = ((color >> 8) & 0xff) * level + 0x80;
+  rb = ((rb + ((rb >> 8) & 0x00ff00ff)) >> 8) & 0x00ff00ff;
+  g = (g + (g >> 8)) & 0xff00;
+  return rb | g | (color & 0xff000000);
+}
+
+static inline void rgba8_fill(Rgba8 *pixels, Rgba8 color, usize len) {
+  for (usize i = 0; i < len; ++i) {
+    pixels[i] = color;
+  }
+}
+
+/// A channel of a vertex color, clamped to 0..255.
+static inline u8 color_channel(f32 x) {
+  return (u8)maxf(minf(x, 255), 0);
+}
+
+/// The vertex color of a pixel from its varyings, opaque white if the triangle has no colors.
+static inline Rgba8 rgba8_from_varyings(const Varyings *varyings) {
+  if (varyings->len < COLOR_VARYINGS)
+    return RGBA8_WHITE;
+  const f32 *get = varyings->get;
+  return rgba8(color_channel(get[0]), color_channel(get[1]), color_channel(get[2]), 255);
+}
+
+/// `rgba8_from_varyings` of every pixel of a span, for the draw span callback (see `draw_span_callback_t`), into
+/// `out[0..x_end - x_begin]`.
+static inline void rgba8_span_from_varyings(
+    const Varyings *varyings, usize x_begin, usize x_end, const f32 *depths, Rgba8 *out) {
+  if (varyings->len < COLOR_VARYINGS) {
+    rgba8_fill(out, RGBA8_WHITE, x_end - x_begin);
+    return;
+  }
+  // The first pixel's are those of its first covered sample with multisampling.
+  out[0] = rgba8_from_varyings(varyings);
+  // `varyings_span_at` of each channel, with the planes in locals so that the loop vectorizes.
+  f32 r_row = varyings->plane_row[0], r_ddx = varyings->plane_ddx[0];
+  f32 g_row = varyings->plane_row[1], g_ddx = varyings->plane_ddx[1];
+  f32 b_row = varyings->plane_row[2], b_ddx = varyings->plane_ddx[2];
+  i32 len = (i32)(x_end - x_begin);
+  for (i32 i = 1; i < len; ++i) {
+    f32 x = (f32)((i32)x_begin + i);
+    u32 r = color_channel((r_row + r_ddx * x) * depths[i]);
+    u32 g = color_channel((g_row + g_ddx * x) * depths[i]);
+    u32 b = color_channel((b_row + b_ddx * x) * depths[i]);
+    out[i] = r | (g << 8) | (b << 16) | 0xff000000;
+  }
+}
+
+/// `out[i] = rgba8_scale(albedo[i], levels[i])` for the pixels in `rect`, a row at a time with the compose kernel (see
+/// dispatch.h). The strides are in pixels, the buffers are linear.
+void compose_rgba8_rect(ScreenRect rect,
+                        const u8 *levels,
+                        usize levels_stride,
+                        const Rgba8 *albedo,
+                        usize albedo_stride,
+                        Rgba8 *out,
+                        usize out_stride);
+
+/// Drops the alpha of `len` pixels, into `3 * len` bytes R, G, B (e.g. for writing a PPM).
+void pack_rgb8_row(const Rgba8 *pixels, usize len, u8 *out);
@@ -0,0 +1,5 @@
+#include "common.h"
+
+#ifdef DEBUG
+usize heap_allocations_ = 0;
+#endif
@@ -72,8 +72,8 @@ static inline void print_stacktrace() {
           print_stacktrace(),                                                                                          \
           exit(1)))
 #else
-#define DEBUG_ASSERT(COND) 0
-#define DEBUG_ASSERT_PRINTF(COND, ...) 0
+#define DEBUG_ASSERT(COND) ((void)0)
+#define DEBUG_ASSERT_PRINTF(COND, ...) ((void)0)
 #endif
 
 #define PANIC() (fprintf(stderr, "[%s@%s:%d] PANIC\n", __FUNCTION__, __FILE__, __LINE__), print_stacktrace(), exit(1))
@@ -99,7 +99,26 @@ static inline void print_stacktrace() {
 #define TODO_FUNCTION()                                                                                                \
   (printf("[%s@%s:%d] TODO: function not implemented\n", __FUNCTION__, __FILE__, __LINE__), print_stacktrace(), exit(1))
 
+#ifdef DEBUG
+/// Don't use this directly, use `heap_allocations`.
+extern usize heap_allocations_;
+#endif
+
+/// Number of `xalloc` and `xrealloc` calls so far (from all threads) in debug builds, always 0 otherwise. For checking
+/// that code which should only use memory it already has, like the steady-state frames of the render loop, doesn't
+/// allocate.
+static inline usize heap_allocations() {
+#ifdef DEBUG
+  return __atomic_load_n(&heap_allocations_, __ATOMIC_RELAXED);
+#else
+  return 0;
+#endif
+}
+
 __attribute__((always_inline)) static inline void *xalloc_(usize len) {
+#ifdef DEBUG
+  __atomic_fetch_add(&heap_allocations_, 1, __ATOMIC_RELAXED);
+#endif
   void *p = malloc(len);
   ASSERT(p != NULL);
   return p;
@@ -107,6 +126,9 @@ __attribute__((always_inline)) static inline void *xalloc_(usize len) {
 
 __attribute__((always_inline)) static inline void *xrealloc_(void *p, usize len) {
   DEBUG_ASSERT(p != NULL);
+#ifdef DEBUG
+  __atomic_fetch_add(&heap_allocations_, 1, __ATOMIC_RELAXED);
+#endif
   p = realloc(p, len);
   ASSERT(p != NULL);
   return p;
@@ -118,3 +140,125 @@ __attribute__((always_inline)) static inline void xfree(void *p) {
 
 #define xalloc(TY, COUNT) ((TY *restrict)xalloc_(sizeof(TY) * (COUNT)))
 #define xrealloc(P, TY, COUNT) ((TY *)xrealloc_((P), sizeof(TY) * (COUNT)))
+
+/// Alignment of every allocation of an `Arena`, enough for any type.
+#define ARENA_ALIGNMENT _Alignof(max_align_t)
+
+/// Memory allocated from the heap by an `Arena` that was full, freed by the next `arena_reset`.
+typedef struct arena_chunk {
+  struct arena_chunk *next;
+  usize size;
+} ArenaChunk;
+
+// The memory of a chunk comes after its header.
+static_assert(sizeof(ArenaChunk) <= ARENA_ALIGNMENT);
+
+/// A linear allocator for transient data, e.g. what is only needed during a frame. Allocating bumps an offset into one
+/// block of memory, and `arena_reset` frees everything at once.
+///
+/// When the block is full, allocations fall back to the heap until the next `arena_reset`, which then grows the block
+/// to the most that was ever in use at once, so that once that is known (usually after the first frame), the arena
+/// doesn't touch the heap anymore.
+///
+/// SAFETY: Only use new_arena to construct this.
+typedef struct arena {
+  /// LEN: len, CAP: capacity.
+  u8 *data;
+  usize len;
+  usize capacity;
+  /// Allocations that didn't fit in `data`, since the last `arena_reset`.
+  ArenaChunk *chunks;
+  usize chunks_size;
+  /// Most bytes in use at once so far.
+  usize high_water;
+} Arena;
+
+static inline usize arena_align_(usize size) {
+  return (size + ARENA_ALIGNMENT - 1) / ARENA_ALIGNMENT * ARENA_ALIGNMENT;
+}
+
+static inline Arena new_arena(usize capacity) {
+  capacity = arena_align_(capacity);
+  return (Arena){
+      .data = xalloc(u8, capacity),
+      .len = 0,
+      .capacity = capacity,
+      .chunks = NULL,
+      .chunks_size = 0,
+      .high_water = 0,
+  };
+}
+
+static inline void arena_free_chunks_(Arena *arena) {
+  while (arena->chunks != NULL) {
+    ArenaChunk *next = arena->chunks->next;
+    xfree(arena->chunks);
+    arena->chunks = next;
+  }
+  arena->chunks_size = 0;
+}
+
+static inline void free_arena(Arena arena) {
+  arena_free_chunks_(&arena);
+  xfree(arena.data);
+}
+
+/// Free everything allocated from the arena.
+static inline void arena_reset(Arena *arena) {
+  arena_free_chunks_(arena);
+  if (arena->high_water > arena->capacity) {
+    // Some room to spare, so that a slightly bigger frame doesn't fall back to the heap again.
+    usize capacity = arena_align_(arena->high_water + arena->high_water / 4);
+    xfree(arena->data);
+    arena->data = xalloc(u8, capacity);
+    arena->capacity = capacity;
+  }
+  arena->len = 0;
+}
+
+/// Don't use this directly, use `arena_alloc`.
+static inline void *arena_alloc_(Arena *arena, usize size) {
+  size = arena_align_(size);
+  void *p;
+  if (size <= arena->capacity - arena->len) {
+    p = arena->data + arena->len;
+    arena->len += size;
+  } else {
+    ArenaChunk *chunk = (ArenaChunk *)xalloc(u8, ARENA_ALIGNMENT + size);
+    chunk->next = arena->chunks;
+    chunk->size = size;
+    arena->chunks = chunk;
+    arena->chunks_size += size;
+    p = (u8 *)chunk + ARENA_ALIGNMENT;
+  }
+  if (arena->len + arena->chunks_size > arena->high_water)
+    arena->high_water = arena->len + arena->chunks_size;
+  return p;
+}
+
+/// Allocate `COUNT` uninitialized values of type `TY`, valid until the next `arena_reset` (or `arena_restore` to before
+/// them).
+#define arena_alloc(ARENA, TY, COUNT) ((TY *)arena_alloc_((ARENA), sizeof(TY) * (COUNT)))
+
+/// A position of an arena, see `arena_mark`.
+typedef struct arena_mark {
+  usize len;
+  ArenaChunk *chunks;
+} ArenaMark;
+
+/// The current position of the arena, to go back to with `arena_restore`.
+static inline ArenaMark arena_mark(const Arena *arena) {
+  return (ArenaMark){.len = arena->len, .chunks = arena->chunks};
+}
+
+/// Free what was allocated since `arena_mark` returned `mark`, for scratch space that is only needed for a while.
+static inline void arena_restore(Arena *arena, ArenaMark mark) {
+  ASSERT(mark.len <= arena->len);
+  arena->len = mark.len;
+  while (arena->chunks != mark.chunks) {
+    ArenaChunk *next = arena->chunks->next;
+    arena->chunks_size -= arena->chunks->size;
+    xfree(arena->chunks);
+    arena->chunks = next;
+  }
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include "linear_alg.h"
+
+/*
+  Cube with 2 units of edge length centered at the origin.
+*/
+
+[[maybe_unused]]
+static const Vec3 cube_vertices[] = {
+    // clang-format off
+    {{-1.0f, -1.0f, -1.0f}},
+    {{ 1.0f, -1.0f, -1.0f}},
+    {{ 1.0f,  1.0f, -1.0f}},
+    {{-1.0f,  1.0f, -1.0f}},
+    {{-1.0f, -1.0f,  1.0f}},
+    {{ 1.0f, -1.0f,  1.0f}},
+    {{ 1.0f,  1.0f,  1.0f}},
+    {{-1.0f,  1.0f,  1.0f}},
+    // clang-format on
+};
+
+[[maybe_unused]]
+static const usize cube_indices[] = {
+    0, 3, 2, //
+    2, 1, 0, //
+    4, 5, 6, //
+    6, 7, 4, //
+    7, 3, 0, //
+    0, 4, 7, //
+    1, 2, 6, //
+    6, 5, 1, //
+    0, 1, 5, //
+    5, 4, 0, //
+    2, 3, 7, //
+    7, 6, 2, //
+};
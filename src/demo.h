@@ -0,0 +1,70 @@
+#pragma once
+
+#include "common.h"
+#include "linear_alg.h"
+#include "render.h"
+#include "color.h"
+
+// The scene shown by the demo, shared between the GUI and the headless tools so that they render the same thing.
+
+/// Camera of the demo scene.
+static inline Camera_ demo_camera() {
+  return (Camera_){
+      .pos = {{10, 0, 0}},
+      .min_x = -2.0f,
+      .min_y = -2.0f,
+      .max_x = +2.0f,
+      .max_y = +2.0f,
+      .fov = to_rad(90.f),
+      .aspect_ratio = 1.f,
+      .near_clipping_dist = 0.1f,
+      .far_clipping_dist = 100.f,
+  };
+}
+
+/// Light of the demo scene.
+static inline Vec3 demo_light() {
+  return (Vec3){{-10, 5, -1}};
+}
+
+/// Transform applied to the objects before the rotation.
+static inline Mat4x4 demo_base_transform() {
+  Mat4x4 base_transform = mat4x4_id;
+  base_transform = mul4x4(translate3d((Vec3){{0, 0, -0.7f}}), base_transform);
+  base_transform = mul4x4(mat3x3to4x4(rotate3d_x(to_rad(20))), base_transform);
+  return base_transform;
+}
+
+/// Rotation of the objects, angle in radian.
+static inline Mat4x4 demo_rotation(f32 rad) {
+  return mat3x3to4x4(rotate3d_z(rad));
+}
+
+/// Rotation of the objects at some point in time, see `FrameClock`.
+static inline Mat4x4 demo_rotation_for_time(u64 ms) {
+  const u64 rotation_period_ms = 5 * 1000;
+  // Convert current time to a fraction of the period
+  f32 fraction_of_period = (f32)(ms % rotation_period_ms) / (f32)rotation_period_ms;
+  // Convert fraction to radians (2 * PI radians in a full circle)
+  f32 rad = fraction_of_period * 2.0f * (f32)M_PI;
+  return demo_rotation(rad);
+}
+
+/// Vertex colors of the demo meshes (see color.h): R, G and B go from 0 to 255 along X, Y and Z across the bounding
+/// box of the vertices, which makes the cube the RGB cube. `colors` has room for `COLOR_VARYINGS` values per vertex.
+static inline void demo_vertex_colors(const Vec3 *vertices, usize len, f32 *colors) {
+  static_assert(COLOR_VARYINGS == 3);
+  Vec3 min = vertices[0];
+  Vec3 max = vertices[0];
+  for (usize i = 1; i < len; ++i) {
+    for (usize j = 0; j < 3; ++j) {
+      min.get[j] = minf(min.get[j], vertices[i].get[j]);
+      max.get[j] = maxf(max.get[j], vertices[i].get[j]);
+    }
+  }
+  for (usize i = 0; i < len; ++i) {
+    for (usize j = 0; j < 3; ++j) {
+      colors[i * 3 + j] = (vertices[i].get[j] - min.get[j]) / maxf(max.get[j] - min.get[j], 1e-6f) * 255.f;
+    }
+  }
+}
@@ -0,0 +1,158 @@
+#include "dispatch.h"
+
+#include <strings.h>
+
+#include "shaders.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define HAS_X86_KERNELS
+#endif
+
+static void clear_depth_scalar(f32 *depth_buffer, usize len) {
+  for (usize i = 0; i < len; ++i) {
+    depth_buffer[i] = INFINITY;
+  }
+}
+
+static void transform_scalar(const Mat4x4 *m, const Vec3 *in, Vec3 *out, usize len) {
+  for (usize i = 0; i < len; ++i) {
+    out[i] = vec4to3(mul4x4_4(*m, vec3to4(in[i])));
+  }
+}
+
+static void nabla_depth_row_scalar(
+    usize width, usize height, usize stride, usize y, usize x0, usize x1, const f32 *depth_buffer, u8 *out) {
+  for (usize x = x0; x < x1; ++x) {
+    out[x - x0] = nabla_depth(width, height, stride, x, y, depth_buffer);
+  }
+}
+
+static void compose_rgba8_row_scalar(const u8 *levels, const Rgba8 *albedo, usize len, Rgba8 *out) {
+  for (usize i = 0; i < len; ++i) {
+    out[i] = rgba8_scale(albedo[i], levels[i]);
+  }
+}
+
+#ifdef HAS_X86_KERNELS
+
+// Defined in kernels_{sse4,avx2,avx512}.c.
+#define DECLARE_KERNELS(SUFFIX)                                                                                        \
+  clear_depth_kernel_t clear_depth_##SUFFIX;                                                                           \
+  transform_kernel_t transform_##SUFFIX;                                                                               \
+  raster_row_kernel_t raster_row_##SUFFIX;                                                                             \
+  nabla_depth_row_kernel_t nabla_depth_row_##SUFFIX;                                                                   \
+  texture_sample_row_kernel_t texture_sample_row_##SUFFIX;                                                             \
+  compose_rgba8_row_kernel_t compose_rgba8_row_##SUFFIX;
+
+DECLARE_KERNELS(sse4)
+DECLARE_KERNELS(avx2)
+DECLARE_KERNELS(avx512)
+
+#undef DECLARE_KERNELS
+
+#endif
+
+#define KERNELS(ISA, SUFFIX)                                                                                           \
+  [ISA] = {                                                                                                            \
+      .isa = ISA,                                                                                                      \
+      .clear_depth = clear_depth_##SUFFIX,                                                                             \
+      .transform = transform_##SUFFIX,                                                                                 \
+      .raster_row = raster_row_##SUFFIX,                                                                               \
+      .nabla_depth_row = nabla_depth_row_##SUFFIX,                                                                     \
+      .texture_sample_row = texture_sample_row_##SUFFIX,                                                               \
+      .compose_rgba8_row = compose_rgba8_row_##SUFFIX,                                                                 \
+  }
+
+/// Kernels of each ISA, all NULL for ISAs that aren't compiled in.
+static const Kernels all_kernels[ISA_COUNT] = {
+    KERNELS(ISA_SCALAR, scalar),
+#ifdef HAS_X86_KERNELS
+    KERNELS(ISA_SSE4, sse4),
+    KERNELS(ISA_AVX2, avx2),
+    KERNELS(ISA_AVX512, avx512),
+#endif
+};
+
+#undef KERNELS
+
+Kernels kernels;
+
+static const char *const isa_names[ISA_COUNT] = {
+    [ISA_SCALAR] = "scalar",
+    [ISA_SSE4] = "sse4",
+    [ISA_AVX2] = "avx2",
+    [ISA_AVX512] = "avx512",
+};
+
+const char *isa_name(Isa isa) {
+  return isa < ISA_COUNT ? isa_names[isa] : "unknown";
+}
+
+bool parse_isa(const char *name, Isa *isa) {
+  for (Isa i = 0; i < ISA_COUNT; ++i) {
+    if (strcasecmp(name, isa_names[i]) == 0) {
+      *isa = i;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool isa_supported(Isa isa) {
+  if (isa >= ISA_COUNT || all_kernels[isa].clear_depth == NULL)
+    return false;
+#ifdef HAS_X86_KERNELS
+  // cpuid, which also checks that the OS saves the AVX registers.
+  __builtin_cpu_init();
+  switch (isa) {
+  case ISA_SCALAR:
+    return true;
+  case ISA_SSE4:
+    return __builtin_cpu_supports("sse4.1");
+  case ISA_AVX2:
+    return __builtin_cpu_supports("avx2");
+  case ISA_AVX512:
+    return __builtin_cpu_supports("avx512f");
+  }
+  return false;
+#else
+  return isa == ISA_SCALAR;
+#endif
+}
+
+bool select_isa(Isa isa) {
+  if (!isa_supported(isa))
+    return false;
+  kernels = all_kernels[isa];
+  return true;
+}
+
+Isa best_supported_isa() {
+  Isa isa = ISA_AVX512;
+  while (!isa_supported(isa)) {
+    --isa;
+  }
+  return isa;
+}
+
+/// Binds `kernels` before `main`, so that they are usable from anywhere without initialization.
+[[gnu::constructor]] static void init_kernels() {
+  Isa isa = best_supported_isa();
+  const char *name = getenv("RENDER_ISA");
+  if (name != NULL && name[0] != '\0') {
+    Isa requested;
+    if (!parse_isa(name, &requested)) {
+      fprintf(stderr, "Unknown RENDER_ISA %s, using %s\n", name, isa_name(isa));
+    } else if (!isa_supported(requested)) {
+      // Fall back to the best ISA below the requested one.
+      while (!isa_supported(requested)) {
+        --requested;
+      }
+      fprintf(stderr, "RENDER_ISA %s is not supported, using %s\n", name, isa_name(requested));
+      isa = requested;
+    } else {
+      isa = requested;
+    }
+  }
+  select_isa(isa);
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "common.h"
+#include "linear_alg.h"
+#include "triangle.h"
+#include "texture.h"
+#include "color.h"
+
+// Runtime dispatch of the hot kernels to SIMD implementations.
+//
+// The binary is built for the baseline of the target (plain x86-64 has SSE2 only), with the SIMD kernels compiled
+// separately for each instruction set (see kernels_simd.h). At startup the CPU is probed and `kernels` is bound to the
+// best implementations it supports. All implementations give bit-identical results.
+//
+// The `RENDER_ISA` environment variable (scalar, sse4, avx2, avx512) overrides the choice, e.g. for testing each path
+// on one machine. An ISA the CPU doesn't support falls back to the best one it does.
+
+typedef enum isa {
+  ISA_SCALAR,
+  ISA_SSE4,
+  ISA_AVX2,
+  ISA_AVX512,
+} Isa;
+
+#define ISA_COUNT (ISA_AVX512 + 1)
+
+/// Fill the depth buffer with infinity.
+typedef void(clear_depth_kernel_t)(f32 *depth_buffer, usize len);
+
+/// `out[i] = transform(*m, in[i])` for `i` in `0..len`. `in` and `out` may be the same array.
+typedef void(transform_kernel_t)(const Mat4x4 *m, const Vec3 *in, Vec3 *out, usize len);
+
+/// See `raster_row_scalar`.
+typedef usize(raster_row_kernel_t)(
+    const TriangleRow *row, usize x0, usize x1, f32 *depth_row, usize *xs, f32 *depths, usize *covered);
+
+/// `out[x - x0] = nabla_depth(width, height, stride, x, y, depth_buffer)` for `x` in `x0..x1`.
+typedef void(nabla_depth_row_kernel_t)(
+    usize width, usize height, usize stride, usize y, usize x0, usize x1, const f32 *depth_buffer, u8 *out);
+
+/// See `texture_sample_row_scalar`.
+typedef void(texture_sample_row_kernel_t)(const Texture *texture,
+                                          TextureFilter filter,
+                                          const f32 *us,
+                                          const f32 *vs,
+                                          const f32 *lods,
+                                          usize len,
+                                          u8 *out);
+
+/// `out[i] = rgba8_scale(albedo[i], levels[i])` for `i` in `0..len`.
+typedef void(compose_rgba8_row_kernel_t)(const u8 *levels, const Rgba8 *albedo, usize len, Rgba8 *out);
+
+typedef struct kernels {
+  Isa isa;
+  clear_depth_kernel_t *clear_depth;
+  transform_kernel_t *transform;
+  raster_row_kernel_t *raster_row;
+  nabla_depth_row_kernel_t *nabla_depth_row;
+  texture_sample_row_kernel_t *texture_sample_row;
+  compose_rgba8_row_kernel_t *compose_rgba8_row;
+} Kernels;
+
+/// The kernels in use.
+extern Kernels kernels;
+
+/// e.g. "avx2".
+const char *isa_name(Isa isa);
+
+/// Parse the name of an ISA (as returned by `isa_name`), returns `false` if there is no such ISA.
+bool parse_isa(const char *name, Isa *isa);
+
+/// Whether the CPU supports the ISA and its kernels are compiled in.
+bool isa_supported(Isa isa);
+
+/// Bind `kernels` to the implementations for an ISA, returns `false` (leaving `kernels` untouched) if not supported.
+/// Not thread-safe, only call this while nothing is rendering.
+bool select_isa(Isa isa);
+
+/// The best ISA that is supported.
+Isa best_supported_isa();
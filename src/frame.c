@@ -0,0 +1,211 @@
+#include "frame.h"
+
+FrameTargets new_frame_targets(
+    usize width, usize height, RenderLayout layout, usize samples, bool colors, usize shadow_map_size) {
+  usize stride = render_target_stride(width, sizeof(u8));
+  bool tiled = layout == RENDER_LAYOUT_TILED;
+  FrameTargets frame = {
+      .width = width,
+      .height = height,
+      .stride = stride,
+      .layout = layout,
+      .frame_buffer = alloc_render_target(stride * render_target_rows(height)),
+      .shaded_buffer = alloc_render_target(stride * height),
+      .shaded_kind = SHADER_KIND_DEFAULT,
+      .linear_frame_buffer = tiled ? alloc_render_target(stride * height) : NULL,
+      .linear_depth_buffer =
+          tiled ? alloc_render_target(sizeof(f32) * render_target_stride(width, sizeof(f32)) * height) : NULL,
+      .linear_albedo_buffer = tiled && colors ? alloc_render_target(sizeof(Rgba8) * stride * height) : NULL,
+      .colors = false,
+      .colors_changed = false,
+      .albedo_buffer = colors ? alloc_render_target(sizeof(Rgba8) * stride * render_target_rows(height)) : NULL,
+      .color_buffer = colors ? alloc_render_target(sizeof(Rgba8) * stride * height) : NULL,
+      .albedo_begin = colors ? xalloc(usize, height) : NULL,
+      .albedo_end = colors ? xalloc(usize, height) : NULL,
+      .samples = samples,
+      .has_shadow_map = shadow_map_size != 0,
+      .shadows = false,
+      .shadow_filter = SHADOW_FILTER_PCF_2X2,
+      .shadows_changed = false,
+  };
+  // Presented before anything is shaded, e.g. in a window's first frame.
+  memset(frame.shaded_buffer, 0, stride * height);
+  if (colors) {
+    rgba8_fill(frame.albedo_buffer, RGBA8_WHITE, stride * render_target_rows(height));
+    rgba8_fill(frame.color_buffer, rgba8(0, 0, 0, 255), stride * height);
+    for (usize y = 0; y < height; ++y) {
+      frame.albedo_begin[y] = width;
+      frame.albedo_end[y] = 0;
+    }
+  }
+  if (samples != 1)
+    frame.msaa = new_msaa_color_buffer(width, height, samples);
+  if (frame.has_shadow_map)
+    frame.shadow = new_shadow_map(shadow_map_size);
+  return frame;
+}
+
+void free_frame_targets(FrameTargets frame) {
+  free_render_target(frame.frame_buffer);
+  free_render_target(frame.shaded_buffer);
+  if (frame.layout == RENDER_LAYOUT_TILED) {
+    free_render_target(frame.linear_frame_buffer);
+    free_render_target(frame.linear_depth_buffer);
+  }
+  if (frame.albedo_buffer != NULL) {
+    if (frame.layout == RENDER_LAYOUT_TILED)
+      free_render_target(frame.linear_albedo_buffer);
+    free_render_target(frame.albedo_buffer);
+    free_render_target(frame.color_buffer);
+    xfree(frame.albedo_begin);
+    xfree(frame.albedo_end);
+  }
+  if (frame.samples != 1)
+    free_msaa_color_buffer(frame.msaa);
+  if (frame.has_shadow_map)
+    free_shadow_map(frame.shadow);
+}
+
+void frame_targets_set_colors(FrameTargets *frame, bool colors) {
+  ASSERT(!colors || frame->albedo_buffer != NULL);
+  frame->colors_changed |= colors != frame->colors;
+  frame->colors = colors;
+}
+
+void frame_targets_set_shadows(FrameTargets *frame, bool shadows, ShadowFilter filter) {
+  ASSERT(!shadows || frame->has_shadow_map);
+  frame->shadows_changed |= shadows != frame->shadows || filter != frame->shadow_filter;
+  frame->shadows = shadows;
+  frame->shadow_filter = filter;
+}
+
+ScreenRect frame_targets_redrawn_rect(const FrameTargets *frame,
+                                      const Renderer *renderer,
+                                      ScreenRect dirty,
+                                      bool redraw_all) {
+  if (redraw_all || frame->shadows || frame->shadows_changed || frame->colors_changed)
+    return (ScreenRect){0, 0, renderer->width, renderer->height};
+  return dirty;
+}
+
+/// Clears the pixels `x_begin..x_end` of row `y` of the frame buffer (if `frame_buffer`) and of the albedo buffer (if
+/// `albedo`), in either layout.
+static void clear_row(FrameTargets *frame, usize y, usize x_begin, usize x_end, bool frame_buffer, bool albedo) {
+  // The pixels of a row are contiguous within each tile.
+  for (usize x = x_begin; x < x_end;) {
+    usize end = frame->layout == RENDER_LAYOUT_LINEAR ? x_end
+                                                      : minzu((x / RENDER_TILE_WIDTH + 1) * RENDER_TILE_WIDTH, x_end);
+    usize i = render_target_index(frame->layout, frame->stride, x, y);
+    if (frame_buffer)
+      memset(&frame->frame_buffer[i], 0, end - x);
+    if (albedo)
+      rgba8_fill(&frame->albedo_buffer[i], RGBA8_WHITE, end - x);
+    x = end;
+  }
+}
+
+void frame_targets_clear(FrameTargets *frame, const Renderer *renderer) {
+  ScreenRect rect = renderer->scissor;
+  bool full = rect.min_x == 0 && rect.min_y == 0 && rect.max_x == renderer->width && rect.max_y == renderer->height;
+  if (full) {
+    // All the rows drawn, padding included, in one go.
+    memset(frame->frame_buffer, 0, frame->stride * render_target_rows(renderer->height));
+  }
+  for (usize y = rect.min_y; y < rect.max_y; ++y) {
+    if (!full)
+      clear_row(frame, y, rect.min_x, rect.max_x, true, false);
+    if (!frame->colors)
+      continue;
+    // Only the pixels drawn with colors since they were last cleared aren't white.
+    usize begin = frame->albedo_begin[y];
+    usize end = frame->albedo_end[y];
+    clear_row(frame, y, maxzu(begin, rect.min_x), minzu(end, rect.max_x), false, true);
+    if (rect.min_x <= begin && end <= rect.max_x) {
+      frame->albedo_begin[y] = frame->width;
+      frame->albedo_end[y] = 0;
+    }
+  }
+  // The expanded pixels outside of the scissor were resolved in the previous frame already.
+  if (frame->samples != 1 && !screen_rect_is_empty(rect))
+    msaa_color_clear(&frame->msaa);
+}
+
+void frame_targets_draw_shadow_map(
+    FrameTargets *frame, Vec3 light, const Mesh *const *casters, const Mat4x4 *transforms, usize casters_len) {
+  if (!frame->shadows)
+    return;
+  Aabb bounds = aabb_transform(transforms[0], casters[0]->bounds);
+  for (usize i = 1; i < casters_len; ++i) {
+    bounds = aabb_union(bounds, aabb_transform(transforms[i], casters[i]->bounds));
+  }
+  shadow_map_begin(&frame->shadow, light, bounds);
+  for (usize i = 0; i < casters_len; ++i) {
+    shadow_map_add_caster(&frame->shadow, casters[i], transforms[i]);
+  }
+}
+
+ScreenRect frame_targets_shade(FrameTargets *frame, const Renderer *renderer, ShaderKind shader_kind) {
+  ScreenRect redrawn = renderer->scissor;
+  usize width = renderer->width;
+  usize height = renderer->height;
+  // The colors of the samples of the edges, before the shaders read the frame buffer.
+  if (frame->samples != 1 && !screen_rect_is_empty(redrawn))
+    msaa_color_resolve(&frame->msaa, frame->frame_buffer, frame->stride, frame->layout);
+  if (frame->shadows && !screen_rect_is_empty(redrawn))
+    shadow_map_resolve(
+        &frame->shadow, renderer, frame->shadow_filter, frame->frame_buffer, frame->stride, frame->layout);
+  frame->shadows_changed = false;
+  frame->colors_changed = false;
+
+  ScreenRect shaded = shader_dirty_rect(shader_kind, width, height, redrawn);
+  if (shader_kind != frame->shaded_kind) {
+    shaded = (ScreenRect){0, 0, width, height};
+    frame->shaded_kind = shader_kind;
+  }
+  if (screen_rect_is_empty(shaded))
+    return shaded;
+
+  const u8 *frame_buffer = frame->frame_buffer;
+  const f32 *depth_buffer = renderer->depth_buffer;
+  const Rgba8 *albedo_buffer = frame->albedo_buffer;
+  if (frame->layout == RENDER_LAYOUT_TILED) {
+    // The shaders read the depth around each pixel by rows.
+    detile_render_target(
+        frame->linear_frame_buffer, frame->stride, frame->frame_buffer, frame->stride, width, height, sizeof(u8));
+    frame_buffer = frame->linear_frame_buffer;
+    if (shader_kind != SHADER_KIND_DEFAULT) {
+      detile_render_target(frame->linear_depth_buffer,
+                           renderer->stride,
+                           renderer->depth_buffer,
+                           renderer->stride,
+                           width,
+                           height,
+                           sizeof(f32));
+      depth_buffer = frame->linear_depth_buffer;
+    }
+    if (frame->colors) {
+      detile_render_target(frame->linear_albedo_buffer,
+                           frame->stride,
+                           frame->albedo_buffer,
+                           frame->stride,
+                           width,
+                           height,
+                           sizeof(Rgba8));
+      albedo_buffer = frame->linear_albedo_buffer;
+    }
+  }
+  apply_shader_rect(shader_kind,
+                    width,
+                    height,
+                    shaded,
+                    frame_buffer,
+                    frame->stride,
+                    depth_buffer,
+                    renderer->stride,
+                    frame->shaded_buffer,
+                    frame->stride);
+  if (frame->colors)
+    compose_rgba8_rect(
+        shaded, frame->shaded_buffer, frame->stride, albedo_buffer, frame->stride, frame->color_buffer, frame->stride);
+  return shaded;
+}
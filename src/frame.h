@@ -0,0 +1,169 @@
+#pragma once
+
+#include "common.h"
+#include "render.h"
+#include "mesh.h"
+#include "msaa.h"
+#include "color.h"
+#include "shadow.h"
+#include "shaders.h"
+
+// The render targets of a frame besides the renderer's depth buffers, and the passes over them that make up a frame
+// around drawing the scene, shared by the GUI and the benchmark so that both render the same frames.
+//
+// Only the renderer's scissor is cleared and redrawn every frame (see `frame_targets_redrawn_rect`), the frame buffer
+// keeps the unshaded light levels of the other pixels. Once drawn, the samples and the shadows of the scissor are
+// resolved, and the pixels around it are shaded into `shaded_buffer`, and composed with the vertex colors into
+// `color_buffer`, which are what's presented.
+//
+// Example:
+//
+// ```
+// FrameTargets frame = new_frame_targets(width, height, RENDER_LAYOUT_LINEAR, 1, true, 1024);
+// renderer.draw_pixel_callback_cx = &frame;
+// while (...) {
+//   renderer.scissor = frame_targets_redrawn_rect(&frame, &renderer, scene_dirty_rect(&scene, &renderer), false);
+//   renderer_clear_frame(&renderer);
+//   frame_targets_clear(&frame, &renderer);
+//   frame_targets_draw_shadow_map(&frame, renderer.light, casters, transforms, casters_len);
+//   // draw with a callback calling `frame_targets_draw_span`...
+//   ScreenRect shaded = frame_targets_shade(&frame, &renderer, shader_kind);
+//   // present `frame.shaded_buffer` (or `frame.color_buffer` with colors)...
+// }
+// free_frame_targets(frame);
+// ```
+
+/// SAFETY: Only use new_frame_targets to construct this.
+typedef struct frame_targets {
+  /// The size the targets are allocated for, that of the renderer (see `renderer_set_resolution` for drawing less).
+  usize width;
+  usize height;
+  /// Distance between the rows of every buffer but `linear_depth_buffer`, see `render_target_stride`.
+  usize stride;
+  /// Of `frame_buffer` and `albedo_buffer`, the same as the renderer's. The other buffers are linear.
+  RenderLayout layout;
+  /// LEN: stride * render_target_rows(height), from `alloc_render_target`. The light levels, unshaded.
+  u8 *frame_buffer;
+  /// LEN: stride * height, from `alloc_render_target`. The frame buffer shaded. Only the pixels around the redrawn ones
+  /// are shaded again (see `shader_dirty_rect`), all of them when the shader changes.
+  u8 *shaded_buffer;
+  /// The shader `shaded_buffer` was last shaded with.
+  ShaderKind shaded_kind;
+  /// Only when tiled, `NULL` otherwise. The linear copies the shaders read: of the frame buffer, of the renderer's
+  /// depth buffer (with the renderer's stride), and of the albedo buffer with colors.
+  /// LEN: stride * height, renderer->stride * height, stride * height.
+  u8 *linear_frame_buffer;
+  f32 *linear_depth_buffer;
+  Rgba8 *linear_albedo_buffer;
+  /// Draw the vertex colors of the meshes (see color.h), see `frame_targets_set_colors`. The frame must be redrawn
+  /// whole when it changes (see `colors_changed`), as the colors of the pixels that aren't redrawn are stale.
+  bool colors;
+  bool colors_changed;
+  /// Only if allocated with colors, `NULL` otherwise. The vertex color of every pixel, only drawn with `colors`, the
+  /// renderer's scissor is cleared to white with the frame buffer, and the shaded buffer composed with it, which is
+  /// what's presented with `colors`.
+  /// LEN: stride * render_target_rows(height), stride * height.
+  Rgba8 *albedo_buffer;
+  Rgba8 *color_buffer;
+  /// Only if allocated with colors, `NULL` otherwise. LEN: height. Of each row, the pixels
+  /// `albedo_begin[y]..albedo_end[y]` drawn with colors since they were last cleared, the only ones that need clearing,
+  /// the others are white still. Each row is only drawn by one thread (see `cmdbuf_submit`).
+  usize *albedo_begin;
+  usize *albedo_end;
+  /// Of multisampling, the same as the renderer's (see `renderer_set_samples`), 1 for none.
+  usize samples;
+  /// Only if `samples` isn't 1, resolved into `frame_buffer` before shading.
+  MsaaColorBuffer msaa;
+  /// Only if allocated with a size, drawn with `frame_targets_draw_shadow_map` and resolved into `frame_buffer` after
+  /// the samples.
+  ShadowMap shadow;
+  bool has_shadow_map;
+  /// See `frame_targets_set_shadows`. Shadows move with any caster, so the frame must be redrawn whole with them, and
+  /// when they change (see `shadows_changed`).
+  bool shadows;
+  ShadowFilter shadow_filter;
+  bool shadows_changed;
+} FrameTargets;
+
+/// For a renderer of `width` x `height` pixels, `layout` and `samples` (see `renderer_set_samples`). The color buffers
+/// are only allocated with `colors`, the shadow map only with a `shadow_map_size` (its size) that isn't 0. Colors and
+/// shadows start off, the shadow filter at `SHADOW_FILTER_PCF_2X2`.
+FrameTargets new_frame_targets(
+    usize width, usize height, RenderLayout layout, usize samples, bool colors, usize shadow_map_size);
+
+void free_frame_targets(FrameTargets frame);
+
+/// Turns the vertex colors on or off, marking the change. They must have been allocated to turn them on.
+void frame_targets_set_colors(FrameTargets *frame, bool colors);
+
+/// Turns the shadows on or off with `filter`, marking the change. The shadow map must have been allocated to turn them
+/// on.
+void frame_targets_set_shadows(FrameTargets *frame, bool shadows, ShadowFilter filter);
+
+/// The pixels to redraw: `dirty` (e.g. from `scene_dirty_rect`), or all of them with `redraw_all`, with shadows, or
+/// when the colors or the shadows changed.
+ScreenRect frame_targets_redrawn_rect(const FrameTargets *frame,
+                                      const Renderer *renderer,
+                                      ScreenRect dirty,
+                                      bool redraw_all);
+
+/// Clears the renderer's scissor of the frame buffer, and of the albedo buffer with colors (only the pixels drawn with
+/// colors since). Call it with `renderer_clear_frame`.
+void frame_targets_clear(FrameTargets *frame, const Renderer *renderer);
+
+/// With shadows, draws the shadow map of the casters, `casters[i]` transformed by `transforms[i]`, seen from the light
+/// `light` (see `Renderer::light`). Does nothing without shadows.
+void frame_targets_draw_shadow_map(
+    FrameTargets *frame, Vec3 light, const Mesh *const *casters, const Mat4x4 *transforms, usize casters_len);
+
+/// Once the renderer's scissor is drawn: resolves its samples and shadows, shades the pixels around it into
+/// `shaded_buffer` with `shader_kind` (all of them when the shader changed), and composes those with the vertex colors
+/// into `color_buffer` with colors. Returns the pixels shaded.
+ScreenRect frame_targets_shade(FrameTargets *frame, const Renderer *renderer, ShaderKind shader_kind);
+
+/// Marks the pixels `x_begin..x_end` of row `y` as drawn with colors, see `FrameTargets::albedo_begin`.
+static inline void frame_targets_mark_albedo(FrameTargets *frame, usize y, usize x_begin, usize x_end) {
+  frame->albedo_begin[y] = minzu(frame->albedo_begin[y], x_begin);
+  frame->albedo_end[y] = maxzu(frame->albedo_end[y], x_end);
+}
+
+/// For the draw pixel callback (see `draw_pixel_callback_t`): draws pixel (x, y), in either layout. Safe to call from
+/// threads drawing different rows.
+static inline void frame_targets_draw_pixel(
+    FrameTargets *frame, usize x, usize y, u8 light_level, u8 coverage, const Varyings *varyings) {
+  usize i = render_target_index(frame->layout, frame->stride, x, y);
+  if (frame->colors) {
+    frame->albedo_buffer[i] = rgba8_from_varyings(varyings);
+    frame_targets_mark_albedo(frame, y, x, x + 1);
+  }
+  if (frame->samples != 1)
+    msaa_color_write(&frame->msaa, &frame->frame_buffer[i], x, y, coverage, light_level);
+  else
+    frame->frame_buffer[i] = light_level;
+}
+
+/// For the draw span callback (see `draw_span_callback_t`): draws the pixels `x_begin..x_end` of row `y`, in either
+/// layout. Safe to call from threads drawing different rows.
+static inline void frame_targets_draw_span(FrameTargets *frame,
+                                           usize y,
+                                           usize x_begin,
+                                           usize x_end,
+                                           const f32 *depths,
+                                           u8 light_level,
+                                           const u8 *coverage,
+                                           const Varyings *varyings) {
+  // Spans don't cross tiles, so they are contiguous in either layout.
+  usize i = render_target_index(frame->layout, frame->stride, x_begin, y);
+  if (frame->colors) {
+    rgba8_span_from_varyings(varyings, x_begin, x_end, depths, &frame->albedo_buffer[i]);
+    frame_targets_mark_albedo(frame, y, x_begin, x_end);
+  }
+  u8 *pixels = &frame->frame_buffer[i];
+  if (frame->samples == 1) {
+    memset(pixels, light_level, x_end - x_begin);
+    return;
+  }
+  for (usize x = x_begin; x < x_end; ++x) {
+    msaa_color_write(&frame->msaa, &pixels[x - x_begin], x, y, coverage[x - x_begin], light_level);
+  }
+}
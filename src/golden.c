@@ -0,0 +1,1101 @@
+// Golden-image regression check of the renderer.
+//
+// Renders a set of canonical scenes headlessly with every shader, and compares the frame buffers and depth buffers
+// against the reference images checked in under `golden/` (frame buffers as binary PGM, depth buffers as PFM, and the
+// composed colors of the scenes with vertex colors as binary PPM).
+// With `--diff`, instead compares every accelerated backend, with the kernels of every instruction set the CPU supports
+// (see dispatch.h), against the scalar reference backend with the scalar kernels.
+// With `--update`, (re)writes the reference images (with the scalar kernels), only do this for intentional changes of
+// the output.
+//
+// Usage: golden [--update | --diff] [--dir DIR] [--tolerance N] [--depth-tolerance X] [--max-bad-pixels X]
+//               [--output DIR]
+
+#include <ctype.h>
+
+#include "common.h"
+#include "linear_alg.h"
+#include "math_helpers.h"
+#include "teapot.h"
+#include "cube.h"
+#include "demo.h"
+#include "dispatch.h"
+#include "mesh.h"
+#include "render.h"
+#include "cmdbuf.h"
+#include "occlusion.h"
+#include "scene.h"
+#include "shaders.h"
+#include "texture.h"
+#include "msaa.h"
+#include "shadow.h"
+#include "color.h"
+
+/// Reference images are small to keep the repo small, the scenes are framed to still cover a good number of pixels.
+#define GOLDEN_WIDTH 128
+#define GOLDEN_HEIGHT 128
+
+/// Of the shadow map of the scenes with shadows.
+#define GOLDEN_SHADOW_MAP_SIZE 256
+
+typedef enum golden_mode {
+  GOLDEN_MODE_CHECK,
+  GOLDEN_MODE_UPDATE,
+  GOLDEN_MODE_DIFF,
+} GoldenMode;
+
+typedef struct golden_options {
+  GoldenMode mode;
+  /// Directory of the reference images.
+  const char *dir;
+  /// Max difference of a pixel in the frame buffer before it counts as a bad pixel.
+  u8 tolerance;
+  /// Max relative difference of a pixel in the depth buffer before it counts as a bad pixel.
+  f32 depth_tolerance;
+  /// Max fraction of bad pixels in an image for it to still match.
+  f32 max_bad_pixels;
+  /// If not `NULL`, write the rendered images that didn't match to this directory.
+  const char *output_dir;
+} GoldenOptions;
+
+typedef struct golden_object {
+  const Vec3 *vertices;
+  usize vertices_len;
+  /// `NULL` for indexless objects.
+  const usize *indices;
+  usize indices_len;
+  Mat4x4 m;
+  /// `NULL` for objects without vertex attributes, see `Mesh::attributes`.
+  const f32 *attributes;
+  usize attributes_len;
+} GoldenObject;
+
+#define GOLDEN_MAX_OBJECTS 16
+
+typedef struct golden_scene {
+  const char *name;
+  GoldenObject objects[GOLDEN_MAX_OBJECTS];
+  usize objects_len;
+  /// If not `NULL`, the objects with vertex attributes are textured, the first two being their texture coords.
+  const Texture *texture;
+  TextureFilter filter;
+  /// Of multisampling (see `renderer_set_samples`), 0 for none.
+  usize samples;
+  /// Whether every object casts shadows onto the others, from the light of the renderer.
+  bool shadows;
+  ShadowFilter shadow_filter;
+  /// Whether the attributes of the objects are vertex colors (see color.h), which are composed with the frame of the
+  /// default shader into a color image. The albedo isn't multisampled, so these scenes shouldn't be either: which
+  /// triangle gives an edge pixel its color would depend on the order the backend draws them in.
+  bool colors;
+} GoldenScene;
+
+/// Plays the role of `GuiPainter` but without a window.
+typedef struct golden_painter {
+  /// LEN: GOLDEN_WIDTH * GOLDEN_HEIGHT, with a stride of `GOLDEN_WIDTH`.
+  u8 *frame_buffer;
+  /// Of `frame_buffer`, the same as the renderer's.
+  RenderLayout layout;
+  /// Of the scene.
+  const Texture *texture;
+  /// Only if `texture` is not `NULL`.
+  TexcoordBuffer texcoords;
+  /// Of the scene, multisampled if not 1.
+  usize samples;
+  /// Only if multisampled.
+  MsaaColorBuffer msaa;
+  /// Only if the scene has shadows, of its objects where they are drawn last.
+  ShadowMap shadow;
+  /// Only if the scene has colors, `NULL` otherwise. LEN: GOLDEN_WIDTH * GOLDEN_HEIGHT, laid out as `frame_buffer`.
+  Rgba8 *albedo_buffer;
+} GoldenPainter;
+
+/// A way of rendering a scene. The first backend is the scalar reference, all others must produce the same images.
+typedef struct backend {
+  const char *name;
+  void (*draw_scene)(Renderer *renderer, const GoldenScene *scene);
+  /// Of the depth and frame buffers, which are detiled before the comparison.
+  RenderLayout layout;
+} Backend;
+
+/// Pixels of triangles with vertex attributes are textured in scenes with a texture, get their vertex color in scenes
+/// with colors, and get the mean of their varyings instead of the light level otherwise.
+static void golden_draw_pixel_callback(void *cx_,
+                                       usize width,
+                                       usize height,
+                                       usize x,
+                                       usize y,
+                                       f32 z,
+                                       u8 light_level,
+                                       u8 coverage,
+                                       const Varyings *varyings) {
+  GoldenPainter *cx = cx_;
+  u8 value = light_level;
+  if (cx->texture != NULL) {
+    if (varyings->len >= 2)
+      texcoord_buffer_write(&cx->texcoords, cx->texture, x, y, z, varyings);
+    else
+      texcoord_buffer_skip(&cx->texcoords, x, y);
+  } else if (cx->albedo_buffer != NULL) {
+    cx->albedo_buffer[render_target_index(cx->layout, GOLDEN_WIDTH, x, y)] = rgba8_from_varyings(varyings);
+  } else if (varyings->len != 0) {
+    f32 sum = 0;
+    for (usize i = 0; i < varyings->len; ++i) {
+      sum += varyings->get[i];
+    }
+    value = (u8)maxf(minf(sum / (f32)varyings->len, 255), 0);
+  }
+  u8 *pixel = &cx->frame_buffer[render_target_index(cx->layout, GOLDEN_WIDTH, x, y)];
+  if (cx->samples != 1)
+    msaa_color_write(&cx->msaa, pixel, x, y, coverage, value);
+  else
+    *pixel = value;
+}
+
+DEF_DRAW_FUNCTIONS(golden_, , golden_draw_pixel_callback);
+
+/// `golden_draw_pixel_callback` on every pixel of the span, with the varyings the span gives them, so that drawing by
+/// spans must give the same images.
+static void golden_draw_span_callback(void *cx,
+                                      usize width,
+                                      usize height,
+                                      usize y,
+                                      usize x_begin,
+                                      usize x_end,
+                                      const f32 *depths,
+                                      u8 light_level,
+                                      const u8 *coverage,
+                                      const Varyings *varyings) {
+  Varyings pixel_varyings = *varyings;
+  for (usize x = x_begin; x < x_end; ++x) {
+    usize i = x - x_begin;
+    for (usize j = 0; j < varyings->len && i != 0; ++j) {
+      pixel_varyings.get[j] = varyings_span_at(varyings, j, x, depths[i]);
+    }
+    golden_draw_pixel_callback(cx, width, height, x, y, depths[i], light_level, coverage[i], &pixel_varyings);
+  }
+}
+
+DEF_DRAW_SPAN_FUNCTIONS(golden_, _spans, golden_draw_span_callback);
+
+/// The vertex and raster stages of `draw_object`, for objects with vertex attributes, which it doesn't take.
+static void draw_object_with_attributes(Renderer *renderer, const GoldenObject *object) {
+  Vec3 *world = xalloc(Vec3, object->vertices_len);
+  Vec3 *projected = xalloc(Vec3, object->vertices_len);
+  project_vertices(renderer, object->vertices, object->vertices_len, object->m, world, projected);
+  usize triangles_len = (object->indices == NULL ? object->vertices_len : object->indices_len) / 3;
+  for (usize j = 0; j < triangles_len; ++j) {
+    usize i0 = object->indices == NULL ? j * 3 + 0 : object->indices[j * 3 + 0];
+    usize i1 = object->indices == NULL ? j * 3 + 1 : object->indices[j * 3 + 1];
+    usize i2 = object->indices == NULL ? j * 3 + 2 : object->indices[j * 3 + 2];
+    ProjectedTriangle triangle = assemble_triangle(renderer, world, projected, i0, i1, i2);
+    triangle_set_attributes(&triangle, object->attributes, object->attributes_len, i0, i1, i2);
+    golden_rasterize_triangle(renderer, triangle);
+  }
+  xfree(projected);
+  xfree(world);
+}
+
+/// The reference: immediate-mode draw calls, like the demo.
+static void draw_scene_immediate(Renderer *renderer, const GoldenScene *scene) {
+  for (usize i = 0; i < scene->objects_len; ++i) {
+    const GoldenObject *object = &scene->objects[i];
+    if (object->attributes != NULL)
+      draw_object_with_attributes(renderer, object);
+    else if (object->indices == NULL)
+      golden_draw_object_indexless(renderer, object->vertices, object->vertices_len, object->m);
+    else
+      golden_draw_object(
+          renderer, object->vertices, object->vertices_len, object->indices, object->indices_len, object->m);
+  }
+}
+
+/// Vertex stage of all triangles first, then raster stage of all triangles, like the benchmark.
+static void draw_scene_staged(Renderer *renderer, const GoldenScene *scene) {
+  for (usize i = 0; i < scene->objects_len; ++i) {
+    const GoldenObject *object = &scene->objects[i];
+    usize triangles_len = (object->indices == NULL ? object->vertices_len : object->indices_len) / 3;
+    ProjectedTriangle *triangles = xalloc(ProjectedTriangle, triangles_len);
+    for (usize j = 0; j < triangles_len; ++j) {
+      usize i0 = object->indices == NULL ? j * 3 + 0 : object->indices[j * 3 + 0];
+      usize i1 = object->indices == NULL ? j * 3 + 1 : object->indices[j * 3 + 1];
+      usize i2 = object->indices == NULL ? j * 3 + 2 : object->indices[j * 3 + 2];
+      triangles[j] = project_triangle(
+          renderer, object->vertices[i0], object->vertices[i1], object->vertices[i2], object->m);
+      if (object->attributes != NULL)
+        triangle_set_attributes(&triangles[j], object->attributes, object->attributes_len, i0, i1, i2);
+    }
+    for (usize j = 0; j < triangles_len; ++j) {
+      rasterize_triangle(renderer, triangles[j], golden_draw_pixel_callback);
+    }
+    xfree(triangles);
+  }
+}
+
+/// Runs of objects with the same geometry drawn as instances of one mesh.
+static void draw_scene_instanced(Renderer *renderer, const GoldenScene *scene) {
+  Instance instances[GOLDEN_MAX_OBJECTS];
+  for (usize i = 0; i < scene->objects_len;) {
+    const GoldenObject *first = &scene->objects[i];
+    Mesh mesh = new_mesh(first->vertices, first->vertices_len, first->indices, first->indices_len);
+    mesh_set_attributes(&mesh, first->attributes, first->attributes_len);
+    usize instances_len = 0;
+    for (; i < scene->objects_len; ++i) {
+      const GoldenObject *object = &scene->objects[i];
+      if (object->vertices != first->vertices || object->indices != first->indices ||
+          object->attributes != first->attributes)
+        break;
+      instances[instances_len++] = new_instance(renderer, object->m);
+    }
+    golden_draw_object_instanced(renderer, &mesh, instances, instances_len);
+  }
+}
+
+/// Adds the objects of a golden scene to a `Scene`. `meshes` must have room for all of them.
+static void add_scene_objects(const Renderer *renderer, const GoldenScene *golden_scene, Mesh *meshes, Scene *scene) {
+  for (usize i = 0; i < golden_scene->objects_len; ++i) {
+    const GoldenObject *object = &golden_scene->objects[i];
+    meshes[i] = new_mesh(object->vertices, object->vertices_len, object->indices, object->indices_len);
+    mesh_set_attributes(&meshes[i], object->attributes, object->attributes_len);
+    // Objects of the same geometry share the mesh, so that they are drawn as instances.
+    const Mesh *mesh = &meshes[i];
+    for (usize j = 0; j < i; ++j) {
+      if (meshes[j].vertices == meshes[i].vertices && meshes[j].indices == meshes[i].indices &&
+          meshes[j].attributes == meshes[i].attributes) {
+        mesh = &meshes[j];
+        break;
+      }
+    }
+    scene_add_object(scene, mesh, new_instance(renderer, object->m));
+  }
+}
+
+/// The objects in a `Scene`, culled with its BVH.
+static void draw_scene_bvh(Renderer *renderer, const GoldenScene *golden_scene) {
+  Mesh meshes[GOLDEN_MAX_OBJECTS];
+  Scene scene = new_scene();
+  add_scene_objects(renderer, golden_scene, meshes, &scene);
+  draw_scene(renderer, &scene, NULL, golden_rasterize_triangle);
+  free_scene(scene);
+}
+
+/// Like `draw_scene_bvh`, drawn by spans.
+static void draw_scene_spans(Renderer *renderer, const GoldenScene *golden_scene) {
+  Mesh meshes[GOLDEN_MAX_OBJECTS];
+  Scene scene = new_scene();
+  add_scene_objects(renderer, golden_scene, meshes, &scene);
+  draw_scene(renderer, &scene, NULL, golden_rasterize_triangle_spans);
+  free_scene(scene);
+}
+
+/// The objects in a `Scene`, with every object as an occluder of the others.
+static void draw_scene_occlusion(Renderer *renderer, const GoldenScene *golden_scene) {
+  Mesh meshes[GOLDEN_MAX_OBJECTS];
+  Scene scene = new_scene();
+  add_scene_objects(renderer, golden_scene, meshes, &scene);
+  OcclusionBuffer occlusion = new_occlusion_buffer(renderer);
+  occlusion_begin(&occlusion, renderer);
+  for (usize i = 0; i < scene.objects_len; ++i) {
+    occlusion_add_occluder(&occlusion, scene.objects[i].mesh, scene.objects[i].instance.m);
+  }
+  occlusion_finish(&occlusion);
+  draw_scene(renderer, &scene, &occlusion, golden_rasterize_triangle);
+  free_occlusion_buffer(occlusion);
+  free_scene(scene);
+}
+
+/// The objects in a `Scene`, recorded into a command buffer and submitted grouped by mesh, on one thread.
+static void draw_scene_cmdbuf(Renderer *renderer, const GoldenScene *golden_scene) {
+  Mesh meshes[GOLDEN_MAX_OBJECTS];
+  Scene scene = new_scene();
+  add_scene_objects(renderer, golden_scene, meshes, &scene);
+  CommandBuffer cmdbuf = new_command_buffer();
+  scene_record(renderer, &scene, NULL, &cmdbuf);
+  cmdbuf_submit(renderer, &cmdbuf, CMD_SORT_STATE, NULL, golden_rasterize_triangle);
+  free_command_buffer(cmdbuf);
+  free_scene(scene);
+}
+
+/// Like `draw_scene_cmdbuf`, but submitted front to back, split between threads.
+static void draw_scene_cmdbuf_threads(Renderer *renderer, const GoldenScene *golden_scene) {
+  Mesh meshes[GOLDEN_MAX_OBJECTS];
+  Scene scene = new_scene();
+  add_scene_objects(renderer, golden_scene, meshes, &scene);
+  CommandBuffer cmdbuf = new_command_buffer();
+  CmdExecutor executor = new_cmd_executor(4);
+  scene_record(renderer, &scene, NULL, &cmdbuf);
+  cmdbuf_submit(renderer, &cmdbuf, CMD_SORT_FRONT_TO_BACK, &executor, golden_rasterize_triangle);
+  free_cmd_executor(executor);
+  free_command_buffer(cmdbuf);
+  free_scene(scene);
+}
+
+/// Draws the objects of a scene with shadows into the shadow map, where they are in world space.
+static void draw_shadow_map(ShadowMap *shadow, const Renderer *renderer, const GoldenScene *scene) {
+  Mesh meshes[GOLDEN_MAX_OBJECTS];
+  Aabb bounds = {0};
+  for (usize i = 0; i < scene->objects_len; ++i) {
+    const GoldenObject *object = &scene->objects[i];
+    meshes[i] = new_mesh(object->vertices, object->vertices_len, object->indices, object->indices_len);
+    Aabb object_bounds = aabb_transform(object->m, meshes[i].bounds);
+    bounds = i == 0 ? object_bounds : aabb_union(bounds, object_bounds);
+  }
+  shadow_map_begin(shadow, renderer->light, bounds);
+  for (usize i = 0; i < scene->objects_len; ++i) {
+    shadow_map_add_caster(shadow, &meshes[i], scene->objects[i].m);
+  }
+}
+
+/// The color passes that follow drawing a frame (see `render_scene`): the colors of the samples, the shadows, then the
+/// textures.
+static void resolve_frame(GoldenPainter *painter, const Renderer *renderer, const GoldenScene *scene) {
+  if (painter->samples != 1)
+    msaa_color_resolve(&painter->msaa, painter->frame_buffer, GOLDEN_WIDTH, painter->layout);
+  if (scene->shadows)
+    shadow_map_resolve(
+        &painter->shadow, renderer, scene->shadow_filter, painter->frame_buffer, GOLDEN_WIDTH, painter->layout);
+  if (scene->texture != NULL)
+    texcoord_buffer_resolve(
+        &painter->texcoords, scene->texture, scene->filter, painter->frame_buffer, GOLDEN_WIDTH, painter->layout);
+}
+
+/// The objects in a `Scene`, drawn with the first one moved away, then moved back and redrawn only in the dirty
+/// rectangle, on top of the previous frame like the demo does. Scenes with shadows are redrawn whole, as the demo does
+/// too: moving an object moves its shadow, which may fall outside of the dirty rectangle.
+static void draw_scene_dirty(Renderer *renderer, const GoldenScene *golden_scene) {
+  GoldenPainter *painter = renderer->draw_pixel_callback_cx;
+  Mesh meshes[GOLDEN_MAX_OBJECTS];
+  Scene scene = new_scene();
+  add_scene_objects(renderer, golden_scene, meshes, &scene);
+  Mat4x4 m = scene.objects[0].instance.m;
+  scene_set_transform(&scene, 0, mul4x4(translate3d((Vec3){{0, 0.4f, 0.3f}}), m));
+  renderer->scissor = scene_dirty_rect(&scene, renderer);
+  draw_scene(renderer, &scene, NULL, golden_rasterize_triangle);
+  resolve_frame(painter, renderer, golden_scene);
+
+  scene_set_transform(&scene, 0, m);
+  renderer->scissor = scene_dirty_rect(&scene, renderer);
+  if (golden_scene->shadows)
+    renderer->scissor = (ScreenRect){0, 0, renderer->width, renderer->height};
+  renderer_clear_frame(renderer);
+  ScreenRect rect = renderer->scissor;
+  for (usize y = rect.min_y; y < rect.max_y; ++y) {
+    for (usize x = rect.min_x; x < rect.max_x; ++x) {
+      usize i = render_target_index(painter->layout, GOLDEN_WIDTH, x, y);
+      painter->frame_buffer[i] = 0;
+      if (painter->albedo_buffer != NULL)
+        painter->albedo_buffer[i] = RGBA8_WHITE;
+    }
+  }
+  if (painter->samples != 1)
+    msaa_color_clear(&painter->msaa);
+  if (golden_scene->texture != NULL)
+    texcoord_buffer_clear(&painter->texcoords);
+  draw_scene(renderer, &scene, NULL, golden_rasterize_triangle);
+  free_scene(scene);
+}
+
+static const Backend backends[] = {
+    {"immediate", draw_scene_immediate},
+    {"staged", draw_scene_staged},
+    {"instanced", draw_scene_instanced},
+    {"bvh", draw_scene_bvh},
+    {"occlusion", draw_scene_occlusion},
+    {"cmdbuf", draw_scene_cmdbuf},
+    {"cmdbuf_threads", draw_scene_cmdbuf_threads},
+    {"dirty", draw_scene_dirty},
+    {"spans", draw_scene_spans},
+    {"immediate_tiled", draw_scene_immediate, RENDER_LAYOUT_TILED},
+    {"cmdbuf_threads_tiled", draw_scene_cmdbuf_threads, RENDER_LAYOUT_TILED},
+    {"dirty_tiled", draw_scene_dirty, RENDER_LAYOUT_TILED},
+    {"spans_tiled", draw_scene_spans, RENDER_LAYOUT_TILED},
+};
+
+// clang-format off
+
+/// Triangles seen (nearly) edge-on. The camera looks in negative X, so screen X is world Y and screen Y is world Z.
+static const Vec3 edge_on_vertices[] = {
+    // In the XY plane, exactly edge-on, should be a horizontal line at most.
+    {{-1.0f, -1.5f, 1.0f}}, {{ 1.0f, -1.5f, 1.0f}}, {{ 0.0f,  1.5f, 1.0f}},
+    // In the XZ plane, exactly edge-on, should be a vertical line at most.
+    {{-1.0f, -1.0f, -1.5f}}, {{ 1.0f, -1.0f, -1.5f}}, {{ 0.0f, -1.0f,  0.5f}},
+    // Slightly tilted away from edge-on, should be a sliver.
+    {{-1.0f,  0.5f, -1.0f}}, {{ 1.0f,  0.6f, -1.0f}}, {{ 0.0f,  1.5f, -0.9f}},
+};
+
+/// Triangles that extend from in front of the camera to behind it (the camera is at X = 10).
+static const Vec3 near_plane_vertices[] = {
+    {{ 0.0f, -1.5f, -1.5f}}, {{20.0f,  0.0f, -1.0f}}, {{ 0.0f,  1.5f, -1.5f}},
+    {{ 9.95f, -0.5f, 0.5f}}, {{10.05f,  0.5f,  0.5f}}, {{ 9.95f,  0.5f,  1.5f}},
+    {{-5.0f,  1.0f,  1.0f}}, {{15.0f,  1.5f,  1.0f}}, {{-5.0f,  1.5f,  1.8f}},
+};
+
+/// Two attributes per vertex of the cube, each going from 0 to 255 across it.
+static const f32 cube_attributes[] = {
+    0,   0,   255, 0,   255, 255, 0,   255, // Vertices 0 to 3.
+    0,   255, 255, 255, 255, 0,   0,   0,   // Vertices 4 to 7.
+};
+
+/// A quad behind the cube receding into the distance, with an attribute going from 0 at the near edge to 255 at the
+/// far edge. Interpolated perspective-correctly, it stays closer to 0 over most of the quad.
+static const Vec3 receding_vertices[] = {
+    {{ -2.0f, -1.8f, -1.8f}}, {{ -2.0f,  1.8f, -1.8f}}, {{-30.0f,  1.8f,  1.8f}},
+    {{-30.0f,  1.8f,  1.8f}}, {{-30.0f, -1.8f,  1.8f}}, {{ -2.0f, -1.8f, -1.8f}},
+};
+
+static const f32 receding_attributes[] = {0, 0, 255, 255, 255, 0};
+
+/// Texture coords of `receding_vertices`, the texture repeats many times towards the far edge.
+static const f32 receding_texcoords[] = {
+    0, 0,  8, 0,  8, 16,
+    8, 16, 0, 16, 0, 0,
+};
+
+/// A tilted quad in front of the receding one, with half of the texture magnified over it.
+static const Vec3 magnified_vertices[] = {
+    {{ 1.0f, -1.0f, -0.6f}}, {{ 0.5f,  0.8f, -0.6f}}, {{ 0.5f,  0.8f,  1.2f}},
+    {{ 0.5f,  0.8f,  1.2f}}, {{ 1.0f, -1.0f,  1.2f}}, {{ 1.0f, -1.0f, -0.6f}},
+};
+
+static const f32 magnified_texcoords[] = {
+    0,    0,    0.5f, 0,    0.5f, 0.5f,
+    0.5f, 0.5f, 0,    0.5f, 0,    0,
+};
+
+// clang-format on
+
+#define GOLDEN_TEXTURE_SIZE 64
+
+/// A checkerboard of 8x8 texels with a gradient, so that bilinear filtering and the mip levels show.
+static Texture golden_texture() {
+  u8 texels[GOLDEN_TEXTURE_SIZE * GOLDEN_TEXTURE_SIZE];
+  for (usize y = 0; y < GOLDEN_TEXTURE_SIZE; ++y) {
+    for (usize x = 0; x < GOLDEN_TEXTURE_SIZE; ++x) {
+      bool is_white = (x / 8 + y / 8) % 2 == 0;
+      texels[y * GOLDEN_TEXTURE_SIZE + x] = (u8)((is_white ? 160 : 0) + x + y / 2);
+    }
+  }
+  return new_texture(texels, GOLDEN_TEXTURE_SIZE, GOLDEN_TEXTURE_SIZE);
+}
+
+/// `texture` is used by the textured scenes, `teapot_colors` and `cube_colors` (see `demo_vertex_colors`) by the scenes
+/// with colors.
+static usize make_scenes(GoldenScene *scenes,
+                         const Texture *texture,
+                         const f32 *teapot_colors,
+                         const f32 *cube_colors) {
+  Mat4x4 base_transform = demo_base_transform();
+  Mat4x4 id = mat4x4_id;
+  Mat4x4 cube_transform = mul4x4(demo_rotation(to_rad(45)), base_transform);
+  Mat4x4 demo_transform = mul4x4(demo_rotation(to_rad(200)), base_transform);
+  Mat4x4 wall_transform = mul4x4(translate3d((Vec3){{-1.5f, 0, 0}}), scale3d((Vec3){{0.1f, 1.9f, 1.9f}}));
+  Mat4x4 small_cube_transform = mul4x4(scale3d((Vec3){{0.2f, 0.2f, 0.2f}}), cube_transform);
+  small_cube_transform = mul4x4(translate3d((Vec3){{2.5f, -1.1f, 0.4f}}), small_cube_transform);
+  usize len = 0;
+  scenes[len++] = (GoldenScene){
+      .name = "teapot",
+      .objects = {{ARR_ARG(teapot), NULL, 0, mul4x4(demo_rotation(to_rad(30)), base_transform)}},
+      .objects_len = 1,
+  };
+  scenes[len++] = (GoldenScene){
+      .name = "cube",
+      .objects = {{ARR_ARG(cube_vertices), ARR_ARG(cube_indices), cube_transform}},
+      .objects_len = 1,
+  };
+  scenes[len++] = (GoldenScene){
+      .name = "demo",
+      .objects =
+          {
+              {ARR_ARG(teapot), NULL, 0, demo_transform},
+              {ARR_ARG(cube_vertices), ARR_ARG(cube_indices), demo_transform},
+          },
+      .objects_len = 2,
+  };
+  // Many small teapots, some of them partly or entirely off-screen.
+  GoldenScene *instances = &scenes[len++];
+  *instances = (GoldenScene){.name = "instances"};
+  const Vec3 positions[] = {
+      {{0, -1.3f, -1.3f}}, {{0, 0, -1.3f}}, {{0, 1.3f, -1.3f}}, {{0, -1.3f, 0}}, {{0, 0, 0}},
+      {{0, 1.3f, 0}}, {{0, -1.3f, 1.3f}}, {{0, 0, 1.3f}}, {{0, 1.3f, 1.3f}}, {{0, 2.1f, 0.5f}},
+      {{0, 4.0f, 0}}, {{0, 0, -5.0f}}, {{-30.0f, 0, 0}}, {{0, -3.0f, 3.0f}},
+  };
+  for (usize i = 0; i < ARR_LEN(positions); ++i) {
+    Mat4x4 m = mul4x4(demo_rotation(to_rad(40.f * (f32)i)), base_transform);
+    m = mul4x4(scale3d((Vec3){{0.45f, 0.45f, 0.45f}}), m);
+    m = mul4x4(translate3d(positions[i]), m);
+    instances->objects[instances->objects_len++] = (GoldenObject){ARR_ARG(teapot), NULL, 0, m};
+  }
+  // A wall with teapots behind it, most of them entirely hidden.
+  GoldenScene *occluders = &scenes[len++];
+  *occluders = (GoldenScene){.name = "occluders"};
+  occluders->objects[occluders->objects_len++] = (GoldenObject){
+      ARR_ARG(cube_vertices),
+      ARR_ARG(cube_indices),
+      mul4x4(translate3d((Vec3){{3, 0, 0}}), scale3d((Vec3){{0.2f, 1.6f, 1.7f}})),
+  };
+  const Vec3 hidden_positions[] = {
+      {{-2, 0, 0}}, {{-2, -0.3f, 0.8f}}, {{-4, 0.4f, -0.7f}}, {{-2, 1.7f, 0}}, {{-2, -1.5f, -1.6f}}, {{5, 0, 0}},
+  };
+  for (usize i = 0; i < ARR_LEN(hidden_positions); ++i) {
+    Mat4x4 m = mul4x4(demo_rotation(to_rad(70.f * (f32)i)), base_transform);
+    m = mul4x4(scale3d((Vec3){{0.4f, 0.4f, 0.4f}}), m);
+    m = mul4x4(translate3d(hidden_positions[i]), m);
+    occluders->objects[occluders->objects_len++] = (GoldenObject){ARR_ARG(teapot), NULL, 0, m};
+  }
+  // The edges of the wall with multisampling, where samples away from the pixel coords see past it.
+  scenes[len] = *occluders;
+  scenes[len].name = "occluders_msaa4";
+  scenes[len++].samples = 4;
+  scenes[len++] = (GoldenScene){
+      .name = "edge_on",
+      .objects = {{ARR_ARG(edge_on_vertices), NULL, 0, id}},
+      .objects_len = 1,
+  };
+  scenes[len++] = (GoldenScene){
+      .name = "near_plane",
+      .objects = {{ARR_ARG(near_plane_vertices), NULL, 0, id}},
+      .objects_len = 1,
+  };
+  scenes[len++] = (GoldenScene){
+      .name = "varyings",
+      .objects =
+          {
+              {ARR_ARG(receding_vertices), NULL, 0, id, receding_attributes, 1},
+              {ARR_ARG(cube_vertices), ARR_ARG(cube_indices), cube_transform, cube_attributes, 2},
+          },
+      .objects_len = 2,
+  };
+  for (TextureFilter filter = TEXTURE_FILTER_NEAREST; filter <= TEXTURE_FILTER_BILINEAR; ++filter) {
+    scenes[len++] = (GoldenScene){
+        .name = filter == TEXTURE_FILTER_NEAREST ? "textured_nearest" : "textured_bilinear",
+        .objects =
+            {
+                {ARR_ARG(receding_vertices), NULL, 0, id, receding_texcoords, 2},
+                {ARR_ARG(magnified_vertices), NULL, 0, id, magnified_texcoords, 2},
+            },
+        .objects_len = 2,
+        .texture = texture,
+        .filter = filter,
+    };
+  }
+  // The edges are anti-aliased, the depths (of the first samples) are those of the scenes without multisampling.
+  scenes[len++] = (GoldenScene){
+      .name = "demo_msaa4",
+      .objects =
+          {
+              {ARR_ARG(teapot), NULL, 0, demo_transform},
+              {ARR_ARG(cube_vertices), ARR_ARG(cube_indices), demo_transform},
+          },
+      .objects_len = 2,
+      .samples = 4,
+  };
+  scenes[len++] = (GoldenScene){
+      .name = "varyings_msaa8",
+      .objects =
+          {
+              {ARR_ARG(receding_vertices), NULL, 0, id, receding_attributes, 1},
+              {ARR_ARG(cube_vertices), ARR_ARG(cube_indices), cube_transform, cube_attributes, 2},
+          },
+      .objects_len = 2,
+      .samples = 8,
+  };
+  // A wall behind the demo teapot, which casts its shadow onto it and onto itself, and a small cube in front casting
+  // its shadow onto the teapot.
+  for (ShadowFilter filter = SHADOW_FILTER_HARD; filter <= SHADOW_FILTER_PCF_3X3; filter += 2) {
+    scenes[len++] = (GoldenScene){
+        .name = filter == SHADOW_FILTER_HARD ? "shadows_hard" : "shadows_pcf3x3",
+        .objects =
+            {
+                {ARR_ARG(teapot), NULL, 0, demo_transform},
+                {ARR_ARG(cube_vertices), ARR_ARG(cube_indices), wall_transform},
+                {ARR_ARG(cube_vertices), ARR_ARG(cube_indices), small_cube_transform},
+            },
+        .objects_len = 3,
+        .shadows = true,
+        .shadow_filter = filter,
+    };
+  }
+  // The demo scene in color, with the shadow of the wall over the colors of the teapot.
+  scenes[len++] = (GoldenScene){
+      .name = "colors",
+      .objects =
+          {
+              {ARR_ARG(teapot), NULL, 0, demo_transform, teapot_colors, COLOR_VARYINGS},
+              {ARR_ARG(cube_vertices), ARR_ARG(cube_indices), demo_transform, cube_colors, COLOR_VARYINGS},
+              {ARR_ARG(cube_vertices), ARR_ARG(cube_indices), wall_transform},
+          },
+      .objects_len = 3,
+      .shadows = true,
+      .shadow_filter = SHADOW_FILTER_PCF_3X3,
+      .colors = true,
+  };
+  return len;
+}
+
+[[gnu::noreturn]] static void usage_exit(const char *argv0) {
+  fprintf(stderr,
+          "Usage: %s [--update | --diff] [--dir DIR] [--tolerance N] [--depth-tolerance X] [--max-bad-pixels X] "
+          "[--output DIR]\n",
+          argv0);
+  exit(1);
+}
+
+static f64 parse_f64_arg(const char *argv0, const char *arg) {
+  char *end;
+  f64 x = strtod(arg, &end);
+  if (*arg == '\0' || *end != '\0' || x < 0)
+    usage_exit(argv0);
+  return x;
+}
+
+static GoldenOptions parse_options(i32 argc, char **argv) {
+  GoldenOptions options = {
+      .mode = GOLDEN_MODE_CHECK,
+      .dir = "golden",
+      .tolerance = 0,
+      .depth_tolerance = 1e-5f,
+      .max_bad_pixels = 0,
+      .output_dir = NULL,
+  };
+  for (i32 i = 1; i < argc; ++i) {
+    const char *arg = argv[i];
+    bool has_value = i + 1 < argc;
+    if (strcmp(arg, "--update") == 0) {
+      options.mode = GOLDEN_MODE_UPDATE;
+    } else if (strcmp(arg, "--diff") == 0) {
+      options.mode = GOLDEN_MODE_DIFF;
+    } else if (strcmp(arg, "--dir") == 0 && has_value) {
+      options.dir = argv[++i];
+    } else if (strcmp(arg, "--output") == 0 && has_value) {
+      options.output_dir = argv[++i];
+    } else if (strcmp(arg, "--tolerance") == 0 && has_value) {
+      f64 tolerance = parse_f64_arg(argv[0], argv[++i]);
+      if (tolerance > 255)
+        usage_exit(argv[0]);
+      options.tolerance = (u8)tolerance;
+    } else if (strcmp(arg, "--depth-tolerance") == 0 && has_value) {
+      options.depth_tolerance = (f32)parse_f64_arg(argv[0], argv[++i]);
+    } else if (strcmp(arg, "--max-bad-pixels") == 0 && has_value) {
+      options.max_bad_pixels = (f32)parse_f64_arg(argv[0], argv[++i]);
+    } else {
+      usage_exit(argv[0]);
+    }
+  }
+  return options;
+}
+
+/// File name friendly name of a shader, e.g. "debug_depth".
+static const char *shader_file_name(ShaderKind shader_kind, char *buffer, usize buffer_len) {
+  snprintf(buffer, buffer_len, "%s", shader_name(shader_kind));
+  for (char *c = buffer; *c != '\0'; ++c) {
+    *c = *c == ' ' ? '_' : (char)tolower(*c);
+  }
+  return buffer;
+}
+
+static bool write_pgm(const char *path, const u8 *pixels, usize width, usize height) {
+  FILE *file = fopen(path, "wb");
+  if (file == NULL)
+    return false;
+  fprintf(file, "P5\n%zu %zu\n255\n", width, height);
+  fwrite(pixels, 1, width * height, file);
+  return fclose(file) == 0;
+}
+
+static bool read_pgm(const char *path, u8 *pixels, usize width, usize height) {
+  FILE *file = fopen(path, "rb");
+  if (file == NULL)
+    return false;
+  usize width_, height_;
+  u32 max;
+  bool ok = fscanf(file, "P5 %zu %zu %u", &width_, &height_, &max) == 3 && fgetc(file) != EOF && width_ == width &&
+            height_ == height && max == 255 && fread(pixels, 1, width * height, file) == width * height;
+  fclose(file);
+  return ok;
+}
+
+static bool write_ppm(const char *path, const Rgba8 *pixels, usize width, usize height) {
+  FILE *file = fopen(path, "wb");
+  if (file == NULL)
+    return false;
+  fprintf(file, "P6\n%zu %zu\n255\n", width, height);
+  u8 *row = xalloc(u8, 3 * width);
+  for (usize y = 0; y < height; ++y) {
+    pack_rgb8_row(&pixels[y * width], width, row);
+    fwrite(row, 1, 3 * width, file);
+  }
+  xfree(row);
+  return fclose(file) == 0;
+}
+
+static bool read_ppm(const char *path, Rgba8 *pixels, usize width, usize height) {
+  FILE *file = fopen(path, "rb");
+  if (file == NULL)
+    return false;
+  usize width_, height_;
+  u32 max;
+  bool ok = fscanf(file, "P6 %zu %zu %u", &width_, &height_, &max) == 3 && fgetc(file) != EOF && width_ == width &&
+            height_ == height && max == 255;
+  for (usize i = 0; ok && i < width * height; ++i) {
+    u8 rgb[3];
+    ok = fread(rgb, 1, 3, file) == 3;
+    pixels[i] = rgba8(rgb[0], rgb[1], rgb[2], 255);
+  }
+  fclose(file);
+  return ok;
+}
+
+/// PFM stores rows bottom to top, little-endian with a negative scale.
+static bool write_pfm(const char *path, const f32 *pixels, usize width, usize height) {
+  FILE *file = fopen(path, "wb");
+  if (file == NULL)
+    return false;
+  fprintf(file, "Pf\n%zu %zu\n-1.0\n", width, height);
+  for (usize y = height; y-- > 0;) {
+    fwrite(&pixels[y * width], sizeof(f32), width, file);
+  }
+  return fclose(file) == 0;
+}
+
+static bool read_pfm(const char *path, f32 *pixels, usize width, usize height) {
+  FILE *file = fopen(path, "rb");
+  if (file == NULL)
+    return false;
+  usize width_, height_;
+  f64 scale;
+  bool ok = fscanf(file, "Pf %zu %zu %lf", &width_, &height_, &scale) == 3 && fgetc(file) != EOF &&
+            width_ == width && height_ == height && scale < 0;
+  for (usize y = height; ok && y-- > 0;) {
+    ok = fread(&pixels[y * width], sizeof(f32), width, file) == width;
+  }
+  fclose(file);
+  return ok;
+}
+
+/// Number of pixels that differ by more than the tolerance.
+static usize count_bad_pixels_u8(const GoldenOptions *options, const u8 *expected, const u8 *actual, usize len) {
+  usize bad = 0;
+  for (usize i = 0; i < len; ++i) {
+    i32 diff = abs((i32)expected[i] - (i32)actual[i]);
+    bad += diff > options->tolerance;
+  }
+  return bad;
+}
+
+/// Number of pixels with a channel that differs by more than the tolerance.
+static usize count_bad_pixels_rgba8(const GoldenOptions *options,
+                                    const Rgba8 *expected,
+                                    const Rgba8 *actual,
+                                    usize len) {
+  usize bad = 0;
+  for (usize i = 0; i < len; ++i) {
+    bool is_bad = false;
+    for (usize shift = 0; shift < 32; shift += 8) {
+      i32 diff = abs((i32)((expected[i] >> shift) & 0xff) - (i32)((actual[i] >> shift) & 0xff));
+      is_bad |= diff > options->tolerance;
+    }
+    bad += is_bad;
+  }
+  return bad;
+}
+
+/// Number of pixels that differ by more than the tolerance.
+static usize count_bad_pixels_f32(const GoldenOptions *options, const f32 *expected, const f32 *actual, usize len) {
+  usize bad = 0;
+  for (usize i = 0; i < len; ++i) {
+    f32 x = expected[i];
+    f32 y = actual[i];
+    if (x == y)
+      continue;
+    if (isinf(x) || isinf(y) || isnan(x) || isnan(y)) {
+      ++bad;
+      continue;
+    }
+    bad += fabsf(x - y) > options->depth_tolerance * maxf(1.f, fabsf(x));
+  }
+  return bad;
+}
+
+/// Render one scene with one backend, into `frame_buffers[shader_kind]` and `depth_buffer`, and `color_buffer` if the
+/// scene has colors.
+static void render_scene(const Backend *backend,
+                         const GoldenScene *scene,
+                         u8 *frame_buffers[SHADER_KIND_HIGHLIGHT_ONLY + 1],
+                         f32 *depth_buffer,
+                         Rgba8 *color_buffer) {
+  static_assert(GOLDEN_WIDTH % RENDER_TILE_WIDTH == 0 && GOLDEN_HEIGHT % RENDER_TILE_HEIGHT == 0);
+  Renderer renderer = new_renderer(GOLDEN_WIDTH, GOLDEN_HEIGHT, demo_camera(), demo_light());
+  renderer.layout = backend->layout;
+  usize samples = maxzu(scene->samples, 1);
+  renderer_set_samples(&renderer, samples);
+  GoldenPainter painter = {
+      .frame_buffer = xalloc(u8, GOLDEN_WIDTH * GOLDEN_HEIGHT),
+      .layout = backend->layout,
+      .texture = scene->texture,
+      .samples = samples,
+  };
+  if (scene->texture != NULL)
+    painter.texcoords = new_texcoord_buffer(GOLDEN_WIDTH, GOLDEN_HEIGHT);
+  if (samples != 1)
+    painter.msaa = new_msaa_color_buffer(GOLDEN_WIDTH, GOLDEN_HEIGHT, samples);
+  if (scene->shadows) {
+    painter.shadow = new_shadow_map(GOLDEN_SHADOW_MAP_SIZE);
+    draw_shadow_map(&painter.shadow, &renderer, scene);
+  }
+  if (scene->colors) {
+    painter.albedo_buffer = xalloc(Rgba8, GOLDEN_WIDTH * GOLDEN_HEIGHT);
+    rgba8_fill(painter.albedo_buffer, RGBA8_WHITE, GOLDEN_WIDTH * GOLDEN_HEIGHT);
+  }
+  renderer.draw_pixel_callback_cx = &painter;
+  renderer_clear_frame(&renderer);
+  memset(painter.frame_buffer, 0, GOLDEN_WIDTH * GOLDEN_HEIGHT);
+  backend->draw_scene(&renderer, scene);
+  resolve_frame(&painter, &renderer, scene);
+  if (samples != 1)
+    free_msaa_color_buffer(painter.msaa);
+  if (scene->shadows)
+    free_shadow_map(painter.shadow);
+  if (scene->texture != NULL)
+    free_texcoord_buffer(painter.texcoords);
+
+  // The images are compared and stored linear, without the padding of the rows.
+  if (backend->layout == RENDER_LAYOUT_TILED) {
+    detile_render_target(
+        depth_buffer, GOLDEN_WIDTH, renderer.depth_buffer, renderer.stride, GOLDEN_WIDTH, GOLDEN_HEIGHT, sizeof(f32));
+    u8 *tiled = painter.frame_buffer;
+    painter.frame_buffer = xalloc(u8, GOLDEN_WIDTH * GOLDEN_HEIGHT);
+    detile_render_target(painter.frame_buffer, GOLDEN_WIDTH, tiled, GOLDEN_WIDTH, GOLDEN_WIDTH, GOLDEN_HEIGHT, 1);
+    xfree(tiled);
+    if (scene->colors) {
+      Rgba8 *tiled_albedo = painter.albedo_buffer;
+      painter.albedo_buffer = xalloc(Rgba8, GOLDEN_WIDTH * GOLDEN_HEIGHT);
+      detile_render_target(
+          painter.albedo_buffer, GOLDEN_WIDTH, tiled_albedo, GOLDEN_WIDTH, GOLDEN_WIDTH, GOLDEN_HEIGHT, sizeof(Rgba8));
+      xfree(tiled_albedo);
+    }
+  } else {
+    for (usize y = 0; y < GOLDEN_HEIGHT; ++y) {
+      memcpy(&depth_buffer[y * GOLDEN_WIDTH], &renderer.depth_buffer[y * renderer.stride], sizeof(f32) * GOLDEN_WIDTH);
+    }
+  }
+  for (ShaderKind kind = SHADER_KIND_DEFAULT; kind <= SHADER_KIND_HIGHLIGHT_ONLY; ++kind) {
+    u8 *frame_buffer = frame_buffers[kind];
+    memcpy(frame_buffer, painter.frame_buffer, GOLDEN_WIDTH * GOLDEN_HEIGHT);
+    apply_shader_frame(kind, GOLDEN_WIDTH, GOLDEN_HEIGHT, frame_buffer, GOLDEN_WIDTH, depth_buffer, GOLDEN_WIDTH);
+  }
+  if (scene->colors) {
+    compose_rgba8_rect((ScreenRect){0, 0, GOLDEN_WIDTH, GOLDEN_HEIGHT},
+                       frame_buffers[SHADER_KIND_DEFAULT],
+                       GOLDEN_WIDTH,
+                       painter.albedo_buffer,
+                       GOLDEN_WIDTH,
+                       color_buffer,
+                       GOLDEN_WIDTH);
+    xfree(painter.albedo_buffer);
+  }
+
+  xfree(painter.frame_buffer);
+  free_renderer(renderer);
+}
+
+typedef struct golden_images {
+  u8 *frame_buffers[SHADER_KIND_HIGHLIGHT_ONLY + 1];
+  f32 *depth_buffer;
+  /// Only used by the scenes with colors.
+  Rgba8 *color_buffer;
+} GoldenImages;
+
+static GoldenImages new_golden_images() {
+  GoldenImages images;
+  for (ShaderKind kind = SHADER_KIND_DEFAULT; kind <= SHADER_KIND_HIGHLIGHT_ONLY; ++kind) {
+    images.frame_buffers[kind] = xalloc(u8, GOLDEN_WIDTH * GOLDEN_HEIGHT);
+  }
+  images.depth_buffer = xalloc(f32, GOLDEN_WIDTH * GOLDEN_HEIGHT);
+  images.color_buffer = xalloc(Rgba8, GOLDEN_WIDTH * GOLDEN_HEIGHT);
+  return images;
+}
+
+static void free_golden_images(GoldenImages images) {
+  for (ShaderKind kind = SHADER_KIND_DEFAULT; kind <= SHADER_KIND_HIGHLIGHT_ONLY; ++kind) {
+    xfree(images.frame_buffers[kind]);
+  }
+  xfree(images.depth_buffer);
+  xfree(images.color_buffer);
+}
+
+typedef enum image_kind {
+  /// `u8` light levels, PGM.
+  IMAGE_KIND_FRAME,
+  /// `f32` depths, PFM.
+  IMAGE_KIND_DEPTH,
+  /// `Rgba8` colors, PPM.
+  IMAGE_KIND_COLOR,
+} ImageKind;
+
+static usize count_bad_pixels(
+    const GoldenOptions *options, ImageKind kind, const void *expected, const void *actual, usize len) {
+  switch (kind) {
+  case IMAGE_KIND_FRAME:
+    return count_bad_pixels_u8(options, expected, actual, len);
+  case IMAGE_KIND_DEPTH:
+    return count_bad_pixels_f32(options, expected, actual, len);
+  case IMAGE_KIND_COLOR:
+    return count_bad_pixels_rgba8(options, expected, actual, len);
+  }
+  PANIC_PRINTF("Unknown image kind %d\n", kind);
+}
+
+static bool write_image(const char *path, ImageKind kind, const void *pixels) {
+  switch (kind) {
+  case IMAGE_KIND_FRAME:
+    return write_pgm(path, pixels, GOLDEN_WIDTH, GOLDEN_HEIGHT);
+  case IMAGE_KIND_DEPTH:
+    return write_pfm(path, pixels, GOLDEN_WIDTH, GOLDEN_HEIGHT);
+  case IMAGE_KIND_COLOR:
+    return write_ppm(path, pixels, GOLDEN_WIDTH, GOLDEN_HEIGHT);
+  }
+  PANIC_PRINTF("Unknown image kind %d\n", kind);
+}
+
+/// Compare one image and print the result, returns whether it matched.
+static bool compare_image(const GoldenOptions *options,
+                          const char *label,
+                          const char *file_name,
+                          const void *expected,
+                          const void *actual,
+                          ImageKind kind) {
+  usize len = GOLDEN_WIDTH * GOLDEN_HEIGHT;
+  usize bad = count_bad_pixels(options, kind, expected, actual, len);
+  bool ok = (f32)bad <= options->max_bad_pixels * (f32)len;
+  printf("%s %s: %zu bad pixels\n", ok ? "ok  " : "FAIL", label, bad);
+  if (!ok && options->output_dir != NULL) {
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/%s", options->output_dir, file_name);
+    if (!write_image(path, kind, actual))
+      fprintf(stderr, "Cannot write %s\n", path);
+  }
+  return ok;
+}
+
+/// Compare `actual` against `expected` (either rendered by the reference backend or loaded from the reference images),
+/// returns the number of mismatching images.
+static usize compare_images(const GoldenOptions *options,
+                            const GoldenScene *scene,
+                            const char *backend_name,
+                            const GoldenImages *expected,
+                            const GoldenImages *actual) {
+  usize failures = 0;
+  char label[256], file_name[256], shader_buffer[64];
+  snprintf(label, sizeof(label), "%s/%s/depth", backend_name, scene->name);
+  snprintf(file_name, sizeof(file_name), "%s.depth.pfm", scene->name);
+  failures +=
+      !compare_image(options, label, file_name, expected->depth_buffer, actual->depth_buffer, IMAGE_KIND_DEPTH);
+  for (ShaderKind kind = SHADER_KIND_DEFAULT; kind <= SHADER_KIND_HIGHLIGHT_ONLY; ++kind) {
+    const char *shader = shader_file_name(kind, shader_buffer, sizeof(shader_buffer));
+    snprintf(label, sizeof(label), "%s/%s/%s", backend_name, scene->name, shader);
+    snprintf(file_name, sizeof(file_name), "%s.%s.pgm", scene->name, shader);
+    failures += !compare_image(
+        options, label, file_name, expected->frame_buffers[kind], actual->frame_buffers[kind], IMAGE_KIND_FRAME);
+  }
+  if (scene->colors) {
+    snprintf(label, sizeof(label), "%s/%s/color", backend_name, scene->name);
+    snprintf(file_name, sizeof(file_name), "%s.color.ppm", scene->name);
+    failures +=
+        !compare_image(options, label, file_name, expected->color_buffer, actual->color_buffer, IMAGE_KIND_COLOR);
+  }
+  return failures;
+}
+
+/// Load (`GOLDEN_MODE_CHECK`) or write (`GOLDEN_MODE_UPDATE`) the reference images of a scene.
+static bool load_or_write_references(const GoldenOptions *options, const GoldenScene *scene, GoldenImages *images) {
+  bool write = options->mode == GOLDEN_MODE_UPDATE;
+  char path[1024], shader_buffer[64];
+  snprintf(path, sizeof(path), "%s/%s.depth.pfm", options->dir, scene->name);
+  bool ok = write ? write_pfm(path, images->depth_buffer, GOLDEN_WIDTH, GOLDEN_HEIGHT)
+                  : read_pfm(path, images->depth_buffer, GOLDEN_WIDTH, GOLDEN_HEIGHT);
+  if (!ok) {
+    fprintf(stderr, "Cannot %s %s\n", write ? "write" : "read", path);
+    return false;
+  }
+  for (ShaderKind kind = SHADER_KIND_DEFAULT; kind <= SHADER_KIND_HIGHLIGHT_ONLY; ++kind) {
+    const char *shader = shader_file_name(kind, shader_buffer, sizeof(shader_buffer));
+    snprintf(path, sizeof(path), "%s/%s.%s.pgm", options->dir, scene->name, shader);
+    ok = write ? write_pgm(path, images->frame_buffers[kind], GOLDEN_WIDTH, GOLDEN_HEIGHT)
+               : read_pgm(path, images->frame_buffers[kind], GOLDEN_WIDTH, GOLDEN_HEIGHT);
+    if (!ok) {
+      fprintf(stderr, "Cannot %s %s\n", write ? "write" : "read", path);
+      return false;
+    }
+  }
+  if (scene->colors) {
+    snprintf(path, sizeof(path), "%s/%s.color.ppm", options->dir, scene->name);
+    ok = write ? write_ppm(path, images->color_buffer, GOLDEN_WIDTH, GOLDEN_HEIGHT)
+               : read_ppm(path, images->color_buffer, GOLDEN_WIDTH, GOLDEN_HEIGHT);
+    if (!ok) {
+      fprintf(stderr, "Cannot %s %s\n", write ? "write" : "read", path);
+      return false;
+    }
+  }
+  return true;
+}
+
+i32 main(i32 argc, char **argv) {
+  GoldenOptions options = parse_options(argc, argv);
+  GoldenScene scenes[32];
+  Texture texture = golden_texture();
+  f32 *teapot_colors = xalloc(f32, ARR_LEN(teapot) * COLOR_VARYINGS);
+  demo_vertex_colors(ARR_ARG(teapot), teapot_colors);
+  f32 *cube_colors = xalloc(f32, ARR_LEN(cube_vertices) * COLOR_VARYINGS);
+  demo_vertex_colors(ARR_ARG(cube_vertices), cube_colors);
+  usize scenes_len = make_scenes(scenes, &texture, teapot_colors, cube_colors);
+
+  GoldenImages reference = new_golden_images();
+  GoldenImages actual = new_golden_images();
+  Isa default_isa = kernels.isa;
+  usize failures = 0;
+  for (usize i = 0; i < scenes_len; ++i) {
+    const GoldenScene *scene = &scenes[i];
+    switch (options.mode) {
+    case GOLDEN_MODE_UPDATE:
+      select_isa(ISA_SCALAR);
+      render_scene(&backends[0], scene, reference.frame_buffers, reference.depth_buffer, reference.color_buffer);
+      select_isa(default_isa);
+      if (!load_or_write_references(&options, scene, &reference))
+        return 1;
+      printf("updated %s\n", scene->name);
+      break;
+    case GOLDEN_MODE_CHECK:
+      if (!load_or_write_references(&options, scene, &reference))
+        return 1;
+      render_scene(&backends[0], scene, actual.frame_buffers, actual.depth_buffer, actual.color_buffer);
+      failures += compare_images(&options, scene, backends[0].name, &reference, &actual);
+      break;
+    case GOLDEN_MODE_DIFF:
+      select_isa(ISA_SCALAR);
+      render_scene(&backends[0], scene, reference.frame_buffers, reference.depth_buffer, reference.color_buffer);
+      for (Isa isa = ISA_SCALAR; isa < ISA_COUNT; ++isa) {
+        if (!select_isa(isa))
+          continue;
+        for (usize j = isa == ISA_SCALAR ? 1 : 0; j < ARR_LEN(backends); ++j) {
+          char name[64];
+          snprintf(name, sizeof(name), "%s/%s", backends[j].name, isa_name(isa));
+          render_scene(&backends[j], scene, actual.frame_buffers, actual.depth_buffer, actual.color_buffer);
+          failures += compare_images(&options, scene, name, &reference, &actual);
+        }
+      }
+      select_isa(default_isa);
+      break;
+    }
+  }
+  free_golden_images(reference);
+  free_golden_images(actual);
+  free_texture(texture);
+  xfree(teapot_colors);
+  xfree(cube_colors);
+
+  if (failures != 0) {
+    printf("%zu images did not match\n", failures);
+    return 1;
+  }
+  return 0;
+}
@@ -1,25 +1,43 @@
 #include "gui.h"
+#include "trace.h"
 
 #include <raylib.h>
 
-GuiPainter new_gui_painter(usize width, usize height, f32 target_fps) {
-  u8 *frame_buffer = xalloc(u8, width * height);
+GuiPainter new_gui_painter(usize width,
+                           usize height,
+                           f32 target_fps,
+                           usize samples,
+                           f32 min_scale,
+                           f32 max_scale,
+                           usize shadow_map_size) {
   return (GuiPainter){
       .shader_kind = SHADER_KIND_DEFAULT,
-      .frame_buffer = frame_buffer,
-      .width = width,
-      .height = height,
+      .frame = new_frame_targets(width, height, RENDER_LAYOUT_LINEAR, samples, true, shadow_map_size),
+      .redraw_all = false,
       .debug_line_count = 0,
       .target_fps = target_fps,
+      .resolution = new_resolution_controller(1.f / target_fps, min_scale, max_scale),
+      .dynamic_resolution = false,
+      .trace_path = "trace.json",
   };
 }
 
+/// Must be called before the window is closed, for the texture.
 void free_gui_drawing_cx(GuiPainter cx) {
-  xfree(cx.frame_buffer);
+  UnloadTexture(cx.raylib_texture);
+  UnloadTexture(cx.raylib_color_texture);
+  free_frame_targets(cx.frame);
 }
 
-void gui_clear_frame(GuiPainter *cx) {
-  memset(cx->frame_buffer, 0, cx->width * cx->height);
+void gui_update_resolution(GuiPainter *cx, Renderer *renderer) {
+  usize width = cx->dynamic_resolution ? resolution_scaled(&cx->resolution, cx->frame.width) : cx->frame.width;
+  usize height = cx->dynamic_resolution ? resolution_scaled(&cx->resolution, cx->frame.height) : cx->frame.height;
+  if (width != renderer->width || height != renderer->height)
+    renderer_set_resolution(renderer, width, height);
+}
+
+void gui_clear_frame(GuiPainter *cx, const Renderer *renderer) {
+  frame_targets_clear(&cx->frame, renderer);
   cx->debug_line_count = 0;
   BeginDrawing();
 }
@@ -30,58 +48,117 @@ static inline void gui_debug_println(GuiPainter *cx, const char *text) {
   DrawText(text, 10, y, 20, WHITE);
 }
 
+/// Copies the last column and row of what's rendered to the ones after it, if they're in the buffer, for the bilinear
+/// filtering of the upscaling to read at the edges instead of what was left there at another resolution. The pixels
+/// are `pixel_size` bytes.
+static void extend_edges(
+    void *buffer_, usize pixel_size, usize stride, usize buffer_height, usize width, usize height) {
+  u8 *buffer = buffer_;
+  usize row_size = stride * pixel_size;
+  if (width < stride) {
+    for (usize y = 0; y < height; ++y) {
+      memcpy(&buffer[y * row_size + width * pixel_size], &buffer[y * row_size + (width - 1) * pixel_size], pixel_size);
+    }
+  }
+  if (height < buffer_height)
+    memcpy(&buffer[height * row_size], &buffer[(height - 1) * row_size], minzu(width + 1, stride) * pixel_size);
+}
+
 /// Calls raylib to paint the frame buffer into the window.
 void gui_finish_frame(GuiPainter *cx, const Renderer *renderer) {
-  // Run shader shader.
-  for (usize y = 0; y < cx->height; ++y) {
-    for (usize x = 0; x < cx->width; ++x) {
-      u8 *light_level = &cx->frame_buffer[y * cx->width + x];
-      apply_shader(cx->shader_kind, cx->width, cx->height, x, y, light_level, renderer->depth_buffer);
-    }
+  ScreenRect redrawn = renderer->scissor;
+  usize width = renderer->width;
+  usize height = renderer->height;
+  FrameTargets *frame = &cx->frame;
+  ScreenRect shaded;
+  {
+    TRACE_SCOPE("shade");
+    shaded = frame_targets_shade(frame, renderer, cx->shader_kind);
+  }
+  if (!screen_rect_is_empty(shaded)) {
+    extend_edges(frame->shaded_buffer, sizeof(u8), frame->stride, frame->height, width, height);
+    if (frame->colors)
+      extend_edges(frame->color_buffer, sizeof(Rgba8), frame->stride, frame->height, width, height);
   }
 
-  Image image = (Image){
-      .width = (i32)cx->width,
-      .height = (i32)cx->height,
-      .data = cx->frame_buffer,
-      .format = PIXELFORMAT_UNCOMPRESSED_GRAYSCALE,
-      .mipmaps = 1,
-  };
-  Texture2D raylib_texture = LoadTextureFromImage(image);
-  DrawTexture(raylib_texture, 0, 0, WHITE);
+  {
+    TRACE_SCOPE("upload");
+    Texture2D texture = frame->colors ? cx->raylib_color_texture : cx->raylib_texture;
+    // The texture still has the previous frame otherwise.
+    if (!screen_rect_is_empty(shaded))
+      UpdateTexture(texture, frame->colors ? (const void *)frame->color_buffer : frame->shaded_buffer);
+    Rectangle rendered = {0, 0, (f32)width, (f32)height};
+    Rectangle window = {0, 0, (f32)frame->width, (f32)frame->height};
+    DrawTexturePro(texture, rendered, window, (Vector2){0, 0}, 0, WHITE);
+  }
   gui_debug_println(cx, TextFormat("FPS: %.0f/%.0f", 1.f / GetFrameTime(), cx->target_fps));
-  const char *shader;
-  switch (cx->shader_kind) {
-  case SHADER_KIND_DEFAULT:
-    shader = "BORING";
-    break;
-  case SHADER_KIND_HIGHLIGHTED:
-    shader = "HIGHLIGHTED";
-    break;
-  case SHADER_KIND_DEBUG_DEPTH:
-    shader = "DEBUG DEPTH";
-    break;
-  case SHADER_KIND_DEBUG_DEPTH_HIGHLIGHTED:
-    shader = "DEBUG DEPTH HIGHLIGHTED";
-    break;
-  case SHADER_KIND_HIGHLIGHT_ONLY:
-    shader = "HIGHLIGHT ONLY";
-    break;
-  }
-  gui_debug_println(cx, TextFormat("Shader: [R/Shift+R]: %s", shader));
+  RenderStats stats;
+  if (renderer_stats(renderer, &stats)) {
+    gui_debug_println(
+        cx, TextFormat("Objects: %zu culled, %zu occluded", stats.objects_culled, stats.objects_occluded));
+    gui_debug_println(cx,
+                      TextFormat("Triangles: %zu submitted, %zu culled, %zu rasterized",
+                                 stats.triangles_submitted,
+                                 stats.triangles_culled,
+                                 stats.triangles_rasterized));
+    gui_debug_println(cx,
+                      TextFormat("Pixels: %zu tested, %zu passed, %zu callbacks",
+                                 stats.pixels_tested,
+                                 stats.depth_test_passes,
+                                 stats.callback_invocations));
+    gui_debug_println(cx, TextFormat("Overdraw: %.2f", render_stats_overdraw(&stats)));
+  }
+#ifdef RENDER_TRACE
+  gui_debug_println(cx, TextFormat("Trace [T]: %s", trace_is_enabled() ? "RECORDING" : "OFF"));
+#endif
+  gui_debug_println(cx, TextFormat("Shader: [R/Shift+R]: %s", shader_name(cx->shader_kind)));
+  if (frame->samples != 1)
+    gui_debug_println(cx, TextFormat("MSAA: %zux", frame->samples));
+  gui_debug_println(cx, TextFormat("Colors [C]: %s", frame->colors ? "ON" : "OFF"));
+  gui_debug_println(
+      cx, TextFormat("Shadows [H/Shift+H]: %s", frame->shadows ? shadow_filter_name(frame->shadow_filter) : "OFF"));
+  gui_debug_println(cx,
+                    TextFormat("Redrawn [D]: %zux%zu%s",
+                               redrawn.max_x - redrawn.min_x,
+                               redrawn.max_y - redrawn.min_y,
+                               cx->redraw_all ? " (ALL)" : ""));
+  gui_debug_println(cx,
+                    TextFormat("Resolution [V]: %zux%zu (%.0f%%)%s",
+                               width,
+                               height,
+                               (f32)width * 100 / (f32)frame->width,
+                               cx->dynamic_resolution ? " DYNAMIC" : ""));
   gui_debug_println(cx, TextFormat("FOV [+/-/0]: %.1f", to_deg(renderer->cam.fov)));
   gui_debug_println(cx,
                     TextFormat("Camera XYZ: %.02f %.02f %.02f",
                                renderer->cam.pos.get[0],
                                renderer->cam.pos.get[1],
                                renderer->cam.pos.get[2]));
+  // Everything but the wait for the next frame, which is what `EndDrawing` does.
+  if (cx->dynamic_resolution)
+    resolution_frame_end(&cx->resolution);
   EndDrawing();
 }
 
 void gui_setup_window(GuiPainter *cx) {
   SetTraceLogLevel(LOG_ERROR); // Silence raylib logging.
-  InitWindow((i32)cx->width, (i32)cx->height, "Render");
+  InitWindow((i32)cx->frame.width, (i32)cx->frame.height, "Render");
   SetTargetFPS(cx->target_fps == INFINITY ? 2147483647 : (i32)cx->target_fps);
+  // The frame buffer is uploaded into the same texture every frame.
+  Image image = (Image){
+      .width = (i32)cx->frame.stride,
+      .height = (i32)cx->frame.height,
+      .data = cx->frame.shaded_buffer,
+      .format = PIXELFORMAT_UNCOMPRESSED_GRAYSCALE,
+      .mipmaps = 1,
+  };
+  cx->raylib_texture = LoadTextureFromImage(image);
+  image.data = cx->frame.color_buffer;
+  image.format = PIXELFORMAT_UNCOMPRESSED_R8G8B8A8;
+  cx->raylib_color_texture = LoadTextureFromImage(image);
+  // For upscaling with dynamic resolution, it samples the texels exactly otherwise.
+  SetTextureFilter(cx->raylib_texture, TEXTURE_FILTER_BILINEAR);
+  SetTextureFilter(cx->raylib_color_texture, TEXTURE_FILTER_BILINEAR);
 }
 
 [[maybe_unused]]
@@ -104,7 +181,29 @@ static inline bool is_super_down() {
   return IsKeyDown(KEY_LEFT_SUPER) || IsKeyDown(KEY_RIGHT_SUPER);
 }
 
-void gui_handle_event(GuiPainter *cx, Renderer *renderer) {
+FrameToggles gui_frame_toggles(const GuiPainter *cx) {
+  return (FrameToggles){
+      .shadows = cx->frame.shadows,
+      .shadow_filter = cx->frame.shadow_filter,
+      .colors = cx->frame.colors,
+      .redraw_all = cx->redraw_all,
+      .dynamic_resolution = cx->dynamic_resolution,
+      .resolution_scale = cx->dynamic_resolution ? cx->resolution.scale : 1.f,
+  };
+}
+
+void gui_set_frame_toggles(GuiPainter *cx, const FrameToggles *toggles) {
+  frame_targets_set_shadows(&cx->frame, toggles->shadows, toggles->shadow_filter);
+  frame_targets_set_colors(&cx->frame, toggles->colors);
+  cx->redraw_all = toggles->redraw_all;
+  cx->dynamic_resolution = toggles->dynamic_resolution;
+  // Overrides what the controller decided from the replay's own frame times.
+  cx->resolution.scale = toggles->resolution_scale;
+}
+
+void gui_handle_event(GuiPainter *cx, Renderer *renderer, const FrameClock *clock) {
+  // Movements were tuned for one step per frame at 60 FPS.
+  f32 frames_at_60fps = clock->delta_s * 60.f;
   if (is_shift_down() && IsKeyPressed(KEY_R)) {
     select_prev_shader(&cx->shader_kind);
     return;
@@ -113,27 +212,69 @@ void gui_handle_event(GuiPainter *cx, Renderer *renderer) {
     select_next_shader(&cx->shader_kind);
     return;
   }
+  if (IsKeyPressed(KEY_D)) {
+    cx->redraw_all = !cx->redraw_all;
+    return;
+  }
+  if (is_shift_down() && IsKeyPressed(KEY_H)) {
+    ShadowFilter filter = cx->frame.shadow_filter;
+    frame_targets_set_shadows(
+        &cx->frame, cx->frame.shadows, filter == SHADOW_FILTER_PCF_4X4 ? SHADOW_FILTER_HARD : filter + 1);
+    return;
+  }
+  if (IsKeyPressed(KEY_H)) {
+    frame_targets_set_shadows(&cx->frame, !cx->frame.shadows, cx->frame.shadow_filter);
+    return;
+  }
+  if (IsKeyPressed(KEY_C)) {
+    frame_targets_set_colors(&cx->frame, !cx->frame.colors);
+    return;
+  }
+  if (IsKeyPressed(KEY_V)) {
+    cx->dynamic_resolution = !cx->dynamic_resolution;
+    resolution_reset(&cx->resolution);
+    return;
+  }
+  if (IsKeyPressed(KEY_T)) {
+    if (trace_is_enabled()) {
+      trace_set_enabled(false);
+      if (!trace_flush(cx->trace_path))
+        fprintf(stderr, "Cannot write trace to %s\n", cx->trace_path);
+    } else {
+      trace_set_enabled(true);
+    }
+    return;
+  }
   if (IsKeyDown(KEY_EQUAL) || IsKeyDown(KEY_KP_ADD)) {
-    renderer->cam.fov -= to_rad(1.f) / ((f32)GetFPS() / 60.f);
+    renderer->cam.fov -= to_rad(1.f) * frames_at_60fps;
   }
   if (IsKeyDown(KEY_MINUS) || IsKeyDown(KEY_KP_SUBTRACT)) {
-    renderer->cam.fov += to_rad(1.f) / ((f32)GetFPS() / 60.f);
+    renderer->cam.fov += to_rad(1.f) * frames_at_60fps;
   }
   if (IsKeyDown(KEY_ZERO) || IsKeyDown(KEY_KP_0)) {
     renderer->cam.fov = to_rad(90.f);
   }
   if (IsKeyDown(KEY_W)) {
-    renderer->cam.pos.get[0] -= 0.1f / ((f32)GetFPS() / 60.f);
+    renderer->cam.pos.get[0] -= 0.1f * frames_at_60fps;
   }
   if (IsKeyDown(KEY_S)) {
-    renderer->cam.pos.get[0] += 0.1f / ((f32)GetFPS() / 60.f);
+    renderer->cam.pos.get[0] += 0.1f * frames_at_60fps;
   }
 }
 
-void gui_draw_pixel_callback(void *cx_, usize width, usize height, usize x, usize y, f32 z, u8 light_level) {
+void gui_draw_span_callback(void *cx_,
+                            usize width,
+                            usize height,
+                            usize y,
+                            usize x_begin,
+                            usize x_end,
+                            const f32 *depths,
+                            u8 light_level,
+                            const u8 *coverage,
+                            const Varyings *varyings) {
   GuiPainter *cx = cx_;
-  cx->frame_buffer[y * width + x] = light_level;
+  frame_targets_draw_span(&cx->frame, y, x_begin, x_end, depths, light_level, coverage, varyings);
 }
 
-DEF_DRAW_FUNCTIONS(, _gui, gui_draw_pixel_callback);
+DEF_DRAW_SPAN_FUNCTIONS(, _gui, gui_draw_span_callback);
 
@@ -3,33 +3,79 @@
 #include "common.h"
 #include "shaders.h"
 #include "render.h"
+#include "frame.h"
+#include "resolution.h"
+#include "clock.h"
+#include "replay.h"
 
 #include <raylib.h>
 
 /// Manages drawing the frame buffer with raylib and handling GUI events.
 typedef struct gui_painter {
   ShaderKind shader_kind;
-  u8 *frame_buffer;
-  usize width;
-  usize height;
+  /// Of the size of the window, linear. Frames are rendered into their top left at the renderer's size and upscaled to
+  /// the window. Colors are toggled with [C], shadows with [H] and their filter cycled with [Shift+H].
+  FrameTargets frame;
+  /// Redraw the whole frame every frame instead of only where something changed, toggled with [D].
+  bool redraw_all;
   f32 target_fps;
+  /// Lowers the renderer's resolution to hold `target_fps`, toggled with [V].
+  ResolutionController resolution;
+  bool dynamic_resolution;
   usize debug_line_count;
+  /// Where the timeline is written when tracing (see trace.h) is stopped with [T].
+  const char *trace_path;
+  /// `frame.stride` pixels wide, so that the shaded buffer is uploaded as it is, the padding isn't drawn.
   Texture2D raylib_texture;
+  /// The same for `frame.color_buffer`, in `PIXELFORMAT_UNCOMPRESSED_R8G8B8A8`.
+  Texture2D raylib_color_texture;
 } GuiPainter;
 
-GuiPainter new_gui_painter(usize width, usize height, f32 target_fps);
+/// `samples` must be the renderer's. Dynamic resolution starts off, with the scale between `min_scale` and
+/// `max_scale`. Shadows start off, with a shadow map of `shadow_map_size` x `shadow_map_size`.
+GuiPainter new_gui_painter(usize width,
+                           usize height,
+                           f32 target_fps,
+                           usize samples,
+                           f32 min_scale,
+                           f32 max_scale,
+                           usize shadow_map_size);
 
 void free_gui_drawing_cx(GuiPainter cx);
 
-void gui_clear_frame(GuiPainter *cx);
+/// Sets the resolution of the renderer, made with the window's size, to the resolution controller's, or to the
+/// window's without dynamic resolution. Call it before `scene_dirty_rect`, which redraws everything when it changes.
+void gui_update_resolution(GuiPainter *cx, Renderer *renderer);
 
+/// Clears the renderer's scissor of the frame buffer.
+void gui_clear_frame(GuiPainter *cx, const Renderer *renderer);
+
+/// Shades and presents the frame, the renderer's scissor having been redrawn, upscaled to the window.
 void gui_finish_frame(GuiPainter *cx, const Renderer *renderer);
 
 void gui_setup_window(GuiPainter *cx);
 
-void gui_handle_event(GuiPainter *cx, Renderer *renderer);
+/// Movements are scaled by the frame time of `clock`, so that they are independent of the frame rate.
+void gui_handle_event(GuiPainter *cx, Renderer *renderer, const FrameClock *clock);
+
+/// The toggles of the current frame, for recording it.
+FrameToggles gui_frame_toggles(const GuiPainter *cx);
+
+/// Sets the toggles of a replayed frame, instead of `gui_handle_event`, marking what changed like the keys do. The
+/// resolution scale is taken as it is, call `gui_update_resolution` after it.
+void gui_set_frame_toggles(GuiPainter *cx, const FrameToggles *toggles);
 
-void gui_draw_pixel_callback(void *cx_, usize width, usize height, usize x, usize y, f32 z, u8 light_level);
+/// Draws the frame buffer a span at a time, see `draw_span_callback_t`.
+void gui_draw_span_callback(void *cx_,
+                            usize width,
+                            usize height,
+                            usize y,
+                            usize x_begin,
+                            usize x_end,
+                            const f32 *depths,
+                            u8 light_level,
+                            const u8 *coverage,
+                            const Varyings *varyings);
 
-DEF_DRAW_FUNCTIONS_HEADER(, _gui, draw_pixel_callback_gui);
+DEF_DRAW_SPAN_FUNCTIONS_HEADER(, _gui, gui_draw_span_callback);
 
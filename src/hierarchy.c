@@ -0,0 +1,83 @@
+#include "hierarchy.h"
+
+#include "trace.h"
+
+#define HIERARCHY_INITIAL_CAPACITY 16
+
+Hierarchy new_hierarchy() {
+  usize capacity = HIERARCHY_INITIAL_CAPACITY;
+  return (Hierarchy){
+      .parents = xalloc(usize, capacity),
+      .locals = xalloc(Mat4x4, capacity),
+      .worlds = xalloc(Mat4x4, capacity),
+      .dirty = xalloc(bool, capacity),
+      .changed = xalloc(bool, capacity),
+      .len = 0,
+      .capacity = capacity,
+      .dirty_len = 0,
+  };
+}
+
+void free_hierarchy(Hierarchy hierarchy) {
+  xfree(hierarchy.parents);
+  xfree(hierarchy.locals);
+  xfree(hierarchy.worlds);
+  xfree(hierarchy.dirty);
+  xfree(hierarchy.changed);
+}
+
+usize hierarchy_add(Hierarchy *hierarchy, usize parent, Mat4x4 local) {
+  // Adding children after their parents is what keeps the parents before their children.
+  ASSERT(parent == HIERARCHY_NO_PARENT || parent < hierarchy->len);
+  if (hierarchy->len == hierarchy->capacity) {
+    usize capacity = hierarchy->capacity * 2;
+    hierarchy->parents = xrealloc(hierarchy->parents, usize, capacity);
+    hierarchy->locals = xrealloc(hierarchy->locals, Mat4x4, capacity);
+    hierarchy->worlds = xrealloc(hierarchy->worlds, Mat4x4, capacity);
+    hierarchy->dirty = xrealloc(hierarchy->dirty, bool, capacity);
+    hierarchy->changed = xrealloc(hierarchy->changed, bool, capacity);
+    hierarchy->capacity = capacity;
+  }
+  usize node = hierarchy->len++;
+  hierarchy->parents[node] = parent;
+  hierarchy->locals[node] = local;
+  hierarchy->worlds[node] = local;
+  hierarchy->dirty[node] = true;
+  hierarchy->changed[node] = false;
+  ++hierarchy->dirty_len;
+  return node;
+}
+
+void hierarchy_set_local(Hierarchy *hierarchy, usize node, Mat4x4 local) {
+  ASSERT(node < hierarchy->len);
+  hierarchy->locals[node] = local;
+  if (!hierarchy->dirty[node]) {
+    hierarchy->dirty[node] = true;
+    ++hierarchy->dirty_len;
+  }
+}
+
+usize hierarchy_update(Hierarchy *hierarchy) {
+  TRACE_SCOPE("hierarchy_update");
+  if (hierarchy->dirty_len == 0) {
+    // Nothing changed, so neither did any world matrix.
+    memset(hierarchy->changed, 0, sizeof(bool) * hierarchy->len);
+    return 0;
+  }
+  usize updated = 0;
+  for (usize i = 0; i < hierarchy->len; ++i) {
+    usize parent = hierarchy->parents[i];
+    // Parents come first, so `changed[parent]` is already up to date.
+    bool parent_changed = parent != HIERARCHY_NO_PARENT && hierarchy->changed[parent];
+    bool changed = hierarchy->dirty[i] || parent_changed;
+    hierarchy->changed[i] = changed;
+    hierarchy->dirty[i] = false;
+    if (!changed)
+      continue;
+    hierarchy->worlds[i] = parent == HIERARCHY_NO_PARENT ? hierarchy->locals[i]
+                                                         : mul4x4(hierarchy->worlds[parent], hierarchy->locals[i]);
+    ++updated;
+  }
+  hierarchy->dirty_len = 0;
+  return updated;
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include "common.h"
+#include "linear_alg.h"
+
+// Parent/child transforms.
+//
+// Every node has a local matrix (relative to its parent) and a cached world matrix (parent's world * local). The nodes
+// are stored in flat arrays with parents before their children, so that `hierarchy_update` brings all world matrices
+// up to date in one linear pass. Only the nodes whose local matrix changed, and their descendants, are recomputed, so
+// static nodes cost no matrix multiplication per frame.
+//
+// Example:
+//
+// ```
+// Hierarchy hierarchy = new_hierarchy();
+// usize car = hierarchy_add(&hierarchy, HIERARCHY_NO_PARENT, car_m);
+// usize wheel = hierarchy_add(&hierarchy, car, wheel_m);
+// while (...) {
+//   hierarchy_set_local(&hierarchy, car, new_car_m);
+//   hierarchy_update(&hierarchy);
+//   if (hierarchy_world_changed(&hierarchy, wheel))
+//     scene_set_transform(&scene, wheel_object, hierarchy_world(&hierarchy, wheel));
+// }
+// free_hierarchy(hierarchy);
+// ```
+
+#define HIERARCHY_NO_PARENT ((usize)-1)
+
+/// SAFETY: Only use new_hierarchy to construct this.
+typedef struct hierarchy {
+  /// `HIERARCHY_NO_PARENT` for roots, otherwise smaller than the index of the node itself.
+  /// LEN: len, CAP: capacity.
+  usize *parents;
+  /// LEN: len, CAP: capacity.
+  Mat4x4 *locals;
+  /// LEN: len, CAP: capacity.
+  Mat4x4 *worlds;
+  /// The local matrix changed since the last `hierarchy_update`.
+  /// LEN: len, CAP: capacity.
+  bool *dirty;
+  /// The world matrix changed in the last `hierarchy_update`.
+  /// LEN: len, CAP: capacity.
+  bool *changed;
+  usize len;
+  usize capacity;
+  /// Number of nodes marked dirty since the last `hierarchy_update`.
+  usize dirty_len;
+} Hierarchy;
+
+Hierarchy new_hierarchy();
+
+void free_hierarchy(Hierarchy hierarchy);
+
+/// Add a node under `parent` (or `HIERARCHY_NO_PARENT`), returns the node.
+/// Its world matrix is computed by the next `hierarchy_update`.
+usize hierarchy_add(Hierarchy *hierarchy, usize parent, Mat4x4 local);
+
+void hierarchy_set_local(Hierarchy *hierarchy, usize node, Mat4x4 local);
+
+/// Recompute the world matrices of the nodes whose local matrix changed, and of their descendants.
+/// Returns the number of world matrices recomputed.
+usize hierarchy_update(Hierarchy *hierarchy);
+
+static inline Mat4x4 hierarchy_world(const Hierarchy *hierarchy, usize node) {
+  return hierarchy->worlds[node];
+}
+
+/// Whether the world matrix of a node changed in the last `hierarchy_update`.
+static inline bool hierarchy_world_changed(const Hierarchy *hierarchy, usize node) {
+  return hierarchy->changed[node];
+}
@@ -0,0 +1,28 @@
+// AVX2 kernels, see kernels_simd.h. Compiled with -mavx2, only called on CPUs that support it.
+
+#ifdef __AVX2__
+
+#include <immintrin.h>
+
+#define KERNEL(NAME) NAME##_avx2
+#define LANES 8
+#define VF __m256
+#define VF_SET1(X) _mm256_set1_ps(X)
+#define VF_SEQ(X) _mm256_add_ps(_mm256_set1_ps((f32)(X)), _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7))
+#define VF_LOADU(P) _mm256_loadu_ps(P)
+#define VF_STOREU(P, V) _mm256_storeu_ps(P, V)
+#define VF_STOREU_I32(P, V) _mm256_storeu_si256((__m256i *)(P), _mm256_cvttps_epi32(V))
+#define VF_ADD(A, B) _mm256_add_ps(A, B)
+#define VF_SUB(A, B) _mm256_sub_ps(A, B)
+#define VF_MUL(A, B) _mm256_mul_ps(A, B)
+#define VF_DIV(A, B) _mm256_div_ps(A, B)
+#define VF_SQRT(A) _mm256_sqrt_ps(A)
+#define VF_MIN(A, B) _mm256_min_ps(A, B)
+#define VF_MAX(A, B) _mm256_max_ps(A, B)
+#define VF_FLOOR(A) _mm256_floor_ps(A)
+#define VF_LT(A, B) ((u32)_mm256_movemask_ps(_mm256_cmp_ps(A, B, _CMP_LT_OQ)))
+#define VF_GT(A, B) ((u32)_mm256_movemask_ps(_mm256_cmp_ps(A, B, _CMP_GT_OQ)))
+
+#include "kernels_simd.h"
+
+#endif
@@ -0,0 +1,29 @@
+// AVX-512 kernels, see kernels_simd.h. Compiled with -mavx512f, only called on CPUs that support it.
+
+#ifdef __AVX512F__
+
+#include <immintrin.h>
+
+#define KERNEL(NAME) NAME##_avx512
+#define LANES 16
+#define VF __m512
+#define VF_SET1(X) _mm512_set1_ps(X)
+#define VF_SEQ(X)                                                                                                      \
+  _mm512_add_ps(_mm512_set1_ps((f32)(X)), _mm512_setr_ps(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15))
+#define VF_LOADU(P) _mm512_loadu_ps(P)
+#define VF_STOREU(P, V) _mm512_storeu_ps(P, V)
+#define VF_STOREU_I32(P, V) _mm512_storeu_si512(P, _mm512_cvttps_epi32(V))
+#define VF_ADD(A, B) _mm512_add_ps(A, B)
+#define VF_SUB(A, B) _mm512_sub_ps(A, B)
+#define VF_MUL(A, B) _mm512_mul_ps(A, B)
+#define VF_DIV(A, B) _mm512_div_ps(A, B)
+#define VF_SQRT(A) _mm512_sqrt_ps(A)
+#define VF_MIN(A, B) _mm512_min_ps(A, B)
+#define VF_MAX(A, B) _mm512_max_ps(A, B)
+#define VF_FLOOR(A) _mm512_roundscale_ps(A, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC)
+#define VF_LT(A, B) ((u32)_mm512_cmp_ps_mask(A, B, _CMP_LT_OQ))
+#define VF_GT(A, B) ((u32)_mm512_cmp_ps_mask(A, B, _CMP_GT_OQ))
+
+#include "kernels_simd.h"
+
+#endif
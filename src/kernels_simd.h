@@ -0,0 +1,243 @@
+// The SIMD kernels of dispatch.h, written once against the vector operations below and compiled for each instruction
+// set by kernels_sse4.c, kernels_avx2.c and kernels_avx512.c, each of which defines the operations and then includes
+// this file. No include guard, as it's meant to be included once per instruction set (and in nothing else).
+//
+// The operations:
+//   KERNEL(NAME)         name of a kernel for this instruction set, e.g. NAME##_avx2
+//   LANES                number of f32 in a vector
+//   VF                   the vector type
+//   VF_SET1(X)           all lanes X
+//   VF_SEQ(X)            lane i is (f32)(X + i), X is a usize smaller than 2^24
+//   VF_LOADU(P)          load from `const f32 *`, no alignment
+//   VF_STOREU(P, V)      store to `f32 *`, no alignment
+//   VF_STOREU_I32(P, V)  truncate to i32 (like cvttss2si) and store to `i32 *`, no alignment
+//   VF_ADD, VF_SUB, VF_MUL, VF_DIV, VF_SQRT
+//   VF_MIN(A, B)         lane i is A < B ? A : B (so B if either is NaN), VF_MAX with >
+//   VF_FLOOR
+//   VF_LT(A, B), VF_GT   comparison, bit i of the resulting u32 is lane i, NaN compares false
+//
+// The integer kernels use GCC vector extensions of `LANES` lanes instead (`VU8`, `VU32` below), which the compiler
+// lowers to the instruction set of the file.
+//
+// Each operation rounds exactly like the scalar one, and the kernels do the same operations in the same order as the
+// scalar code they replace, so the results are bit-identical. Keep it that way, golden --diff checks.
+
+#include "common.h"
+#include "linear_alg.h"
+#include "math_helpers.h"
+#include "triangle.h"
+#include "shaders.h"
+#include "texture.h"
+#include "color.h"
+
+#define LANES_MASK ((u32)((1ull << LANES) - 1))
+
+typedef u8 VU8 __attribute__((vector_size(LANES)));
+typedef u32 VU32 __attribute__((vector_size(LANES * sizeof(u32))));
+
+void KERNEL(clear_depth)(f32 *depth_buffer, usize len) {
+  VF infinity = VF_SET1(INFINITY);
+  usize i = 0;
+  for (; i < len / LANES * LANES; i += LANES) {
+    VF_STOREU(&depth_buffer[i], infinity);
+  }
+  for (; i < len; ++i) {
+    depth_buffer[i] = INFINITY;
+  }
+}
+
+void KERNEL(transform)(const Mat4x4 *m, const Vec3 *in, Vec3 *out, usize len) {
+  // Transposes `LANES` vectors at a time, one register per component.
+  usize i = 0;
+  for (; i < len / LANES * LANES; i += LANES) {
+    f32 components[3][LANES];
+    for (usize lane = 0; lane < LANES; ++lane) {
+      components[0][lane] = in[i + lane].get[0];
+      components[1][lane] = in[i + lane].get[1];
+      components[2][lane] = in[i + lane].get[2];
+    }
+    VF x = VF_LOADU(components[0]);
+    VF y = VF_LOADU(components[1]);
+    VF z = VF_LOADU(components[2]);
+    for (usize row = 0; row < 3; ++row) {
+      // The w of the vertices is 1, and m[row][3] * 1 is exactly m[row][3].
+      VF result = VF_ADD(VF_MUL(VF_SET1(m->get[row][0]), x), VF_MUL(VF_SET1(m->get[row][1]), y));
+      result = VF_ADD(result, VF_MUL(VF_SET1(m->get[row][2]), z));
+      result = VF_ADD(result, VF_SET1(m->get[row][3]));
+      VF_STOREU(components[row], result);
+    }
+    for (usize lane = 0; lane < LANES; ++lane) {
+      out[i + lane] = (Vec3){{components[0][lane], components[1][lane], components[2][lane]}};
+    }
+  }
+  for (; i < len; ++i) {
+    out[i] = vec4to3(mul4x4_4(*m, vec3to4(in[i])));
+  }
+}
+
+usize KERNEL(raster_row)(
+    const TriangleRow *row, usize x0, usize x1, f32 *depth_row, usize *xs, f32 *depths, usize *covered) {
+  const TriangleSetup *t = row->triangle;
+  VF zero = VF_SET1(0);
+  usize passed = 0;
+  usize x = x0;
+  for (; x + LANES <= x1; x += LANES) {
+    VF cam_x = VF_ADD(VF_MUL(VF_SEQ(x), VF_SET1(row->x_ratio)), VF_SET1(row->min_x));
+    // See `is_in_triangle`.
+    VF d0 = VF_SUB(VF_MUL(VF_SUB(cam_x, VF_SET1(t->p1.get[0])), VF_SET1(t->dy01)), VF_SET1(row->sign0));
+    VF d1 = VF_SUB(VF_MUL(VF_SUB(cam_x, VF_SET1(t->p2.get[0])), VF_SET1(t->dy12)), VF_SET1(row->sign1));
+    VF d2 = VF_SUB(VF_MUL(VF_SUB(cam_x, VF_SET1(t->p0.get[0])), VF_SET1(t->dy20)), VF_SET1(row->sign2));
+    u32 has_neg = VF_LT(d0, zero) | VF_LT(d1, zero) | VF_LT(d2, zero);
+    u32 has_pos = VF_GT(d0, zero) | VF_GT(d1, zero) | VF_GT(d2, zero);
+    u32 inside = ~(has_neg & has_pos) & LANES_MASK;
+    if (inside == 0)
+      continue;
+    // See `triangular_interpolate_z`.
+    VF dx2 = VF_SUB(cam_x, VF_SET1(t->p2.get[0]));
+    VF denominator = VF_SET1(t->denominator);
+    VF w0 = VF_DIV(VF_ADD(VF_MUL(VF_SET1(t->dy12), dx2), VF_SET1(row->weight0)), denominator);
+    VF w1 = VF_DIV(VF_ADD(VF_MUL(VF_SET1(t->dy20), dx2), VF_SET1(row->weight1)), denominator);
+    VF w2 = VF_SUB(VF_SUB(VF_SET1(1), w0), w1);
+    VF z_ = VF_ADD(VF_MUL(w0, VF_SET1(t->inv_z0)), VF_MUL(w1, VF_SET1(t->inv_z1)));
+    z_ = VF_ADD(z_, VF_MUL(w2, VF_SET1(t->inv_z2)));
+    VF depth = VF_DIV(VF_SET1(1), z_);
+    u32 pass = inside & VF_LT(depth, VF_LOADU(&depth_row[x]));
+    if (pass == 0)
+      continue;
+    f32 depths_[LANES];
+    VF_STOREU(depths_, depth);
+    for (; pass != 0; pass &= pass - 1) {
+      usize lane = (usize)__builtin_ctz(pass);
+      *covered += depth_row[x + lane] == INFINITY;
+      depth_row[x + lane] = depths_[lane];
+      xs[passed] = x + lane;
+      depths[passed] = depths_[lane];
+      ++passed;
+    }
+  }
+  return passed + raster_row_scalar(row, x, x1, depth_row, &xs[passed], &depths[passed], covered);
+}
+
+void KERNEL(nabla_depth_row)(
+    usize width, usize height, usize stride, usize y, usize x0, usize x1, const f32 *depth_buffer, u8 *out) {
+  // How far `nabla_depth` reads, pixels closer to the edges wrap around and are left to the scalar version.
+  const usize margin = NABLA_DEPTH_RADIUS - NABLA_DEPTH_STEP;
+  usize x = x0;
+  if (y >= margin && y + margin < height && width > 2 * margin) {
+    for (; x < minzu(margin, x1); ++x) {
+      out[x - x0] = nabla_depth(width, height, stride, x, y, depth_buffer);
+    }
+    usize end = minzu(x1, width - margin);
+    for (; x + LANES <= end; x += LANES) {
+      VF dx = VF_SET1(0);
+      VF dy = VF_SET1(0);
+      for (u8 y_eps = 0; y_eps < NABLA_DEPTH_RADIUS; y_eps += NABLA_DEPTH_STEP) {
+        for (u8 x_eps = 0; x_eps < NABLA_DEPTH_RADIUS; x_eps += NABLA_DEPTH_STEP) {
+          f32 dist = sqrtf(pow2f(x_eps) + pow2f(y_eps));
+          VF factor = VF_SET1(dist / (f32)NABLA_DEPTH_RADIUS);
+          dx = VF_ADD(dx, VF_MUL(VF_LOADU(&depth_buffer[y * stride + x - x_eps]), factor));
+          dx = VF_SUB(dx, VF_MUL(VF_LOADU(&depth_buffer[y * stride + x + x_eps]), factor));
+          dy = VF_ADD(dy, VF_MUL(VF_LOADU(&depth_buffer[(y - y_eps) * stride + x]), factor));
+          dy = VF_SUB(dy, VF_MUL(VF_LOADU(&depth_buffer[(y + y_eps) * stride + x]), factor));
+        }
+      }
+      dx = VF_MUL(dx, VF_SET1(pow2f((f32)NABLA_DEPTH_STEP)));
+      dy = VF_MUL(dy, VF_SET1(pow2f((f32)NABLA_DEPTH_STEP)));
+      dx = VF_DIV(dx, VF_SET1(pow2f((f32)NABLA_DEPTH_RADIUS)));
+      dy = VF_DIV(dy, VF_SET1(pow2f((f32)NABLA_DEPTH_RADIUS)));
+      VF nabla = VF_SQRT(VF_ADD(VF_MUL(dx, dx), VF_MUL(dy, dy)));
+      i32 nabla_[LANES];
+      VF_STOREU_I32(nabla_, VF_MUL(nabla, VF_SET1(255.f)));
+      for (usize lane = 0; lane < LANES; ++lane) {
+        out[x - x0 + lane] = (u8)nabla_[lane];
+      }
+    }
+  }
+  for (; x < x1; ++x) {
+    out[x - x0] = nabla_depth(width, height, stride, x, y, depth_buffer);
+  }
+}
+
+void KERNEL(texture_sample_row)(const Texture *texture,
+                                TextureFilter filter,
+                                const f32 *us,
+                                const f32 *vs,
+                                const f32 *lods,
+                                usize len,
+                                u8 *out) {
+  // See `texture_clamp_coord`.
+#define CLAMP_COORD(X) VF_MIN(VF_MAX(X, VF_SET1(-TEXTURE_COORD_LIMIT)), VF_SET1(TEXTURE_COORD_LIMIT))
+  usize i = 0;
+  for (; i + LANES <= len; i += LANES) {
+    // The coords are computed for all lanes at once, the texels (of the level of each lane) are loaded one by one.
+    usize levels[LANES];
+    f32 widths[LANES];
+    f32 heights[LANES];
+    for (usize lane = 0; lane < LANES; ++lane) {
+      levels[lane] = texture_level(texture, lods[i + lane]);
+      widths[lane] = (f32)texture->widths[levels[lane]];
+      heights[lane] = (f32)texture->heights[levels[lane]];
+    }
+    VF u = VF_MUL(VF_LOADU(&us[i]), VF_LOADU(widths));
+    VF v = VF_MUL(VF_LOADU(&vs[i]), VF_LOADU(heights));
+    i32 xs[LANES];
+    i32 ys[LANES];
+    if (filter == TEXTURE_FILTER_NEAREST) {
+      // See `texture_sample_nearest`.
+      VF_STOREU_I32(xs, VF_FLOOR(CLAMP_COORD(u)));
+      VF_STOREU_I32(ys, VF_FLOOR(CLAMP_COORD(v)));
+      for (usize lane = 0; lane < LANES; ++lane) {
+        out[i + lane] = texture_texel(texture, levels[lane], xs[lane], ys[lane]);
+      }
+      continue;
+    }
+    // See `texture_sample_bilinear`.
+    VF x = CLAMP_COORD(VF_SUB(u, VF_SET1(0.5f)));
+    VF y = CLAMP_COORD(VF_SUB(v, VF_SET1(0.5f)));
+    VF x0 = VF_FLOOR(x);
+    VF y0 = VF_FLOOR(y);
+    VF_STOREU_I32(xs, x0);
+    VF_STOREU_I32(ys, y0);
+    f32 t00[LANES], t10[LANES], t01[LANES], t11[LANES];
+    for (usize lane = 0; lane < LANES; ++lane) {
+      t00[lane] = (f32)texture_texel(texture, levels[lane], xs[lane], ys[lane]);
+      t10[lane] = (f32)texture_texel(texture, levels[lane], xs[lane] + 1, ys[lane]);
+      t01[lane] = (f32)texture_texel(texture, levels[lane], xs[lane], ys[lane] + 1);
+      t11[lane] = (f32)texture_texel(texture, levels[lane], xs[lane] + 1, ys[lane] + 1);
+    }
+    VF tx = VF_SUB(x, x0);
+    VF ty = VF_SUB(y, y0);
+    VF top = VF_ADD(VF_LOADU(t00), VF_MUL(VF_SUB(VF_LOADU(t10), VF_LOADU(t00)), tx));
+    VF bottom = VF_ADD(VF_LOADU(t01), VF_MUL(VF_SUB(VF_LOADU(t11), VF_LOADU(t01)), tx));
+    i32 samples[LANES];
+    VF_STOREU_I32(samples, VF_ADD(VF_ADD(top, VF_MUL(VF_SUB(bottom, top), ty)), VF_SET1(0.5f)));
+    for (usize lane = 0; lane < LANES; ++lane) {
+      out[i + lane] = (u8)samples[lane];
+    }
+  }
+#undef CLAMP_COORD
+  texture_sample_row_scalar(texture, filter, &us[i], &vs[i], &lods[i], len - i, &out[i]);
+}
+
+void KERNEL(compose_rgba8_row)(const u8 *levels, const Rgba8 *albedo, usize len, Rgba8 *out) {
+  usize i = 0;
+  for (; i + LANES <= len; i += LANES) {
+    VU8 level8;
+    VU32 color;
+    memcpy(&level8, &levels[i], sizeof(level8));
+    memcpy(&color, &albedo[i], sizeof(color));
+    // See `rgba8_scale`.
+    VU32 level = __builtin_convertvector(level8, VU32);
+    VU32 rb = (color & 0x00ff00ff) * level + 0x00800080;
+    VU32 g = ((color >> 8) & 0xff) * level + 0x80;
+    rb = ((rb + ((rb >> 8) & 0x00ff00ff)) >> 8) & 0x00ff00ff;
+    g = (g + (g >> 8)) & 0xff00;
+    VU32 result = rb | g | (color & 0xff000000);
+    memcpy(&out[i], &result, sizeof(result));
+  }
+  for (; i < len; ++i) {
+    out[i] = rgba8_scale(albedo[i], levels[i]);
+  }
+}
+
+#undef LANES_MASK
@@ -0,0 +1,28 @@
+// SSE4.1 kernels, see kernels_simd.h. Compiled with -msse4.1, only called on CPUs that support it.
+
+#ifdef __SSE4_1__
+
+#include <immintrin.h>
+
+#define KERNEL(NAME) NAME##_sse4
+#define LANES 4
+#define VF __m128
+#define VF_SET1(X) _mm_set1_ps(X)
+#define VF_SEQ(X) _mm_add_ps(_mm_set1_ps((f32)(X)), _mm_setr_ps(0, 1, 2, 3))
+#define VF_LOADU(P) _mm_loadu_ps(P)
+#define VF_STOREU(P, V) _mm_storeu_ps(P, V)
+#define VF_STOREU_I32(P, V) _mm_storeu_si128((__m128i *)(P), _mm_cvttps_epi32(V))
+#define VF_ADD(A, B) _mm_add_ps(A, B)
+#define VF_SUB(A, B) _mm_sub_ps(A, B)
+#define VF_MUL(A, B) _mm_mul_ps(A, B)
+#define VF_DIV(A, B) _mm_div_ps(A, B)
+#define VF_SQRT(A) _mm_sqrt_ps(A)
+#define VF_MIN(A, B) _mm_min_ps(A, B)
+#define VF_MAX(A, B) _mm_max_ps(A, B)
+#define VF_FLOOR(A) _mm_floor_ps(A)
+#define VF_LT(A, B) ((u32)_mm_movemask_ps(_mm_cmplt_ps(A, B)))
+#define VF_GT(A, B) ((u32)_mm_movemask_ps(_mm_cmpgt_ps(A, B)))
+
+#include "kernels_simd.h"
+
+#endif
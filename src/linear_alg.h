@@ -118,9 +118,16 @@ static inline Vec4 mul4x4_4(Mat4x4 x, Vec4 y);
 /// [ _ ]
 static inline f32 dot4(Vec4 x, Vec4 y);
 
+/// Inverse of the affine map of the first 3 rows of a 4x4 matrix, as if its last row was [ 0 0 0 1 ]. The 3x3 part must
+/// be invertible.
+static inline Mat4x4 inverse_affine4x4(Mat4x4 m);
+
 /// 4x4 matrix that performs a translation.
 static inline Mat4x4 translate3d(Vec3 v);
 
+/// 4x4 matrix that performs a scaling along each axis.
+static inline Mat4x4 scale3d(Vec3 v);
+
 /// 3x3 matrix that performs a rotation along the x axis.
 /// Angle in radian.
 static inline Mat3x3 rotate3d_x(f32 th);
@@ -365,14 +372,14 @@ static inline Mat4x4 mul4x4(Mat4x4 x, Mat4x4 y) {
           x.get[0][0] * y.get[0][0] + x.get[0][1] * y.get[1][0] + x.get[0][2] * y.get[2][0] + x.get[0][3] * y.get[3][0], // col 0
           x.get[0][0] * y.get[0][1] + x.get[0][1] * y.get[1][1] + x.get[0][2] * y.get[2][1] + x.get[0][3] * y.get[3][1], // col 1
           x.get[0][0] * y.get[0][2] + x.get[0][1] * y.get[1][2] + x.get[0][2] * y.get[2][2] + x.get[0][3] * y.get[3][2], // col 2
-          x.get[0][0] * y.get[0][3] + x.get[0][1] * y.get[1][3] + x.get[0][3] * y.get[2][3] + x.get[0][3] * y.get[3][3], // col 3
+          x.get[0][0] * y.get[0][3] + x.get[0][1] * y.get[1][3] + x.get[0][2] * y.get[2][3] + x.get[0][3] * y.get[3][3], // col 3
       },
       {
           // row 1
           x.get[1][0] * y.get[0][0] + x.get[1][1] * y.get[1][0] + x.get[1][2] * y.get[2][0] + x.get[1][3] * y.get[3][0], // col 0
           x.get[1][0] * y.get[0][1] + x.get[1][1] * y.get[1][1] + x.get[1][2] * y.get[2][1] + x.get[1][3] * y.get[3][1], // col 1
           x.get[1][0] * y.get[0][2] + x.get[1][1] * y.get[1][2] + x.get[1][2] * y.get[2][2] + x.get[1][3] * y.get[3][2], // col 2
-          x.get[1][0] * y.get[0][3] + x.get[1][1] * y.get[1][3] + x.get[1][3] * y.get[2][3] + x.get[1][3] * y.get[3][3], // col 3
+          x.get[1][0] * y.get[0][3] + x.get[1][1] * y.get[1][3] + x.get[1][2] * y.get[2][3] + x.get[1][3] * y.get[3][3], // col 3
       },
       {
           // row 2
@@ -409,6 +416,34 @@ static inline f32 dot4(Vec4 x, Vec4 y) {
   return x.get[0] * y.get[0] + x.get[1] * y.get[1] + x.get[2] * y.get[2] + x.get[3] * y.get[3];
 }
 
+static inline Mat4x4 inverse_affine4x4(Mat4x4 m) {
+  // The inverse of the 3x3 part is its adjugate over its determinant, the translation is mapped back by it.
+  f32(*a)[4] = m.get;
+  f32 c00 = a[1][1] * a[2][2] - a[1][2] * a[2][1];
+  f32 c01 = a[1][2] * a[2][0] - a[1][0] * a[2][2];
+  f32 c02 = a[1][0] * a[2][1] - a[1][1] * a[2][0];
+  f32 inv_det = 1 / (a[0][0] * c00 + a[0][1] * c01 + a[0][2] * c02);
+  Mat4x4 result = {{
+      {c00 * inv_det,
+       (a[0][2] * a[2][1] - a[0][1] * a[2][2]) * inv_det,
+       (a[0][1] * a[1][2] - a[0][2] * a[1][1]) * inv_det,
+       0},
+      {c01 * inv_det,
+       (a[0][0] * a[2][2] - a[0][2] * a[2][0]) * inv_det,
+       (a[0][2] * a[1][0] - a[0][0] * a[1][2]) * inv_det,
+       0},
+      {c02 * inv_det,
+       (a[0][1] * a[2][0] - a[0][0] * a[2][1]) * inv_det,
+       (a[0][0] * a[1][1] - a[0][1] * a[1][0]) * inv_det,
+       0},
+      {0, 0, 0, 1},
+  }};
+  for (usize i = 0; i < 3; ++i) {
+    result.get[i][3] = -(result.get[i][0] * a[0][3] + result.get[i][1] * a[1][3] + result.get[i][2] * a[2][3]);
+  }
+  return result;
+}
+
 static inline Mat4x4 translate3d(Vec3 v) {
   return (Mat4x4){{
       {1, 0, 0, v.get[0]},
@@ -418,6 +453,15 @@ static inline Mat4x4 translate3d(Vec3 v) {
   }};
 }
 
+static inline Mat4x4 scale3d(Vec3 v) {
+  return (Mat4x4){{
+      {v.get[0], 0, 0, 0},
+      {0, v.get[1], 0, 0},
+      {0, 0, v.get[2], 0},
+      {0, 0, 0, 1},
+  }};
+}
+
 static inline Mat3x3 rotate3d_x(f32 th) {
   return (Mat3x3){{
       {1, 0, 0},
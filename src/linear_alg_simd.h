@@ -0,0 +1,252 @@
+#pragma once
+
+#include "common.h"
+#include "linear_alg.h"
+
+#if defined(__SSE__)
+#include <immintrin.h>
+#endif
+
+// Aligned counterparts of the types in linear_alg.h, with SSE/AVX implementations of the matrix operations. Results are
+// bit-identical to their scalar counterparts in linear_alg.h (the additions happen in the same order), and fall back to
+// those when the target has no SSE.
+//
+// Only the microbenchmarks use these, to compare aligned AoS SIMD with the scalar code. The renderer's vertex stage
+// goes through `kernels.transform` (see dispatch.h), which works on `Vec3` arrays as they are stored in the meshes and
+// is compiled for every instruction set the CPU may have; that is the implementation to optimize.
+
+/// `Vec4` aligned for SIMD loads and stores.
+typedef struct vec4a {
+  _Alignas(16) f32 get[4];
+} Vec4A;
+
+/// `Mat4x4` aligned for SIMD loads and stores, row-major like `Mat4x4`.
+typedef struct mat4x4a {
+  _Alignas(32) f32 get[4][4];
+} Mat4x4A;
+
+static inline Vec4A vec4a(Vec4 v);
+static inline Vec4 vec4a_unaligned(Vec4A v);
+static inline Mat4x4A mat4x4a(Mat4x4 m);
+static inline Mat4x4 mat4x4a_unaligned(Mat4x4A m);
+
+/// [x, y, z] => [x, y, z, 1]
+static inline Vec4A vec3to4a(Vec3 v);
+
+/// [x, y, z, w] => [x, y, z]
+static inline Vec3 vec4ato3(Vec4A v);
+
+/// `mul4x4` for aligned matrices.
+static inline Mat4x4A mul4x4a(const Mat4x4A *x, const Mat4x4A *y);
+
+/// `mul4x4_4` for aligned matrices and vectors.
+static inline Vec4A mul4x4a_4(const Mat4x4A *x, Vec4A y);
+
+/// `cross3` for aligned vectors, w of the inputs is ignored and w of the result is 0.
+static inline Vec4A cross3a(Vec4A x, Vec4A y);
+
+/// `dot3` for aligned vectors, w is ignored.
+static inline f32 dot3a(Vec4A x, Vec4A y);
+
+/// `out[i] = mul4x4a_4(m, in[i])` for `i` in `0..len`.
+/// `in` and `out` may be the same array.
+static inline void mul4x4a_4_batch(const Mat4x4A *m, const Vec4A *in, Vec4A *out, usize len);
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ------------------------------------------------ Implementation -----------------------------------------------------
+
+static inline Vec4A vec4a(Vec4 v) {
+  return (Vec4A){{v.get[0], v.get[1], v.get[2], v.get[3]}};
+}
+
+static inline Vec4 vec4a_unaligned(Vec4A v) {
+  return (Vec4){{v.get[0], v.get[1], v.get[2], v.get[3]}};
+}
+
+static inline Mat4x4A mat4x4a(Mat4x4 m) {
+  Mat4x4A result;
+  memcpy(result.get, m.get, sizeof(result.get));
+  return result;
+}
+
+static inline Mat4x4 mat4x4a_unaligned(Mat4x4A m) {
+  Mat4x4 result;
+  memcpy(result.get, m.get, sizeof(result.get));
+  return result;
+}
+
+static inline Vec4A vec3to4a(Vec3 v) {
+  return (Vec4A){{v.get[0], v.get[1], v.get[2], 1}};
+}
+
+static inline Vec3 vec4ato3(Vec4A v) {
+  return (Vec3){{v.get[0], v.get[1], v.get[2]}};
+}
+
+#if defined(__SSE__)
+
+static inline Mat4x4A mul4x4a(const Mat4x4A *x, const Mat4x4A *y) {
+  // Row i of the result is x[i][0] * y[0] + x[i][1] * y[1] + x[i][2] * y[2] + x[i][3] * y[3], where y[k] are rows.
+  __m128 y0 = _mm_load_ps(y->get[0]);
+  __m128 y1 = _mm_load_ps(y->get[1]);
+  __m128 y2 = _mm_load_ps(y->get[2]);
+  __m128 y3 = _mm_load_ps(y->get[3]);
+  Mat4x4A result;
+  for (usize i = 0; i < 4; ++i) {
+    __m128 row = _mm_mul_ps(_mm_set1_ps(x->get[i][0]), y0);
+    row = _mm_add_ps(row, _mm_mul_ps(_mm_set1_ps(x->get[i][1]), y1));
+    row = _mm_add_ps(row, _mm_mul_ps(_mm_set1_ps(x->get[i][2]), y2));
+    row = _mm_add_ps(row, _mm_mul_ps(_mm_set1_ps(x->get[i][3]), y3));
+    _mm_store_ps(result.get[i], row);
+  }
+  return result;
+}
+
+/// Columns of `m`, for computing `m * v` as a sum of columns scaled by the components of `v`.
+typedef struct mat4x4a_columns_ {
+  __m128 c0, c1, c2, c3;
+} Mat4x4AColumns_;
+
+static inline Mat4x4AColumns_ mat4x4a_columns_(const Mat4x4A *m) {
+  Mat4x4AColumns_ columns = {
+      _mm_load_ps(m->get[0]),
+      _mm_load_ps(m->get[1]),
+      _mm_load_ps(m->get[2]),
+      _mm_load_ps(m->get[3]),
+  };
+  _MM_TRANSPOSE4_PS(columns.c0, columns.c1, columns.c2, columns.c3);
+  return columns;
+}
+
+static inline __m128 mul4x4a_4_columns_(const Mat4x4AColumns_ *m, __m128 v) {
+  __m128 result = _mm_mul_ps(m->c0, _mm_shuffle_ps(v, v, _MM_SHUFFLE(0, 0, 0, 0)));
+  result = _mm_add_ps(result, _mm_mul_ps(m->c1, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 1, 1, 1))));
+  result = _mm_add_ps(result, _mm_mul_ps(m->c2, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 2, 2, 2))));
+  result = _mm_add_ps(result, _mm_mul_ps(m->c3, _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 3, 3, 3))));
+  return result;
+}
+
+static inline Vec4A mul4x4a_4(const Mat4x4A *x, Vec4A y) {
+  Mat4x4AColumns_ columns = mat4x4a_columns_(x);
+  Vec4A result;
+  _mm_store_ps(result.get, mul4x4a_4_columns_(&columns, _mm_load_ps(y.get)));
+  return result;
+}
+
+static inline Vec4A cross3a(Vec4A x, Vec4A y) {
+  // [x1 y2 - x2 y1, x2 y0 - x0 y2, x0 y1 - x1 y0, x3 y3 - x3 y3]
+  __m128 x_ = _mm_load_ps(x.get);
+  __m128 y_ = _mm_load_ps(y.get);
+  __m128 x_yzx = _mm_shuffle_ps(x_, x_, _MM_SHUFFLE(3, 0, 2, 1));
+  __m128 x_zxy = _mm_shuffle_ps(x_, x_, _MM_SHUFFLE(3, 1, 0, 2));
+  __m128 y_yzx = _mm_shuffle_ps(y_, y_, _MM_SHUFFLE(3, 0, 2, 1));
+  __m128 y_zxy = _mm_shuffle_ps(y_, y_, _MM_SHUFFLE(3, 1, 0, 2));
+  __m128 result = _mm_sub_ps(_mm_mul_ps(x_yzx, y_zxy), _mm_mul_ps(x_zxy, y_yzx));
+  // w would be NaN if x3 or y3 is infinity.
+  result = _mm_and_ps(result, _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1)));
+  Vec4A result_;
+  _mm_store_ps(result_.get, result);
+  return result_;
+}
+
+static inline f32 dot3a(Vec4A x, Vec4A y) {
+  __m128 products = _mm_mul_ps(_mm_load_ps(x.get), _mm_load_ps(y.get));
+  // (x0 y0 + x1 y1) + x2 y2
+  __m128 sum = _mm_add_ss(products, _mm_shuffle_ps(products, products, _MM_SHUFFLE(1, 1, 1, 1)));
+  sum = _mm_add_ss(sum, _mm_shuffle_ps(products, products, _MM_SHUFFLE(2, 2, 2, 2)));
+  return _mm_cvtss_f32(sum);
+}
+
+/// `m * v` for 4 vectors at a time, given as their x, y, z and w components.
+#define MUL4X4A_4_SOA_(SET1, ADD, MUL, M, X, Y, Z, W, ROW)                                                            \
+  ADD(ADD(ADD(MUL(SET1((M)->get[ROW][0]), X), MUL(SET1((M)->get[ROW][1]), Y)), MUL(SET1((M)->get[ROW][2]), Z)),       \
+      MUL(SET1((M)->get[ROW][3]), W))
+
+#if defined(__AVX__)
+/// `_MM_TRANSPOSE4_PS` within each 128-bit lane.
+static inline void transpose4_in_lanes_(__m256 *r0, __m256 *r1, __m256 *r2, __m256 *r3) {
+  __m256 t0 = _mm256_unpacklo_ps(*r0, *r1);
+  __m256 t1 = _mm256_unpacklo_ps(*r2, *r3);
+  __m256 t2 = _mm256_unpackhi_ps(*r0, *r1);
+  __m256 t3 = _mm256_unpackhi_ps(*r2, *r3);
+  *r0 = _mm256_shuffle_ps(t0, t1, _MM_SHUFFLE(1, 0, 1, 0));
+  *r1 = _mm256_shuffle_ps(t0, t1, _MM_SHUFFLE(3, 2, 3, 2));
+  *r2 = _mm256_shuffle_ps(t2, t3, _MM_SHUFFLE(1, 0, 1, 0));
+  *r3 = _mm256_shuffle_ps(t2, t3, _MM_SHUFFLE(3, 2, 3, 2));
+}
+#endif
+
+static inline void mul4x4a_4_batch(const Mat4x4A *m, const Vec4A *in, Vec4A *out, usize len) {
+  // Transposes groups of vectors so that each register holds one component of several vectors, which turns the
+  // product into plain multiply-adds without any shuffling.
+  // A local copy, since stores to `out` could otherwise alias `m` and force reloading it every iteration.
+  const Mat4x4A m_ = *m;
+  usize i = 0;
+#if defined(__AVX__)
+  // 8 vectors at a time, the even ones in the low lanes and the odd ones in the high lanes.
+  for (; i < len / 8 * 8; i += 8) {
+    // `in` is only 16-byte aligned.
+    __m256 x = _mm256_loadu_ps(in[i + 0].get);
+    __m256 y = _mm256_loadu_ps(in[i + 2].get);
+    __m256 z = _mm256_loadu_ps(in[i + 4].get);
+    __m256 w = _mm256_loadu_ps(in[i + 6].get);
+    transpose4_in_lanes_(&x, &y, &z, &w);
+    __m256 x_ = MUL4X4A_4_SOA_(_mm256_set1_ps, _mm256_add_ps, _mm256_mul_ps, &m_, x, y, z, w, 0);
+    __m256 y_ = MUL4X4A_4_SOA_(_mm256_set1_ps, _mm256_add_ps, _mm256_mul_ps, &m_, x, y, z, w, 1);
+    __m256 z_ = MUL4X4A_4_SOA_(_mm256_set1_ps, _mm256_add_ps, _mm256_mul_ps, &m_, x, y, z, w, 2);
+    __m256 w_ = MUL4X4A_4_SOA_(_mm256_set1_ps, _mm256_add_ps, _mm256_mul_ps, &m_, x, y, z, w, 3);
+    transpose4_in_lanes_(&x_, &y_, &z_, &w_);
+    _mm256_storeu_ps(out[i + 0].get, x_);
+    _mm256_storeu_ps(out[i + 2].get, y_);
+    _mm256_storeu_ps(out[i + 4].get, z_);
+    _mm256_storeu_ps(out[i + 6].get, w_);
+  }
+#endif
+  for (; i < len / 4 * 4; i += 4) {
+    __m128 x = _mm_load_ps(in[i + 0].get);
+    __m128 y = _mm_load_ps(in[i + 1].get);
+    __m128 z = _mm_load_ps(in[i + 2].get);
+    __m128 w = _mm_load_ps(in[i + 3].get);
+    _MM_TRANSPOSE4_PS(x, y, z, w);
+    __m128 x_ = MUL4X4A_4_SOA_(_mm_set1_ps, _mm_add_ps, _mm_mul_ps, &m_, x, y, z, w, 0);
+    __m128 y_ = MUL4X4A_4_SOA_(_mm_set1_ps, _mm_add_ps, _mm_mul_ps, &m_, x, y, z, w, 1);
+    __m128 z_ = MUL4X4A_4_SOA_(_mm_set1_ps, _mm_add_ps, _mm_mul_ps, &m_, x, y, z, w, 2);
+    __m128 w_ = MUL4X4A_4_SOA_(_mm_set1_ps, _mm_add_ps, _mm_mul_ps, &m_, x, y, z, w, 3);
+    _MM_TRANSPOSE4_PS(x_, y_, z_, w_);
+    _mm_store_ps(out[i + 0].get, x_);
+    _mm_store_ps(out[i + 1].get, y_);
+    _mm_store_ps(out[i + 2].get, z_);
+    _mm_store_ps(out[i + 3].get, w_);
+  }
+  Mat4x4AColumns_ columns = mat4x4a_columns_(&m_);
+  for (; i < len; ++i) {
+    _mm_store_ps(out[i].get, mul4x4a_4_columns_(&columns, _mm_load_ps(in[i].get)));
+  }
+}
+
+#else
+
+static inline Mat4x4A mul4x4a(const Mat4x4A *x, const Mat4x4A *y) {
+  return mat4x4a(mul4x4(mat4x4a_unaligned(*x), mat4x4a_unaligned(*y)));
+}
+
+static inline Vec4A mul4x4a_4(const Mat4x4A *x, Vec4A y) {
+  return vec4a(mul4x4_4(mat4x4a_unaligned(*x), vec4a_unaligned(y)));
+}
+
+static inline Vec4A cross3a(Vec4A x, Vec4A y) {
+  Vec3 result = cross3(vec4ato3(x), vec4ato3(y));
+  return (Vec4A){{result.get[0], result.get[1], result.get[2], 0}};
+}
+
+static inline f32 dot3a(Vec4A x, Vec4A y) {
+  return dot3(vec4ato3(x), vec4ato3(y));
+}
+
+static inline void mul4x4a_4_batch(const Mat4x4A *m, const Vec4A *in, Vec4A *out, usize len) {
+  for (usize i = 0; i < len; ++i) {
+    out[i] = mul4x4a_4(m, in[i]);
+  }
+}
+
+#endif
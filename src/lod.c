@@ -0,0 +1,501 @@
+#include "lod.h"
+
+#include "trace.h"
+
+/// Weight of the planes that keep the open edges of a mesh (e.g. the rim of the teapot) in place, relative to the
+/// planes of the triangles.
+#define LOD_BOUNDARY_WEIGHT 100.0
+
+/// A collapse is rejected if it turns any triangle by more than about 80 degrees, which would fold the surface over.
+#define LOD_MIN_NORMAL_COS 0.2f
+
+/// Sum of squared distances to a set of planes, as the symmetric 4x4 matrix of the quadratic form, upper triangle only:
+/// xx xy xz xw yy yz yw zz zw ww.
+typedef struct quadric {
+  f64 get[10];
+} Quadric;
+
+static Quadric plane_quadric(Vec3 normal, f32 d, f64 weight) {
+  f64 a = normal.get[0], b = normal.get[1], c = normal.get[2];
+  return (Quadric){{
+      weight * a * a, weight * a * b, weight * a * c, weight * a * d, weight * b * b,
+      weight * b * c, weight * b * d, weight * c * c, weight * c * d, weight * d * d,
+  }};
+}
+
+static inline Quadric add_quadric(Quadric x, Quadric y) {
+  for (usize i = 0; i < 10; ++i) {
+    x.get[i] += y.get[i];
+  }
+  return x;
+}
+
+static f64 quadric_error(const Quadric *q, Vec3 p) {
+  f64 x = p.get[0], y = p.get[1], z = p.get[2];
+  const f64 *a = q->get;
+  f64 error = a[0] * x * x + a[4] * y * y + a[7] * z * z + a[9];
+  error += 2 * (a[1] * x * y + a[2] * x * z + a[3] * x + a[5] * y * z + a[6] * y + a[8] * z);
+  // Rounding can make it slightly negative.
+  return error > 0 ? error : 0;
+}
+
+/// The point with the least error, `false` if there isn't a unique one (e.g. all the planes are parallel).
+static bool quadric_optimum(const Quadric *q, Vec3 *p) {
+  const f64 *a = q->get;
+  // Cramer's rule on the upper-left 3x3 block, against the negated last column.
+  f64 c0 = a[4] * a[7] - a[5] * a[5];
+  f64 c1 = a[2] * a[5] - a[1] * a[7];
+  f64 c2 = a[1] * a[5] - a[2] * a[4];
+  f64 det = a[0] * c0 + a[1] * c1 + a[2] * c2;
+  f64 trace = a[0] + a[4] + a[7];
+  if (fabs(det) <= 1e-9 * trace * trace * trace)
+    return false;
+  f64 b0 = -a[3], b1 = -a[6], b2 = -a[8];
+  f64 x = b0 * c0 + b1 * c1 + b2 * c2;
+  f64 y = b0 * c1 + b1 * (a[0] * a[7] - a[2] * a[2]) + b2 * (a[1] * a[2] - a[0] * a[5]);
+  f64 z = b0 * c2 + b1 * (a[1] * a[2] - a[0] * a[5]) + b2 * (a[0] * a[4] - a[1] * a[1]);
+  *p = (Vec3){{(f32)(x / det), (f32)(y / det), (f32)(z / det)}};
+  return true;
+}
+
+/// Triangles around a vertex.
+typedef struct triangle_list {
+  /// LEN: len, CAP: capacity.
+  u32 *items;
+  usize len;
+  usize capacity;
+} TriangleList;
+
+static void triangle_list_push(TriangleList *list, u32 triangle) {
+  if (list->len == list->capacity) {
+    list->capacity = list->capacity == 0 ? 8 : list->capacity * 2;
+    list->items = list->items == NULL ? xalloc(u32, list->capacity) : xrealloc(list->items, u32, list->capacity);
+  }
+  list->items[list->len++] = triangle;
+}
+
+/// Moving `v0` and `v1` to `p`, removing `v1`.
+typedef struct collapse {
+  f64 cost;
+  Vec3 p;
+  u32 v0;
+  u32 v1;
+  /// `Simplifier::stamps` of `v0` and `v1` when this was computed, it's outdated if any of them changed since.
+  u32 stamp0;
+  u32 stamp1;
+} Collapse;
+
+typedef struct simplifier {
+  /// LEN: vertices_len.
+  Vec3 *positions;
+  Quadric *quadrics;
+  /// Bumped every time a vertex moves.
+  u32 *stamps;
+  bool *removed;
+  TriangleList *triangles_of;
+  /// For finding the vertices adjacent to two vertices, see `next_mark`.
+  u32 *marks;
+  u32 mark;
+  usize vertices_len;
+  /// 3 vertices per triangle, in the same order as in the original triangles.
+  /// LEN: triangles_len * 3.
+  u32 *triangles;
+  bool *triangle_removed;
+  usize triangles_len;
+  /// Triangles that are not removed.
+  usize live_triangles_len;
+  /// Min-heap by cost.
+  /// LEN: heap_len, CAP: heap_capacity.
+  Collapse *heap;
+  usize heap_len;
+  usize heap_capacity;
+  /// Highest cost of the collapses done so far.
+  f64 max_cost;
+} Simplifier;
+
+/// Merges bit-identical vertices (indexless meshes repeat every vertex for each of its triangles) and drops the
+/// triangles that end up with a repeated vertex.
+static Simplifier new_simplifier(const Mesh *mesh) {
+  usize corners_len = mesh->indices == NULL ? mesh->vertices_len : mesh->indices_len;
+  Simplifier s = {
+      .positions = xalloc(Vec3, mesh->vertices_len),
+      .triangles = xalloc(u32, corners_len / 3 * 3),
+      .heap_capacity = 64,
+  };
+  s.heap = xalloc(Collapse, s.heap_capacity);
+  u32 *welded = xalloc(u32, mesh->vertices_len);
+  for (usize i = 0; i < mesh->vertices_len; ++i) {
+    usize j = 0;
+    while (j < s.vertices_len && memcmp(&s.positions[j], &mesh->vertices[i], sizeof(Vec3)) != 0) {
+      ++j;
+    }
+    if (j == s.vertices_len)
+      s.positions[s.vertices_len++] = mesh->vertices[i];
+    welded[i] = (u32)j;
+  }
+  for (usize i = 0; i < corners_len / 3; ++i) {
+    u32 triangle[3];
+    for (usize j = 0; j < 3; ++j) {
+      triangle[j] = welded[mesh->indices == NULL ? i * 3 + j : mesh->indices[i * 3 + j]];
+    }
+    if (triangle[0] == triangle[1] || triangle[1] == triangle[2] || triangle[2] == triangle[0])
+      continue;
+    memcpy(&s.triangles[s.triangles_len++ * 3], triangle, sizeof(triangle));
+  }
+  xfree(welded);
+  s.live_triangles_len = s.triangles_len;
+  s.triangle_removed = xalloc(bool, s.triangles_len);
+  memset(s.triangle_removed, 0, sizeof(bool) * s.triangles_len);
+  s.quadrics = xalloc(Quadric, s.vertices_len);
+  memset(s.quadrics, 0, sizeof(Quadric) * s.vertices_len);
+  s.stamps = xalloc(u32, s.vertices_len);
+  memset(s.stamps, 0, sizeof(u32) * s.vertices_len);
+  s.removed = xalloc(bool, s.vertices_len);
+  memset(s.removed, 0, sizeof(bool) * s.vertices_len);
+  s.triangles_of = xalloc(TriangleList, s.vertices_len);
+  memset(s.triangles_of, 0, sizeof(TriangleList) * s.vertices_len);
+  s.marks = xalloc(u32, s.vertices_len);
+  memset(s.marks, 0, sizeof(u32) * s.vertices_len);
+  for (usize i = 0; i < s.triangles_len; ++i) {
+    for (usize j = 0; j < 3; ++j) {
+      triangle_list_push(&s.triangles_of[s.triangles[i * 3 + j]], (u32)i);
+    }
+  }
+  return s;
+}
+
+static void free_simplifier(Simplifier s) {
+  for (usize i = 0; i < s.vertices_len; ++i) {
+    xfree(s.triangles_of[i].items);
+  }
+  xfree(s.positions);
+  xfree(s.quadrics);
+  xfree(s.stamps);
+  xfree(s.removed);
+  xfree(s.triangles_of);
+  xfree(s.marks);
+  xfree(s.triangles);
+  xfree(s.triangle_removed);
+  xfree(s.heap);
+}
+
+/// A fresh value for `Simplifier::marks`, different from all the ones in there.
+static u32 next_mark(Simplifier *s) {
+  if (++s->mark == 0) {
+    memset(s->marks, 0, sizeof(u32) * s->vertices_len);
+    s->mark = 1;
+  }
+  return s->mark;
+}
+
+static inline bool triangle_has(const Simplifier *s, u32 triangle, u32 v) {
+  const u32 *vertices = &s->triangles[triangle * 3];
+  return vertices[0] == v || vertices[1] == v || vertices[2] == v;
+}
+
+/// Not normalized, zero for degenerate triangles.
+static inline Vec3 triangle_cross(const Simplifier *s, u32 triangle) {
+  Vec3 p0 = s->positions[s->triangles[triangle * 3 + 0]];
+  Vec3 p1 = s->positions[s->triangles[triangle * 3 + 1]];
+  Vec3 p2 = s->positions[s->triangles[triangle * 3 + 2]];
+  return cross3(sub3(p1, p0), sub3(p2, p0));
+}
+
+/// Number of triangles that have both `v0` and `v1`, 1 for an open edge, 2 for an edge inside the surface.
+static usize edge_triangles_len(const Simplifier *s, u32 v0, u32 v1) {
+  usize len = 0;
+  const TriangleList *list = &s->triangles_of[v0];
+  for (usize i = 0; i < list->len; ++i) {
+    len += !s->triangle_removed[list->items[i]] && triangle_has(s, list->items[i], v1);
+  }
+  return len;
+}
+
+static void init_quadrics(Simplifier *s) {
+  for (usize i = 0; i < s->triangles_len; ++i) {
+    Vec3 n = triangle_cross(s, (u32)i);
+    f32 len = abs3(n);
+    if (len == 0)
+      continue;
+    n = (Vec3){{n.get[0] / len, n.get[1] / len, n.get[2] / len}};
+    Quadric plane = plane_quadric(n, -dot3(n, s->positions[s->triangles[i * 3 + 0]]), 1);
+    for (usize j = 0; j < 3; ++j) {
+      u32 v = s->triangles[i * 3 + j];
+      s->quadrics[v] = add_quadric(s->quadrics[v], plane);
+    }
+    // Open edges get a plane through them perpendicular to the triangle, so that they only move along themselves.
+    for (usize j = 0; j < 3; ++j) {
+      u32 v0 = s->triangles[i * 3 + j], v1 = s->triangles[i * 3 + (j + 1) % 3];
+      if (edge_triangles_len(s, v0, v1) != 1)
+        continue;
+      Vec3 m = cross3(sub3(s->positions[v1], s->positions[v0]), n);
+      f32 m_len = abs3(m);
+      if (m_len == 0)
+        continue;
+      m = (Vec3){{m.get[0] / m_len, m.get[1] / m_len, m.get[2] / m_len}};
+      Quadric edge_plane = plane_quadric(m, -dot3(m, s->positions[v0]), LOD_BOUNDARY_WEIGHT);
+      s->quadrics[v0] = add_quadric(s->quadrics[v0], edge_plane);
+      s->quadrics[v1] = add_quadric(s->quadrics[v1], edge_plane);
+    }
+  }
+}
+
+static void heap_push(Simplifier *s, Collapse collapse) {
+  if (s->heap_len == s->heap_capacity) {
+    s->heap_capacity *= 2;
+    s->heap = xrealloc(s->heap, Collapse, s->heap_capacity);
+  }
+  usize i = s->heap_len++;
+  while (i != 0 && s->heap[(i - 1) / 2].cost > collapse.cost) {
+    s->heap[i] = s->heap[(i - 1) / 2];
+    i = (i - 1) / 2;
+  }
+  s->heap[i] = collapse;
+}
+
+static Collapse heap_pop(Simplifier *s) {
+  Collapse top = s->heap[0];
+  Collapse last = s->heap[--s->heap_len];
+  usize i = 0;
+  while (true) {
+    usize child = i * 2 + 1;
+    if (child >= s->heap_len)
+      break;
+    if (child + 1 < s->heap_len && s->heap[child + 1].cost < s->heap[child].cost)
+      ++child;
+    if (s->heap[child].cost >= last.cost)
+      break;
+    s->heap[i] = s->heap[child];
+    i = child;
+  }
+  if (s->heap_len != 0)
+    s->heap[i] = last;
+  return top;
+}
+
+static void push_collapse(Simplifier *s, u32 v0, u32 v1) {
+  Quadric q = add_quadric(s->quadrics[v0], s->quadrics[v1]);
+  Vec3 p0 = s->positions[v0];
+  Vec3 p1 = s->positions[v1];
+  Vec3 mid = {{(p0.get[0] + p1.get[0]) / 2, (p0.get[1] + p1.get[1]) / 2, (p0.get[2] + p1.get[2]) / 2}};
+  Vec3 p;
+  f64 cost;
+  // The optimum can be far off for nearly flat neighbourhoods, only trust it near the edge.
+  if (quadric_optimum(&q, &p) && abs3(sub3(p, mid)) <= abs3(sub3(p1, p0))) {
+    cost = quadric_error(&q, p);
+  } else {
+    p = mid;
+    cost = quadric_error(&q, mid);
+    f64 cost0 = quadric_error(&q, p0);
+    f64 cost1 = quadric_error(&q, p1);
+    if (cost0 < cost)
+      p = p0, cost = cost0;
+    if (cost1 < cost)
+      p = p1, cost = cost1;
+  }
+  heap_push(s, (Collapse){cost, p, v0, v1, s->stamps[v0], s->stamps[v1]});
+}
+
+/// Whether a collapse keeps the surface a surface: the edge still exists, the two vertices share no neighbours besides
+/// the ones across the edge (otherwise the collapse would pinch the surface), and no triangle flips over.
+static bool collapse_is_valid(Simplifier *s, const Collapse *collapse) {
+  u32 v0 = collapse->v0, v1 = collapse->v1;
+  usize shared = edge_triangles_len(s, v0, v1);
+  if (shared == 0)
+    return false;
+  u32 mark = next_mark(s);
+  u32 shared_mark = next_mark(s);
+  const TriangleList *list0 = &s->triangles_of[v0];
+  for (usize i = 0; i < list0->len; ++i) {
+    if (s->triangle_removed[list0->items[i]])
+      continue;
+    for (usize j = 0; j < 3; ++j) {
+      s->marks[s->triangles[list0->items[i] * 3 + j]] = mark;
+    }
+  }
+  usize common = 0;
+  const TriangleList *list1 = &s->triangles_of[v1];
+  for (usize i = 0; i < list1->len; ++i) {
+    if (s->triangle_removed[list1->items[i]])
+      continue;
+    for (usize j = 0; j < 3; ++j) {
+      u32 v = s->triangles[list1->items[i] * 3 + j];
+      if (v != v0 && v != v1 && s->marks[v] == mark) {
+        s->marks[v] = shared_mark;
+        ++common;
+      }
+    }
+  }
+  if (common != shared)
+    return false;
+  for (usize k = 0; k < 2; ++k) {
+    u32 v = k == 0 ? v0 : v1;
+    const TriangleList *list = &s->triangles_of[v];
+    for (usize i = 0; i < list->len; ++i) {
+      u32 triangle = list->items[i];
+      if (s->triangle_removed[triangle] || (triangle_has(s, triangle, v0) && triangle_has(s, triangle, v1)))
+        continue;
+      Vec3 before = triangle_cross(s, triangle);
+      Vec3 position = s->positions[v];
+      s->positions[v] = collapse->p;
+      Vec3 after = triangle_cross(s, triangle);
+      s->positions[v] = position;
+      f32 after_len = abs3(after);
+      if (after_len == 0 || dot3(before, after) < LOD_MIN_NORMAL_COS * abs3(before) * after_len)
+        return false;
+    }
+  }
+  return true;
+}
+
+static void apply_collapse(Simplifier *s, const Collapse *collapse) {
+  u32 v0 = collapse->v0, v1 = collapse->v1;
+  s->positions[v0] = collapse->p;
+  s->quadrics[v0] = add_quadric(s->quadrics[v0], s->quadrics[v1]);
+  s->removed[v1] = true;
+  ++s->stamps[v0];
+  ++s->stamps[v1];
+  if (collapse->cost > s->max_cost)
+    s->max_cost = collapse->cost;
+  TriangleList *list1 = &s->triangles_of[v1];
+  for (usize i = 0; i < list1->len; ++i) {
+    u32 triangle = list1->items[i];
+    if (s->triangle_removed[triangle])
+      continue;
+    if (triangle_has(s, triangle, v0)) {
+      s->triangle_removed[triangle] = true;
+      --s->live_triangles_len;
+      continue;
+    }
+    for (usize j = 0; j < 3; ++j) {
+      if (s->triangles[triangle * 3 + j] == v1)
+        s->triangles[triangle * 3 + j] = v0;
+    }
+    triangle_list_push(&s->triangles_of[v0], triangle);
+  }
+  list1->len = 0;
+  // Drop the removed triangles, and requeue the edges around the moved vertex with their new costs.
+  TriangleList *list0 = &s->triangles_of[v0];
+  u32 mark = next_mark(s);
+  usize len = 0;
+  for (usize i = 0; i < list0->len; ++i) {
+    u32 triangle = list0->items[i];
+    if (s->triangle_removed[triangle])
+      continue;
+    list0->items[len++] = triangle;
+    for (usize j = 0; j < 3; ++j) {
+      u32 v = s->triangles[triangle * 3 + j];
+      if (v != v0 && s->marks[v] != mark) {
+        s->marks[v] = mark;
+        push_collapse(s, v0, v);
+      }
+    }
+  }
+  list0->len = len;
+}
+
+/// Collapse edges until there are at most `target_len` triangles left or nothing can be collapsed anymore.
+static void simplify(Simplifier *s, usize target_len) {
+  while (s->live_triangles_len > target_len && s->heap_len != 0) {
+    Collapse collapse = heap_pop(s);
+    if (s->removed[collapse.v0] || s->removed[collapse.v1] || s->stamps[collapse.v0] != collapse.stamp0 ||
+        s->stamps[collapse.v1] != collapse.stamp1)
+      continue;
+    if (collapse_is_valid(s, &collapse))
+      apply_collapse(s, &collapse);
+  }
+}
+
+/// The current state of the simplification as a mesh, owning its vertices and indices.
+static LodLevel snapshot(Simplifier *s) {
+  u32 *new_index = xalloc(u32, s->vertices_len);
+  Vec3 *vertices = xalloc(Vec3, s->vertices_len);
+  usize *indices = xalloc(usize, s->live_triangles_len * 3);
+  usize vertices_len = 0, indices_len = 0;
+  u32 mark = next_mark(s);
+  for (usize i = 0; i < s->triangles_len; ++i) {
+    if (s->triangle_removed[i])
+      continue;
+    for (usize j = 0; j < 3; ++j) {
+      u32 v = s->triangles[i * 3 + j];
+      if (s->marks[v] != mark) {
+        s->marks[v] = mark;
+        new_index[v] = (u32)vertices_len;
+        vertices[vertices_len++] = s->positions[v];
+      }
+      indices[indices_len++] = new_index[v];
+    }
+  }
+  xfree(new_index);
+  return (LodLevel){
+      .mesh = new_mesh(vertices, vertices_len, indices, indices_len),
+      .error = (f32)sqrt(s->max_cost),
+  };
+}
+
+LodChain new_lod_chain(Mesh mesh) {
+  TRACE_SCOPE("new_lod_chain");
+  LodChain lods = {.levels = {{mesh, 0}}, .levels_len = 1};
+  Simplifier s = new_simplifier(&mesh);
+  init_quadrics(&s);
+  for (usize i = 0; i < s.triangles_len; ++i) {
+    for (usize j = 0; j < 3; ++j) {
+      u32 v0 = s.triangles[i * 3 + j], v1 = s.triangles[i * 3 + (j + 1) % 3];
+      // Edges inside the surface are in two triangles, once in each direction.
+      if (v0 < v1 || edge_triangles_len(&s, v0, v1) == 1)
+        push_collapse(&s, v0, v1);
+    }
+  }
+  usize triangles_len = mesh_triangles_len(&mesh);
+  while (lods.levels_len < LOD_MAX_LEVELS && triangles_len / 2 >= LOD_MIN_TRIANGLES) {
+    simplify(&s, triangles_len / 2);
+    // Stop once the simplification gets stuck, a level that isn't much simpler isn't worth it.
+    if (s.live_triangles_len > triangles_len * 3 / 4)
+      break;
+    lods.levels[lods.levels_len++] = snapshot(&s);
+    triangles_len = s.live_triangles_len;
+  }
+  free_simplifier(s);
+  // Vertices can move slightly outside of the original mesh, grow the bounding volumes of all levels to fit them all.
+  Vec3 center = mesh.center;
+  Aabb bounds = mesh.bounds;
+  f32 radius = mesh.radius;
+  for (usize i = 1; i < lods.levels_len; ++i) {
+    const Mesh *level = &lods.levels[i].mesh;
+    bounds = aabb_union(bounds, level->bounds);
+    for (usize j = 0; j < level->vertices_len; ++j) {
+      radius = maxf(radius, abs3(sub3(level->vertices[j], center)));
+    }
+  }
+  for (usize i = 0; i < lods.levels_len; ++i) {
+    lods.levels[i].mesh.center = center;
+    lods.levels[i].mesh.radius = radius;
+    lods.levels[i].mesh.bounds = bounds;
+  }
+  return lods;
+}
+
+void free_lod_chain(LodChain lods) {
+  for (usize i = 1; i < lods.levels_len; ++i) {
+    xfree((Vec3 *)lods.levels[i].mesh.vertices);
+    xfree((usize *)lods.levels[i].mesh.indices);
+  }
+}
+
+usize lod_select(const LodChain *lods, const Renderer *renderer, Mat4x4 m, usize current) {
+  f32 scale = screen_scale(renderer, m);
+  current = minzu(current, lods->levels_len - 1);
+  usize level = 0;
+  while (level + 1 < lods->levels_len && lods->levels[level + 1].error * scale <= LOD_MAX_ERROR_PIXELS) {
+    ++level;
+  }
+  // Finer levels are switched to right away, coarser ones only with some margin.
+  if (level <= current)
+    return level;
+  level = current;
+  while (level + 1 < lods->levels_len &&
+         lods->levels[level + 1].error * scale <= LOD_MAX_ERROR_PIXELS * LOD_HYSTERESIS) {
+    ++level;
+  }
+  return level;
+}
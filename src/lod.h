@@ -0,0 +1,63 @@
+#pragma once
+
+#include "common.h"
+#include "linear_alg.h"
+#include "mesh.h"
+#include "render.h"
+
+// Levels of detail of a mesh, simplified once at load time, for drawing objects that are small on screen with fewer
+// triangles.
+//
+// The levels are made by collapsing edges in order of their quadric error (Garland and Heckbert, "Surface
+// Simplification Using Quadric Error Metrics", 1997), each level having about half the triangles of the one before
+// it. Every level remembers how far (in model space) its surface may be from the original, and `lod_select` picks the
+// coarsest level for which that is less than `LOD_MAX_ERROR_PIXELS` on screen.
+//
+// Example:
+//
+// ```
+// Mesh teapot_mesh = new_mesh(ARR_ARG(teapot), NULL, 0);
+// LodChain teapot_lods = new_lod_chain(teapot_mesh);
+// usize lod = 0;
+// while (...) {
+//   lod = lod_select(&teapot_lods, &renderer, m, lod);
+//   draw_object_instanced_xxx(&renderer, &teapot_lods.levels[lod].mesh, &instance, 1);
+// }
+// free_lod_chain(teapot_lods);
+// ```
+
+#define LOD_MAX_LEVELS 8
+
+/// No level is simplified to fewer triangles than this.
+#define LOD_MIN_TRIANGLES 32
+
+/// Max distance on screen, in pixels, between the surface of a level and the original surface.
+#define LOD_MAX_ERROR_PIXELS 1.f
+
+/// Switching to a coarser level only happens once its error is below this fraction of `LOD_MAX_ERROR_PIXELS`, so that
+/// objects whose size hovers around a threshold don't keep switching back and forth.
+#define LOD_HYSTERESIS 0.75f
+
+typedef struct lod_level {
+  Mesh mesh;
+  /// Upper bound of the distance between the surface of this level and the original, in model space.
+  f32 error;
+} LodLevel;
+
+/// SAFETY: Only use new_lod_chain to construct this.
+typedef struct lod_chain {
+  /// From the finest (the original mesh, not owned) to the coarsest (owned). All levels have the bounding volumes of
+  /// the original mesh grown to contain every level, so that which level is drawn doesn't change culling. The
+  /// simplified levels have no vertex attributes.
+  /// LEN: levels_len.
+  LodLevel levels[LOD_MAX_LEVELS];
+  usize levels_len;
+} LodChain;
+
+LodChain new_lod_chain(Mesh mesh);
+
+void free_lod_chain(LodChain lods);
+
+/// The level to draw an object with model matrix `m` at, given the level `current` it was drawn at the last time (0
+/// the first time).
+usize lod_select(const LodChain *lods, const Renderer *renderer, Mat4x4 m, usize current);
@@ -1,102 +1,220 @@
-#include <time.h>
-
 #include "common.h"
 #include "linear_alg.h"
 #include "teapot.h"
+#include "cube.h"
+#include "demo.h"
+#include "clock.h"
+#include "replay.h"
 #include "render.h"
+#include "mesh.h"
+#include "scene.h"
+#include "cmdbuf.h"
+#include "hierarchy.h"
+#include "lod.h"
 #include "gui.h"
+#include "frame.h"
+#include "trace.h"
 
-#include <sys/time.h>
 #include <raylib.h>
 
-[[maybe_unused]]
-static const Vec3 cube_vertices[] = {
-    // clang-format off
-    {{-1.0f, -1.0f, -1.0f}},
-    {{ 1.0f, -1.0f, -1.0f}},
-    {{ 1.0f,  1.0f, -1.0f}},
-    {{-1.0f,  1.0f, -1.0f}},
-    {{-1.0f, -1.0f,  1.0f}},
-    {{ 1.0f, -1.0f,  1.0f}},
-    {{ 1.0f,  1.0f,  1.0f}},
-    {{-1.0f,  1.0f,  1.0f}},
-    // clang-format on
-};
-
-[[maybe_unused]]
-static const usize cube_indices[] = {
-    0, 3, 2, //
-    2, 1, 0, //
-    4, 5, 6, //
-    6, 7, 4, //
-    7, 3, 0, //
-    0, 4, 7, //
-    1, 2, 6, //
-    6, 5, 1, //
-    0, 1, 5, //
-    5, 4, 0, //
-    2, 3, 7, //
-    7, 6, 2, //
-};
-
-static inline u64 current_ms() {
-  struct timespec t;
-  clock_gettime(CLOCK_REALTIME, &t);
-  return (u64)(t.tv_sec) * 1000 + (u64)(t.tv_nsec / 1000000);
-}
-
-static inline Mat4x4 rotation_for_current_time() {
-  u64 ms = current_ms();
-  const u64 rotation_period_ms = 5 * 1000;
-  // Convert current time to a fraction of the period
-  f32 fraction_of_period = (ms % rotation_period_ms) / (f32)rotation_period_ms;
-  // Convert fraction to radians (2 * PI radians in a full circle)
-  f32 rad = fraction_of_period * 2.0f * (f32)M_PI;
-  return mat3x3to4x4(rotate3d_z(rad));
+typedef struct options {
+  /// Record the session into a frame log, see replay.h.
+  const char *record_path;
+  /// Replay a frame log as fast as possible instead of taking keyboard input.
+  const char *replay_path;
+  /// Use a `FRAME_CLOCK_FIXED_STEP` clock with this step if not zero.
+  u64 fixed_step_ms;
+  /// Threads drawing the scene, each into a band of rows. One by default: the threads share a single batch list, and a
+  /// speedup from more of them is yet to be measured on a multi-core machine.
+  usize threads_len;
+  /// Samples per pixel of multisample anti-aliasing, 1 for none.
+  usize samples;
+  /// Start with dynamic resolution on, see resolution.h.
+  bool dynamic_resolution;
+  /// Bounds of the scale of dynamic resolution.
+  f32 min_scale;
+  f32 max_scale;
+} Options;
+
+static Options parse_options(i32 argc, char **argv) {
+  Options options = {
+      .record_path = NULL,
+      .replay_path = NULL,
+      .fixed_step_ms = 0,
+      .threads_len = 1,
+      .samples = 1,
+      .dynamic_resolution = false,
+      .min_scale = 0.5f,
+      .max_scale = 1.f,
+  };
+  for (i32 i = 1; i < argc; ++i) {
+    const char *arg = argv[i];
+    bool has_value = i + 1 < argc;
+    if (strcmp(arg, "--record") == 0 && has_value) {
+      options.record_path = argv[++i];
+    } else if (strcmp(arg, "--replay") == 0 && has_value) {
+      options.replay_path = argv[++i];
+    } else if (strcmp(arg, "--fixed-step") == 0 && has_value) {
+      options.fixed_step_ms = strtoull(argv[++i], NULL, 10);
+    } else if (strcmp(arg, "--threads") == 0 && has_value) {
+      options.threads_len = strtoull(argv[++i], NULL, 10);
+      ASSERT_PRINTF(options.threads_len >= 1 && options.threads_len <= CMD_MAX_THREADS,
+                    "--threads must be between 1 and %d\n",
+                    CMD_MAX_THREADS);
+    } else if (strcmp(arg, "--msaa") == 0 && has_value) {
+      options.samples = strtoull(argv[++i], NULL, 10);
+      ASSERT_PRINTF(options.samples == 1 || options.samples == 4 || options.samples == 8, "--msaa must be 1, 4 or 8\n");
+    } else if (strcmp(arg, "--dynamic-resolution") == 0) {
+      options.dynamic_resolution = true;
+    } else if (strcmp(arg, "--min-scale") == 0 && has_value) {
+      options.min_scale = strtof(argv[++i], NULL);
+    } else if (strcmp(arg, "--max-scale") == 0 && has_value) {
+      options.max_scale = strtof(argv[++i], NULL);
+    } else {
+      PANIC_PRINTF("Usage: %s [--record PATH | --replay PATH] [--fixed-step MS] [--threads N] [--msaa 1|4|8] "
+                   "[--dynamic-resolution] [--min-scale S] [--max-scale S]\n",
+                   argv[0]);
+    }
+  }
+  ASSERT_PRINTF(options.min_scale > 0 && options.min_scale <= options.max_scale && options.max_scale <= 1,
+                "--min-scale and --max-scale must be in 0..=1, in order\n");
+  // Replays run as fast as possible, there's no frame budget to hold: they take the scale of every frame from the log.
+  ASSERT_PRINTF(!options.dynamic_resolution || options.replay_path == NULL,
+                "--dynamic-resolution cannot be used with --replay\n");
+  return options;
 }
 
-i32 main() {
+i32 main(i32 argc, char **argv) {
+  Options options = parse_options(argc, argv);
 
-  const f32 fps = 60.f;
   const usize width = 800;
   const usize height = 800;
+  // Replays run as fast as possible.
+  const f32 fps = options.replay_path != NULL ? INFINITY : 60.f;
+  const usize shadow_map_size = 1024;
+
+  Renderer renderer = new_renderer(width, height, demo_camera(), demo_light());
+  renderer_set_samples(&renderer, options.samples);
+
+  // Both objects hang off a spinning root, only the root's local matrix changes per frame.
+  Hierarchy hierarchy = new_hierarchy();
+  usize spin_node = hierarchy_add(&hierarchy, HIERARCHY_NO_PARENT, demo_rotation_for_time(0));
+  usize teapot_node = hierarchy_add(&hierarchy, spin_node, demo_base_transform());
+  usize cube_node = hierarchy_add(&hierarchy, spin_node, demo_base_transform());
+  hierarchy_update(&hierarchy);
+
+  Mesh teapot_mesh = new_mesh(ARR_ARG(teapot), NULL, 0);
+  LodChain teapot_lods = new_lod_chain(teapot_mesh);
+  Mesh cube_mesh = new_mesh(ARR_ARG(cube_vertices), ARR_ARG(cube_indices));
+  // Given to the meshes only with colors on, drawing the varyings costs even when the colors aren't drawn. The
+  // simplified levels of the teapot have none, they are drawn white.
+  f32 *teapot_colors = xalloc(f32, ARR_LEN(teapot) * COLOR_VARYINGS);
+  demo_vertex_colors(ARR_ARG(teapot), teapot_colors);
+  f32 *cube_colors = xalloc(f32, ARR_LEN(cube_vertices) * COLOR_VARYINGS);
+  demo_vertex_colors(ARR_ARG(cube_vertices), cube_colors);
+  Scene scene = new_scene();
+  usize teapot_id =
+      scene_add_lod_object(&scene, &teapot_lods, new_instance(&renderer, hierarchy_world(&hierarchy, teapot_node)));
+  usize cube_id = scene_add_object(&scene, &cube_mesh, new_instance(&renderer, hierarchy_world(&hierarchy, cube_node)));
+  // The scene is recorded every frame, then drawn by the threads, each into a band of the screen.
+  CommandBuffer cmdbuf = new_command_buffer();
+  CmdExecutor executor = new_cmd_executor(options.threads_len);
+
+  GuiPainter gui_painter =
+      new_gui_painter(width, height, fps, options.samples, options.min_scale, options.max_scale, shadow_map_size);
+  gui_painter.dynamic_resolution = options.dynamic_resolution;
+  renderer.draw_pixel_callback_cx = &gui_painter;
 
-  Vec3 light = {{-10, 5, -1}};
-  Camera_ cam = {
-      .pos = {{10, 0, 0}},
-      .min_x = -2.0f,
-      .min_y = -2.0f,
-      .max_x = +2.0f,
-      .max_y = +2.0f,
-      .fov = to_rad(90.f),
-      .aspect_ratio = 1.f,
-      .near_clipping_dist = 0.1f,
-      .far_clipping_dist = 100.f,
-  };
-  Renderer renderer = new_renderer(width, height, cam, light);
-
-  Mat4x4 base_transform = mat4x4_id;
-  base_transform = mul4x4(translate3d((Vec3){{0, 0, -0.7f}}), base_transform);
-  base_transform = mul4x4(mat3x3to4x4(rotate3d_x(to_rad(20))), base_transform);
+  FrameClock clock = options.fixed_step_ms != 0 ? new_fixed_step_clock(options.fixed_step_ms) : new_realtime_clock();
+  FrameRecorder recorder;
+  if (options.record_path != NULL)
+    ASSERT_PRINTF(open_frame_recorder(&recorder, options.record_path), "Cannot create %s\n", options.record_path);
+  FrameLog log;
+  usize replayed_frames = 0;
+  if (options.replay_path != NULL)
+    ASSERT_PRINTF(load_frame_log(options.replay_path, &log), "Cannot load %s\n", options.replay_path);
 
-  GuiPainter gui_painter = new_gui_painter(width, height, fps);
-  renderer.draw_pixel_callback_cx = &gui_painter;
   gui_setup_window(&gui_painter);
 
-  while (!WindowShouldClose()) {
-    gui_handle_event(&gui_painter, &renderer);
-
+  for (usize frame = 0; !WindowShouldClose(); ++frame) {
+#ifdef DEBUG
+    usize allocations = heap_allocations();
+    bool tracing = trace_is_enabled();
+    bool shadows = gui_painter.frame.shadows;
+#endif
+    frame_clock_tick(&clock);
+    resolution_frame_begin(&gui_painter.resolution);
+    FrameInput input;
+    if (options.replay_path != NULL) {
+      if (replayed_frames == log.len)
+        break;
+      input = log.frames[replayed_frames++];
+      FrameToggles toggles;
+      apply_frame_input(&input, &renderer, &gui_painter.shader_kind, &toggles);
+      gui_set_frame_toggles(&gui_painter, &toggles);
+    } else {
+      gui_handle_event(&gui_painter, &renderer, &clock);
+      FrameToggles toggles = gui_frame_toggles(&gui_painter);
+      input = current_frame_input(clock.now_ms, &renderer, gui_painter.shader_kind, &toggles);
+    }
+    if (options.record_path != NULL)
+      record_frame(&recorder, &input);
+
+    hierarchy_set_local(&hierarchy, spin_node, demo_rotation_for_time(input.time_ms));
+    hierarchy_update(&hierarchy);
+    if (hierarchy_world_changed(&hierarchy, teapot_node))
+      scene_set_transform(&scene, teapot_id, hierarchy_world(&hierarchy, teapot_node));
+    if (hierarchy_world_changed(&hierarchy, cube_node))
+      scene_set_transform(&scene, cube_id, hierarchy_world(&hierarchy, cube_node));
+
+    // Only what changed since the last frame is cleared and redrawn.
+    gui_update_resolution(&gui_painter, &renderer);
+    FrameTargets *frame_targets = &gui_painter.frame;
+    if (frame_targets->colors_changed) {
+      usize colors_len = frame_targets->colors ? COLOR_VARYINGS : 0;
+      mesh_set_attributes(&teapot_lods.levels[0].mesh, teapot_colors, colors_len);
+      mesh_set_attributes(&cube_mesh, cube_colors, colors_len);
+    }
+    renderer.scissor = frame_targets_redrawn_rect(
+        frame_targets, &renderer, scene_dirty_rect(&scene, &renderer), gui_painter.redraw_all);
     renderer_clear_frame(&renderer);
-    gui_clear_frame(&gui_painter);
+    gui_clear_frame(&gui_painter, &renderer);
+
+    // The shadow map, from the full meshes whatever their level of detail on screen.
+    const Mesh *casters[] = {&teapot_mesh, &cube_mesh};
+    Mat4x4 casters_m[] = {hierarchy_world(&hierarchy, teapot_node), hierarchy_world(&hierarchy, cube_node)};
+    frame_targets_draw_shadow_map(frame_targets, renderer.light, casters, casters_m, ARR_LEN(casters));
 
     // Render stuff.
-    Mat4x4 transform = mul4x4(rotation_for_current_time(), base_transform);
-    draw_object_indexless_gui(&renderer, ARR_ARG(teapot), transform);
-    draw_object_gui(&renderer, cube_vertices, ARR_ARG(cube_indices), transform);
+    if (!screen_rect_is_empty(renderer.scissor)) {
+      cmdbuf_reset(&cmdbuf);
+      scene_record(&renderer, &scene, NULL, &cmdbuf);
+      cmdbuf_submit(&renderer, &cmdbuf, CMD_SORT_STATE, &executor, rasterize_triangle_gui);
+    }
 
     // Finish frame.
     gui_finish_frame(&gui_painter, &renderer);
+#ifdef DEBUG
+    // The arenas and the command buffer have grown to what a frame needs after the first one, and the threads allocate
+    // their trace buffer in the first frame they are traced, the shadow map's arena in the first frame with shadows.
+    if (frame >= 2 && tracing == trace_is_enabled() && shadows == gui_painter.frame.shadows)
+      ASSERT_PRINTF(heap_allocations() == allocations, "Frame %zu allocated from the heap\n", frame);
+#endif
   }
 
+  free_gui_drawing_cx(gui_painter);
+  CloseWindow();
+  free_cmd_executor(executor);
+  free_command_buffer(cmdbuf);
+  free_scene(scene);
+  free_hierarchy(hierarchy);
+  free_lod_chain(teapot_lods);
+  xfree(teapot_colors);
+  xfree(cube_colors);
+  if (options.record_path != NULL)
+    ASSERT_PRINTF(close_frame_recorder(&recorder), "Cannot write %s\n", options.record_path);
+  if (options.replay_path != NULL)
+    free_frame_log(log);
+
   return 0;
 }
@@ -0,0 +1,39 @@
+#include "mesh.h"
+
+Mesh new_mesh(const Vec3 *vertices, usize vertices_len, const usize *indices, usize indices_len) {
+  ASSERT(vertices_len != 0);
+  ASSERT((indices == NULL ? vertices_len : indices_len) % 3 == 0);
+  // The sphere around the center of the bounding box, not the smallest one but close enough for culling.
+  Vec3 min = vertices[0];
+  Vec3 max = vertices[0];
+  for (usize i = 1; i < vertices_len; ++i) {
+    for (usize j = 0; j < 3; ++j) {
+      min.get[j] = minf(min.get[j], vertices[i].get[j]);
+      max.get[j] = maxf(max.get[j], vertices[i].get[j]);
+    }
+  }
+  Aabb bounds = {min, max};
+  Vec3 center = aabb_center(bounds);
+  f32 radius = 0;
+  for (usize i = 0; i < vertices_len; ++i) {
+    radius = maxf(radius, abs3(sub3(vertices[i], center)));
+  }
+  return (Mesh){
+      .vertices = vertices,
+      .vertices_len = vertices_len,
+      .indices = indices,
+      .indices_len = indices_len,
+      .attributes = NULL,
+      .attributes_len = 0,
+      .center = center,
+      .radius = radius,
+      .bounds = bounds,
+  };
+}
+
+void mesh_set_attributes(Mesh *mesh, const f32 *attributes, usize attributes_len) {
+  ASSERT(attributes_len <= MAX_VERTEX_ATTRIBUTES);
+  ASSERT(attributes != NULL || attributes_len == 0);
+  mesh->attributes = attributes_len == 0 ? NULL : attributes;
+  mesh->attributes_len = attributes_len;
+}
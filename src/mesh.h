@@ -0,0 +1,88 @@
+#pragma once
+
+#include "common.h"
+#include "linear_alg.h"
+#include "math_helpers.h"
+
+/// Axis-aligned bounding box.
+typedef struct aabb {
+  Vec3 min;
+  Vec3 max;
+} Aabb;
+
+static inline Aabb aabb_union(Aabb x, Aabb y) {
+  return (Aabb){
+      .min = {{minf(x.min.get[0], y.min.get[0]), minf(x.min.get[1], y.min.get[1]), minf(x.min.get[2], y.min.get[2])}},
+      .max = {{maxf(x.max.get[0], y.max.get[0]), maxf(x.max.get[1], y.max.get[1]), maxf(x.max.get[2], y.max.get[2])}},
+  };
+}
+
+static inline Vec3 aabb_center(Aabb x) {
+  return (Vec3){{
+      (x.min.get[0] + x.max.get[0]) / 2,
+      (x.min.get[1] + x.max.get[1]) / 2,
+      (x.min.get[2] + x.max.get[2]) / 2,
+  }};
+}
+
+/// The bounding box of a transformed bounding box.
+static inline Aabb aabb_transform(Mat4x4 m, Aabb x) {
+  // Each corner coordinate of the result picks whichever end of each axis maps lower/higher (Arvo, Graphics Gems 1990).
+  Aabb result;
+  for (usize i = 0; i < 3; ++i) {
+    result.min.get[i] = m.get[i][3];
+    result.max.get[i] = m.get[i][3];
+    for (usize j = 0; j < 3; ++j) {
+      f32 a = m.get[i][j] * x.min.get[j];
+      f32 b = m.get[i][j] * x.max.get[j];
+      result.min.get[i] += minf(a, b);
+      result.max.get[i] += maxf(a, b);
+    }
+  }
+  return result;
+}
+
+/// Max number of attributes per vertex of a mesh, see `Mesh::attributes`.
+#define MAX_VERTEX_ATTRIBUTES 8
+
+/// Geometry that can be drawn many times over, see `draw_object_instanced`.
+/// Doesn't own the vertices, indices and attributes.
+typedef struct mesh {
+  const Vec3 *vertices;
+  usize vertices_len;
+  /// `NULL` for indexless meshes, where every 3 vertices make a triangle.
+  const usize *indices;
+  usize indices_len;
+  /// `attributes_len` values per vertex (e.g. color or texture coords), interpolated across the triangles and passed to
+  /// the draw pixel callback (see `Varyings`). `NULL` if the mesh has none, see `mesh_set_attributes`.
+  /// LEN: vertices_len * attributes_len.
+  const f32 *attributes;
+  usize attributes_len;
+  /// Center of the bounding sphere, in model space.
+  Vec3 center;
+  /// Radius of the bounding sphere, in model space.
+  f32 radius;
+  /// Bounding box, in model space.
+  Aabb bounds;
+} Mesh;
+
+/// `indices` may be `NULL` for indexless meshes, see `Mesh`.
+Mesh new_mesh(const Vec3 *vertices, usize vertices_len, const usize *indices, usize indices_len);
+
+/// Gives the vertices of a mesh `attributes_len` attributes each, at most `MAX_VERTEX_ATTRIBUTES`.
+void mesh_set_attributes(Mesh *mesh, const f32 *attributes, usize attributes_len);
+
+/// Number of triangles in a mesh.
+static inline usize mesh_triangles_len(const Mesh *mesh) {
+  return (mesh->indices == NULL ? mesh->vertices_len : mesh->indices_len) / 3;
+}
+
+/// One copy of a mesh in the scene.
+typedef struct instance {
+  /// Model matrix.
+  Mat4x4 m;
+  /// Light for this instance (see `Renderer::light`).
+  Vec3 light;
+  /// Light level of the surfaces facing away from the light.
+  u8 ambient;
+} Instance;
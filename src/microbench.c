@@ -0,0 +1,1219 @@
+// Micro-benchmarks of the building blocks of the renderer, for judging optimizations of them in isolation.
+//
+// Every benchmark runs a fixed number of operations per sample. After some warmup samples, it measures a number of
+// samples and reports the time and TSC cycles per operation (min, median, p99 and mean over the samples) as CSV.
+//
+// Usage: microbench [--samples N] [--warmup N] [--filter SUBSTRING]
+
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "common.h"
+#include "linear_alg.h"
+#include "linear_alg_simd.h"
+#include "triangle.h"
+#include "teapot.h"
+#include "cube.h"
+#include "mesh.h"
+#include "scene.h"
+#include "cmdbuf.h"
+#include "hierarchy.h"
+#include "lod.h"
+#include "occlusion.h"
+#include "demo.h"
+#include "render.h"
+#include "shaders.h"
+#include "texture.h"
+#include "dispatch.h"
+#include "shadow.h"
+#include "color.h"
+
+/// Number of distinct inputs each benchmark cycles through, small enough to stay in L1.
+#define INPUTS_LEN 256
+
+/// Width and height of the frame the `draw_triangle` benchmarks draw into.
+#define FRAME_SIZE 512
+
+/// Width and height of the texture of the `texture_sample_row` benchmarks, 16 MiB, more than the caches.
+#define TEXTURE_SIZE 4096
+
+/// Texels of level 0 per pixel of the `texture_sample_row` benchmarks, like a distant textured wall.
+#define TEXTURE_MINIFICATION 8
+
+/// Width and height of the shadow map of the shadow benchmarks.
+#define SHADOW_MAP_SIZE 1024
+
+typedef struct inputs {
+  Mat4x4 mats[INPUTS_LEN];
+  Vec4 vec4s[INPUTS_LEN];
+  Vec3 vec3s[INPUTS_LEN];
+  Mat4x4A mats_a[INPUTS_LEN];
+  Vec4A vec4s_a[INPUTS_LEN];
+  /// Points in [-2, 2], the same range as the vec3s, so that some of them are in the triangles made of those.
+  f32 xs[INPUTS_LEN];
+  f32 ys[INPUTS_LEN];
+} Inputs;
+
+/// State shared by all benchmarks.
+typedef struct microbench_cx {
+  Inputs inputs;
+  Renderer renderer;
+  /// Like `renderer`, with 4 and 8 samples per pixel (see `renderer_set_samples`).
+  Renderer msaa_renderers[2];
+  /// LEN: FRAME_SIZE * FRAME_SIZE, written by the draw pixel callback.
+  u8 *frame_buffer;
+  Mesh teapot_mesh;
+  LodChain teapot_lods;
+  Mesh cube_mesh;
+  /// A large grid of teapots, few of them on-screen.
+  Scene scene;
+  /// `wall` in front of layers of teapots.
+  Scene walled_scene;
+  Mat4x4 wall;
+  OcclusionBuffer occlusion;
+  /// A grid of still teapots around a spinning one, `dashboard_spinner`, which turns by a step every frame.
+  Scene dashboard;
+  usize dashboard_spinner;
+  f32 dashboard_angle;
+  /// LEN: FRAME_SIZE * FRAME_SIZE, the frame buffer shaded by the dashboard benchmarks.
+  u8 *shaded_buffer;
+  /// The grid of teapots of the instancing benchmarks, recorded once.
+  CommandBuffer teapots_cmdbuf;
+  /// `MICROBENCH_THREADS` threads.
+  CmdExecutor executor;
+  /// A root with `HIERARCHY_GROUPS` groups of `HIERARCHY_GROUP_LEN` nodes under it.
+  Hierarchy hierarchy;
+  /// `TEXTURE_SIZE` x `TEXTURE_SIZE` random texels.
+  Texture texture;
+  /// The texture coords of a frame of `FRAME_SIZE` x `FRAME_SIZE` pixels, a row at a time, with the texture minified
+  /// `TEXTURE_MINIFICATION` times.
+  /// LEN: FRAME_SIZE each.
+  f32 *texture_us;
+  f32 *texture_vs;
+  /// The mip level of the pixels, `texture_lod` of the minification.
+  f32 *texture_lods;
+  /// LEN: FRAME_SIZE.
+  u8 *samples;
+  /// The next row to sample, carried over between samples so that they don't all read the same part of the texture.
+  usize texture_row;
+  /// `SHADOW_MAP_SIZE` x `SHADOW_MAP_SIZE`, of the grid of teapots of the instancing benchmarks.
+  ShadowMap shadow;
+  /// The bounds of that grid.
+  Aabb teapot_grid_bounds;
+  /// Random colors and light levels of a frame, composed into `color_buffer` by the compose benchmarks.
+  /// LEN: FRAME_SIZE * FRAME_SIZE each.
+  Rgba8 *albedo_buffer;
+  u8 *levels;
+  Rgba8 *color_buffer;
+} MicrobenchCx;
+
+typedef struct microbench {
+  const char *name;
+  /// Operations per sample.
+  usize ops;
+  /// Called before every sample without being measured, may be NULL.
+  void (*setup)(MicrobenchCx *cx);
+  /// Runs `ops` operations and returns something derived from all the results.
+  f32 (*run)(MicrobenchCx *cx, usize ops);
+} Microbench;
+
+typedef struct microbench_options {
+  usize samples;
+  usize warmup;
+  /// Only run the benchmarks whose names contain this, if not NULL.
+  const char *filter;
+} MicrobenchOptions;
+
+/// Results are written here so that the compiler cannot optimize the benchmarked code away.
+static volatile f32 sink;
+
+/// Makes the compiler assume that everything `p` points to is read, so that stores to it cannot be optimized away.
+static inline void escape(void *p) {
+  __asm__ volatile("" : : "r"(p) : "memory");
+}
+
+static inline u64 now_ns() {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (u64)t.tv_sec * 1000000000 + (u64)t.tv_nsec;
+}
+
+/// Time stamp counter, which ticks at a constant rate regardless of frequency scaling. Always 0 on targets without one.
+static inline u64 now_cycles() {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return 0;
+#endif
+}
+
+static f32 random_f32() {
+  return (f32)rand() / (f32)RAND_MAX * 4.f - 2.f;
+}
+
+static void init_inputs(Inputs *inputs) {
+  srand(42);
+  for (usize i = 0; i < INPUTS_LEN; ++i) {
+    for (usize j = 0; j < 4; ++j) {
+      for (usize k = 0; k < 4; ++k) {
+        inputs->mats[i].get[j][k] = random_f32();
+      }
+      inputs->vec4s[i].get[j] = random_f32();
+    }
+    inputs->vec3s[i] = vec4to3(inputs->vec4s[i]);
+    inputs->mats_a[i] = mat4x4a(inputs->mats[i]);
+    inputs->vec4s_a[i] = vec4a(inputs->vec4s[i]);
+    inputs->xs[i] = random_f32();
+    inputs->ys[i] = random_f32();
+  }
+}
+
+static void microbench_draw_pixel_callback(void *cx,
+                                           usize width,
+                                           usize height,
+                                           usize x,
+                                           usize y,
+                                           f32 z,
+                                           u8 light_level,
+                                           u8 coverage,
+                                           const Varyings *varyings) {
+  u8 *frame_buffer = cx;
+  frame_buffer[y * width + x] = light_level;
+}
+
+DEF_DRAW_FUNCTIONS(microbench_, , microbench_draw_pixel_callback)
+
+static void microbench_draw_span_callback(void *cx,
+                                          usize width,
+                                          usize height,
+                                          usize y,
+                                          usize x_begin,
+                                          usize x_end,
+                                          const f32 *depths,
+                                          u8 light_level,
+                                          const u8 *coverage,
+                                          const Varyings *varyings) {
+  u8 *frame_buffer = cx;
+  memset(&frame_buffer[y * width + x_begin], light_level, x_end - x_begin);
+}
+
+DEF_DRAW_SPAN_FUNCTIONS(microbench_, _spans, microbench_draw_span_callback)
+
+/// Uses all the varyings, so that none of them is optimized out.
+static void microbench_varyings_draw_pixel_callback(void *cx,
+                                                    usize width,
+                                                    usize height,
+                                                    usize x,
+                                                    usize y,
+                                                    f32 z,
+                                                    u8 light_level,
+                                                    u8 coverage,
+                                                    const Varyings *varyings) {
+  u8 *frame_buffer = cx;
+  f32 sum = 0;
+  for (usize i = 0; i < varyings->len; ++i) {
+    sum += varyings->get[i];
+  }
+  frame_buffer[y * width + x] = (u8)(i32)sum;
+}
+
+DEF_DRAW_FUNCTIONS(microbench_varyings_, , microbench_varyings_draw_pixel_callback)
+
+// ---------------------------------------------------------------------------------------------------------------------
+// -------------------------------------------- linear_alg.h and SIMD --------------------------------------------------
+
+static f32 bench_mul4x4(MicrobenchCx *cx, usize ops) {
+  const Inputs *inputs = &cx->inputs;
+  f32 acc = 0;
+  for (usize i = 0; i < ops; ++i) {
+    Mat4x4 m = mul4x4(inputs->mats[i % INPUTS_LEN], inputs->mats[(i + 1) % INPUTS_LEN]);
+    acc += m.get[i % 4][(i / 4) % 4];
+  }
+  return acc;
+}
+
+static f32 bench_mul4x4a(MicrobenchCx *cx, usize ops) {
+  const Inputs *inputs = &cx->inputs;
+  f32 acc = 0;
+  for (usize i = 0; i < ops; ++i) {
+    Mat4x4A m = mul4x4a(&inputs->mats_a[i % INPUTS_LEN], &inputs->mats_a[(i + 1) % INPUTS_LEN]);
+    acc += m.get[i % 4][(i / 4) % 4];
+  }
+  return acc;
+}
+
+static f32 bench_mul4x4_4(MicrobenchCx *cx, usize ops) {
+  const Inputs *inputs = &cx->inputs;
+  f32 acc = 0;
+  for (usize i = 0; i < ops; ++i) {
+    Vec4 v = mul4x4_4(inputs->mats[i % INPUTS_LEN], inputs->vec4s[(i + 1) % INPUTS_LEN]);
+    acc += v.get[i % 4];
+  }
+  return acc;
+}
+
+static f32 bench_mul4x4a_4(MicrobenchCx *cx, usize ops) {
+  const Inputs *inputs = &cx->inputs;
+  f32 acc = 0;
+  for (usize i = 0; i < ops; ++i) {
+    Vec4A v = mul4x4a_4(&inputs->mats_a[i % INPUTS_LEN], inputs->vec4s_a[(i + 1) % INPUTS_LEN]);
+    acc += v.get[i % 4];
+  }
+  return acc;
+}
+
+static f32 bench_cross3(MicrobenchCx *cx, usize ops) {
+  const Inputs *inputs = &cx->inputs;
+  f32 acc = 0;
+  for (usize i = 0; i < ops; ++i) {
+    Vec3 v = cross3(inputs->vec3s[i % INPUTS_LEN], inputs->vec3s[(i + 1) % INPUTS_LEN]);
+    acc += v.get[i % 3];
+  }
+  return acc;
+}
+
+static f32 bench_cross3a(MicrobenchCx *cx, usize ops) {
+  const Inputs *inputs = &cx->inputs;
+  f32 acc = 0;
+  for (usize i = 0; i < ops; ++i) {
+    Vec4A v = cross3a(inputs->vec4s_a[i % INPUTS_LEN], inputs->vec4s_a[(i + 1) % INPUTS_LEN]);
+    acc += v.get[i % 3];
+  }
+  return acc;
+}
+
+static f32 bench_dot3(MicrobenchCx *cx, usize ops) {
+  const Inputs *inputs = &cx->inputs;
+  f32 acc = 0;
+  for (usize i = 0; i < ops; ++i) {
+    acc += dot3(inputs->vec3s[i % INPUTS_LEN], inputs->vec3s[(i + 1) % INPUTS_LEN]);
+  }
+  return acc;
+}
+
+static f32 bench_dot3a(MicrobenchCx *cx, usize ops) {
+  const Inputs *inputs = &cx->inputs;
+  f32 acc = 0;
+  for (usize i = 0; i < ops; ++i) {
+    acc += dot3a(inputs->vec4s_a[i % INPUTS_LEN], inputs->vec4s_a[(i + 1) % INPUTS_LEN]);
+  }
+  return acc;
+}
+
+/// One `mul4x4_4` per vector, over the whole input array at a time.
+static f32 bench_transform_array(MicrobenchCx *cx, usize ops) {
+  const Inputs *inputs = &cx->inputs;
+  Vec4 out[INPUTS_LEN];
+  f32 acc = 0;
+  for (usize i = 0; i < ops; i += INPUTS_LEN) {
+    Mat4x4 m = inputs->mats[(i / INPUTS_LEN) % INPUTS_LEN];
+    for (usize j = 0; j < INPUTS_LEN; ++j) {
+      out[j] = mul4x4_4(m, inputs->vec4s[j]);
+    }
+    escape(out);
+    acc += out[(i / INPUTS_LEN) % INPUTS_LEN].get[0];
+  }
+  return acc;
+}
+
+static f32 bench_mul4x4a_4_batch(MicrobenchCx *cx, usize ops) {
+  const Inputs *inputs = &cx->inputs;
+  Vec4A out[INPUTS_LEN];
+  f32 acc = 0;
+  for (usize i = 0; i < ops; i += INPUTS_LEN) {
+    mul4x4a_4_batch(&inputs->mats_a[(i / INPUTS_LEN) % INPUTS_LEN], inputs->vec4s_a, out, INPUTS_LEN);
+    escape(out);
+    acc += out[(i / INPUTS_LEN) % INPUTS_LEN].get[0];
+  }
+  return acc;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+// --------------------------------------------- Parts of the rasterizer -----------------------------------------------
+
+static f32 bench_transform(MicrobenchCx *cx, usize ops) {
+  const Inputs *inputs = &cx->inputs;
+  f32 acc = 0;
+  for (usize i = 0; i < ops; ++i) {
+    Vec3 v = transform(inputs->mats[i % INPUTS_LEN], inputs->vec3s[(i + 1) % INPUTS_LEN]);
+    acc += v.get[i % 3];
+  }
+  return acc;
+}
+
+static f32 bench_surface_light_level(MicrobenchCx *cx, usize ops) {
+  const Inputs *inputs = &cx->inputs;
+  u32 acc = 0;
+  for (usize i = 0; i < ops; ++i) {
+    acc += surface_light_level(inputs->vec3s[i % INPUTS_LEN], inputs->vec3s[(i + 1) % INPUTS_LEN], 20);
+  }
+  return (f32)acc;
+}
+
+static f32 bench_triangular_interpolate_z(MicrobenchCx *cx, usize ops) {
+  const Inputs *inputs = &cx->inputs;
+  f32 acc = 0;
+  for (usize i = 0; i < ops; ++i) {
+    f32 z = triangular_interpolate_z(inputs->vec3s[i % INPUTS_LEN],
+                                     inputs->vec3s[(i + 1) % INPUTS_LEN],
+                                     inputs->vec3s[(i + 2) % INPUTS_LEN],
+                                     inputs->xs[i % INPUTS_LEN],
+                                     inputs->ys[i % INPUTS_LEN]);
+    acc += z == INFINITY ? 1.f : z;
+  }
+  return acc;
+}
+
+/// `nabla_depth` is internal to shaders.c, `shader_highlight_only` is nothing but a call to it.
+static f32 bench_nabla_depth(MicrobenchCx *cx, usize ops) {
+  const Renderer *renderer = &cx->renderer;
+  u32 acc = 0;
+  for (usize i = 0; i < ops; ++i) {
+    usize x = i % renderer->width;
+    usize y = (i / renderer->width) % renderer->height;
+    acc += shader_highlight_only(renderer->width, renderer->height, renderer->stride, x, y, 0, renderer->depth_buffer);
+  }
+  return (f32)acc;
+}
+
+/// A depth buffer with edges in it, for `nabla_depth`.
+static void setup_checkerboard_depth(MicrobenchCx *cx) {
+  Renderer *renderer = &cx->renderer;
+  for (usize y = 0; y < renderer->height; ++y) {
+    for (usize x = 0; x < renderer->width; ++x) {
+      bool is_white = (x / 16 + y / 16) % 2 == 0;
+      renderer->depth_buffer[y * renderer->stride + x] = is_white ? 9.f : 10.f;
+    }
+  }
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ------------------------------------------------- draw_triangle -----------------------------------------------------
+
+static void setup_clear_frame(MicrobenchCx *cx) {
+  renderer_clear_frame(&cx->renderer);
+}
+
+static void setup_clear_msaa_frames(MicrobenchCx *cx) {
+  for (usize i = 0; i < ARR_LEN(cx->msaa_renderers); ++i) {
+    renderer_clear_frame(&cx->msaa_renderers[i]);
+  }
+}
+
+/// A point that projects to (x, y) in camera coords.
+static inline Vec3 cam_point(f32 x, f32 y) {
+  // The camera looks in negative X direction, so camera coords X and Y are world Y and Z.
+  return (Vec3){{0, x, y}};
+}
+
+/// Draws the triangle `ops` times with `draw_triangle`, each time slightly closer to the camera than the last so that
+/// every pixel of it passes the depth test, as with the worst case of overdraw.
+static f32 bench_draw_triangle_with(MicrobenchCx *cx,
+                                    usize ops,
+                                    Vec3 p0,
+                                    Vec3 p1,
+                                    Vec3 p2,
+                                    void (*draw_triangle)(Renderer *, Vec3, Vec3, Vec3, Mat4x4)) {
+  Renderer *renderer = &cx->renderer;
+  // Over the `ops` draws the triangle moves 1 unit towards the camera.
+  f32 step = 1.f / (f32)ops;
+  for (usize i = 0; i < ops; ++i) {
+    Mat4x4 m = translate3d((Vec3){{(f32)i * step, 0, 0}});
+    draw_triangle(renderer, p0, p1, p2, m);
+  }
+  escape(cx->frame_buffer);
+  return renderer->depth_buffer[0];
+}
+
+/// `bench_draw_triangle_with` the per-pixel callback.
+static f32 bench_draw_triangle(MicrobenchCx *cx, usize ops, Vec3 p0, Vec3 p1, Vec3 p2) {
+  return bench_draw_triangle_with(cx, ops, p0, p1, p2, microbench_draw_triangle);
+}
+
+/// Size of a pixel in camera coords.
+#define PX (4.f / (f32)FRAME_SIZE)
+
+static f32 bench_draw_triangle_1px(MicrobenchCx *cx, usize ops) {
+  return bench_draw_triangle(cx, ops, cam_point(0, 0), cam_point(PX, 0), cam_point(0, PX));
+}
+
+static f32 bench_draw_triangle_10px(MicrobenchCx *cx, usize ops) {
+  return bench_draw_triangle(cx, ops, cam_point(0, 0), cam_point(10 * PX, 0), cam_point(0, 10 * PX));
+}
+
+static f32 bench_draw_triangle_100px(MicrobenchCx *cx, usize ops) {
+  return bench_draw_triangle(cx, ops, cam_point(-1, -1), cam_point(-1 + 100 * PX, -1), cam_point(-1, -1 + 100 * PX));
+}
+
+/// Covers the whole frame.
+static f32 bench_draw_triangle_full_screen(MicrobenchCx *cx, usize ops) {
+  return bench_draw_triangle(cx, ops, cam_point(-2, -2), cam_point(6, -2), cam_point(-2, 6));
+}
+
+static f32 bench_draw_triangle_100px_spans(MicrobenchCx *cx, usize ops) {
+  return bench_draw_triangle_with(cx,
+                                  ops,
+                                  cam_point(-1, -1),
+                                  cam_point(-1 + 100 * PX, -1),
+                                  cam_point(-1, -1 + 100 * PX),
+                                  microbench_draw_triangle_spans);
+}
+
+static f32 bench_draw_triangle_full_screen_spans(MicrobenchCx *cx, usize ops) {
+  return bench_draw_triangle_with(
+      cx, ops, cam_point(-2, -2), cam_point(6, -2), cam_point(-2, 6), microbench_draw_triangle_spans);
+}
+
+/// Long and thin along the diagonal, so that its bounding box is almost the whole frame but it covers few pixels.
+static f32 bench_draw_triangle_sliver(MicrobenchCx *cx, usize ops) {
+  return bench_draw_triangle(cx, ops, cam_point(-1.9f, -1.9f), cam_point(1.9f, 1.9f), cam_point(-1.9f + 2 * PX, -1.9f));
+}
+
+/// Like `bench_draw_triangle_100px`, with multisampling, `msaa_renderers[i]`.
+static f32 bench_draw_triangle_msaa(MicrobenchCx *cx, usize ops, usize i) {
+  Renderer *renderer = &cx->msaa_renderers[i];
+  f32 step = 1.f / (f32)ops;
+  for (usize j = 0; j < ops; ++j) {
+    Mat4x4 m = translate3d((Vec3){{(f32)j * step, 0, 0}});
+    microbench_draw_triangle(
+        renderer, cam_point(-1, -1), cam_point(-1 + 100 * PX, -1), cam_point(-1, -1 + 100 * PX), m);
+  }
+  escape(cx->frame_buffer);
+  return renderer->depth_buffer[0];
+}
+
+static f32 bench_draw_triangle_100px_msaa4(MicrobenchCx *cx, usize ops) {
+  return bench_draw_triangle_msaa(cx, ops, 0);
+}
+
+static f32 bench_draw_triangle_100px_msaa8(MicrobenchCx *cx, usize ops) {
+  return bench_draw_triangle_msaa(cx, ops, 1);
+}
+
+/// Like `bench_draw_triangle_100px`, with `len` attributes per vertex.
+static f32 bench_draw_triangle_varyings(MicrobenchCx *cx, usize ops, usize len) {
+  Renderer *renderer = &cx->renderer;
+  f32 attributes[3 * MAX_VERTEX_ATTRIBUTES];
+  for (usize i = 0; i < 3 * len; ++i) {
+    attributes[i] = (f32)(i * 7 % 11);
+  }
+  f32 step = 1.f / (f32)ops;
+  for (usize i = 0; i < ops; ++i) {
+    Mat4x4 m = translate3d((Vec3){{(f32)i * step, 0, 0}});
+    ProjectedTriangle triangle = project_triangle(
+        renderer, cam_point(-1, -1), cam_point(-1 + 100 * PX, -1), cam_point(-1, -1 + 100 * PX), m);
+    triangle_set_attributes(&triangle, attributes, len, 0, 1, 2);
+    microbench_varyings_rasterize_triangle(renderer, triangle);
+  }
+  escape(cx->frame_buffer);
+  return renderer->depth_buffer[0];
+}
+
+static f32 bench_draw_triangle_100px_4_varyings(MicrobenchCx *cx, usize ops) {
+  return bench_draw_triangle_varyings(cx, ops, 4);
+}
+
+static f32 bench_draw_triangle_100px_8_varyings(MicrobenchCx *cx, usize ops) {
+  return bench_draw_triangle_varyings(cx, ops, MAX_VERTEX_ATTRIBUTES);
+}
+
+#undef PX
+
+/// Side of the grid of teapots of the instancing benchmarks, about half of them are on-screen.
+#define TEAPOT_GRID_SIZE 8
+#define TEAPOT_GRID_LEN (TEAPOT_GRID_SIZE * TEAPOT_GRID_SIZE)
+
+/// Instance `i` of the grid of small teapots.
+static Instance teapot_grid_instance(const Renderer *renderer, usize i) {
+  f32 y = (f32)(i % TEAPOT_GRID_SIZE) - 3.5f;
+  f32 z = (f32)(i / TEAPOT_GRID_SIZE) - 3.5f;
+  Mat4x4 m = mul4x4(demo_rotation((f32)i), demo_base_transform());
+  m = mul4x4(scale3d((Vec3){{0.25f, 0.25f, 0.25f}}), m);
+  m = mul4x4(translate3d((Vec3){{0, y, z}}), m);
+  return new_instance(renderer, m);
+}
+
+/// The grid of teapots, one `draw_object_indexless` per teapot.
+static f32 bench_draw_teapots(MicrobenchCx *cx, usize ops) {
+  for (usize i = 0; i < ops; ++i) {
+    Instance instance = teapot_grid_instance(&cx->renderer, i % TEAPOT_GRID_LEN);
+    microbench_draw_object_indexless(&cx->renderer, ARR_ARG(teapot), instance.m);
+  }
+  escape(cx->frame_buffer);
+  return cx->renderer.depth_buffer[0];
+}
+
+/// The grid of teapots, one `draw_object_instanced` for all of them.
+static f32 bench_draw_teapots_instanced(MicrobenchCx *cx, usize ops) {
+  Instance instances[TEAPOT_GRID_LEN];
+  ASSERT(ops <= ARR_LEN(instances));
+  for (usize i = 0; i < ops; ++i) {
+    instances[i] = teapot_grid_instance(&cx->renderer, i);
+  }
+  microbench_draw_object_instanced(&cx->renderer, &cx->teapot_mesh, instances, ops);
+  escape(cx->frame_buffer);
+  return cx->renderer.depth_buffer[0];
+}
+
+/// The grid of teapots, depth only, like for the shadow map or the occlusion buffer.
+static f32 bench_draw_teapots_depth_only(MicrobenchCx *cx, usize ops) {
+  Instance instances[TEAPOT_GRID_LEN];
+  ASSERT(ops <= ARR_LEN(instances));
+  for (usize i = 0; i < ops; ++i) {
+    instances[i] = teapot_grid_instance(&cx->renderer, i);
+  }
+  draw_object_depth_only(&cx->renderer, &cx->teapot_mesh, instances, ops);
+  return cx->renderer.depth_buffer[0];
+}
+
+/// Threads of `MicrobenchCx::executor`.
+#define MICROBENCH_THREADS 4
+
+static void init_teapots_cmdbuf(MicrobenchCx *cx) {
+  cx->teapots_cmdbuf = new_command_buffer();
+  for (usize i = 0; i < TEAPOT_GRID_LEN; ++i) {
+    cmdbuf_draw(&cx->teapots_cmdbuf, &cx->teapot_mesh, teapot_grid_instance(&cx->renderer, i));
+  }
+  cx->executor = new_cmd_executor(MICROBENCH_THREADS);
+}
+
+/// The grid of teapots, submitted from a command buffer recorded once, on the calling thread.
+static f32 bench_submit_teapots(MicrobenchCx *cx, usize ops) {
+  for (usize i = 0; i < ops; ++i) {
+    cmdbuf_submit(&cx->renderer, &cx->teapots_cmdbuf, CMD_SORT_FRONT_TO_BACK, NULL, microbench_rasterize_triangle);
+  }
+  escape(cx->frame_buffer);
+  return cx->renderer.depth_buffer[0];
+}
+
+/// The grid of teapots, submitted from a command buffer recorded once, split between threads.
+static f32 bench_submit_teapots_threads(MicrobenchCx *cx, usize ops) {
+  for (usize i = 0; i < ops; ++i) {
+    cmdbuf_submit(
+        &cx->renderer, &cx->teapots_cmdbuf, CMD_SORT_FRONT_TO_BACK, &cx->executor, microbench_rasterize_triangle);
+  }
+  escape(cx->frame_buffer);
+  return cx->renderer.depth_buffer[0];
+}
+
+/// Side of the grid of far away teapots, about 10 pixels across each.
+#define SMALL_TEAPOT_GRID_SIZE 16
+#define SMALL_TEAPOT_GRID_LEN (SMALL_TEAPOT_GRID_SIZE * SMALL_TEAPOT_GRID_SIZE)
+
+/// Instance `i` of the grid of far away teapots.
+static Instance small_teapot_grid_instance(const Renderer *renderer, usize i) {
+  f32 y = ((f32)(i % SMALL_TEAPOT_GRID_SIZE) - 7.5f) * 0.25f;
+  f32 z = ((f32)(i / SMALL_TEAPOT_GRID_SIZE) - 7.5f) * 0.25f;
+  Mat4x4 m = mul4x4(demo_rotation((f32)i), demo_base_transform());
+  m = mul4x4(scale3d((Vec3){{0.05f, 0.05f, 0.05f}}), m);
+  m = mul4x4(translate3d((Vec3){{0, y, z}}), m);
+  return new_instance(renderer, m);
+}
+
+/// The grid of far away teapots, drawn with all their triangles.
+static f32 bench_draw_small_teapots(MicrobenchCx *cx, usize ops) {
+  for (usize i = 0; i < ops; ++i) {
+    Instance instance = small_teapot_grid_instance(&cx->renderer, i % SMALL_TEAPOT_GRID_LEN);
+    microbench_draw_object_instanced(&cx->renderer, &cx->teapot_mesh, &instance, 1);
+  }
+  escape(cx->frame_buffer);
+  return cx->renderer.depth_buffer[0];
+}
+
+/// The grid of far away teapots, each drawn at the level of detail that fits its size.
+static f32 bench_draw_lod_teapots(MicrobenchCx *cx, usize ops) {
+  for (usize i = 0; i < ops; ++i) {
+    Instance instance = small_teapot_grid_instance(&cx->renderer, i % SMALL_TEAPOT_GRID_LEN);
+    usize lod = lod_select(&cx->teapot_lods, &cx->renderer, instance.m, 0);
+    microbench_draw_object_instanced(&cx->renderer, &cx->teapot_lods.levels[lod].mesh, &instance, 1);
+  }
+  escape(cx->frame_buffer);
+  return cx->renderer.depth_buffer[0];
+}
+
+/// Layers of `WALLED_GRID_SIZE` x `WALLED_GRID_SIZE` teapots in `MicrobenchCx::walled_scene`, all hidden by the wall.
+#define WALLED_LAYERS 4
+#define WALLED_GRID_SIZE 4
+
+static void init_walled_scene(MicrobenchCx *cx) {
+  cx->walled_scene = new_scene();
+  cx->wall = mul4x4(translate3d((Vec3){{3, 0, 0}}), scale3d((Vec3){{0.2f, 1.8f, 1.8f}}));
+  scene_add_object(&cx->walled_scene, &cx->cube_mesh, new_instance(&cx->renderer, cx->wall));
+  for (usize i = 0; i < WALLED_LAYERS * WALLED_GRID_SIZE * WALLED_GRID_SIZE; ++i) {
+    f32 x = -(f32)(i / (WALLED_GRID_SIZE * WALLED_GRID_SIZE));
+    f32 y = ((f32)(i % WALLED_GRID_SIZE) - 1.5f) * 0.8f;
+    f32 z = ((f32)(i / WALLED_GRID_SIZE % WALLED_GRID_SIZE) - 1.5f) * 0.8f;
+    Mat4x4 m = mul4x4(demo_rotation((f32)i), demo_base_transform());
+    m = mul4x4(scale3d((Vec3){{0.2f, 0.2f, 0.2f}}), m);
+    m = mul4x4(translate3d((Vec3){{x, y, z}}), m);
+    scene_add_object(&cx->walled_scene, &cx->teapot_mesh, new_instance(&cx->renderer, m));
+  }
+  scene_update(&cx->walled_scene);
+  cx->occlusion = new_occlusion_buffer(&cx->renderer);
+}
+
+/// The wall and the teapots behind it, drawing the hidden teapots too.
+static f32 bench_draw_walled_scene(MicrobenchCx *cx, usize ops) {
+  for (usize i = 0; i < ops; ++i) {
+    draw_scene(&cx->renderer, &cx->walled_scene, NULL, microbench_rasterize_triangle);
+  }
+  escape(cx->frame_buffer);
+  return cx->renderer.depth_buffer[0];
+}
+
+/// The wall and the teapots behind it, skipping the hidden teapots.
+static f32 bench_draw_walled_scene_occlusion(MicrobenchCx *cx, usize ops) {
+  for (usize i = 0; i < ops; ++i) {
+    occlusion_begin(&cx->occlusion, &cx->renderer);
+    occlusion_add_occluder(&cx->occlusion, &cx->cube_mesh, cx->wall);
+    occlusion_finish(&cx->occlusion);
+    draw_scene(&cx->renderer, &cx->walled_scene, &cx->occlusion, microbench_rasterize_triangle);
+  }
+  escape(cx->frame_buffer);
+  return cx->renderer.depth_buffer[0];
+}
+
+/// Side of the grid of teapots of `MicrobenchCx::dashboard`, the one in the middle spins.
+#define DASHBOARD_GRID_SIZE 3
+
+static Mat4x4 dashboard_transform(usize i, f32 angle) {
+  f32 y = ((f32)(i % DASHBOARD_GRID_SIZE) - (DASHBOARD_GRID_SIZE - 1) / 2.f) * 1.2f;
+  f32 z = ((f32)(i / DASHBOARD_GRID_SIZE) - (DASHBOARD_GRID_SIZE - 1) / 2.f) * 1.2f;
+  Mat4x4 m = mul4x4(demo_rotation(angle), demo_base_transform());
+  m = mul4x4(scale3d((Vec3){{0.35f, 0.35f, 0.35f}}), m);
+  return mul4x4(translate3d((Vec3){{0, y, z}}), m);
+}
+
+static void init_dashboard(MicrobenchCx *cx) {
+  cx->dashboard = new_scene();
+  for (usize i = 0; i < DASHBOARD_GRID_SIZE * DASHBOARD_GRID_SIZE; ++i) {
+    Mat4x4 m = dashboard_transform(i, (f32)i);
+    scene_add_object(&cx->dashboard, &cx->teapot_mesh, new_instance(&cx->renderer, m));
+  }
+  cx->dashboard_spinner = DASHBOARD_GRID_SIZE * DASHBOARD_GRID_SIZE / 2;
+  cx->dashboard_angle = 0;
+  cx->shaded_buffer = xalloc(u8, FRAME_SIZE * FRAME_SIZE);
+}
+
+/// Draws and shades the frame of the dashboard that's on screen, the frames are redrawn on top of it.
+static void dashboard_frame(MicrobenchCx *cx, bool dirty) {
+  Renderer *renderer = &cx->renderer;
+  ScreenRect full = {0, 0, FRAME_SIZE, FRAME_SIZE};
+  cx->dashboard_angle += 0.05f;
+  Mat4x4 m = dashboard_transform(cx->dashboard_spinner, cx->dashboard_angle);
+  scene_set_transform(&cx->dashboard, cx->dashboard_spinner, m);
+  ScreenRect dirty_rect = scene_dirty_rect(&cx->dashboard, renderer);
+  ScreenRect rect = dirty ? dirty_rect : full;
+  renderer->scissor = rect;
+  renderer_clear_frame(renderer);
+  for (usize y = rect.min_y; y < rect.max_y; ++y) {
+    memset(&cx->frame_buffer[y * FRAME_SIZE + rect.min_x], 0, rect.max_x - rect.min_x);
+  }
+  draw_scene(renderer, &cx->dashboard, NULL, microbench_rasterize_triangle);
+  ScreenRect shaded = shader_dirty_rect(SHADER_KIND_HIGHLIGHTED, FRAME_SIZE, FRAME_SIZE, rect);
+  apply_shader_rect(SHADER_KIND_HIGHLIGHTED,
+                    FRAME_SIZE,
+                    FRAME_SIZE,
+                    shaded,
+                    cx->frame_buffer,
+                    FRAME_SIZE,
+                    renderer->depth_buffer,
+                    renderer->stride,
+                    cx->shaded_buffer,
+                    FRAME_SIZE);
+  renderer->scissor = full;
+}
+
+static void setup_dashboard(MicrobenchCx *cx) {
+  dashboard_frame(cx, false);
+}
+
+/// Frames of the dashboard with the spinning teapot, cleared, drawn and shaded whole.
+static f32 bench_dashboard_full(MicrobenchCx *cx, usize ops) {
+  for (usize i = 0; i < ops; ++i) {
+    dashboard_frame(cx, false);
+  }
+  escape(cx->shaded_buffer);
+  return cx->renderer.depth_buffer[0];
+}
+
+/// Frames of the dashboard with the spinning teapot, only redrawing where it was and is (see `scene_dirty_rect`).
+static f32 bench_dashboard_dirty(MicrobenchCx *cx, usize ops) {
+  for (usize i = 0; i < ops; ++i) {
+    dashboard_frame(cx, true);
+  }
+  escape(cx->shaded_buffer);
+  return cx->renderer.depth_buffer[0];
+}
+
+/// Side of the grid of teapots in `MicrobenchCx::scene`, about 0.1% of them are on-screen.
+#define SCENE_GRID_SIZE 128
+
+static void init_scene(MicrobenchCx *cx) {
+  cx->scene = new_scene();
+  for (usize i = 0; i < SCENE_GRID_SIZE * SCENE_GRID_SIZE; ++i) {
+    f32 y = ((f32)(i % SCENE_GRID_SIZE) - SCENE_GRID_SIZE / 2) * 1.5f;
+    f32 z = ((f32)(i / SCENE_GRID_SIZE) - SCENE_GRID_SIZE / 2) * 1.5f;
+    Mat4x4 m = mul4x4(translate3d((Vec3){{0, y, z}}), scale3d((Vec3){{0.5f, 0.5f, 0.5f}}));
+    scene_add_object(&cx->scene, &cx->teapot_mesh, new_instance(&cx->renderer, m));
+  }
+  scene_update(&cx->scene);
+}
+
+static f32 bench_scene_cull(MicrobenchCx *cx, usize ops) {
+  usize visible = 0;
+  for (usize i = 0; i < ops; ++i) {
+    visible += scene_cull(&cx->scene, &cx->renderer);
+  }
+  return (f32)visible;
+}
+
+/// What `scene_cull` replaces, testing every object.
+static f32 bench_scene_cull_brute_force(MicrobenchCx *cx, usize ops) {
+  usize visible = 0;
+  for (usize i = 0; i < ops; ++i) {
+    Mat4x4 world_to_camera = world_to_camera_matrix(&cx->renderer);
+    for (usize j = 0; j < cx->scene.objects_len; ++j) {
+      visible += aabb_maybe_visible(&cx->renderer, &world_to_camera, cx->scene.objects[j].bounds);
+    }
+  }
+  return (f32)visible;
+}
+
+/// Moves 1% of the objects of the scene back and forth, then refits.
+static f32 bench_scene_refit(MicrobenchCx *cx, usize ops) {
+  Scene *scene = &cx->scene;
+  for (usize i = 0; i < ops; ++i) {
+    f32 dx = i % 2 == 0 ? 0.1f : -0.1f;
+    for (usize j = 0; j < scene->objects_len; j += 100) {
+      scene_set_transform(scene, j, mul4x4(translate3d((Vec3){{dx, 0, 0}}), scene->objects[j].instance.m));
+    }
+    scene_update(scene);
+  }
+  return scene->nodes[0].bounds.max.get[0];
+}
+
+#define HIERARCHY_GROUPS 100
+#define HIERARCHY_GROUP_LEN 100
+
+static void init_hierarchy(MicrobenchCx *cx) {
+  cx->hierarchy = new_hierarchy();
+  usize root = hierarchy_add(&cx->hierarchy, HIERARCHY_NO_PARENT, demo_base_transform());
+  for (usize i = 0; i < HIERARCHY_GROUPS; ++i) {
+    usize group = hierarchy_add(&cx->hierarchy, root, translate3d((Vec3){{0, (f32)i, 0}}));
+    for (usize j = 1; j < HIERARCHY_GROUP_LEN; ++j) {
+      hierarchy_add(&cx->hierarchy, group, demo_rotation((f32)j));
+    }
+  }
+  hierarchy_update(&cx->hierarchy);
+}
+
+/// Nothing moved, should cost no matrix multiplication.
+static f32 bench_hierarchy_static(MicrobenchCx *cx, usize ops) {
+  usize updated = 0;
+  for (usize i = 0; i < ops; ++i) {
+    updated += hierarchy_update(&cx->hierarchy);
+  }
+  return (f32)updated;
+}
+
+/// One group moved, recomputes 1% of the nodes.
+static f32 bench_hierarchy_group_moved(MicrobenchCx *cx, usize ops) {
+  usize updated = 0;
+  for (usize i = 0; i < ops; ++i) {
+    hierarchy_set_local(&cx->hierarchy, 1, translate3d((Vec3){{0, (f32)(i % 2), 0}}));
+    updated += hierarchy_update(&cx->hierarchy);
+  }
+  return (f32)updated;
+}
+
+/// The root moved, recomputes every node.
+static f32 bench_hierarchy_root_moved(MicrobenchCx *cx, usize ops) {
+  usize updated = 0;
+  for (usize i = 0; i < ops; ++i) {
+    hierarchy_set_local(&cx->hierarchy, 0, demo_rotation((f32)i));
+    updated += hierarchy_update(&cx->hierarchy);
+  }
+  return (f32)updated;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ------------------------------------------------------ shadow -------------------------------------------------------
+
+static void init_shadow(MicrobenchCx *cx) {
+  cx->shadow = new_shadow_map(SHADOW_MAP_SIZE);
+  cx->teapot_grid_bounds = aabb_transform(teapot_grid_instance(&cx->renderer, 0).m, cx->teapot_mesh.bounds);
+  for (usize i = 1; i < TEAPOT_GRID_LEN; ++i) {
+    Aabb bounds = aabb_transform(teapot_grid_instance(&cx->renderer, i).m, cx->teapot_mesh.bounds);
+    cx->teapot_grid_bounds = aabb_union(cx->teapot_grid_bounds, bounds);
+  }
+}
+
+/// The shadow map of the grid of teapots, cast on themselves.
+static void draw_teapots_shadow_map(MicrobenchCx *cx) {
+  shadow_map_begin(&cx->shadow, cx->renderer.light, cx->teapot_grid_bounds);
+  for (usize i = 0; i < TEAPOT_GRID_LEN; ++i) {
+    shadow_map_add_caster(&cx->shadow, &cx->teapot_mesh, teapot_grid_instance(&cx->renderer, i).m);
+  }
+}
+
+/// A frame of the grid of teapots and its shadow map, to darken.
+static void setup_teapots_shadow(MicrobenchCx *cx) {
+  setup_clear_frame(cx);
+  Instance instances[TEAPOT_GRID_LEN];
+  for (usize i = 0; i < TEAPOT_GRID_LEN; ++i) {
+    instances[i] = teapot_grid_instance(&cx->renderer, i);
+  }
+  microbench_draw_object_instanced(&cx->renderer, &cx->teapot_mesh, instances, TEAPOT_GRID_LEN);
+  draw_teapots_shadow_map(cx);
+}
+
+static f32 bench_shadow_map_teapots(MicrobenchCx *cx, usize ops) {
+  for (usize i = 0; i < ops; ++i) {
+    draw_teapots_shadow_map(cx);
+  }
+  return cx->shadow.renderer.depth_buffer[0];
+}
+
+static f32 bench_shadow_map_resolve(MicrobenchCx *cx, usize ops, ShadowFilter filter) {
+  for (usize i = 0; i < ops; ++i) {
+    shadow_map_resolve(&cx->shadow, &cx->renderer, filter, cx->frame_buffer, FRAME_SIZE, RENDER_LAYOUT_LINEAR);
+  }
+  escape(cx->frame_buffer);
+  return (f32)cx->frame_buffer[FRAME_SIZE * FRAME_SIZE / 2 + FRAME_SIZE / 2];
+}
+
+static f32 bench_shadow_map_resolve_hard(MicrobenchCx *cx, usize ops) {
+  return bench_shadow_map_resolve(cx, ops, SHADOW_FILTER_HARD);
+}
+
+static f32 bench_shadow_map_resolve_pcf2x2(MicrobenchCx *cx, usize ops) {
+  return bench_shadow_map_resolve(cx, ops, SHADOW_FILTER_PCF_2X2);
+}
+
+static f32 bench_shadow_map_resolve_pcf3x3(MicrobenchCx *cx, usize ops) {
+  return bench_shadow_map_resolve(cx, ops, SHADOW_FILTER_PCF_3X3);
+}
+
+static f32 bench_shadow_map_resolve_pcf4x4(MicrobenchCx *cx, usize ops) {
+  return bench_shadow_map_resolve(cx, ops, SHADOW_FILTER_PCF_4X4);
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ----------------------------------------------------- texture -------------------------------------------------------
+
+static void init_texture(MicrobenchCx *cx) {
+  u8 *texels = xalloc(u8, TEXTURE_SIZE * TEXTURE_SIZE);
+  for (usize i = 0; i < TEXTURE_SIZE * TEXTURE_SIZE; ++i) {
+    texels[i] = (u8)(rand() % 256);
+  }
+  cx->texture = new_texture(texels, TEXTURE_SIZE, TEXTURE_SIZE);
+  xfree(texels);
+  cx->texture_us = xalloc(f32, FRAME_SIZE);
+  cx->texture_vs = xalloc(f32, FRAME_SIZE);
+  cx->texture_lods = xalloc(f32, FRAME_SIZE);
+  cx->samples = xalloc(u8, FRAME_SIZE);
+  cx->texture_row = 0;
+  f32 step = (f32)TEXTURE_MINIFICATION / TEXTURE_SIZE;
+  f32 lod = texture_lod(&cx->texture, step, 0, 0, step);
+  for (usize x = 0; x < FRAME_SIZE; ++x) {
+    cx->texture_us[x] = (f32)x * step;
+    cx->texture_lods[x] = lod;
+  }
+}
+
+/// Samples the frame a row at a time, with the mip levels `lods` for every row.
+static f32 bench_texture_sample(MicrobenchCx *cx, usize ops, TextureFilter filter, const f32 *lods) {
+  u32 acc = 0;
+  f32 step = (f32)TEXTURE_MINIFICATION / TEXTURE_SIZE;
+  for (usize i = 0; i < ops; ++i) {
+    usize row = cx->texture_row++ % FRAME_SIZE;
+    f32 v = (f32)row * step;
+    for (usize x = 0; x < FRAME_SIZE; ++x) {
+      cx->texture_vs[x] = v;
+    }
+    kernels.texture_sample_row(&cx->texture, filter, cx->texture_us, cx->texture_vs, lods, FRAME_SIZE, cx->samples);
+    acc += cx->samples[row];
+  }
+  return (f32)acc;
+}
+
+/// Every pixel from level 0, skipping `TEXTURE_MINIFICATION` texels and a whole tile per pixel.
+static f32 bench_texture_sample_bilinear_level_0(MicrobenchCx *cx, usize ops) {
+  f32 lods[FRAME_SIZE] = {0};
+  return bench_texture_sample(cx, ops, TEXTURE_FILTER_BILINEAR, lods);
+}
+
+/// Every pixel from the mip level of the minification, where neighbouring pixels read neighbouring texels.
+static f32 bench_texture_sample_bilinear_mipmapped(MicrobenchCx *cx, usize ops) {
+  return bench_texture_sample(cx, ops, TEXTURE_FILTER_BILINEAR, cx->texture_lods);
+}
+
+static f32 bench_texture_sample_nearest_mipmapped(MicrobenchCx *cx, usize ops) {
+  return bench_texture_sample(cx, ops, TEXTURE_FILTER_NEAREST, cx->texture_lods);
+}
+
+static void init_colors(MicrobenchCx *cx) {
+  cx->albedo_buffer = xalloc(Rgba8, FRAME_SIZE * FRAME_SIZE);
+  cx->levels = xalloc(u8, FRAME_SIZE * FRAME_SIZE);
+  cx->color_buffer = xalloc(Rgba8, FRAME_SIZE * FRAME_SIZE);
+  for (usize i = 0; i < FRAME_SIZE * FRAME_SIZE; ++i) {
+    cx->albedo_buffer[i] = rgba8((u8)(rand() % 256), (u8)(rand() % 256), (u8)(rand() % 256), 255);
+    cx->levels[i] = (u8)(rand() % 256);
+  }
+}
+
+/// A whole frame, with the compose kernel.
+static f32 bench_compose_rgba8(MicrobenchCx *cx, usize ops) {
+  u32 acc = 0;
+  for (usize i = 0; i < ops; ++i) {
+    compose_rgba8_rect((ScreenRect){0, 0, FRAME_SIZE, FRAME_SIZE},
+                       cx->levels,
+                       FRAME_SIZE,
+                       cx->albedo_buffer,
+                       FRAME_SIZE,
+                       cx->color_buffer,
+                       FRAME_SIZE);
+    escape(cx->color_buffer);
+    acc += cx->color_buffer[i % (FRAME_SIZE * FRAME_SIZE)];
+  }
+  return (f32)acc;
+}
+
+/// The same with `rgba8_scale` a pixel at a time, which the compiler is kept from vectorizing, for comparison.
+static f32 bench_compose_rgba8_per_pixel(MicrobenchCx *cx, usize ops) {
+  u32 acc = 0;
+  for (usize i = 0; i < ops; ++i) {
+    for (usize j = 0; j < FRAME_SIZE * FRAME_SIZE; ++j) {
+      cx->color_buffer[j] = rgba8_scale(cx->albedo_buffer[j], cx->levels[j]);
+      escape(&cx->color_buffer[j]);
+    }
+    acc += cx->color_buffer[i % (FRAME_SIZE * FRAME_SIZE)];
+  }
+  return (f32)acc;
+}
+
+static const Microbench microbenches[] = {
+    {"mul4x4", 1 << 12, NULL, bench_mul4x4},
+    {"mul4x4a", 1 << 12, NULL, bench_mul4x4a},
+    {"mul4x4_4", 1 << 12, NULL, bench_mul4x4_4},
+    {"mul4x4a_4", 1 << 12, NULL, bench_mul4x4a_4},
+    {"cross3", 1 << 12, NULL, bench_cross3},
+    {"cross3a", 1 << 12, NULL, bench_cross3a},
+    {"dot3", 1 << 12, NULL, bench_dot3},
+    {"dot3a", 1 << 12, NULL, bench_dot3a},
+    {"mul4x4_4 (array)", 1 << 12, NULL, bench_transform_array},
+    {"mul4x4a_4_batch", 1 << 12, NULL, bench_mul4x4a_4_batch},
+    {"transform", 1 << 12, NULL, bench_transform},
+    {"surface_light_level", 1 << 12, NULL, bench_surface_light_level},
+    {"triangular_interpolate_z", 1 << 12, NULL, bench_triangular_interpolate_z},
+    {"nabla_depth", 1 << 12, setup_checkerboard_depth, bench_nabla_depth},
+    {"draw_triangle 1px", 1 << 10, setup_clear_frame, bench_draw_triangle_1px},
+    {"draw_triangle 10px", 1 << 8, setup_clear_frame, bench_draw_triangle_10px},
+    {"draw_triangle 100px", 1 << 3, setup_clear_frame, bench_draw_triangle_100px},
+    {"draw_triangle 100px (4 varyings)", 1 << 3, setup_clear_frame, bench_draw_triangle_100px_4_varyings},
+    {"draw_triangle 100px (8 varyings)", 1 << 3, setup_clear_frame, bench_draw_triangle_100px_8_varyings},
+    {"draw_triangle 100px (4x MSAA)", 1 << 3, setup_clear_msaa_frames, bench_draw_triangle_100px_msaa4},
+    {"draw_triangle 100px (8x MSAA)", 1 << 3, setup_clear_msaa_frames, bench_draw_triangle_100px_msaa8},
+    {"draw_triangle full-screen", 1, setup_clear_frame, bench_draw_triangle_full_screen},
+    {"draw_triangle 100px (spans)", 1 << 3, setup_clear_frame, bench_draw_triangle_100px_spans},
+    {"draw_triangle full-screen (spans)", 1, setup_clear_frame, bench_draw_triangle_full_screen_spans},
+    {"draw_triangle sliver", 1 << 3, setup_clear_frame, bench_draw_triangle_sliver},
+    {"draw_object teapot", TEAPOT_GRID_LEN, setup_clear_frame, bench_draw_teapots},
+    {"draw_object_instanced teapot", TEAPOT_GRID_LEN, setup_clear_frame, bench_draw_teapots_instanced},
+    {"draw_object_depth_only teapot", TEAPOT_GRID_LEN, setup_clear_frame, bench_draw_teapots_depth_only},
+    {"cmdbuf_submit teapot grid", 1, setup_clear_frame, bench_submit_teapots},
+    {"cmdbuf_submit teapot grid (4 threads)", 1, setup_clear_frame, bench_submit_teapots_threads},
+    {"draw_object_instanced small teapot", SMALL_TEAPOT_GRID_LEN, setup_clear_frame, bench_draw_small_teapots},
+    {"draw_object_instanced small teapot (lod)", SMALL_TEAPOT_GRID_LEN, setup_clear_frame, bench_draw_lod_teapots},
+    {"draw_scene teapots behind a wall", 1, setup_clear_frame, bench_draw_walled_scene},
+    {"draw_scene teapots behind a wall (occlusion)", 1, setup_clear_frame, bench_draw_walled_scene_occlusion},
+    {"dashboard frame (full redraw)", 1, setup_dashboard, bench_dashboard_full},
+    {"dashboard frame (dirty rect)", 1, setup_dashboard, bench_dashboard_dirty},
+    {"scene_cull 16k objects", 1 << 4, NULL, bench_scene_cull},
+    {"scene_cull 16k objects (brute force)", 1 << 4, NULL, bench_scene_cull_brute_force},
+    {"scene_update refit 1%", 1 << 4, NULL, bench_scene_refit},
+    {"hierarchy_update 10k static", 1 << 4, NULL, bench_hierarchy_static},
+    {"hierarchy_update 10k group moved", 1 << 4, NULL, bench_hierarchy_group_moved},
+    {"hierarchy_update 10k root moved", 1 << 4, NULL, bench_hierarchy_root_moved},
+    {"shadow_map teapot grid", 1, NULL, bench_shadow_map_teapots},
+    {"shadow_map_resolve teapot grid (hard)", 1, setup_teapots_shadow, bench_shadow_map_resolve_hard},
+    {"shadow_map_resolve teapot grid (PCF 2x2)", 1, setup_teapots_shadow, bench_shadow_map_resolve_pcf2x2},
+    {"shadow_map_resolve teapot grid (PCF 3x3)", 1, setup_teapots_shadow, bench_shadow_map_resolve_pcf3x3},
+    {"shadow_map_resolve teapot grid (PCF 4x4)", 1, setup_teapots_shadow, bench_shadow_map_resolve_pcf4x4},
+    {"texture_sample_row bilinear minified 8x (level 0)", 1 << 4, NULL, bench_texture_sample_bilinear_level_0},
+    {"texture_sample_row bilinear minified 8x (mipmapped)", 1 << 4, NULL, bench_texture_sample_bilinear_mipmapped},
+    {"texture_sample_row nearest minified 8x (mipmapped)", 1 << 4, NULL, bench_texture_sample_nearest_mipmapped},
+    {"compose_rgba8 frame", 1, NULL, bench_compose_rgba8},
+    {"compose_rgba8 frame (per pixel)", 1, NULL, bench_compose_rgba8_per_pixel},
+};
+
+/// The aligned SIMD variants must give exactly the same results as the scalar ones.
+static void check_simd_results(const Inputs *inputs) {
+  for (usize i = 0; i < INPUTS_LEN; ++i) {
+    usize j = (i + 1) % INPUTS_LEN;
+    Mat4x4 m = mul4x4(inputs->mats[i], inputs->mats[j]);
+    Mat4x4A m_a = mul4x4a(&inputs->mats_a[i], &inputs->mats_a[j]);
+    ASSERT(memcmp(m.get, m_a.get, sizeof(m.get)) == 0);
+    Vec4 v = mul4x4_4(inputs->mats[i], inputs->vec4s[j]);
+    Vec4A v_a = mul4x4a_4(&inputs->mats_a[i], inputs->vec4s_a[j]);
+    ASSERT(memcmp(v.get, v_a.get, sizeof(v.get)) == 0);
+    Vec3 c = cross3(inputs->vec3s[i], inputs->vec3s[j]);
+    Vec4A c_a = cross3a(inputs->vec4s_a[i], inputs->vec4s_a[j]);
+    ASSERT(memcmp(c.get, c_a.get, sizeof(c.get)) == 0);
+    ASSERT(dot3(inputs->vec3s[i], inputs->vec3s[j]) == dot3a(inputs->vec4s_a[i], inputs->vec4s_a[j]));
+  }
+  Vec4A out[INPUTS_LEN];
+  mul4x4a_4_batch(&inputs->mats_a[0], inputs->vec4s_a, out, INPUTS_LEN);
+  for (usize i = 0; i < INPUTS_LEN; ++i) {
+    Vec4 v = mul4x4_4(inputs->mats[0], inputs->vec4s[i]);
+    ASSERT(memcmp(v.get, out[i].get, sizeof(v.get)) == 0);
+  }
+}
+
+[[gnu::noreturn]] static void usage_exit(const char *argv0) {
+  fprintf(stderr, "Usage: %s [--samples N] [--warmup N] [--filter SUBSTRING]\n", argv0);
+  exit(1);
+}
+
+static usize parse_usize_arg(const char *argv0, const char *arg) {
+  char *end;
+  usize value = strtoull(arg, &end, 10);
+  if (*arg == '\0' || *end != '\0')
+    usage_exit(argv0);
+  return value;
+}
+
+static MicrobenchOptions parse_options(i32 argc, char **argv) {
+  MicrobenchOptions options = {
+      .samples = 200,
+      .warmup = 20,
+      .filter = NULL,
+  };
+  for (i32 i = 1; i < argc; ++i) {
+    const char *arg = argv[i];
+    bool has_value = i + 1 < argc;
+    if (strcmp(arg, "--samples") == 0 && has_value) {
+      options.samples = parse_usize_arg(argv[0], argv[++i]);
+    } else if (strcmp(arg, "--warmup") == 0 && has_value) {
+      options.warmup = parse_usize_arg(argv[0], argv[++i]);
+    } else if (strcmp(arg, "--filter") == 0 && has_value) {
+      options.filter = argv[++i];
+    } else {
+      usage_exit(argv[0]);
+    }
+  }
+  if (options.samples == 0)
+    usage_exit(argv[0]);
+  return options;
+}
+
+static i32 compare_f64(const void *x_, const void *y_) {
+  f64 x = *(const f64 *)x_;
+  f64 y = *(const f64 *)y_;
+  return (x > y) - (x < y);
+}
+
+/// Nearest-rank percentile of a sorted array.
+static f64 percentile(const f64 *sorted, usize len, f64 p) {
+  usize rank = (usize)ceil(p / 100.0 * (f64)len);
+  return sorted[rank == 0 ? 0 : rank - 1];
+}
+
+/// Sorts `per_op` and prints its min, median, p99 and mean as CSV columns.
+static void print_summary(f64 *per_op, usize len) {
+  qsort(per_op, len, sizeof(f64), compare_f64);
+  f64 sum = 0;
+  for (usize i = 0; i < len; ++i) {
+    sum += per_op[i];
+  }
+  printf(",%.3f,%.3f,%.3f,%.3f", per_op[0], percentile(per_op, len, 50), percentile(per_op, len, 99), sum / (f64)len);
+}
+
+static void run_microbench(MicrobenchCx *cx, const MicrobenchOptions *options, const Microbench *microbench) {
+  f64 *ns_per_op = xalloc(f64, options->samples);
+  f64 *cycles_per_op = xalloc(f64, options->samples);
+  for (usize i = 0; i < options->warmup + options->samples; ++i) {
+    if (microbench->setup != NULL)
+      microbench->setup(cx);
+    u64 t0 = now_ns();
+    u64 c0 = now_cycles();
+    sink = microbench->run(cx, microbench->ops);
+    u64 c1 = now_cycles();
+    u64 t1 = now_ns();
+    if (i < options->warmup)
+      continue;
+    ns_per_op[i - options->warmup] = (f64)(t1 - t0) / (f64)microbench->ops;
+    cycles_per_op[i - options->warmup] = (f64)(c1 - c0) / (f64)microbench->ops;
+  }
+  printf("%s,%zu,%zu", microbench->name, microbench->ops, options->samples);
+  print_summary(ns_per_op, options->samples);
+  print_summary(cycles_per_op, options->samples);
+  printf("\n");
+  xfree(ns_per_op);
+  xfree(cycles_per_op);
+}
+
+i32 main(i32 argc, char **argv) {
+  MicrobenchOptions options = parse_options(argc, argv);
+
+  MicrobenchCx *cx = xalloc(MicrobenchCx, 1);
+  init_inputs(&cx->inputs);
+  check_simd_results(&cx->inputs);
+  cx->renderer = new_renderer(FRAME_SIZE, FRAME_SIZE, demo_camera(), demo_light());
+  cx->frame_buffer = xalloc(u8, FRAME_SIZE * FRAME_SIZE);
+  cx->renderer.draw_pixel_callback_cx = cx->frame_buffer;
+  for (usize i = 0; i < ARR_LEN(cx->msaa_renderers); ++i) {
+    cx->msaa_renderers[i] = new_renderer(FRAME_SIZE, FRAME_SIZE, demo_camera(), demo_light());
+    renderer_set_samples(&cx->msaa_renderers[i], i == 0 ? 4 : 8);
+    cx->msaa_renderers[i].draw_pixel_callback_cx = cx->frame_buffer;
+  }
+  cx->teapot_mesh = new_mesh(ARR_ARG(teapot), NULL, 0);
+  cx->teapot_lods = new_lod_chain(cx->teapot_mesh);
+  cx->cube_mesh = new_mesh(ARR_ARG(cube_vertices), ARR_ARG(cube_indices));
+  init_walled_scene(cx);
+  init_dashboard(cx);
+  init_teapots_cmdbuf(cx);
+  init_scene(cx);
+  init_hierarchy(cx);
+  init_texture(cx);
+  init_shadow(cx);
+  init_colors(cx);
+
+  printf("name,ops_per_sample,samples,ns_min,ns_median,ns_p99,ns_mean,"
+         "cycles_min,cycles_median,cycles_p99,cycles_mean\n");
+  for (usize i = 0; i < ARR_LEN(microbenches); ++i) {
+    const Microbench *microbench = &microbenches[i];
+    if (options.filter != NULL && strstr(microbench->name, options.filter) == NULL)
+      continue;
+    run_microbench(cx, &options, microbench);
+  }
+
+  free_scene(cx->scene);
+  free_scene(cx->walled_scene);
+  free_scene(cx->dashboard);
+  xfree(cx->shaded_buffer);
+  free_occlusion_buffer(cx->occlusion);
+  free_command_buffer(cx->teapots_cmdbuf);
+  free_cmd_executor(cx->executor);
+  free_hierarchy(cx->hierarchy);
+  free_texture(cx->texture);
+  xfree(cx->texture_us);
+  xfree(cx->texture_vs);
+  xfree(cx->texture_lods);
+  xfree(cx->samples);
+  free_shadow_map(cx->shadow);
+  xfree(cx->albedo_buffer);
+  xfree(cx->levels);
+  xfree(cx->color_buffer);
+  free_lod_chain(cx->teapot_lods);
+  free_renderer(cx->renderer);
+  for (usize i = 0; i < ARR_LEN(cx->msaa_renderers); ++i) {
+    free_renderer(cx->msaa_renderers[i]);
+  }
+  xfree(cx->frame_buffer);
+  xfree(cx);
+  return 0;
+}
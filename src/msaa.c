@@ -0,0 +1,43 @@
+#include "msaa.h"
+
+#include "trace.h"
+
+MsaaColorBuffer new_msaa_color_buffer(usize width, usize height, usize samples) {
+  ASSERT(samples == 4 || samples == 8);
+  MsaaColorBuffer msaa = {
+      .width = width,
+      .height = height,
+      .samples = samples,
+      .expanded = xalloc(bool, width * height),
+      .sample_colors = xalloc(u8, width * height * samples),
+  };
+  msaa_color_clear(&msaa);
+  return msaa;
+}
+
+void free_msaa_color_buffer(MsaaColorBuffer msaa) {
+  xfree(msaa.expanded);
+  xfree(msaa.sample_colors);
+}
+
+void msaa_color_clear(MsaaColorBuffer *msaa) {
+  memset(msaa->expanded, 0, msaa->width * msaa->height * sizeof(bool));
+}
+
+void msaa_color_resolve(const MsaaColorBuffer *msaa, u8 *frame_buffer, usize frame_stride, RenderLayout layout) {
+  TRACE_SCOPE("msaa_color_resolve");
+  usize samples = msaa->samples;
+  for (usize y = 0; y < msaa->height; ++y) {
+    const bool *expanded = &msaa->expanded[y * msaa->width];
+    for (usize x = 0; x < msaa->width; ++x) {
+      if (!expanded[x])
+        continue;
+      const u8 *sample_colors = &msaa->sample_colors[(y * msaa->width + x) * samples];
+      u32 sum = 0;
+      for (usize s = 0; s < samples; ++s) {
+        sum += sample_colors[s];
+      }
+      frame_buffer[render_target_index(layout, frame_stride, x, y)] = (u8)((sum + samples / 2) / samples);
+    }
+  }
+}
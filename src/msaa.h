@@ -0,0 +1,80 @@
+#pragma once
+
+#include "common.h"
+#include "render.h"
+
+// Multisample anti-aliasing, the color side. The renderer tests coverage and depth per sample (see
+// `renderer_set_samples`) but runs the draw pixel callback once per pixel per triangle, with the mask of the samples
+// the triangle covers, and the callback keeps the colors of the samples in a `MsaaColorBuffer`.
+//
+// The colors are compressed: most pixels are covered whole by the front-most triangle, and such a pixel has a single
+// color, kept in the frame buffer as without multisampling. Only the pixels on the edges of triangles, which get
+// partial masks, have their samples expanded into their own colors. `msaa_color_resolve` averages those into the frame
+// buffer before the shading stage, every other pixel is left as it is.
+//
+// Example:
+//
+// ```
+// renderer_set_samples(&renderer, 4);
+// MsaaColorBuffer msaa = new_msaa_color_buffer(width, height, 4);
+// void my_draw_pixel_callback(...) {
+//   // ...
+//   msaa_color_write(&cx->msaa, &cx->frame_buffer[y * stride + x], x, y, coverage, color);
+// }
+// while (...) {
+//   renderer_clear_frame(&renderer);
+//   memset(frame_buffer, 0, ...);
+//   msaa_color_clear(&msaa);
+//   // draw...
+//   msaa_color_resolve(&msaa, frame_buffer, stride, layout);
+//   // shade and present...
+// }
+// free_msaa_color_buffer(msaa);
+// ```
+
+/// SAFETY: Only use new_msaa_color_buffer to construct this.
+typedef struct msaa_color_buffer {
+  usize width;
+  usize height;
+  /// 4 or 8, as the renderer's.
+  usize samples;
+  /// LEN: width * height, row by row. Whether the samples of a pixel have their own colors in `sample_colors`, its
+  /// color in the frame buffer is that of all of them otherwise.
+  bool *expanded;
+  /// LEN: width * height * samples, the colors of the samples of pixel `i` at `i * samples`. Only those of the
+  /// expanded pixels are meaningful.
+  u8 *sample_colors;
+} MsaaColorBuffer;
+
+MsaaColorBuffer new_msaa_color_buffer(usize width, usize height, usize samples);
+
+void free_msaa_color_buffer(MsaaColorBuffer msaa);
+
+/// Compresses every pixel, at the start of a frame, after clearing the frame buffer.
+void msaa_color_clear(MsaaColorBuffer *msaa);
+
+/// Sets the samples of pixel `x`, `y` in `coverage` (see `draw_pixel_callback_t`) to `color`, for the draw pixel
+/// callback. `pixel` is the pixel in the frame buffer. Only writes the pixel itself, so it's safe to call from threads
+/// drawing different pixels.
+static inline void msaa_color_write(MsaaColorBuffer *msaa, u8 *pixel, usize x, usize y, u8 coverage, u8 color) {
+  usize i = y * msaa->width + x;
+  u8 all = (u8)((1u << msaa->samples) - 1);
+  if (coverage == all) {
+    *pixel = color;
+    msaa->expanded[i] = false;
+    return;
+  }
+  u8 *sample_colors = &msaa->sample_colors[i * msaa->samples];
+  if (!msaa->expanded[i]) {
+    memset(sample_colors, *pixel, msaa->samples);
+    msaa->expanded[i] = true;
+  }
+  for (usize s = 0; s < msaa->samples; ++s) {
+    if (coverage & (1u << s))
+      sample_colors[s] = color;
+  }
+}
+
+/// Writes the mean of the samples of every expanded pixel into `frame_buffer`, which has the size of the color buffer,
+/// with `frame_stride` and `layout` (see `render_target_index`).
+void msaa_color_resolve(const MsaaColorBuffer *msaa, u8 *frame_buffer, usize frame_stride, RenderLayout layout);
@@ -0,0 +1,149 @@
+#include "occlusion.h"
+
+#include "trace.h"
+
+/// Max texels along each axis that `occlusion_aabb_maybe_visible` reads, it goes up the pyramid until the box spans
+/// at most this many.
+#define OCCLUSION_TEST_SPAN 4
+
+OcclusionBuffer new_occlusion_buffer(const Renderer *renderer) {
+  OcclusionBuffer occlusion = {
+      .renderer = new_renderer(renderer->width, renderer->height, renderer->cam, renderer->light),
+      .levels_len = 0,
+  };
+  // The renderer's samples away from the pixel coords can see past the edges of the occluders, so they are drawn with
+  // the same samples.
+  renderer_set_samples(&occlusion.renderer, renderer->samples);
+  usize width = (renderer->width + OCCLUSION_TEXEL_SIZE - 1) / OCCLUSION_TEXEL_SIZE;
+  usize height = (renderer->height + OCCLUSION_TEXEL_SIZE - 1) / OCCLUSION_TEXEL_SIZE;
+  while (true) {
+    ASSERT(occlusion.levels_len < OCCLUSION_MAX_LEVELS);
+    usize level = occlusion.levels_len++;
+    occlusion.widths[level] = width;
+    occlusion.heights[level] = height;
+    occlusion.levels[level] = xalloc(f32, width * height);
+    if (width == 1 && height == 1)
+      break;
+    width = (width + 1) / 2;
+    height = (height + 1) / 2;
+  }
+  return occlusion;
+}
+
+void free_occlusion_buffer(OcclusionBuffer occlusion) {
+  free_renderer(occlusion.renderer);
+  for (usize i = 0; i < occlusion.levels_len; ++i) {
+    xfree(occlusion.levels[i]);
+  }
+}
+
+void occlusion_begin(OcclusionBuffer *occlusion, const Renderer *renderer) {
+  ASSERT(renderer->width == occlusion->renderer.width && renderer->height == occlusion->renderer.height);
+  ASSERT(renderer->samples == occlusion->renderer.samples);
+  occlusion->renderer.cam = renderer->cam;
+  occlusion->renderer.x_ratio = renderer->x_ratio;
+  occlusion->renderer.y_ratio = renderer->y_ratio;
+  occlusion->world_to_camera = world_to_camera_matrix(renderer);
+  renderer_clear_frame(&occlusion->renderer);
+}
+
+void occlusion_add_occluder(OcclusionBuffer *occlusion, const Mesh *mesh, Mat4x4 m) {
+  TRACE_SCOPE("occlusion_add_occluder");
+  Instance instance = new_instance(&occlusion->renderer, m);
+  draw_object_depth_only(&occlusion->renderer, mesh, &instance, 1);
+}
+
+void occlusion_finish(OcclusionBuffer *occlusion) {
+  TRACE_SCOPE("occlusion_finish");
+  // Level 0, the max depth of the samples of the pixels of each texel.
+  const Renderer *renderer = &occlusion->renderer;
+  f32 *texels = occlusion->levels[0];
+  usize texels_width = occlusion->widths[0];
+  for (usize ty = 0; ty < occlusion->heights[0]; ++ty) {
+    f32 *texels_row = &texels[ty * texels_width];
+    for (usize tx = 0; tx < texels_width; ++tx) {
+      texels_row[tx] = -INFINITY;
+    }
+    usize max_y = minzu((ty + 1) * OCCLUSION_TEXEL_SIZE, renderer->height);
+    for (usize s = 0; s < renderer->samples; ++s) {
+      const f32 *depth_buffer = renderer_sample_depth_buffer(renderer, s);
+      for (usize y = ty * OCCLUSION_TEXEL_SIZE; y < max_y; ++y) {
+        const f32 *depth_row = &depth_buffer[y * renderer->stride];
+        for (usize x = 0; x < renderer->width; ++x) {
+          f32 *texel = &texels_row[x / OCCLUSION_TEXEL_SIZE];
+          *texel = maxf(*texel, depth_row[x]);
+        }
+      }
+    }
+  }
+  for (usize level = 1; level < occlusion->levels_len; ++level) {
+    const f32 *below = occlusion->levels[level - 1];
+    usize below_width = occlusion->widths[level - 1];
+    usize below_height = occlusion->heights[level - 1];
+    f32 *depths = occlusion->levels[level];
+    for (usize y = 0; y < occlusion->heights[level]; ++y) {
+      for (usize x = 0; x < occlusion->widths[level]; ++x) {
+        // The texels below on the right and bottom edges can have only 1 child.
+        usize x1 = minzu(x * 2 + 1, below_width - 1);
+        usize y1 = minzu(y * 2 + 1, below_height - 1);
+        f32 depth = maxf(below[y * 2 * below_width + x * 2], below[y * 2 * below_width + x1]);
+        depth = maxf(depth, maxf(below[y1 * below_width + x * 2], below[y1 * below_width + x1]));
+        depths[y * occlusion->widths[level] + x] = depth;
+      }
+    }
+  }
+}
+
+bool occlusion_aabb_maybe_visible(const OcclusionBuffer *occlusion, Aabb aabb) {
+  // Like `aabb_maybe_visible`, the box spans `|row| . half_size` around its center along each axis of camera coords.
+  const Mat4x4 *m = &occlusion->world_to_camera;
+  Vec3 center = transform(*m, aabb_center(aabb));
+  Vec3 half_size = {{
+      (aabb.max.get[0] - aabb.min.get[0]) / 2,
+      (aabb.max.get[1] - aabb.min.get[1]) / 2,
+      (aabb.max.get[2] - aabb.min.get[2]) / 2,
+  }};
+  f32 extent[3];
+  for (usize i = 0; i < 3; ++i) {
+    extent[i] = fabsf(m->get[i][0]) * half_size.get[0] + fabsf(m->get[i][1]) * half_size.get[1] +
+                fabsf(m->get[i][2]) * half_size.get[2];
+    // The vertices are mapped one matrix at a time, which rounds differently, leave some slack for that.
+    extent[i] += 1e-4f * (fabsf(center.get[i]) + extent[i] + 1);
+  }
+  // The depth of the pixels of a triangle is between the depths of its vertices (up to rounding, see above), so at
+  // least this. The depth of anything crossing the camera plane isn't bounded by the box, NaN counts as visible too.
+  f32 min_z = center.get[2] - extent[2];
+  if (!(min_z > 0))
+    return true;
+  const Renderer *renderer = &occlusion->renderer;
+  Camera_ cam = renderer->cam;
+  f32 min_x_cam = maxf(center.get[0] - extent[0], cam.min_x);
+  f32 max_x_cam = minf(center.get[0] + extent[0], cam.max_x);
+  f32 min_y_cam = maxf(center.get[1] - extent[1], cam.min_y);
+  f32 max_y_cam = minf(center.get[1] + extent[1], cam.max_y);
+  if (!(min_x_cam <= max_x_cam && min_y_cam <= max_y_cam))
+    return true;
+  // The pixels `rasterize_triangle` could sample for the box, with the same extra pixels on each side.
+  usize margin = raster_margin(renderer);
+  usize min_x = saturating_subzu(cam_to_screen_x(renderer, min_x_cam), margin);
+  usize max_x = minzu(saturating_addzu(cam_to_screen_x(renderer, max_x_cam), margin), renderer->width - 1);
+  usize min_y = saturating_subzu(cam_to_screen_y(renderer, max_y_cam), margin);
+  usize max_y = minzu(saturating_addzu(cam_to_screen_y(renderer, min_y_cam), margin), renderer->height - 1);
+  usize min_tx = min_x / OCCLUSION_TEXEL_SIZE, max_tx = max_x / OCCLUSION_TEXEL_SIZE;
+  usize min_ty = min_y / OCCLUSION_TEXEL_SIZE, max_ty = max_y / OCCLUSION_TEXEL_SIZE;
+  usize level = 0;
+  while ((max_tx >> level) - (min_tx >> level) >= OCCLUSION_TEST_SPAN ||
+         (max_ty >> level) - (min_ty >> level) >= OCCLUSION_TEST_SPAN) {
+    ++level;
+  }
+  const f32 *depths = occlusion->levels[level];
+  usize width = occlusion->widths[level];
+  for (usize y = min_ty >> level; y <= max_ty >> level; ++y) {
+    for (usize x = min_tx >> level; x <= max_tx >> level; ++x) {
+      // Something in the box may be in front of the occluders here.
+      if (!(min_z > depths[y * width + x]))
+        return true;
+    }
+  }
+  return false;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "common.h"
+#include "linear_alg.h"
+#include "mesh.h"
+#include "render.h"
+
+// Occlusion culling: a few big occluders (walls, terrain) are rasterized into a depth buffer, and the bounding boxes
+// of objects are tested against it, so that the objects hidden behind the occluders are skipped as a whole before any
+// of their vertices are transformed.
+//
+// The test is conservative: an object is only rejected if the renderer would draw none of its pixels anyway. For that,
+// the occluders go through the same depth-only path of the renderer, at the same pixels and samples (with
+// multisampling), and the occluders must be drawn by the renderer too (or be inside things it draws). The depths are
+// then reduced to a low resolution buffer that keeps the farthest depth of the samples of each texel, and a pyramid
+// of the max depth of 2x2 texels over it, so that a test reads a few texels however large the object.
+//
+// Example:
+//
+// ```
+// OcclusionBuffer occlusion = new_occlusion_buffer(&renderer);
+// while (...) {
+//   occlusion_begin(&occlusion, &renderer);
+//   occlusion_add_occluder(&occlusion, &wall_mesh, wall_m);
+//   occlusion_finish(&occlusion);
+//   draw_scene(&renderer, &scene, &occlusion, gui_rasterize_triangle);
+// }
+// free_occlusion_buffer(occlusion);
+// ```
+
+/// Width and height, in pixels of the renderer, of a texel of the occlusion buffer.
+#define OCCLUSION_TEXEL_SIZE 4
+
+#define OCCLUSION_MAX_LEVELS 16
+
+/// SAFETY: Only use new_occlusion_buffer to construct this.
+typedef struct occlusion_buffer {
+  /// Depth-only renderer for the occluders, with the size and camera of the renderer that draws the scene.
+  Renderer renderer;
+  /// Level 0 is one depth per texel, each level after it the max depth of 2x2 texels of the one before it, down to
+  /// 1x1.
+  /// LEN: widths[i] * heights[i].
+  f32 *levels[OCCLUSION_MAX_LEVELS];
+  usize widths[OCCLUSION_MAX_LEVELS];
+  usize heights[OCCLUSION_MAX_LEVELS];
+  usize levels_len;
+  /// Of the camera at `occlusion_begin`.
+  Mat4x4 world_to_camera;
+} OcclusionBuffer;
+
+/// An occlusion buffer for the size and samples of a renderer. Make a new one if either changes.
+OcclusionBuffer new_occlusion_buffer(const Renderer *renderer);
+
+void free_occlusion_buffer(OcclusionBuffer occlusion);
+
+/// Clears the occlusion buffer, for the camera the renderer has now.
+void occlusion_begin(OcclusionBuffer *occlusion, const Renderer *renderer);
+
+/// Rasterize an occluder into the occlusion buffer.
+void occlusion_add_occluder(OcclusionBuffer *occlusion, const Mesh *mesh, Mat4x4 m);
+
+/// Builds the pyramid after all the occluders were added, before any test.
+void occlusion_finish(OcclusionBuffer *occlusion);
+
+/// Returns `false` only if all of a bounding box in world space is behind the occluders (or off-screen), in which case
+/// nothing inside it would be drawn.
+bool occlusion_aabb_maybe_visible(const OcclusionBuffer *occlusion, Aabb aabb);
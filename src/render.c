@@ -1,23 +1,174 @@
 #include "render.h"
 
+#include "dispatch.h"
 #include "math_helpers.h"
+#include "triangle.h"
+#include "trace.h"
+
+#include <sys/mman.h>
+
+usize render_target_stride(usize width, usize element_size) {
+  ASSERT(RENDER_TARGET_ALIGNMENT % element_size == 0);
+  usize align = RENDER_TARGET_ALIGNMENT;
+  usize bytes = (width * element_size + align - 1) / align * align;
+  if (bytes % 4096 == 0)
+    bytes += align;
+  return bytes / element_size;
+}
+
+/// In front of the memory of every render target.
+typedef struct render_target_header {
+  /// Of the whole allocation, including the header.
+  usize size;
+  /// Whether it was allocated with `mmap`, `aligned_alloc` otherwise.
+  bool mapped;
+} RenderTargetHeader;
+
+static_assert(sizeof(RenderTargetHeader) <= RENDER_TARGET_ALIGNMENT);
+
+/// Map `size` bytes (a multiple of `RENDER_TARGET_HUGE_PAGE_SIZE`) at an address aligned to a huge page, preferably
+/// backed by huge pages. Returns `NULL` if mapping fails.
+static u8 *map_huge_pages(usize size) {
+#ifdef MAP_HUGETLB
+  void *p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+  if (p != MAP_FAILED)
+    return p;
+#endif
+  // Transparent huge pages only back the huge-page-aligned parts of a mapping, so map more and trim it.
+  usize align = RENDER_TARGET_HUGE_PAGE_SIZE;
+  u8 *q = mmap(NULL, size + align, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (q == MAP_FAILED)
+    return NULL;
+  usize head = (align - (uintptr_t)q % align) % align;
+  if (head != 0)
+    munmap(q, head);
+  munmap(q + head + size, align - head);
+  q += head;
+#ifdef MADV_HUGEPAGE
+  madvise(q, size, MADV_HUGEPAGE);
+#endif
+  return q;
+}
+
+void *alloc_render_target(usize size) {
+  usize total = size + RENDER_TARGET_ALIGNMENT;
+  u8 *p = NULL;
+  bool mapped = false;
+  if (total >= RENDER_TARGET_HUGE_PAGE_SIZE) {
+    total = (total + RENDER_TARGET_HUGE_PAGE_SIZE - 1) / RENDER_TARGET_HUGE_PAGE_SIZE * RENDER_TARGET_HUGE_PAGE_SIZE;
+    p = map_huge_pages(total);
+    mapped = p != NULL;
+  }
+  if (p == NULL) {
+    total = (total + RENDER_TARGET_ALIGNMENT - 1) / RENDER_TARGET_ALIGNMENT * RENDER_TARGET_ALIGNMENT;
+    p = aligned_alloc(RENDER_TARGET_ALIGNMENT, total);
+    ASSERT(p != NULL);
+  }
+  *(RenderTargetHeader *)p = (RenderTargetHeader){.size = total, .mapped = mapped};
+  return p + RENDER_TARGET_ALIGNMENT;
+}
+
+void free_render_target(void *p) {
+  u8 *base = (u8 *)p - RENDER_TARGET_ALIGNMENT;
+  RenderTargetHeader header = *(RenderTargetHeader *)base;
+  if (header.mapped)
+    munmap(base, header.size);
+  else
+    free(base);
+}
+
+void detile_render_target(void *linear,
+                          usize linear_stride,
+                          const void *tiled,
+                          usize tiled_stride,
+                          usize width,
+                          usize height,
+                          usize element_size) {
+  TRACE_SCOPE("detile_render_target");
+  // The row of a tile is copied whole, the strides are multiples of the tile size so it stays within the row.
+  ASSERT(linear_stride % RENDER_TILE_WIDTH == 0 && tiled_stride % RENDER_TILE_WIDTH == 0);
+  usize tile_row_size = RENDER_TILE_WIDTH * element_size;
+  for (usize y = 0; y < height; ++y) {
+    u8 *dst = (u8 *)linear + y * linear_stride * element_size;
+    const u8 *src = (const u8 *)tiled + render_target_index(RENDER_LAYOUT_TILED, tiled_stride, 0, y) * element_size;
+    for (usize x = 0; x < width; x += RENDER_TILE_WIDTH) {
+      memcpy(&dst[x * element_size], &src[x * RENDER_TILE_HEIGHT * element_size], tile_row_size);
+    }
+  }
+}
 
 Renderer new_renderer(usize width, usize height, Camera_ cam, Vec3 light) {
   ASSERT(cam.max_x > cam.min_x);
   ASSERT(cam.max_y > cam.min_y);
+  usize stride = render_target_stride(width, sizeof(f32));
   return (Renderer){
-      .depth_buffer = xalloc(f32, width * height),
+      .depth_buffer = alloc_render_target(sizeof(f32) * stride * render_target_rows(height)),
+      .stride = stride,
+      .layout = RENDER_LAYOUT_LINEAR,
+      .samples = 1,
+      .sample_depth_buffers = NULL,
       .width = width,
       .height = height,
+      .max_width = width,
+      .max_height = height,
       .x_ratio = (cam.max_x - cam.min_x) / (f32)width,
-      .y_ratio = (cam.max_y - cam.min_x) / (f32)height,
+      .y_ratio = (cam.max_y - cam.min_y) / (f32)height,
       .cam = cam,
       .light = light,
+      .scissor = {0, 0, width, height},
+      .arena = new_arena(RENDERER_ARENA_CAPACITY),
   };
 }
 
 void free_renderer(Renderer renderer) {
-  xfree(renderer.depth_buffer);
+  free_render_target(renderer.depth_buffer);
+  if (renderer.sample_depth_buffers != NULL)
+    free_render_target(renderer.sample_depth_buffers);
+  free_arena(renderer.arena);
+}
+
+/// Elements of each of the depth buffers of a renderer, see `Renderer::sample_depth_buffers`.
+static usize depth_buffer_len(const Renderer *renderer) {
+  return renderer->stride * render_target_rows(renderer->max_height);
+}
+
+void renderer_set_samples(Renderer *renderer, usize samples) {
+  ASSERT(samples == 1 || samples == 4 || samples == 8);
+  if (samples == renderer->samples)
+    return;
+  if (renderer->sample_depth_buffers != NULL)
+    free_render_target(renderer->sample_depth_buffers);
+  renderer->samples = samples;
+  renderer->sample_depth_buffers =
+      samples == 1 ? NULL : alloc_render_target(sizeof(f32) * (samples - 1) * depth_buffer_len(renderer));
+}
+
+const f32 *renderer_sample_depth_buffer(const Renderer *renderer, usize i) {
+  ASSERT(i < renderer->samples);
+  return i == 0 ? renderer->depth_buffer : &renderer->sample_depth_buffers[(i - 1) * depth_buffer_len(renderer)];
+}
+
+void renderer_set_resolution(Renderer *renderer, usize width, usize height) {
+  ASSERT(width >= 1 && width <= renderer->max_width);
+  ASSERT(height >= 1 && height <= renderer->max_height);
+  Camera_ cam = renderer->cam;
+  renderer->width = width;
+  renderer->height = height;
+  renderer->x_ratio = (cam.max_x - cam.min_x) / (f32)width;
+  renderer->y_ratio = (cam.max_y - cam.min_y) / (f32)height;
+  renderer->scissor = (ScreenRect){0, 0, width, height};
+}
+
+/// The sample positions of 4x and 8x multisampling, in 1/16 of a pixel: the usual rotated and sparse grids, moved
+/// so that the first sample is at the pixel coords.
+static const i8 sample_offsets_4[4][2] = {{0, 0}, {8, 4}, {-4, 8}, {4, 12}};
+static const i8 sample_offsets_8[8][2] = {{0, 0}, {-2, 6}, {4, 4}, {-4, -2}, {-6, 8}, {-8, 2}, {2, 10}, {6, -4}};
+
+void render_sample_offset(usize samples, usize i, f32 *dx, f32 *dy) {
+  ASSERT(i < samples);
+  const i8 *offset = samples == 8 ? sample_offsets_8[i] : samples == 4 ? sample_offsets_4[i] : (const i8[2]){0, 0};
+  *dx = (f32)offset[0] / 16;
+  *dy = (f32)offset[1] / 16;
 }
 
 void check_object_indices(usize vertices_len, usize *indices, usize indices_len) {
@@ -46,10 +197,71 @@ f32 screen_to_cam_y(const Renderer *renderer, usize y) {
   return dy - (f32)y * renderer->y_ratio + renderer->cam.min_y;
 }
 
+/// Clears the depths of the pixels in `rect` of one of the depth buffers of a renderer, a run of a row at a time.
+static void clear_depth_rect(const Renderer *renderer, f32 *depth_buffer, ScreenRect rect) {
+  for (usize y = rect.min_y; y < rect.max_y; ++y) {
+    if (renderer->layout == RENDER_LAYOUT_LINEAR) {
+      kernels.clear_depth(&depth_buffer[y * renderer->stride + rect.min_x], rect.max_x - rect.min_x);
+      continue;
+    }
+    // The pixels of a row are contiguous within each tile.
+    for (usize x = rect.min_x; x < rect.max_x;) {
+      usize end = minzu((x / RENDER_TILE_WIDTH + 1) * RENDER_TILE_WIDTH, rect.max_x);
+      kernels.clear_depth(&depth_buffer[render_target_index(RENDER_LAYOUT_TILED, renderer->stride, x, y)], end - x);
+      x = end;
+    }
+  }
+}
+
 void renderer_clear_frame(Renderer *renderer) {
-  for (usize i = 0; i < renderer->width * renderer->height; ++i) {
-    renderer->depth_buffer[i] = INFINITY;
+  TRACE_SCOPE("renderer_clear_frame");
+  ScreenRect scissor = renderer->scissor;
+  usize len = depth_buffer_len(renderer);
+  if (scissor.min_x == 0 && scissor.min_y == 0 && scissor.max_x == renderer->width &&
+      scissor.max_y == renderer->height) {
+    // All the rows drawn, padding included, in one go.
+    usize used_len = renderer->stride * render_target_rows(renderer->height);
+    kernels.clear_depth(renderer->depth_buffer, used_len);
+    for (usize s = 1; s < renderer->samples; ++s) {
+      kernels.clear_depth(&renderer->sample_depth_buffers[(s - 1) * len], used_len);
+    }
+  } else if (!screen_rect_is_empty(scissor)) {
+    clear_depth_rect(renderer, renderer->depth_buffer, scissor);
+    for (usize s = 1; s < renderer->samples; ++s) {
+      clear_depth_rect(renderer, &renderer->sample_depth_buffers[(s - 1) * len], scissor);
+    }
   }
+  arena_reset(&renderer->arena);
+#ifdef RENDER_STATS
+  renderer->stats = (RenderStats){0};
+#endif
+}
+
+bool renderer_stats(const Renderer *renderer, RenderStats *stats) {
+#ifdef RENDER_STATS
+  *stats = renderer->stats;
+  return true;
+#else
+  return false;
+#endif
+}
+
+f32 render_stats_overdraw(const RenderStats *stats) {
+  if (stats->pixels_covered == 0)
+    return 0;
+  return (f32)stats->depth_test_passes / (f32)stats->pixels_covered;
+}
+
+void render_stats_add(RenderStats *stats, const RenderStats *other) {
+  stats->objects_culled += other->objects_culled;
+  stats->objects_occluded += other->objects_occluded;
+  stats->triangles_submitted += other->triangles_submitted;
+  stats->triangles_culled += other->triangles_culled;
+  stats->triangles_rasterized += other->triangles_rasterized;
+  stats->pixels_tested += other->pixels_tested;
+  stats->depth_test_passes += other->depth_test_passes;
+  stats->pixels_covered += other->pixels_covered;
+  stats->callback_invocations += other->callback_invocations;
 }
 
 Vec3 transform(Mat4x4 m, Vec3 v) {
@@ -74,99 +286,252 @@ static inline Mat4x4 projection_matrix(f32 fov, f32 aspect_ratio, f32 near_clipp
   }};
 }
 
+/// The matrices that map world coords to camera coords, computed once per draw call.
+typedef struct view_projection {
+  Mat4x4 view;
+  Mat4x4 proj;
+} ViewProjection;
+
+static inline ViewProjection view_projection(const Camera_ cam) {
+  return (ViewProjection){
+      .view = view_matrix(cam.pos),
+      .proj = projection_matrix(cam.fov, cam.aspect_ratio, cam.near_clipping_dist, cam.far_clipping_dist),
+  };
+}
+
 /// Maps a point from world coord to camera coord.
-static inline Vec3 project_point(const Camera_ cam, Vec3 p) {
-  Mat4x4 view_mat = view_matrix(cam.pos);
-  Mat4x4 proj_mat = projection_matrix(cam.fov, cam.aspect_ratio, cam.near_clipping_dist, cam.far_clipping_dist);
+static inline Vec3 project_point(const ViewProjection *vp, Vec3 p) {
   Vec3 result = p;
-  result = transform(view_mat, result);
-  result = transform(proj_mat, result);
+  result = transform(vp->view, result);
+  result = transform(vp->proj, result);
   return result;
 }
 
-/// Helper function used in `is_in_triangle`.
-static inline f32 sign(f32 x, f32 y, Vec3 p1, Vec3 p2) {
-  return (x - p2.get[0]) * (p1.get[1] - p2.get[1]) - (p1.get[0] - p2.get[0]) * (y - p2.get[1]);
+/// The light level of a surface.
+u8 surface_light_level(Vec3 light, Vec3 normal, u8 floor) {
+  // angle = arccos ( (a . b) / (|a| |b|) )
+  f32 angle = acosf(dot3(light, normal) / (abs3(normal) * abs3(light)));
+  if (angle > to_rad(90))
+    return floor;
+  f32 light_level = (1 - (angle / to_rad(90))) * 255;
+  f32 floor_ = (f32)floor;
+  u8 x = (u8)(light_level * (255 - floor_) / 255 + floor_);
+  return x > floor ? x : floor;
 }
 
-/// The Z of p0, p1, p2 is ignored.
-static inline bool is_in_triangle(Vec3 p0, Vec3 p1, Vec3 p2, f32 x, f32 y) {
-  f32 d0 = sign(x, y, p0, p1);
-  f32 d1 = sign(x, y, p1, p2);
-  f32 d2 = sign(x, y, p2, p0);
-  bool has_neg = (d0 < 0) || (d1 < 0) || (d2 < 0);
-  bool has_pos = (d0 > 0) || (d1 > 0) || (d2 > 0);
-  return !(has_neg && has_pos);
+ProjectedTriangle project_triangle(const Renderer *renderer, Vec3 p0, Vec3 p1, Vec3 p2, Mat4x4 m) {
+  Vec3 p0_ = transform(m, p0);
+  Vec3 p1_ = transform(m, p1);
+  Vec3 p2_ = transform(m, p2);
+  ViewProjection vp = view_projection(renderer->cam);
+  return (ProjectedTriangle){
+      // Project the triangle onto the camera plane.
+      .p0 = project_point(&vp, p0_),
+      .p1 = project_point(&vp, p1_),
+      .p2 = project_point(&vp, p2_),
+      // The light level of this surface.
+      .light_level =
+          surface_light_level(renderer->light, triangle_normal(p0_, p1_, p2_), DEFAULT_AMBIENT_LIGHT_LEVEL),
+  };
 }
 
-/// From a projected triangle (calculated by `project_point`), calculate depth
-/// on (x, y). If outside triangle returns infinity.
-static inline f32 triangular_interpolate_z(Vec3 p0, Vec3 p1, Vec3 p2, f32 x, f32 y) {
-  if (!is_in_triangle(p0, p1, p2, x, y))
-    return INFINITY;
+Instance new_instance(const Renderer *renderer, Mat4x4 m) {
+  return (Instance){
+      .m = m,
+      .light = renderer->light,
+      .ambient = DEFAULT_AMBIENT_LIGHT_LEVEL,
+  };
+}
 
-  // reference: https://codeplea.com/triangular-interpolation
+usize raster_margin(const Renderer *renderer) {
+  return renderer->samples == 1 ? 1 : 2;
+}
 
-  // Weights.
-  // w0 = ((y1 - y2)(px - x2) + (x2 - x1)(py - y2)) /
-  //      ((y1 - y2)(x0 - x2) + (x2 - x1)(y0 - y2))
-  // w1 = ((y2 - y1)(px - x2) + (x0 - x2)(py - y2)) /
-  //      ((y1 - y2)(x0 - x2) + (x2 - x1)(y0 - y2))
-  // w2 = 1 - w0 - w1
-  // ... where:
-  //    x0 ~ x2 => p{0~2}.get[0]
-  //    y0 ~ y2 => p{0~2}.get[1]
-  //    p{x|y}  => {x|y}
+/// The pixels that drawing something spanning `center ± extent` in camera coords (slack included) may touch, see
+/// `aabb_screen_rect`.
+static ScreenRect extent_screen_rect(const Renderer *renderer, Vec3 center, f32 extent_x, f32 extent_y) {
+  // The same as the bounding box of a triangle in `rasterize_triangle`, which is inside it.
+  Camera_ cam = renderer->cam;
+  f32 min_x_cam = maxf(center.get[0] - extent_x, cam.min_x);
+  f32 max_x_cam = minf(center.get[0] + extent_x, cam.max_x);
+  f32 min_y_cam = maxf(center.get[1] - extent_y, cam.min_y);
+  f32 max_y_cam = minf(center.get[1] + extent_y, cam.max_y);
+  // Off-screen, or NaN, which no triangle inside it would be drawn with either.
+  if (!(min_x_cam <= max_x_cam && min_y_cam <= max_y_cam))
+    return (ScreenRect){0, 0, 0, 0};
+  usize margin = raster_margin(renderer);
+  return (ScreenRect){
+      saturating_subzu(cam_to_screen_x(renderer, min_x_cam), margin),
+      saturating_subzu(cam_to_screen_y(renderer, max_y_cam), margin),
+      minzu(saturating_addzu(cam_to_screen_x(renderer, max_x_cam), margin), renderer->width),
+      minzu(saturating_addzu(cam_to_screen_y(renderer, min_y_cam), margin), renderer->height),
+  };
+}
 
-  f32 w0 = ((p1.get[1] - p2.get[1]) * (x - p2.get[0]) + (p2.get[0] - p1.get[0]) * (y - p2.get[1])) /
-           ((p1.get[1] - p2.get[1]) * (p0.get[0] - p2.get[0]) + (p2.get[0] - p1.get[0]) * (p0.get[1] - p2.get[1]));
-  f32 w1 = ((p2.get[1] - p0.get[1]) * (x - p2.get[0]) + (p0.get[0] - p2.get[0]) * (y - p2.get[1])) /
-           ((p1.get[1] - p2.get[1]) * (p0.get[0] - p2.get[0]) + (p2.get[0] - p1.get[0]) * (p0.get[1] - p2.get[1]));
-  f32 w2 = 1 - w0 - w1;
+/// Whether something spanning `center ± extent` in camera coords may overlap the screen.
+static bool extent_maybe_visible(const Renderer *renderer, Vec3 center, f32 extent_x, f32 extent_y) {
+  // The vertices are mapped one matrix at a time, which rounds differently, leave some slack for that.
+  extent_x += 1e-4f * (fabsf(center.get[0]) + extent_x + 1);
+  extent_y += 1e-4f * (fabsf(center.get[1]) + extent_y + 1);
+  Camera_ cam = renderer->cam;
+  // Same as the check in `rasterize_triangle`, NaN counts as visible.
+  bool outside = center.get[0] + extent_x < cam.min_x || center.get[0] - extent_x > cam.max_x ||
+                 center.get[1] + extent_y < cam.min_y || center.get[1] - extent_y > cam.max_y;
+  return !outside;
+}
 
-  // 1/z is linear to (x, y), z is not.
-  f32 z0 = 1 / p0.get[2];
-  f32 z1 = 1 / p1.get[2];
-  f32 z2 = 1 / p2.get[2];
+/// `extent_maybe_visible`, and within the scissor if it doesn't cover the whole screen, like `scene_cull` does for
+/// bounding boxes. E.g. each thread of `cmdbuf_submit` draws a band of rows, and skips the vertex stage of the
+/// instances entirely in the other bands.
+static bool extent_maybe_visible_in_scissor(const Renderer *renderer, Vec3 center, f32 extent_x, f32 extent_y) {
+  if (!extent_maybe_visible(renderer, center, extent_x, extent_y))
+    return false;
+  ScreenRect scissor = renderer->scissor;
+  if (scissor.min_x == 0 && scissor.min_y == 0 && scissor.max_x == renderer->width && scissor.max_y == renderer->height)
+    return true;
+  // The same slack as `extent_maybe_visible`.
+  extent_x += 1e-4f * (fabsf(center.get[0]) + extent_x + 1);
+  extent_y += 1e-4f * (fabsf(center.get[1]) + extent_y + 1);
+  ScreenRect rect = extent_screen_rect(renderer, center, extent_x, extent_y);
+  // Empty only for NaN here, which counts as visible.
+  return screen_rect_is_empty(rect) || !screen_rect_is_empty(screen_rect_intersection(rect, scissor));
+}
 
-  f32 z_ = w0 * z0 + w1 * z1 + w2 * z2;
+/// The center in camera coords of a sphere in model space transformed by `m`, and its extents along X and Y.
+static Vec3 sphere_camera_extent(
+    const ViewProjection *vp, Mat4x4 m, Vec3 center, f32 radius, f32 *extent_x, f32 *extent_y) {
+  // Camera coords are a linear map of model coords (there is no perspective divide), which maps the sphere to an
+  // ellipsoid spanning `radius * |row|` around the mapped center along each axis.
+  Mat4x4 pvm = mul4x4(vp->proj, mul4x4(vp->view, m));
+  *extent_x = radius * sqrtf(pow2f(pvm.get[0][0]) + pow2f(pvm.get[0][1]) + pow2f(pvm.get[0][2]));
+  *extent_y = radius * sqrtf(pow2f(pvm.get[1][0]) + pow2f(pvm.get[1][1]) + pow2f(pvm.get[1][2]));
+  return transform(pvm, center);
+}
 
-  return 1 / z_;
+static bool sphere_maybe_visible_(
+    const Renderer *renderer, const ViewProjection *vp, Mat4x4 m, Vec3 center, f32 radius) {
+  f32 extent_x, extent_y;
+  Vec3 c = sphere_camera_extent(vp, m, center, radius, &extent_x, &extent_y);
+  return extent_maybe_visible(renderer, c, extent_x, extent_y);
 }
 
-/// Normal vector of a triangle.
-static inline Vec3 triangle_normal(Vec3 p0, Vec3 p1, Vec3 p2) {
-  return cross3(sub3(p2, p0), sub3(p1, p0));
+/// `sphere_maybe_visible_` within the renderer's scissor, for the instances of the draw calls.
+static bool sphere_maybe_visible_in_scissor(
+    const Renderer *renderer, const ViewProjection *vp, Mat4x4 m, Vec3 center, f32 radius) {
+  f32 extent_x, extent_y;
+  Vec3 c = sphere_camera_extent(vp, m, center, radius, &extent_x, &extent_y);
+  return extent_maybe_visible_in_scissor(renderer, c, extent_x, extent_y);
 }
 
-/// The light level of a surface.
-u8 surface_light_level(Vec3 light, Vec3 normal, u8 floor) {
-  // angle = arccos ( (a . b) / (|a| |b|) )
-  f32 angle = acosf(dot3(light, normal) / (abs3(normal) * abs3(light)));
-  if (angle > to_rad(90))
-    return floor;
-  f32 light_level = (1 - (angle / to_rad(90))) * 255;
-  f32 floor_ = (f32)floor;
-  u8 x = (u8)(light_level * (255 - floor_) / 255 + floor_);
-  return x > floor ? x : floor;
+bool sphere_maybe_visible(const Renderer *renderer, Mat4x4 m, Vec3 center, f32 radius) {
+  ViewProjection vp = view_projection(renderer->cam);
+  return sphere_maybe_visible_(renderer, &vp, m, center, radius);
 }
 
-typedef void(draw_pixel_callback_t)(void *cx, usize width, usize height, usize x, usize y, f32 z, u8 light_level);
+f32 screen_scale(const Renderer *renderer, Mat4x4 m) {
+  // See `sphere_camera_extent`.
+  ViewProjection vp = view_projection(renderer->cam);
+  Mat4x4 pvm = mul4x4(vp.proj, mul4x4(vp.view, m));
+  f32 x = sqrtf(pow2f(pvm.get[0][0]) + pow2f(pvm.get[0][1]) + pow2f(pvm.get[0][2])) / renderer->x_ratio;
+  f32 y = sqrtf(pow2f(pvm.get[1][0]) + pow2f(pvm.get[1][1]) + pow2f(pvm.get[1][2])) / renderer->y_ratio;
+  return maxf(x, y);
+}
 
-/// Generally you wouldn't want to call this function yourself, instead define a `draw_pixel_callback` function, and do
-/// `DEF_DRAW_FUNCTIONS(prefix_, _affix, my_draw_pixel_callback`. See `DEF_DRAW_FUNCTIONS` for more information.
-void draw_triangle(Renderer *renderer, Vec3 p0, Vec3 p1, Vec3 p2, Mat4x4 m, draw_pixel_callback_t draw_pixel_callback) {
-  Vec3 p0_ = transform(m, p0);
-  Vec3 p1_ = transform(m, p1);
-  Vec3 p2_ = transform(m, p2);
+Mat4x4 world_to_camera_matrix(const Renderer *renderer) {
+  ViewProjection vp = view_projection(renderer->cam);
+  return mul4x4(vp.proj, vp.view);
+}
+
+/// The center of a bounding box in camera coords, and how far it spans around it along X and Y.
+static Vec3 aabb_camera_extent(const Mat4x4 *world_to_camera, Aabb aabb, f32 *extent_x, f32 *extent_y) {
+  // Like in `sphere_camera_extent`, but the box spans `|row| . half_size` along each axis.
+  Vec3 half_size = {{
+      (aabb.max.get[0] - aabb.min.get[0]) / 2,
+      (aabb.max.get[1] - aabb.min.get[1]) / 2,
+      (aabb.max.get[2] - aabb.min.get[2]) / 2,
+  }};
+  const Mat4x4 *m = world_to_camera;
+  *extent_x = fabsf(m->get[0][0]) * half_size.get[0] + fabsf(m->get[0][1]) * half_size.get[1] +
+              fabsf(m->get[0][2]) * half_size.get[2];
+  *extent_y = fabsf(m->get[1][0]) * half_size.get[0] + fabsf(m->get[1][1]) * half_size.get[1] +
+              fabsf(m->get[1][2]) * half_size.get[2];
+  return transform(*m, aabb_center(aabb));
+}
+
+bool aabb_maybe_visible(const Renderer *renderer, const Mat4x4 *world_to_camera, Aabb aabb) {
+  f32 extent_x, extent_y;
+  Vec3 center = aabb_camera_extent(world_to_camera, aabb, &extent_x, &extent_y);
+  return extent_maybe_visible(renderer, center, extent_x, extent_y);
+}
+
+ScreenRect aabb_screen_rect(const Renderer *renderer, const Mat4x4 *world_to_camera, Aabb aabb) {
+  f32 extent_x, extent_y;
+  Vec3 center = aabb_camera_extent(world_to_camera, aabb, &extent_x, &extent_y);
+  // The same slack as `extent_maybe_visible`.
+  extent_x += 1e-4f * (fabsf(center.get[0]) + extent_x + 1);
+  extent_y += 1e-4f * (fabsf(center.get[1]) + extent_y + 1);
+  return extent_screen_rect(renderer, center, extent_x, extent_y);
+}
+
+static void project_vertices_(
+    const ViewProjection *vp, const Vec3 *vertices, usize len, Mat4x4 m, Vec3 *world, Vec3 *projected) {
+  kernels.transform(&m, vertices, world, len);
+  kernels.transform(&vp->view, world, projected, len);
+  kernels.transform(&vp->proj, projected, projected, len);
+}
+
+void project_vertices(
+    const Renderer *renderer, const Vec3 *vertices, usize len, Mat4x4 m, Vec3 *world, Vec3 *projected) {
+  ViewProjection vp = view_projection(renderer->cam);
+  project_vertices_(&vp, vertices, len, m, world, projected);
+}
+
+static inline ProjectedTriangle assemble_triangle_(
+    const Vec3 *world, const Vec3 *projected, usize i0, usize i1, usize i2, Vec3 light, u8 ambient) {
+  return (ProjectedTriangle){
+      .p0 = projected[i0],
+      .p1 = projected[i1],
+      .p2 = projected[i2],
+      .light_level = surface_light_level(light, triangle_normal(world[i0], world[i1], world[i2]), ambient),
+  };
+}
+
+ProjectedTriangle assemble_triangle(
+    const Renderer *renderer, const Vec3 *world, const Vec3 *projected, usize i0, usize i1, usize i2) {
+  return assemble_triangle_(world, projected, i0, i1, i2, renderer->light, DEFAULT_AMBIENT_LIGHT_LEVEL);
+}
+
+/// Number of pixels `rasterize_triangle` hands to the raster row kernel at a time.
+#define RASTER_CHUNK_LEN 64
+
+/// The first sample of pixel X `x` that is inside the triangle, whether or not it passed the depth test, so that what
+/// the callback gets doesn't depend on what was drawn before. `rows` are those of the samples of the row of the pixel,
+/// `coverage` the samples that passed, the first of which is inside and is the last one tried.
+static usize first_sample_inside(const TriangleSetup *t, const TriangleRow *rows, usize x, u8 coverage, f32 *depth) {
+  usize last = (usize)__builtin_ctz(coverage);
+  for (usize s = 0;; ++s) {
+    const TriangleRow *row = &rows[s];
+    *depth = triangular_interpolate_z(t->p0, t->p1, t->p2, (f32)x * row->x_ratio + row->min_x, row->y);
+    if (*depth != INFINITY || s == last)
+      return s;
+  }
+}
+
+/// The mask of the pixels of a chunk without multisampling, for the draw span callback.
+static const u8 single_sample_coverage[RASTER_CHUNK_LEN] = {[0 ... RASTER_CHUNK_LEN - 1] = 1};
 
-  // The light level of this surface.
-  u8 light_level = surface_light_level(renderer->light, triangle_normal(p0_, p1_, p2_), 20);
+/// `rasterize_triangle` and `rasterize_triangle_spans`, with one of the callbacks (or neither, for the depths alone).
+/// Inlined into both so that each only has the code of its own callback.
+[[gnu::always_inline]] static inline void rasterize_triangle_(Renderer *renderer,
+                                                              ProjectedTriangle triangle,
+                                                              draw_pixel_callback_t draw_pixel_callback,
+                                                              draw_span_callback_t draw_span_callback) {
+  Vec3 p0_proj = triangle.p0;
+  Vec3 p1_proj = triangle.p1;
+  Vec3 p2_proj = triangle.p2;
+  u8 light_level = triangle.light_level;
 
-  // Project the triangle onto the camera plane.
-  Vec3 p0_proj = project_point(renderer->cam, p0_);
-  Vec3 p1_proj = project_point(renderer->cam, p1_);
-  Vec3 p2_proj = project_point(renderer->cam, p2_);
+  RENDER_STATS_ADD(renderer, triangles_submitted, 1);
 
   // Calculate the frame that the triangle occupies so we can skip sampling pixels outside of this frame.
   Camera_ cam = renderer->cam;
@@ -175,50 +540,212 @@ void draw_triangle(Renderer *renderer, Vec3 p0, Vec3 p1, Vec3 p2, Mat4x4 m, draw
   f32 max_x_cam = minf(maxf_x3(p0_proj.get[0], p1_proj.get[0], p2_proj.get[0]), cam.max_x);
   f32 min_y_cam = maxf(minf_x3(p0_proj.get[1], p1_proj.get[1], p2_proj.get[1]), cam.min_y);
   f32 max_y_cam = minf(maxf_x3(p0_proj.get[1], p1_proj.get[1], p2_proj.get[1]), cam.max_y);
+  // The triangle is entirely off-screen.
+  // This also keeps the negative coords of such triangles from being converted to `usize` below.
+  if (!(min_x_cam <= max_x_cam && min_y_cam <= max_y_cam)) {
+    RENDER_STATS_ADD(renderer, triangles_culled, 1);
+    return;
+  }
   // Pixel coords.
   usize min_x = cam_to_screen_x(renderer, min_x_cam);
   usize max_x = cam_to_screen_x(renderer, max_x_cam);
   usize min_y = cam_to_screen_y(renderer, max_y_cam);
   usize max_y = cam_to_screen_y(renderer, min_y_cam);
-  // Adds some extra pixels to the frame to compensate for floating point inaccuracies.
-  min_x = saturating_subzu(min_x, 1);
-  max_x = minzu(saturating_addzu(max_x, 1), renderer->width);
-  min_y = saturating_subzu(min_y, 1);
-  max_y = minzu(saturating_addzu(max_y, 1), renderer->height);
-
-  // Sample and draw the pixels.
+  usize samples = renderer->samples;
+  usize margin = raster_margin(renderer);
+  ScreenRect scissor = renderer->scissor;
+  min_x = maxzu(saturating_subzu(min_x, margin), scissor.min_x);
+  max_x = minzu(saturating_addzu(max_x, margin), scissor.max_x);
+  min_y = maxzu(saturating_subzu(min_y, margin), scissor.min_y);
+  max_y = minzu(saturating_addzu(max_y, margin), scissor.max_y);
+  if (min_x >= max_x || min_y >= max_y) {
+    RENDER_STATS_ADD(renderer, triangles_culled, 1);
+    return;
+  }
+  RENDER_STATS_ADD(renderer, triangles_rasterized, 1);
+  RENDER_STATS_ADD(renderer, pixels_tested, (max_x - min_x) * (max_y - min_y));
+
+  // Sample and draw the pixels, a chunk of a row at a time.
+  TriangleSetup setup = triangle_setup(p0_proj, p1_proj, p2_proj);
+  usize xs[RASTER_CHUNK_LEN];
+  f32 depths[RASTER_CHUNK_LEN];
+  usize covered = 0;
+  bool tiled = renderer->layout == RENDER_LAYOUT_TILED;
+  // With multisampling, every sample is rasterized like the pixel coords of a grid moved by its offset, into its own
+  // depth buffer, and the pixels of the chunk gather the samples that passed.
+  f32 sample_dxs[RENDER_MAX_SAMPLES];
+  f32 sample_dys[RENDER_MAX_SAMPLES];
+  for (usize s = 0; s < samples; ++s) {
+    render_sample_offset(samples, s, &sample_dxs[s], &sample_dys[s]);
+  }
+  TriangleRow sample_rows[RENDER_MAX_SAMPLES];
+  f32 sample_ys[RENDER_MAX_SAMPLES];
+  u8 coverage[RASTER_CHUNK_LEN];
+  f32 pixel_depths[RASTER_CHUNK_LEN];
+  // Only evaluated for the pixels that reach the callback.
+  bool has_callback = draw_pixel_callback != NULL || draw_span_callback != NULL;
+  bool has_varyings = triangle.attributes_len != 0 && has_callback;
+  VaryingsSetup varyings_plane;
+  Varyings varyings = {.len = 0};
+  if (has_varyings) {
+    varyings_plane =
+        varyings_setup(&setup, triangle.attributes, triangle.attributes_len, renderer->x_ratio, cam.min_x);
+    // Camera Y goes up while pixel Y goes down.
+    f32 cam_dy = -renderer->y_ratio;
+    varyings.len = triangle.attributes_len;
+    for (usize i = 0; i < varyings.len; ++i) {
+      varyings.plane_ddx[i] = varyings_plane.step[i];
+      varyings.plane_ddy[i] = varyings_plane.ddy[i] * cam_dy;
+    }
+    varyings.inv_z_ddx = varyings_plane.inv_z_step;
+    varyings.inv_z_ddy = varyings_plane.inv_z_ddy * cam_dy;
+  }
   for (usize y = min_y; y < max_y; ++y) {
-    for (usize x = min_x; x < max_x; ++x) {
-      f32 cam_x = screen_to_cam_x(renderer, x);
-      f32 cam_y = screen_to_cam_y(renderer, y);
-      f32 depth = triangular_interpolate_z(p0_proj, p1_proj, p2_proj, cam_x, cam_y);
-      f32 *prev_depth = &renderer->depth_buffer[y * renderer->width + x];
-      if (depth < *prev_depth) {
-        *prev_depth = depth;
-        if (draw_pixel_callback != NULL)
-          draw_pixel_callback(
-              renderer->draw_pixel_callback_cx, renderer->width, renderer->height, x, y, depth, light_level);
+    f32 y_cam = screen_to_cam_y(renderer, y);
+    TriangleRow row = triangle_row(&setup, y_cam, renderer->x_ratio, cam.min_x);
+    if (has_varyings) {
+      varyings_row(&varyings_plane, y_cam);
+      memcpy(varyings.plane_row, varyings_plane.row, sizeof(f32) * varyings.len);
+    }
+    sample_rows[0] = row;
+    sample_ys[0] = y_cam;
+    for (usize s = 1; s < samples; ++s) {
+      // Camera Y goes up while pixel Y goes down.
+      sample_ys[s] = y_cam - sample_dys[s] * renderer->y_ratio;
+      sample_rows[s] =
+          triangle_row(&setup, sample_ys[s], renderer->x_ratio, cam.min_x + sample_dxs[s] * renderer->x_ratio);
+    }
+    // Index of the depth of pixel X 0 of the row, in each of the depth buffers.
+    usize row_index = y * renderer->stride;
+    for (usize x0 = min_x, x1; x0 < max_x; x0 = x1) {
+      x1 = minzu(x0 + RASTER_CHUNK_LEN, max_x);
+      if (tiled) {
+        // The part of the row within a tile is contiguous, offset so that it is indexed by x like a linear row.
+        x1 = minzu(x1, (x0 / RENDER_TILE_WIDTH + 1) * RENDER_TILE_WIDTH);
+        row_index = render_target_index(RENDER_LAYOUT_TILED, renderer->stride, x0, y) - x0;
+      }
+      usize passed = kernels.raster_row(&row, x0, x1, &renderer->depth_buffer[row_index], xs, depths, &covered);
+      if (samples != 1) {
+        memset(coverage, 0, x1 - x0);
+        for (usize i = 0; i < passed; ++i) {
+          usize j = xs[i] - x0;
+          coverage[j] = 1;
+          pixel_depths[j] = depths[i];
+        }
+        for (usize s = 1; s < samples; ++s) {
+          f32 *sample_depth_row = &renderer->sample_depth_buffers[(s - 1) * depth_buffer_len(renderer) + row_index];
+          // Only the first sample counts for `RenderStats::pixels_covered`.
+          usize sample_covered = 0;
+          usize sample_passed =
+              kernels.raster_row(&sample_rows[s], x0, x1, sample_depth_row, xs, depths, &sample_covered);
+          for (usize i = 0; i < sample_passed; ++i) {
+            coverage[xs[i] - x0] |= (u8)(1 << s);
+          }
+        }
+        // The pixels with any sample that passed, in order of X. The depth of those whose first sample didn't pass is
+        // found for the callback.
+        passed = 0;
+        for (usize j = 0; j < x1 - x0; ++j) {
+          if (coverage[j] == 0)
+            continue;
+          xs[passed] = x0 + j;
+          depths[passed] = pixel_depths[j];
+          ++passed;
+        }
+      }
+      RENDER_STATS_ADD(renderer, depth_test_passes, passed);
+      if (!has_callback)
+        continue;
+      if (draw_span_callback != NULL) {
+        for (usize i = 0, j; i < passed; i = j) {
+          // Only the first pixel of a span may not have its first sample covered, as its depth and varyings are then
+          // those of another sample.
+          for (j = i + 1; j < passed && xs[j] == xs[j - 1] + 1 && (samples == 1 || (coverage[xs[j] - x0] & 1)); ++j) {
+          }
+          usize x = xs[i];
+          const u8 *span_coverage = samples == 1 ? single_sample_coverage : &coverage[x - x0];
+          usize s = 0;
+          if ((span_coverage[0] & 1) == 0)
+            s = first_sample_inside(&setup, sample_rows, x, span_coverage[0], &depths[i]);
+          if (has_varyings && s == 0)
+            varyings_at(&varyings_plane, x, depths[i], varyings.get);
+          else if (has_varyings)
+            varyings_at_point(&varyings_plane, (f32)x + sample_dxs[s], sample_ys[s], depths[i], varyings.get);
+          RENDER_STATS_ADD(renderer, callback_invocations, 1);
+          draw_span_callback(renderer->draw_pixel_callback_cx,
+                             renderer->width,
+                             renderer->height,
+                             y,
+                             x,
+                             xs[j - 1] + 1,
+                             &depths[i],
+                             light_level,
+                             span_coverage,
+                             &varyings);
+        }
+        continue;
+      }
+      RENDER_STATS_ADD(renderer, callback_invocations, passed);
+      for (usize i = 0; i < passed; ++i) {
+        usize x = xs[i];
+        u8 pixel_coverage = samples == 1 ? 1 : coverage[x - x0];
+        usize s = 0;
+        if ((pixel_coverage & 1) == 0)
+          s = first_sample_inside(&setup, sample_rows, x, pixel_coverage, &depths[i]);
+        if (has_varyings && s == 0)
+          varyings_at(&varyings_plane, x, depths[i], varyings.get);
+        else if (has_varyings)
+          varyings_at_point(&varyings_plane, (f32)x + sample_dxs[s], sample_ys[s], depths[i], varyings.get);
+        draw_pixel_callback(renderer->draw_pixel_callback_cx,
+                            renderer->width,
+                            renderer->height,
+                            x,
+                            y,
+                            depths[i],
+                            light_level,
+                            pixel_coverage,
+                            &varyings);
       }
     }
   }
+  RENDER_STATS_ADD(renderer, pixels_covered, covered);
+}
+
+void rasterize_triangle(Renderer *renderer, ProjectedTriangle triangle, draw_pixel_callback_t draw_pixel_callback) {
+  rasterize_triangle_(renderer, triangle, draw_pixel_callback, NULL);
+}
+
+void rasterize_triangle_spans(Renderer *renderer, ProjectedTriangle triangle, draw_span_callback_t draw_span_callback) {
+  rasterize_triangle_(renderer, triangle, NULL, draw_span_callback);
 }
 
-typedef void(draw_triangle_callback_t)(Renderer *renderer, Vec3 p0, Vec3 p1, Vec3 p2, Mat4x4 m);
+/// Generally you wouldn't want to call this function yourself, instead define a `draw_pixel_callback` function, and do
+/// `DEF_DRAW_FUNCTIONS(prefix_, _affix, my_draw_pixel_callback`. See `DEF_DRAW_FUNCTIONS` for more information.
+void draw_triangle(Renderer *renderer, Vec3 p0, Vec3 p1, Vec3 p2, Mat4x4 m, draw_pixel_callback_t draw_pixel_callback) {
+  rasterize_triangle(renderer, project_triangle(renderer, p0, p1, p2, m), draw_pixel_callback);
+}
 
 /// Generally you wouldn't want to call this function yourself, instead define a `draw_pixel_callback` function, and do
 /// `DEF_DRAW_FUNCTIONS(prefix_, _affix, my_draw_pixel_callback)`. See `DEF_DRAW_FUNCTIONS` for more information.
 void draw_object(Renderer *renderer,
                  const Vec3 *vertices,
+                 usize vertices_len,
                  const usize *indices,
                  usize indices_len,
                  Mat4x4 m,
-                 draw_triangle_callback_t draw_triangle) {
+                 rasterize_triangle_callback_t rasterize_triangle) {
+  TRACE_SCOPE("draw_object");
+  ASSERT(indices_len % 3 == 0);
+  ArenaMark mark = arena_mark(&renderer->arena);
+  Vec3 *world = arena_alloc(&renderer->arena, Vec3, vertices_len);
+  Vec3 *projected = arena_alloc(&renderer->arena, Vec3, vertices_len);
+  project_vertices(renderer, vertices, vertices_len, m, world, projected);
   for (usize i = 0; i < indices_len; i += 3) {
-    Vec3 p0 = vertices[indices[i + 0]];
-    Vec3 p1 = vertices[indices[i + 1]];
-    Vec3 p2 = vertices[indices[i + 2]];
-    draw_triangle(renderer, p0, p1, p2, m);
+    ProjectedTriangle triangle =
+        assemble_triangle(renderer, world, projected, indices[i + 0], indices[i + 1], indices[i + 2]);
+    rasterize_triangle(renderer, triangle);
   }
+  arena_restore(&renderer->arena, mark);
 }
 
 /// Generally you wouldn't want to call this function yourself, instead define a `draw_pixel_callback` function, and do
@@ -227,11 +754,81 @@ void draw_object_indexless(Renderer *renderer,
                            const Vec3 *vertices,
                            usize vertices_len,
                            Mat4x4 m,
-                           draw_triangle_callback_t draw_triangle) {
+                           rasterize_triangle_callback_t rasterize_triangle) {
+  TRACE_SCOPE("draw_object_indexless");
+  ASSERT(vertices_len % 3 == 0);
+  ArenaMark mark = arena_mark(&renderer->arena);
+  Vec3 *world = arena_alloc(&renderer->arena, Vec3, vertices_len);
+  Vec3 *projected = arena_alloc(&renderer->arena, Vec3, vertices_len);
+  project_vertices(renderer, vertices, vertices_len, m, world, projected);
   for (usize i = 0; i < vertices_len; i += 3) {
-    Vec3 p0 = vertices[i + 0];
-    Vec3 p1 = vertices[i + 1];
-    Vec3 p2 = vertices[i + 2];
-    draw_triangle(renderer, p0, p1, p2, m);
+    rasterize_triangle(renderer, assemble_triangle(renderer, world, projected, i, i + 1, i + 2));
+  }
+  arena_restore(&renderer->arena, mark);
+}
+
+void draw_object_instanced(Renderer *renderer,
+                           const Mesh *mesh,
+                           const Instance *instances,
+                           usize instances_len,
+                           rasterize_triangle_callback_t rasterize_triangle) {
+  TRACE_SCOPE("draw_object_instanced");
+  ArenaMark mark = arena_mark(&renderer->arena);
+  Vec3 *world = arena_alloc(&renderer->arena, Vec3, mesh->vertices_len);
+  Vec3 *projected = arena_alloc(&renderer->arena, Vec3, mesh->vertices_len);
+  ViewProjection vp = view_projection(renderer->cam);
+  usize triangles_len = mesh_triangles_len(mesh);
+  for (usize i = 0; i < instances_len; ++i) {
+    const Instance *instance = &instances[i];
+    if (!sphere_maybe_visible_in_scissor(renderer, &vp, instance->m, mesh->center, mesh->radius)) {
+      RENDER_STATS_ADD(renderer, objects_culled, 1);
+      continue;
+    }
+    project_vertices_(&vp, mesh->vertices, mesh->vertices_len, instance->m, world, projected);
+    for (usize j = 0; j < triangles_len; ++j) {
+      usize i0 = mesh->indices == NULL ? j * 3 + 0 : mesh->indices[j * 3 + 0];
+      usize i1 = mesh->indices == NULL ? j * 3 + 1 : mesh->indices[j * 3 + 1];
+      usize i2 = mesh->indices == NULL ? j * 3 + 2 : mesh->indices[j * 3 + 2];
+      ProjectedTriangle triangle =
+          assemble_triangle_(world, projected, i0, i1, i2, instance->light, instance->ambient);
+      if (mesh->attributes != NULL)
+        triangle_set_attributes(&triangle, mesh->attributes, mesh->attributes_len, i0, i1, i2);
+      rasterize_triangle(renderer, triangle);
+    }
+  }
+  arena_restore(&renderer->arena, mark);
+}
+
+[[gnu::flatten]] void rasterize_triangle_depth_only(Renderer *renderer, ProjectedTriangle triangle) {
+  rasterize_triangle(renderer, triangle, NULL);
+}
+
+void draw_object_depth_only(Renderer *renderer, const Mesh *mesh, const Instance *instances, usize instances_len) {
+  TRACE_SCOPE("draw_object_depth_only");
+  ArenaMark mark = arena_mark(&renderer->arena);
+  Vec3 *world = arena_alloc(&renderer->arena, Vec3, mesh->vertices_len);
+  Vec3 *projected = arena_alloc(&renderer->arena, Vec3, mesh->vertices_len);
+  ViewProjection vp = view_projection(renderer->cam);
+  usize triangles_len = mesh_triangles_len(mesh);
+  for (usize i = 0; i < instances_len; ++i) {
+    const Instance *instance = &instances[i];
+    if (!sphere_maybe_visible_in_scissor(renderer, &vp, instance->m, mesh->center, mesh->radius)) {
+      RENDER_STATS_ADD(renderer, objects_culled, 1);
+      continue;
+    }
+    // The vertices go through the same matrices one at a time as in `draw_object_instanced`, for the same depths.
+    project_vertices_(&vp, mesh->vertices, mesh->vertices_len, instance->m, world, projected);
+    for (usize j = 0; j < triangles_len; ++j) {
+      usize i0 = mesh->indices == NULL ? j * 3 + 0 : mesh->indices[j * 3 + 0];
+      usize i1 = mesh->indices == NULL ? j * 3 + 1 : mesh->indices[j * 3 + 1];
+      usize i2 = mesh->indices == NULL ? j * 3 + 2 : mesh->indices[j * 3 + 2];
+      ProjectedTriangle triangle = {
+          .p0 = projected[i0],
+          .p1 = projected[i1],
+          .p2 = projected[i2],
+      };
+      rasterize_triangle_depth_only(renderer, triangle);
+    }
   }
+  arena_restore(&renderer->arena, mark);
 }
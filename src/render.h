@@ -2,6 +2,8 @@
 
 #include "common.h"
 #include "linear_alg.h"
+#include "math_helpers.h"
+#include "mesh.h"
 
 /// It's called `Camera_` because Raylib also has a `Camera_`.
 /// For now camera always look in negative X direction.
@@ -23,25 +25,205 @@ typedef struct camera {
   f32 far_clipping_dist;
 } Camera_;
 
+/// Counters of what the renderer did since the last `renderer_clear_frame`.
+/// Only collected when compiled with `-DRENDER_STATS` (`make STATS=1`), otherwise counting compiles to nothing.
+typedef struct render_stats {
+  /// Objects (e.g. instances) that were rejected as a whole before any of their triangles were processed.
+  usize objects_culled;
+  /// Objects that were on-screen but hidden behind the occluders (see occlusion.h), skipped as a whole. Not counted in
+  /// `objects_culled`.
+  usize objects_occluded;
+  usize triangles_submitted;
+  /// Triangles whose bounding box doesn't overlap the screen, skipped before any pixels are tested.
+  usize triangles_culled;
+  usize triangles_rasterized;
+  /// Pixels within the bounding boxes of the rasterized triangles.
+  usize pixels_tested;
+  usize depth_test_passes;
+  /// Pixels that passed the depth test at least once, i.e. pixels that are covered by something. With multisampling,
+  /// a pixel passes if any of its samples does, and is covered once its first sample is.
+  usize pixels_covered;
+  usize callback_invocations;
+} RenderStats;
+
+#ifdef RENDER_STATS
+#define RENDER_STATS_ADD(RENDERER, FIELD, N) ((RENDERER)->stats.FIELD += (N))
+#else
+#define RENDER_STATS_ADD(RENDERER, FIELD, N) ((void)0)
+#endif
+
+/// A rectangle of pixels, from `min_x`, `min_y` (inclusive) to `max_x`, `max_y` (exclusive).
+typedef struct screen_rect {
+  usize min_x;
+  usize min_y;
+  usize max_x;
+  usize max_y;
+} ScreenRect;
+
+static inline bool screen_rect_is_empty(ScreenRect rect) {
+  return rect.min_x >= rect.max_x || rect.min_y >= rect.max_y;
+}
+
+/// The smallest rectangle containing both, an empty one counts as nothing.
+static inline ScreenRect screen_rect_union(ScreenRect a, ScreenRect b) {
+  if (screen_rect_is_empty(a))
+    return b;
+  if (screen_rect_is_empty(b))
+    return a;
+  return (ScreenRect){
+      minzu(a.min_x, b.min_x),
+      minzu(a.min_y, b.min_y),
+      maxzu(a.max_x, b.max_x),
+      maxzu(a.max_y, b.max_y),
+  };
+}
+
+/// May be empty.
+static inline ScreenRect screen_rect_intersection(ScreenRect a, ScreenRect b) {
+  return (ScreenRect){
+      maxzu(a.min_x, b.min_x),
+      maxzu(a.min_y, b.min_y),
+      minzu(a.max_x, b.max_x),
+      minzu(a.max_y, b.max_y),
+  };
+}
+
+/// Alignment of the rows of render targets (see `alloc_render_target`): a cache line, which is also enough for aligned
+/// SIMD loads of every width.
+#define RENDER_TARGET_ALIGNMENT 64
+
+/// Render targets of at least this many bytes are backed by huge pages where the OS allows.
+#define RENDER_TARGET_HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+/// Distance, in elements of `element_size` bytes, between the rows of a render target `width` elements wide. Rows start
+/// on a cache line, and strides that are a multiple of 4 KiB get an extra cache line, since those would map every row
+/// to the same cache sets.
+usize render_target_stride(usize width, usize element_size);
+
+/// Width and height, in pixels, of the tiles of `RENDER_LAYOUT_TILED`, can be overridden at build time to try other
+/// shapes. A row of a tile of depths is then one cache line, and as wide as the widest SIMD registers of the raster
+/// kernels, so that they still process whole vectors within a tile. The width must divide 16 (see
+/// `render_target_stride`).
+#ifndef RENDER_TILE_WIDTH
+#define RENDER_TILE_WIDTH 16
+#endif
+#ifndef RENDER_TILE_HEIGHT
+#define RENDER_TILE_HEIGHT 4
+#endif
+
+/// How the pixels of a render target are laid out in memory.
+typedef enum render_layout {
+  /// Row after row, pixel (x, y) at `y * stride + x`.
+  RENDER_LAYOUT_LINEAR,
+  /// Tiles of `RENDER_TILE_WIDTH` x `RENDER_TILE_HEIGHT` pixels, each stored contiguously row after row, the tiles of
+  /// a row of tiles after one another, so that the pixels that are close on screen are close in memory. The same
+  /// `stride` as the linear layout is used, a row of tiles takes up `stride * RENDER_TILE_HEIGHT` pixels.
+  RENDER_LAYOUT_TILED,
+} RenderLayout;
+
+/// Index of pixel (x, y) in a render target with the given layout and stride.
+static inline usize render_target_index(RenderLayout layout, usize stride, usize x, usize y) {
+  if (layout == RENDER_LAYOUT_LINEAR)
+    return y * stride + x;
+  usize tile_y = y / RENDER_TILE_HEIGHT, tile_x = x / RENDER_TILE_WIDTH;
+  usize tile = (tile_y * stride + tile_x * RENDER_TILE_WIDTH) * RENDER_TILE_HEIGHT;
+  return tile + (y % RENDER_TILE_HEIGHT) * RENDER_TILE_WIDTH + x % RENDER_TILE_WIDTH;
+}
+
+/// Rows to allocate for a render target `height` pixels high, whatever its layout: the last row of tiles is whole.
+static inline usize render_target_rows(usize height) {
+  return (height + RENDER_TILE_HEIGHT - 1) / RENDER_TILE_HEIGHT * RENDER_TILE_HEIGHT;
+}
+
+/// Copy a `RENDER_LAYOUT_TILED` render target into a linear one, e.g. to present or export it. Elements are
+/// `element_size` bytes.
+void detile_render_target(void *linear,
+                          usize linear_stride,
+                          const void *tiled,
+                          usize tiled_stride,
+                          usize width,
+                          usize height,
+                          usize element_size);
+
+/// Memory for a render target (depth buffer, frame buffer) of `size` bytes, aligned to `RENDER_TARGET_ALIGNMENT`. Big
+/// ones are mapped with huge pages (`MAP_HUGETLB`, or transparent huge pages if there are none reserved), since a
+/// frame at high resolution spans so many 4 KiB pages that drawing misses the TLB all the time. Free with
+/// `free_render_target`.
+void *alloc_render_target(usize size);
+
+void free_render_target(void *p);
+
+/// Initial capacity of `Renderer::arena`, it grows to what the frames need.
+#define RENDERER_ARENA_CAPACITY (64 * 1024)
+
+/// Max samples per pixel of multisample anti-aliasing, see `renderer_set_samples`.
+#define RENDER_MAX_SAMPLES 8
+
 /// SAFETY: Only use new_renderer to construct this.
 typedef struct renderer {
+  /// What's drawn, the top left of the render targets, see `renderer_set_resolution`.
   usize width;
   usize height;
+  /// What the render targets were allocated for, `new_renderer`'s size.
+  usize max_width;
+  usize max_height;
   /// For converting between camera coords and pixel coords.
   f32 x_ratio;
   /// For converting between camera coords and pixel coords.
   f32 y_ratio;
-  /// LEN: width * height.
+  /// LEN: stride * render_target_rows(max_height), from `alloc_render_target`.
   f32 *depth_buffer;
+  /// Distance between the rows of `depth_buffer`, in pixels, see `render_target_stride`.
+  usize stride;
+  /// Of `depth_buffer`, linear by default. Only change it before `renderer_clear_frame`.
+  RenderLayout layout;
+  /// Depth samples per pixel, 1 by default, see `renderer_set_samples`.
+  usize samples;
+  /// With multisampling, the depths of the samples after the first, `samples - 1` buffers like `depth_buffer` (same
+  /// stride and layout) one after another. The first sample is at the pixel coords, like without multisampling, and
+  /// its depths are in `depth_buffer`, which is what the shaders read. `NULL` with 1 sample.
+  f32 *sample_depth_buffers;
   Camera_ cam;
   Vec3 light;
+  /// Only the pixels in here are cleared and drawn, the whole screen by default. Narrow it to redraw part of the
+  /// previous frame, see `scene_dirty_rect` of scene.h.
+  ScreenRect scissor;
   void *draw_pixel_callback_cx;
+  /// Transient data of the frame, e.g. the vertices of the vertex stage of the draw calls. Reset by
+  /// `renderer_clear_frame`.
+  Arena arena;
+#ifdef RENDER_STATS
+  RenderStats stats;
+#endif
 } Renderer;
 
 Renderer new_renderer(usize width, usize height, Camera_ cam, Vec3 light);
 
 void free_renderer(Renderer renderer);
 
+/// Turns multisample anti-aliasing on, with 4 or 8 samples per pixel, or off with 1. Coverage and depth are then
+/// tested per sample, each with its own depth, but the draw pixel callback still runs once per pixel per triangle,
+/// with the mask of the samples the triangle covers in that pixel (see `MsaaColorBuffer` of msaa.h for keeping the
+/// colors of the samples). Only call it between frames, before `renderer_clear_frame`.
+void renderer_set_samples(Renderer *renderer, usize samples);
+
+/// Draws `width` x `height` pixels, at most the size the renderer was made with, into the top left of the same render
+/// targets (with the same stride), the camera spanning them all. Resets the scissor to the whole of them. Lowering the
+/// resolution makes frames cheaper without reallocating anything, see `ResolutionController` of resolution.h. Only
+/// call it between frames, before `renderer_clear_frame`.
+void renderer_set_resolution(Renderer *renderer, usize width, usize height);
+
+/// Offset of sample `i` of a pixel with `samples` samples per pixel, in pixels from the pixel coords (X right, Y down).
+void render_sample_offset(usize samples, usize i, f32 *dx, f32 *dy);
+
+/// The depth buffer of sample `i` (`depth_buffer` for the first one), with the stride and layout of `depth_buffer`.
+const f32 *renderer_sample_depth_buffer(const Renderer *renderer, usize i);
+
+/// Extra pixels `rasterize_triangle` samples around the bounding box of a triangle, to compensate for floating point
+/// inaccuracies, and one more for the samples away from the pixel coords. Whatever a triangle touches is within this
+/// many pixels of the pixels its bounding box spans.
+usize raster_margin(const Renderer *renderer);
+
 void check_object_indices(usize vertices_len, usize *indices, usize indices_len);
 
 usize cam_to_screen_x(const Renderer *renderer, f32 x);
@@ -53,26 +235,180 @@ f32 screen_to_cam_x(const Renderer *renderer, usize x);
 
 f32 screen_to_cam_y(const Renderer *renderer, usize y);
 
+/// Clears the depths of the pixels in the scissor, and resets the arena and the statistics.
 void renderer_clear_frame(Renderer *renderer);
 
+/// Query the statistics of the current frame.
+/// Returns `false` (and leaves `stats` untouched) if the renderer was compiled without `RENDER_STATS`.
+bool renderer_stats(const Renderer *renderer, RenderStats *stats);
+
+/// Whether the renderer is compiled with `RENDER_STATS`, i.e. whether `renderer_stats` returns anything.
+static inline bool render_stats_enabled() {
+#ifdef RENDER_STATS
+  return true;
+#else
+  return false;
+#endif
+}
+
+/// Average number of times a covered pixel was written to in this frame.
+f32 render_stats_overdraw(const RenderStats *stats);
+
+/// Add the counters of `other` to `stats`.
+void render_stats_add(RenderStats *stats, const RenderStats *other);
+
 Vec3 transform(Mat4x4 m, Vec3 v);
 
-typedef void(draw_pixel_callback_t)(void *cx, usize width, usize height, usize x, usize y, f32 z, u8 light_level);
+/// The light level of a surface, between `floor` and 255.
+u8 surface_light_level(Vec3 light, Vec3 normal, u8 floor);
+
+/// Light level of the surfaces facing away from the light, unless set otherwise per instance.
+#define DEFAULT_AMBIENT_LIGHT_LEVEL 20
+
+/// An instance lit like everything else drawn by the renderer.
+Instance new_instance(const Renderer *renderer, Mat4x4 m);
+
+/// Returns `false` only if a sphere (in model space), transformed by `m`, is entirely outside the screen, in which case
+/// nothing inside it would be drawn.
+bool sphere_maybe_visible(const Renderer *renderer, Mat4x4 m, Vec3 center, f32 radius);
+
+/// Upper bound of the size in pixels, on screen, of one unit of length in model space transformed by `m`. E.g. the
+/// radius of the bounding sphere of a mesh times this is the radius of its projection.
+f32 screen_scale(const Renderer *renderer, Mat4x4 m);
+
+/// Maps world coords to camera coords in one matrix, for culling many things at once with `aabb_maybe_visible`.
+Mat4x4 world_to_camera_matrix(const Renderer *renderer);
+
+/// Returns `false` only if a bounding box in world space is entirely outside the screen, in which case nothing inside
+/// it would be drawn. `world_to_camera` is from `world_to_camera_matrix`.
+bool aabb_maybe_visible(const Renderer *renderer, const Mat4x4 *world_to_camera, Aabb aabb);
+
+/// The pixels that drawing anything inside a bounding box in world space may touch (the same ones `rasterize_triangle`
+/// would sample), within the screen but regardless of the scissor. Empty if the box is entirely off-screen.
+/// `world_to_camera` is from `world_to_camera_matrix`.
+ScreenRect aabb_screen_rect(const Renderer *renderer, const Mat4x4 *world_to_camera, Aabb aabb);
+
+/// The vertex attributes of a triangle (see `Mesh::attributes`) interpolated at a pixel. Like the depth, they are
+/// interpolated perspective-correctly: attribute/z is what's linear in camera coords.
+typedef struct varyings {
+  /// 0 for triangles without attributes.
+  usize len;
+  f32 get[MAX_VERTEX_ATTRIBUTES];
+  /// Attribute/z at pixel X 0 of the row, for the draw span callback (see `varyings_span_at`).
+  f32 plane_row[MAX_VERTEX_ATTRIBUTES];
+  /// Change of attribute/z per pixel along X and Y, the same for every pixel of the triangle.
+  f32 plane_ddx[MAX_VERTEX_ATTRIBUTES];
+  f32 plane_ddy[MAX_VERTEX_ATTRIBUTES];
+  /// Change of 1/z per pixel along X and Y.
+  f32 inv_z_ddx, inv_z_ddy;
+} Varyings;
+
+/// The screen-space derivatives of attribute `i` at a pixel of depth `z`, i.e. its change per pixel along X and Y
+/// (e.g. for picking a mip level). Only costs something for the callbacks that need them.
+static inline void varyings_derivatives(const Varyings *varyings, usize i, f32 z, f32 *ddx, f32 *ddy) {
+  // d(q / w) = (dq - q / w * dw) / w, with q = attribute/z and w = 1/z.
+  *ddx = (varyings->plane_ddx[i] - varyings->get[i] * varyings->inv_z_ddx) * z;
+  *ddy = (varyings->plane_ddy[i] - varyings->get[i] * varyings->inv_z_ddy) * z;
+}
+
+/// Attribute `i` at pixel X `x` of a span of depth `z` (see `draw_span_callback_t`), the same value as `get[i]` in the
+/// draw pixel callback of that pixel.
+static inline f32 varyings_span_at(const Varyings *varyings, usize i, usize x, f32 z) {
+  return (varyings->plane_row[i] + varyings->plane_ddx[i] * (f32)x) * z;
+}
+
+/// `width` and `height` are those of the renderer. The callback indexes its own buffers, with their own stride.
+/// `coverage` has bit `i` set if sample `i` of the pixel is covered by the triangle (and passed the depth test), it is
+/// 1 without multisampling (see `renderer_set_samples`). `z` and `varyings` are those at the first covered sample, so
+/// that they don't come from outside the triangle. `varyings` is only valid during the call.
+typedef void(draw_pixel_callback_t)(void *cx,
+                                    usize width,
+                                    usize height,
+                                    usize x,
+                                    usize y,
+                                    f32 z,
+                                    u8 light_level,
+                                    u8 coverage,
+                                    const Varyings *varyings);
+
+/// The draw pixel callback for a run of pixels `x_begin..x_end` of row `y`, all covered by the triangle and passing the
+/// depth test, so that it can write them with wide stores (e.g. a `memset` of the light level). `depths` and `coverage`
+/// have one entry per pixel of the span, `coverage` being all 1 without multisampling. A span never crosses a chunk of
+/// the raster loop (`RASTER_CHUNK_LEN` pixels), nor a tile in `RENDER_LAYOUT_TILED`, so its pixels are contiguous in
+/// either layout. `varyings->get` is that of pixel `x_begin`, the others are given by `varyings_span_at`. With
+/// multisampling, only the first pixel of a span may lack its first sample, its depth and varyings then being those at
+/// its first covered sample, as for the draw pixel callback.
+typedef void(draw_span_callback_t)(void *cx,
+                                   usize width,
+                                   usize height,
+                                   usize y,
+                                   usize x_begin,
+                                   usize x_end,
+                                   const f32 *depths,
+                                   u8 light_level,
+                                   const u8 *coverage,
+                                   const Varyings *varyings);
+
+/// A triangle that went through the vertex stage (model transform, lighting and projection), ready to be rasterized.
+typedef struct projected_triangle {
+  /// Projected vertices, in camera coords.
+  Vec3 p0;
+  Vec3 p1;
+  Vec3 p2;
+  u8 light_level;
+  /// Number of attributes of each vertex, 0 if the triangle has none.
+  u8 attributes_len;
+  /// Attributes of p0, p1, p2, see `triangle_set_attributes`. Not owned, must stay alive until the triangle is
+  /// rasterized.
+  const f32 *attributes[3];
+} ProjectedTriangle;
+
+/// Gives a triangle the attributes of the vertices `i0`, `i1`, `i2` of `attributes`, which has `attributes_len` values
+/// per vertex (see `Mesh::attributes`).
+static inline void triangle_set_attributes(
+    ProjectedTriangle *triangle, const f32 *attributes, usize attributes_len, usize i0, usize i1, usize i2) {
+  ASSERT(attributes_len <= MAX_VERTEX_ATTRIBUTES);
+  triangle->attributes_len = (u8)attributes_len;
+  triangle->attributes[0] = &attributes[i0 * attributes_len];
+  triangle->attributes[1] = &attributes[i1 * attributes_len];
+  triangle->attributes[2] = &attributes[i2 * attributes_len];
+}
+
+/// The vertex stage of `draw_triangle`.
+ProjectedTriangle project_triangle(const Renderer *renderer, Vec3 p0, Vec3 p1, Vec3 p2, Mat4x4 m);
+
+/// The vertex stage of many vertices at once: model transform into `world`, then projection into `projected`. Both
+/// must have room for `len` vertices. Gives the same results as `project_triangle`, using the transform kernel (see
+/// dispatch.h).
+void project_vertices(
+    const Renderer *renderer, const Vec3 *vertices, usize len, Mat4x4 m, Vec3 *world, Vec3 *projected);
+
+/// A triangle of vertices that went through `project_vertices`, by their indices.
+ProjectedTriangle assemble_triangle(
+    const Renderer *renderer, const Vec3 *world, const Vec3 *projected, usize i0, usize i1, usize i2);
+
+/// The raster stage of `draw_triangle`.
+void rasterize_triangle(Renderer *renderer, ProjectedTriangle triangle, draw_pixel_callback_t draw_pixel_callback);
+
+/// `rasterize_triangle` with a draw span callback, calling it once per run of contiguous pixels instead of once per
+/// pixel. Draws the same pixels, with the same depths and varyings. See `DEF_DRAW_SPAN_FUNCTIONS`.
+void rasterize_triangle_spans(Renderer *renderer, ProjectedTriangle triangle, draw_span_callback_t draw_span_callback);
 
 /// Generally you wouldn't want to call this function yourself, instead define a `draw_pixel_callback` function, and do
 /// `DEF_DRAW_FUNCTIONS(prefix_, _affix, my_draw_pixel_callback`. See `DEF_DRAW_FUNCTIONS` for more information.
 void draw_triangle(Renderer *renderer, Vec3 p0, Vec3 p1, Vec3 p2, Mat4x4 m, draw_pixel_callback_t draw_pixel_callback);
 
-typedef void(draw_triangle_callback_t)(Renderer *renderer, Vec3 p0, Vec3 p1, Vec3 p2, Mat4x4 m);
+typedef void(rasterize_triangle_callback_t)(Renderer *renderer, ProjectedTriangle triangle);
 
 /// Generally you wouldn't want to call this function yourself, instead define a `draw_pixel_callback` function, and do
 /// `DEF_DRAW_FUNCTIONS(prefix_, _affix, my_draw_pixel_callback)`. See `DEF_DRAW_FUNCTIONS` for more information.
 void draw_object(Renderer *renderer,
                  const Vec3 *vertices,
+                 usize vertices_len,
                  const usize *indices,
                  usize indices_len,
                  Mat4x4 m,
-                 draw_triangle_callback_t draw_triangle);
+                 rasterize_triangle_callback_t rasterize_triangle);
 
 /// Generally you wouldn't want to call this function yourself, instead define a `draw_pixel_callback` function, and do
 /// `DEF_DRAW_FUNCTIONS(prefix_, _affix, my_draw_pixel_callback)`. See `DEF_DRAW_FUNCTIONS` for more information.
@@ -80,55 +416,156 @@ void draw_object_indexless(Renderer *renderer,
                            const Vec3 *vertices,
                            usize vertices_len,
                            Mat4x4 m,
-                           draw_triangle_callback_t draw_triangle);
+                           rasterize_triangle_callback_t rasterize_triangle);
+
+/// Draw many copies of one mesh. Instances whose bounding sphere is off-screen are skipped, the others are drawn one
+/// after another with the mesh staying in cache. Gives the same result as `draw_object` (or `draw_object_indexless`)
+/// with each of the model matrices, if the instances are lit like the renderer. Unlike those, the triangles carry the
+/// attributes of the mesh, if it has any.
+///
+/// Generally you wouldn't want to call this function yourself, instead define a `draw_pixel_callback` function, and do
+/// `DEF_DRAW_FUNCTIONS(prefix_, _affix, my_draw_pixel_callback)`. See `DEF_DRAW_FUNCTIONS` for more information.
+void draw_object_instanced(Renderer *renderer,
+                           const Mesh *mesh,
+                           const Instance *instances,
+                           usize instances_len,
+                           rasterize_triangle_callback_t rasterize_triangle);
+
+/// The raster stage specialized for filling the depth buffer alone: `rasterize_triangle` without a draw pixel
+/// callback, so that the pixels that pass are only written to the depth buffer.
+void rasterize_triangle_depth_only(Renderer *renderer, ProjectedTriangle triangle);
 
-/// This macro defines `draw_triangle_xxx`, `draw_object_xxx`, `draw_object_indexless_xxx` function in its header form.
-/// These functions are monomorphosized versions of `draw_triangle`, `draw_object`, `draw_object_indexless`, which are
-/// generic over a `draw_pixel_callback` function.
+/// `draw_object_instanced` specialized for filling the depth buffer alone (shadow maps, occlusion buffers): the
+/// triangles aren't lit, don't carry the attributes of the mesh and go through `rasterize_triangle_depth_only`, the
+/// `light` and `ambient` of the instances are ignored. Gives the same depths.
+void draw_object_depth_only(Renderer *renderer, const Mesh *mesh, const Instance *instances, usize instances_len);
+
+/// This macro defines `draw_triangle_xxx`, `rasterize_triangle_xxx`, `draw_object_xxx`, `draw_object_indexless_xxx`,
+/// `draw_object_instanced_xxx` function in its header form.
+/// These functions are monomorphosized versions of `draw_triangle`, `rasterize_triangle`, `draw_object`,
+/// `draw_object_indexless`, `draw_object_instanced`, which are generic over a `draw_pixel_callback` function.
 /// On GCC and Clang, the monomorphosation process should have zero overhead.
 ///
 /// Example:
 ///
 /// ```
-/// void my_draw_pixel_callback(void *cx, usize width, usize height, usize x, usize y, f32 depth, u8 light_level) {
+/// void my_draw_pixel_callback(void *cx,
+///                             usize width,
+///                             usize height,
+///                             usize x,
+///                             usize y,
+///                             f32 depth,
+///                             u8 light_level,
+///                             u8 coverage,
+///                             const Varyings *varyings) {
 ///   // ...
 /// }
 ///
 /// DEF_DRAW_FUNCTIONS(my_, _function, my_draw_pixel_callback);
 /// ```
 ///
-/// The above would define `my_draw_triangle_function`, `my_draw_object_function`, `my_draw_object_indexless_function`.
+/// The above would define `my_draw_triangle_function`, `my_rasterize_triangle_function`, `my_draw_object_function`,
+/// `my_draw_object_indexless_function`, `my_draw_object_instanced_function`.
 #define DEF_DRAW_FUNCTIONS_HEADER(PREFIX, AFFIX, DRAW_PIXEL_CALLBACK)                                                  \
   void PREFIX##draw_triangle##AFFIX(Renderer *renderer, Vec3 p0, Vec3 p1, Vec3 p2, Mat4x4 m);                          \
-  void PREFIX##draw_object##AFFIX(                                                                                     \
-      Renderer *renderer, const Vec3 *vertices, const usize *indices, usize indices_len, Mat4x4 m);                    \
-  void PREFIX##draw_object_indexless##AFFIX(Renderer *renderer, const Vec3 *vertices, usize vertices_len, Mat4x4 m);
+  void PREFIX##rasterize_triangle##AFFIX(Renderer *renderer, ProjectedTriangle triangle);                              \
+  void PREFIX##draw_object##AFFIX(Renderer *renderer,                                                                  \
+                                  const Vec3 *vertices,                                                                \
+                                  usize vertices_len,                                                                  \
+                                  const usize *indices,                                                                \
+                                  usize indices_len,                                                                   \
+                                  Mat4x4 m);                                                                           \
+  void PREFIX##draw_object_indexless##AFFIX(Renderer *renderer, const Vec3 *vertices, usize vertices_len, Mat4x4 m);   \
+  void PREFIX##draw_object_instanced##AFFIX(                                                                           \
+      Renderer *renderer, const Mesh *mesh, const Instance *instances, usize instances_len);
 
-/// This macro defines `draw_triangle_xxx`, `draw_object_xxx`, `draw_object_indexless_xxx` function.
-/// These functions are monomorphosized versions of `draw_triangle`, `draw_object`, `draw_object_indexless`, which are
-/// generic over a `draw_pixel_callback` function.
+/// This macro defines `draw_triangle_xxx`, `rasterize_triangle_xxx`, `draw_object_xxx`, `draw_object_indexless_xxx`,
+/// `draw_object_instanced_xxx` function.
+/// These functions are monomorphosized versions of `draw_triangle`, `rasterize_triangle`, `draw_object`,
+/// `draw_object_indexless`, `draw_object_instanced`, which are generic over a `draw_pixel_callback` function.
 /// On GCC and Clang, the monomorphosation process should have zero overhead.
 ///
 /// Example:
 ///
 /// ```
-/// void my_draw_pixel_callback(void *cx, usize width, usize height, usize x, usize y, f32 depth, u8 light_level) {
+/// void my_draw_pixel_callback(void *cx,
+///                             usize width,
+///                             usize height,
+///                             usize x,
+///                             usize y,
+///                             f32 depth,
+///                             u8 light_level,
+///                             u8 coverage,
+///                             const Varyings *varyings) {
 ///   // ...
 /// }
 ///
 /// DEF_DRAW_FUNCTIONS(my_, _function, my_draw_pixel_callback);
 /// ```
 ///
-/// The above would define `my_draw_triangle_function`, `my_draw_object_function`, `my_draw_object_indexless_function`.
+/// The above would define `my_draw_triangle_function`, `my_rasterize_triangle_function`, `my_draw_object_function`,
+/// `my_draw_object_indexless_function`, `my_draw_object_instanced_function`.
 #define DEF_DRAW_FUNCTIONS(PREFIX, AFFIX, DRAW_PIXEL_CALLBACK)                                                         \
   [[gnu::flatten]] void PREFIX##draw_triangle##AFFIX(Renderer *renderer, Vec3 p0, Vec3 p1, Vec3 p2, Mat4x4 m) {        \
     draw_triangle(renderer, p0, p1, p2, m, DRAW_PIXEL_CALLBACK);                                                       \
   }                                                                                                                    \
-  [[gnu::flatten]] void PREFIX##draw_object##AFFIX(                                                                    \
-      Renderer *renderer, const Vec3 *vertices, const usize *indices, usize indices_len, Mat4x4 m) {                   \
-    draw_object(renderer, vertices, indices, indices_len, m, PREFIX##draw_triangle##AFFIX);                            \
+  [[gnu::flatten]] void PREFIX##rasterize_triangle##AFFIX(Renderer *renderer, ProjectedTriangle triangle) {          \
+    rasterize_triangle(renderer, triangle, DRAW_PIXEL_CALLBACK);                                                       \
+  }                                                                                                                    \
+  DEF_DRAW_OBJECT_FUNCTIONS_(PREFIX, AFFIX)
+
+/// The draw object functions of `DEF_DRAW_FUNCTIONS` and `DEF_DRAW_SPAN_FUNCTIONS`, over their
+/// `rasterize_triangle_xxx`.
+#define DEF_DRAW_OBJECT_FUNCTIONS_(PREFIX, AFFIX)                                                                      \
+  [[gnu::flatten]] void PREFIX##draw_object##AFFIX(Renderer *renderer,                                                 \
+                                                   const Vec3 *vertices,                                               \
+                                                   usize vertices_len,                                                 \
+                                                   const usize *indices,                                               \
+                                                   usize indices_len,                                                  \
+                                                   Mat4x4 m) {                                                         \
+    draw_object(renderer, vertices, vertices_len, indices, indices_len, m, PREFIX##rasterize_triangle##AFFIX);         \
   }                                                                                                                    \
   [[gnu::flatten]] void PREFIX##draw_object_indexless##AFFIX(                                                          \
       Renderer *renderer, const Vec3 *vertices, usize vertices_len, Mat4x4 m) {                                        \
-    draw_object_indexless(renderer, vertices, vertices_len, m, PREFIX##draw_triangle##AFFIX);                          \
+    draw_object_indexless(renderer, vertices, vertices_len, m, PREFIX##rasterize_triangle##AFFIX);                     \
+  }                                                                                                                    \
+  [[gnu::flatten]] void PREFIX##draw_object_instanced##AFFIX(                                                          \
+      Renderer *renderer, const Mesh *mesh, const Instance *instances, usize instances_len) {                          \
+    draw_object_instanced(renderer, mesh, instances, instances_len, PREFIX##rasterize_triangle##AFFIX);                \
   }
+
+/// `DEF_DRAW_FUNCTIONS_HEADER` for a draw span callback, see `DEF_DRAW_SPAN_FUNCTIONS`.
+#define DEF_DRAW_SPAN_FUNCTIONS_HEADER(PREFIX, AFFIX, DRAW_SPAN_CALLBACK)                                              \
+  DEF_DRAW_FUNCTIONS_HEADER(PREFIX, AFFIX, DRAW_SPAN_CALLBACK)
+
+/// `DEF_DRAW_FUNCTIONS` for a draw span callback (see `draw_span_callback_t`): defines the same functions, which
+/// rasterize with `rasterize_triangle_spans`.
+///
+/// Example:
+///
+/// ```
+/// void my_draw_span_callback(void *cx,
+///                            usize width,
+///                            usize height,
+///                            usize y,
+///                            usize x_begin,
+///                            usize x_end,
+///                            const f32 *depths,
+///                            u8 light_level,
+///                            const u8 *coverage,
+///                            const Varyings *varyings) {
+///   MyCx *my_cx = cx;
+///   // A `RENDER_LAYOUT_LINEAR` frame buffer, `render_target_index` gives the start of the span in either layout.
+///   memset(&my_cx->frame_buffer[y * my_cx->stride + x_begin], light_level, x_end - x_begin);
+/// }
+///
+/// DEF_DRAW_SPAN_FUNCTIONS(my_, _function, my_draw_span_callback);
+/// ```
+#define DEF_DRAW_SPAN_FUNCTIONS(PREFIX, AFFIX, DRAW_SPAN_CALLBACK)                                                     \
+  [[gnu::flatten]] void PREFIX##rasterize_triangle##AFFIX(Renderer *renderer, ProjectedTriangle triangle) {          \
+    rasterize_triangle_spans(renderer, triangle, DRAW_SPAN_CALLBACK);                                                  \
+  }                                                                                                                    \
+  [[gnu::flatten]] void PREFIX##draw_triangle##AFFIX(Renderer *renderer, Vec3 p0, Vec3 p1, Vec3 p2, Mat4x4 m) {        \
+    rasterize_triangle_spans(renderer, project_triangle(renderer, p0, p1, p2, m), DRAW_SPAN_CALLBACK);                 \
+  }                                                                                                                    \
+  DEF_DRAW_OBJECT_FUNCTIONS_(PREFIX, AFFIX)
@@ -0,0 +1,249 @@
+#include "replay.h"
+
+static const char frame_log_magic[8] = "RNDRLOG2";
+
+enum {
+  FRAME_LOG_CAM_POS = 1 << 0,
+  FRAME_LOG_FOV = 1 << 1,
+  FRAME_LOG_SHADER_KIND = 1 << 2,
+  /// The booleans of `FrameToggles` and the shadow filter, packed into a byte as `FRAME_LOG_TOGGLE_*`.
+  FRAME_LOG_TOGGLES = 1 << 3,
+  FRAME_LOG_RESOLUTION_SCALE = 1 << 4,
+};
+
+enum {
+  FRAME_LOG_TOGGLE_SHADOWS = 1 << 0,
+  FRAME_LOG_TOGGLE_COLORS = 1 << 1,
+  FRAME_LOG_TOGGLE_REDRAW_ALL = 1 << 2,
+  FRAME_LOG_TOGGLE_DYNAMIC_RESOLUTION = 1 << 3,
+  /// The shadow filter is in the bits above.
+  FRAME_LOG_TOGGLE_FILTER_SHIFT = 4,
+};
+
+/// The state before the first frame, which the first record is relative to.
+static const FrameInput initial_frame_input = {
+    .time_ms = 0,
+    .cam_pos = {{0, 0, 0}},
+    .fov = 0,
+    .shader_kind = SHADER_KIND_DEFAULT,
+    .toggles =
+        {
+            .shadows = false,
+            .shadow_filter = SHADOW_FILTER_PCF_2X2,
+            .colors = false,
+            .redraw_all = false,
+            .dynamic_resolution = false,
+            .resolution_scale = 1,
+        },
+};
+
+static u8 pack_toggles(const FrameToggles *toggles) {
+  return (toggles->shadows ? FRAME_LOG_TOGGLE_SHADOWS : 0) | (toggles->colors ? FRAME_LOG_TOGGLE_COLORS : 0) |
+         (toggles->redraw_all ? FRAME_LOG_TOGGLE_REDRAW_ALL : 0) |
+         (toggles->dynamic_resolution ? FRAME_LOG_TOGGLE_DYNAMIC_RESOLUTION : 0) |
+         (u8)(toggles->shadow_filter << FRAME_LOG_TOGGLE_FILTER_SHIFT);
+}
+
+/// Returns `false` if the shadow filter is out of range.
+static bool unpack_toggles(u8 packed, FrameToggles *toggles) {
+  u8 filter = packed >> FRAME_LOG_TOGGLE_FILTER_SHIFT;
+  if (filter > SHADOW_FILTER_PCF_4X4)
+    return false;
+  toggles->shadows = (packed & FRAME_LOG_TOGGLE_SHADOWS) != 0;
+  toggles->colors = (packed & FRAME_LOG_TOGGLE_COLORS) != 0;
+  toggles->redraw_all = (packed & FRAME_LOG_TOGGLE_REDRAW_ALL) != 0;
+  toggles->dynamic_resolution = (packed & FRAME_LOG_TOGGLE_DYNAMIC_RESOLUTION) != 0;
+  toggles->shadow_filter = (ShadowFilter)filter;
+  return true;
+}
+
+static void write_leb128(FILE *file, u64 x) {
+  do {
+    u8 byte = x & 0x7F;
+    x >>= 7;
+    fputc(byte | (x != 0 ? 0x80 : 0), file);
+  } while (x != 0);
+}
+
+static bool read_leb128(FILE *file, u64 *x) {
+  *x = 0;
+  for (u32 shift = 0; shift < 64; shift += 7) {
+    i32 byte = fgetc(file);
+    if (byte == EOF)
+      return false;
+    *x |= (u64)(byte & 0x7F) << shift;
+    if ((byte & 0x80) == 0)
+      return true;
+  }
+  return false;
+}
+
+static void write_f32(FILE *file, f32 x) {
+  u32 bits;
+  memcpy(&bits, &x, sizeof(bits));
+  for (u32 i = 0; i < 4; ++i) {
+    fputc((u8)(bits >> (i * 8)), file);
+  }
+}
+
+static bool read_f32(FILE *file, f32 *x) {
+  u32 bits = 0;
+  for (u32 i = 0; i < 4; ++i) {
+    i32 byte = fgetc(file);
+    if (byte == EOF)
+      return false;
+    bits |= (u32)byte << (i * 8);
+  }
+  memcpy(x, &bits, sizeof(bits));
+  return true;
+}
+
+bool open_frame_recorder(FrameRecorder *recorder, const char *path) {
+  FILE *file = fopen(path, "wb");
+  if (file == NULL)
+    return false;
+  fwrite(frame_log_magic, 1, sizeof(frame_log_magic), file);
+  *recorder = (FrameRecorder){
+      .file = file,
+      .prev = initial_frame_input,
+  };
+  return true;
+}
+
+void record_frame(FrameRecorder *recorder, const FrameInput *input) {
+  const FrameInput *prev = &recorder->prev;
+  u8 flags = 0;
+  if (memcmp(&input->cam_pos, &prev->cam_pos, sizeof(Vec3)) != 0)
+    flags |= FRAME_LOG_CAM_POS;
+  if (input->fov != prev->fov)
+    flags |= FRAME_LOG_FOV;
+  if (input->shader_kind != prev->shader_kind)
+    flags |= FRAME_LOG_SHADER_KIND;
+  if (pack_toggles(&input->toggles) != pack_toggles(&prev->toggles))
+    flags |= FRAME_LOG_TOGGLES;
+  if (input->toggles.resolution_scale != prev->toggles.resolution_scale)
+    flags |= FRAME_LOG_RESOLUTION_SCALE;
+  DEBUG_ASSERT(input->time_ms >= prev->time_ms);
+
+  fputc(flags, recorder->file);
+  write_leb128(recorder->file, input->time_ms - prev->time_ms);
+  if (flags & FRAME_LOG_CAM_POS) {
+    for (usize i = 0; i < 3; ++i) {
+      write_f32(recorder->file, input->cam_pos.get[i]);
+    }
+  }
+  if (flags & FRAME_LOG_FOV)
+    write_f32(recorder->file, input->fov);
+  if (flags & FRAME_LOG_SHADER_KIND)
+    fputc((u8)input->shader_kind, recorder->file);
+  if (flags & FRAME_LOG_TOGGLES)
+    fputc(pack_toggles(&input->toggles), recorder->file);
+  if (flags & FRAME_LOG_RESOLUTION_SCALE)
+    write_f32(recorder->file, input->toggles.resolution_scale);
+  recorder->prev = *input;
+}
+
+bool close_frame_recorder(FrameRecorder *recorder) {
+  bool ok = !ferror(recorder->file);
+  ok &= fclose(recorder->file) == 0;
+  recorder->file = NULL;
+  return ok;
+}
+
+/// Read one record, returns `false` on a truncated or invalid record.
+static bool read_frame(FILE *file, const FrameInput *prev, FrameInput *input) {
+  i32 flags = fgetc(file);
+  if (flags == EOF)
+    return false;
+  *input = *prev;
+  u64 dt_ms;
+  if (!read_leb128(file, &dt_ms))
+    return false;
+  input->time_ms += dt_ms;
+  if (flags & FRAME_LOG_CAM_POS) {
+    for (usize i = 0; i < 3; ++i) {
+      if (!read_f32(file, &input->cam_pos.get[i]))
+        return false;
+    }
+  }
+  if ((flags & FRAME_LOG_FOV) && !read_f32(file, &input->fov))
+    return false;
+  if (flags & FRAME_LOG_SHADER_KIND) {
+    i32 shader_kind = fgetc(file);
+    if (shader_kind == EOF || shader_kind > SHADER_KIND_HIGHLIGHT_ONLY)
+      return false;
+    input->shader_kind = (ShaderKind)shader_kind;
+  }
+  if (flags & FRAME_LOG_TOGGLES) {
+    i32 toggles = fgetc(file);
+    if (toggles == EOF || !unpack_toggles((u8)toggles, &input->toggles))
+      return false;
+  }
+  if (flags & FRAME_LOG_RESOLUTION_SCALE) {
+    f32 *scale = &input->toggles.resolution_scale;
+    if (!read_f32(file, scale) || !(*scale > 0 && *scale <= 1))
+      return false;
+  }
+  return true;
+}
+
+bool load_frame_log(const char *path, FrameLog *log) {
+  FILE *file = fopen(path, "rb");
+  if (file == NULL)
+    return false;
+  char magic[sizeof(frame_log_magic)];
+  if (fread(magic, 1, sizeof(magic), file) != sizeof(magic) || memcmp(magic, frame_log_magic, sizeof(magic)) != 0) {
+    fclose(file);
+    return false;
+  }
+  usize cap = 256;
+  *log = (FrameLog){
+      .frames = xalloc(FrameInput, cap),
+      .len = 0,
+  };
+  FrameInput prev = initial_frame_input;
+  bool ok = true;
+  for (i32 c; (c = fgetc(file)) != EOF;) {
+    ungetc(c, file);
+    FrameInput input;
+    if (!read_frame(file, &prev, &input)) {
+      ok = false;
+      break;
+    }
+    if (log->len == cap) {
+      cap *= 2;
+      log->frames = xrealloc(log->frames, FrameInput, cap);
+    }
+    log->frames[log->len++] = input;
+    prev = input;
+  }
+  ok &= !ferror(file);
+  fclose(file);
+  if (!ok)
+    free_frame_log(*log);
+  return ok;
+}
+
+void free_frame_log(FrameLog log) {
+  xfree(log.frames);
+}
+
+FrameInput current_frame_input(u64 time_ms,
+                               const Renderer *renderer,
+                               ShaderKind shader_kind,
+                               const FrameToggles *toggles) {
+  return (FrameInput){
+      .time_ms = time_ms,
+      .cam_pos = renderer->cam.pos,
+      .fov = renderer->cam.fov,
+      .shader_kind = shader_kind,
+      .toggles = *toggles,
+  };
+}
+
+void apply_frame_input(const FrameInput *input, Renderer *renderer, ShaderKind *shader_kind, FrameToggles *toggles) {
+  renderer->cam.pos = input->cam_pos;
+  renderer->cam.fov = input->fov;
+  *shader_kind = input->shader_kind;
+  *toggles = input->toggles;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "common.h"
+#include "linear_alg.h"
+#include "render.h"
+#include "shaders.h"
+#include "shadow.h"
+
+// Recording and replaying the sequence of frames of a session, so that the exact same frames can be re-rendered for
+// comparing the performance of different builds.
+//
+// The log is a binary file: the 8-byte magic "RNDRLOG2", followed by one record per frame. Each record is one byte of
+// flags telling which fields changed since the previous frame, the time since the previous frame in milliseconds as an
+// unsigned LEB128, and then only the changed fields (little-endian). A frame where only time passed takes 2 bytes.
+
+/// The settings toggled at runtime in the GUI (see `GuiPainter`), which change what a frame costs.
+typedef struct frame_toggles {
+  bool shadows;
+  ShadowFilter shadow_filter;
+  bool colors;
+  bool redraw_all;
+  bool dynamic_resolution;
+  /// Of the width and height the frame is rendered at, see `ResolutionController::scale`. Only with
+  /// `dynamic_resolution`, replays render at the recorded scale instead of adapting it.
+  f32 resolution_scale;
+} FrameToggles;
+
+/// Everything that decides what a frame looks like.
+typedef struct frame_input {
+  /// Time of the frame, see `FrameClock::now_ms`.
+  u64 time_ms;
+  Vec3 cam_pos;
+  f32 fov;
+  ShaderKind shader_kind;
+  FrameToggles toggles;
+} FrameInput;
+
+typedef struct frame_recorder {
+  FILE *file;
+  /// The fields of the first frame are compared against this.
+  FrameInput prev;
+} FrameRecorder;
+
+/// A loaded log.
+typedef struct frame_log {
+  FrameInput *frames;
+  usize len;
+} FrameLog;
+
+/// Returns `false` if the file cannot be created.
+bool open_frame_recorder(FrameRecorder *recorder, const char *path);
+
+void record_frame(FrameRecorder *recorder, const FrameInput *input);
+
+/// Returns `false` if writing the log failed.
+bool close_frame_recorder(FrameRecorder *recorder);
+
+/// Returns `false` if the file cannot be read or is not a valid log.
+bool load_frame_log(const char *path, FrameLog *log);
+
+void free_frame_log(FrameLog log);
+
+/// The `FrameInput` of the frame currently being rendered.
+FrameInput current_frame_input(u64 time_ms,
+                               const Renderer *renderer,
+                               ShaderKind shader_kind,
+                               const FrameToggles *toggles);
+
+/// Put a renderer into the state of a recorded frame. The toggles are the caller's to apply, e.g. with
+/// `gui_set_frame_toggles`.
+void apply_frame_input(const FrameInput *input, Renderer *renderer, ShaderKind *shader_kind, FrameToggles *toggles);
@@ -0,0 +1,60 @@
+#include "resolution.h"
+
+#include "clock.h"
+#include "math_helpers.h"
+
+ResolutionController new_resolution_controller(f32 budget_s, f32 min_scale, f32 max_scale) {
+  ASSERT(budget_s >= 0);
+  ASSERT(min_scale > 0 && min_scale <= max_scale && max_scale <= 1);
+  return (ResolutionController){
+      .budget_s = budget_s,
+      .min_scale = min_scale,
+      .max_scale = max_scale,
+      .scale_down_above = 0.9f,
+      .scale_up_below = 0.6f,
+      .scale = max_scale,
+      .frame_times_len = 0,
+      .frame_start_ns = 0,
+  };
+}
+
+void resolution_frame_begin(ResolutionController *resolution) {
+  resolution->frame_start_ns = monotonic_ns();
+}
+
+void resolution_frame_end(ResolutionController *resolution) {
+  u64 elapsed_ns = monotonic_ns() - resolution->frame_start_ns;
+  resolution_add_frame_time(resolution, (f32)elapsed_ns / 1e9f);
+}
+
+void resolution_reset(ResolutionController *resolution) {
+  resolution->frame_times_len = 0;
+}
+
+void resolution_add_frame_time(ResolutionController *resolution, f32 frame_time_s) {
+  resolution->frame_times_s[resolution->frame_times_len++] = frame_time_s;
+  if (resolution->frame_times_len < RESOLUTION_WINDOW)
+    return;
+  resolution->frame_times_len = 0;
+  f32 sum = 0;
+  for (usize i = 0; i < RESOLUTION_WINDOW; ++i) {
+    sum += resolution->frame_times_s[i];
+  }
+  f32 mean = sum / RESOLUTION_WINDOW;
+  f32 budget = resolution->budget_s;
+  bool down = mean > budget * resolution->scale_down_above;
+  bool up = mean < budget * resolution->scale_up_below;
+  if (!down && !up)
+    return;
+  // The time goes with the number of pixels, the square of the scale. Parts of the frame don't depend on the resolution
+  // (e.g. the vertex stage), so that this undershoots, and the next windows go the rest of the way.
+  f32 target = budget * (resolution->scale_down_above + resolution->scale_up_below) / 2;
+  f32 scale = resolution->scale * sqrtf(target / maxf(mean, 1e-6f));
+  scale = roundf(scale / RESOLUTION_SCALE_STEP) * RESOLUTION_SCALE_STEP;
+  // At least one step in the direction it has to go.
+  if (down)
+    scale = minf(scale, resolution->scale - RESOLUTION_SCALE_STEP);
+  else
+    scale = maxf(scale, resolution->scale + RESOLUTION_SCALE_STEP);
+  resolution->scale = minf(maxf(scale, resolution->min_scale), resolution->max_scale);
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "common.h"
+
+// Dynamic resolution: lowers the resolution the frames are rendered at when they take longer than the frame budget,
+// and raises it back when there's time to spare, so that the frame rate holds instead of frames being dropped. The
+// presenter upscales the frame to the window (see `renderer_set_resolution` of render.h for drawing into part of the
+// render targets).
+//
+// The controller measures the time the CPU spends on each frame, not counting the wait for the next one, and decides
+// once every `RESOLUTION_WINDOW` frames from their mean. Between `scale_up_below` and `scale_down_above` of the budget
+// it leaves the scale alone, outside it aims for the middle of the two, assuming that the time is proportional to the
+// number of pixels. Every change redraws the whole frame once, the window averages that out.
+//
+// Example:
+//
+// ```
+// ResolutionController resolution = new_resolution_controller(1.f / 60, 0.5f, 1.f);
+// while (...) {
+//   resolution_frame_begin(&resolution);
+//   renderer_set_resolution(&renderer, resolution_scaled(&resolution, width), resolution_scaled(&resolution, height));
+//   // draw...
+//   resolution_frame_end(&resolution);
+//   // present, upscaled...
+// }
+// ```
+
+/// Frames per decision.
+#define RESOLUTION_WINDOW 30
+
+/// The scale only takes multiples of this, so that small changes of the frame time don't keep changing it.
+#define RESOLUTION_SCALE_STEP 0.05f
+
+typedef struct resolution_controller {
+  /// Frame time it aims to stay under, in seconds.
+  f32 budget_s;
+  /// Bounds of `scale`, in `0..=1`.
+  f32 min_scale;
+  f32 max_scale;
+  /// Fractions of `budget_s` the mean frame time has to go above to lower the scale, and below to raise it.
+  f32 scale_down_above;
+  f32 scale_up_below;
+  /// Of the width and height the frames are rendered at, see `resolution_scaled`.
+  f32 scale;
+  /// The frames since the last decision, in seconds.
+  /// LEN: frame_times_len.
+  f32 frame_times_s[RESOLUTION_WINDOW];
+  usize frame_times_len;
+  /// Monotonic time of `resolution_frame_begin`.
+  u64 frame_start_ns;
+} ResolutionController;
+
+/// Starts at `max_scale`, with the default hysteresis (see `ResolutionController`).
+ResolutionController new_resolution_controller(f32 budget_s, f32 min_scale, f32 max_scale);
+
+/// Marks the start of the work of a frame.
+void resolution_frame_begin(ResolutionController *resolution);
+
+/// Marks the end of the work of a frame, before presenting it, and adds its time with `resolution_add_frame_time`.
+void resolution_frame_end(ResolutionController *resolution);
+
+/// Adds the time of a frame, in seconds, and adapts `scale` once there are `RESOLUTION_WINDOW` of them.
+void resolution_add_frame_time(ResolutionController *resolution, f32 frame_time_s);
+
+/// Forgets the frames since the last decision, e.g. after pausing the controller.
+void resolution_reset(ResolutionController *resolution);
+
+/// `size`, of the window, scaled by `scale`, at least 1.
+static inline usize resolution_scale_size(f32 scale, usize size) {
+  usize scaled = (usize)((f32)size * scale + 0.5f);
+  return scaled < 1 ? 1 : scaled > size ? size : scaled;
+}
+
+/// `size`, of the window, scaled by the controller's scale, at least 1.
+static inline usize resolution_scaled(const ResolutionController *resolution, usize size) {
+  return resolution_scale_size(resolution->scale, size);
+}
@@ -0,0 +1,368 @@
+#include "scene.h"
+
+#include "trace.h"
+
+#define SCENE_INITIAL_CAPACITY 16
+
+Scene new_scene() {
+  usize capacity = SCENE_INITIAL_CAPACITY;
+  return (Scene){
+      .objects = xalloc(SceneObject, capacity),
+      .objects_len = 0,
+      .objects_capacity = capacity,
+      .order = xalloc(u32, capacity),
+      .nodes = xalloc(BvhNode, 2 * capacity),
+      .nodes_len = 0,
+      .dirty = xalloc(u32, capacity),
+      .dirty_len = 0,
+      .moved_since_build = 0,
+      .needs_rebuild = false,
+      .visible = xalloc(u32, capacity),
+      .visible_len = 0,
+      .instances = xalloc(Instance, capacity),
+      .redraw = xalloc(u32, capacity),
+      .redraw_len = 0,
+      // Nothing was drawn yet, no camera is like this one.
+      .drawn_width = 0,
+      .drawn_height = 0,
+  };
+}
+
+void free_scene(Scene scene) {
+  xfree(scene.objects);
+  xfree(scene.order);
+  xfree(scene.nodes);
+  xfree(scene.dirty);
+  xfree(scene.visible);
+  xfree(scene.instances);
+  xfree(scene.redraw);
+}
+
+usize scene_add_object(Scene *scene, const Mesh *mesh, Instance instance) {
+  if (scene->objects_len == scene->objects_capacity) {
+    usize capacity = scene->objects_capacity * 2;
+    ASSERT(capacity <= UINT32_MAX);
+    scene->objects = xrealloc(scene->objects, SceneObject, capacity);
+    scene->order = xrealloc(scene->order, u32, capacity);
+    scene->nodes = xrealloc(scene->nodes, BvhNode, 2 * capacity);
+    scene->dirty = xrealloc(scene->dirty, u32, capacity);
+    scene->visible = xrealloc(scene->visible, u32, capacity);
+    scene->instances = xrealloc(scene->instances, Instance, capacity);
+    scene->redraw = xrealloc(scene->redraw, u32, capacity);
+    scene->objects_capacity = capacity;
+  }
+  usize id = scene->objects_len++;
+  scene->objects[id] = (SceneObject){
+      .mesh = mesh,
+      .lods = NULL,
+      .lod = 0,
+      .instance = instance,
+      .bounds = aabb_transform(instance.m, mesh->bounds),
+      .leaf = UINT32_MAX,
+      .dirty = false,
+      .moved = false,
+      .redraw = true,
+      .drawn_rect = {0, 0, 0, 0},
+  };
+  scene->redraw[scene->redraw_len++] = (u32)id;
+  scene->needs_rebuild = true;
+  return id;
+}
+
+usize scene_add_lod_object(Scene *scene, const LodChain *lods, Instance instance) {
+  // All levels have the same bounds, so culling can go by the finest one.
+  usize id = scene_add_object(scene, &lods->levels[0].mesh, instance);
+  scene->objects[id].lods = lods;
+  return id;
+}
+
+/// The mesh to draw an object with, at the level of detail that fits its size on screen.
+static const Mesh *select_mesh(const Renderer *renderer, SceneObject *object) {
+  if (object->lods == NULL)
+    return object->mesh;
+  object->lod = lod_select(object->lods, renderer, object->instance.m, object->lod);
+  return &object->lods->levels[object->lod].mesh;
+}
+
+void scene_set_transform(Scene *scene, usize id, Mat4x4 m) {
+  ASSERT(id < scene->objects_len);
+  SceneObject *object = &scene->objects[id];
+  object->instance.m = m;
+  object->bounds = aabb_transform(m, object->mesh->bounds);
+  if (!object->dirty) {
+    object->dirty = true;
+    scene->dirty[scene->dirty_len++] = (u32)id;
+  }
+  if (!object->moved) {
+    object->moved = true;
+    ++scene->moved_since_build;
+  }
+  if (!object->redraw) {
+    object->redraw = true;
+    scene->redraw[scene->redraw_len++] = (u32)id;
+  }
+}
+
+static inline f32 centroid(const Scene *scene, u32 id, usize axis) {
+  const Aabb *bounds = &scene->objects[id].bounds;
+  return bounds->min.get[axis] + bounds->max.get[axis];
+}
+
+/// Reorders `order[begin..end)` so that `order[nth]` is the object with the nth smallest centroid along `axis`, with
+/// smaller ones before it and larger ones after it.
+static void select_nth(Scene *scene, usize begin, usize end, usize nth, usize axis) {
+  u32 *order = scene->order;
+  while (end - begin > 1) {
+    f32 pivot = centroid(scene, order[(begin + end) / 2], axis);
+    usize lt = begin, i = begin, gt = end;
+    // Three-way partition, so that many equal centroids don't degrade it.
+    while (i < gt) {
+      f32 x = centroid(scene, order[i], axis);
+      u32 tmp;
+      if (x < pivot) {
+        tmp = order[lt], order[lt] = order[i], order[i] = tmp;
+        ++lt, ++i;
+      } else if (x > pivot) {
+        --gt;
+        tmp = order[gt], order[gt] = order[i], order[i] = tmp;
+      } else {
+        ++i;
+      }
+    }
+    if (nth < lt)
+      end = lt;
+    else if (nth >= gt)
+      begin = gt;
+    else
+      return;
+  }
+}
+
+/// Builds the subtree of `nodes[index]` from the objects `order[begin..end)`.
+static void build_node(Scene *scene, u32 index, usize begin, usize end) {
+  Aabb bounds = scene->objects[scene->order[begin]].bounds;
+  Aabb centroids = {aabb_center(bounds), aabb_center(bounds)};
+  for (usize i = begin + 1; i < end; ++i) {
+    Aabb object_bounds = scene->objects[scene->order[i]].bounds;
+    Vec3 c = aabb_center(object_bounds);
+    bounds = aabb_union(bounds, object_bounds);
+    centroids = aabb_union(centroids, (Aabb){c, c});
+  }
+  BvhNode *node = &scene->nodes[index];
+  node->bounds = bounds;
+  if (end - begin <= SCENE_MAX_LEAF_OBJECTS) {
+    node->first = (u32)begin;
+    node->count = (u32)(end - begin);
+    for (usize i = begin; i < end; ++i) {
+      scene->objects[scene->order[i]].leaf = index;
+    }
+    return;
+  }
+  // Median split along the longest axis of the centroids, which keeps the tree balanced.
+  usize axis = 0;
+  for (usize i = 1; i < 3; ++i) {
+    f32 size = centroids.max.get[i] - centroids.min.get[i];
+    if (size > centroids.max.get[axis] - centroids.min.get[axis])
+      axis = i;
+  }
+  usize mid = (begin + end) / 2;
+  select_nth(scene, begin, end, mid, axis);
+  u32 children = (u32)scene->nodes_len;
+  scene->nodes_len += 2;
+  node->first = children;
+  node->count = 0;
+  scene->nodes[children + 0].parent = index;
+  scene->nodes[children + 1].parent = index;
+  build_node(scene, children + 0, begin, mid);
+  build_node(scene, children + 1, mid, end);
+}
+
+static void rebuild(Scene *scene) {
+  TRACE_SCOPE("scene_rebuild");
+  scene->nodes_len = 0;
+  scene->moved_since_build = 0;
+  scene->needs_rebuild = false;
+  if (scene->objects_len == 0)
+    return;
+  for (usize i = 0; i < scene->objects_len; ++i) {
+    scene->order[i] = (u32)i;
+    scene->objects[i].moved = false;
+  }
+  scene->nodes_len = 1;
+  scene->nodes[0].parent = UINT32_MAX;
+  build_node(scene, 0, 0, scene->objects_len);
+}
+
+/// Refit the boxes on the path from a leaf to the root.
+static void refit(Scene *scene, u32 leaf) {
+  BvhNode *node = &scene->nodes[leaf];
+  Aabb bounds = scene->objects[scene->order[node->first]].bounds;
+  for (usize i = node->first + 1; i < node->first + node->count; ++i) {
+    bounds = aabb_union(bounds, scene->objects[scene->order[i]].bounds);
+  }
+  while (true) {
+    // If this box didn't change, neither do the ones above it.
+    if (memcmp(&node->bounds, &bounds, sizeof(Aabb)) == 0)
+      return;
+    node->bounds = bounds;
+    if (node->parent == UINT32_MAX)
+      return;
+    node = &scene->nodes[node->parent];
+    bounds = aabb_union(scene->nodes[node->first].bounds, scene->nodes[node->first + 1].bounds);
+  }
+}
+
+void scene_update(Scene *scene) {
+  if (scene->needs_rebuild || scene->moved_since_build > scene->objects_len / 2) {
+    rebuild(scene);
+  } else if (scene->dirty_len != 0) {
+    TRACE_SCOPE("scene_refit");
+    for (usize i = 0; i < scene->dirty_len; ++i) {
+      refit(scene, scene->objects[scene->dirty[i]].leaf);
+    }
+  }
+  for (usize i = 0; i < scene->dirty_len; ++i) {
+    scene->objects[scene->dirty[i]].dirty = false;
+  }
+  scene->dirty_len = 0;
+}
+
+static i32 compare_u32(const void *x_, const void *y_) {
+  u32 x = *(const u32 *)x_;
+  u32 y = *(const u32 *)y_;
+  return (x > y) - (x < y);
+}
+
+/// Whether a bounding box may be visible on screen, and within the scissor if it doesn't cover the whole screen.
+static bool aabb_maybe_visible_in_scissor(const Renderer *renderer,
+                                          const Mat4x4 *world_to_camera,
+                                          bool scissored,
+                                          Aabb aabb) {
+  if (!aabb_maybe_visible(renderer, world_to_camera, aabb))
+    return false;
+  if (!scissored)
+    return true;
+  ScreenRect rect = aabb_screen_rect(renderer, world_to_camera, aabb);
+  return !screen_rect_is_empty(screen_rect_intersection(rect, renderer->scissor));
+}
+
+usize scene_cull(Scene *scene, const Renderer *renderer) {
+  TRACE_SCOPE("scene_cull");
+  scene_update(scene);
+  scene->visible_len = 0;
+  if (scene->nodes_len == 0)
+    return 0;
+  Mat4x4 world_to_camera = world_to_camera_matrix(renderer);
+  ScreenRect scissor = renderer->scissor;
+  bool scissored = scissor.min_x != 0 || scissor.min_y != 0 || scissor.max_x != renderer->width ||
+                   scissor.max_y != renderer->height;
+  // The tree is balanced (see `build_node`), so its depth is at most log2 of the number of objects.
+  u32 stack[64];
+  usize stack_len = 0;
+  stack[stack_len++] = 0;
+  while (stack_len != 0) {
+    const BvhNode *node = &scene->nodes[stack[--stack_len]];
+    if (!aabb_maybe_visible_in_scissor(renderer, &world_to_camera, scissored, node->bounds))
+      continue;
+    if (node->count == 0) {
+      stack[stack_len++] = node->first + 1;
+      stack[stack_len++] = node->first + 0;
+      continue;
+    }
+    for (usize i = node->first; i < node->first + node->count; ++i) {
+      u32 id = scene->order[i];
+      // A leaf can straddle the edge of the screen with some of its objects entirely off-screen.
+      if (node->count == 1 ||
+          aabb_maybe_visible_in_scissor(renderer, &world_to_camera, scissored, scene->objects[id].bounds))
+        scene->visible[scene->visible_len++] = id;
+    }
+  }
+  // Keep the drawing order independent of the shape of the tree.
+  qsort(scene->visible, scene->visible_len, sizeof(u32), compare_u32);
+  return scene->visible_len;
+}
+
+usize scene_cull_occluded(Scene *scene, const OcclusionBuffer *occlusion) {
+  TRACE_SCOPE("scene_cull_occluded");
+  usize visible_len = 0;
+  for (usize i = 0; i < scene->visible_len; ++i) {
+    u32 id = scene->visible[i];
+    if (occlusion_aabb_maybe_visible(occlusion, scene->objects[id].bounds))
+      scene->visible[visible_len++] = id;
+  }
+  usize occluded = scene->visible_len - visible_len;
+  scene->visible_len = visible_len;
+  return occluded;
+}
+
+ScreenRect scene_dirty_rect(Scene *scene, const Renderer *renderer) {
+  TRACE_SCOPE("scene_dirty_rect");
+  Mat4x4 world_to_camera = world_to_camera_matrix(renderer);
+  bool redraw_all = memcmp(&scene->drawn_cam, &renderer->cam, sizeof(Camera_)) != 0 ||
+                    scene->drawn_width != renderer->width || scene->drawn_height != renderer->height;
+  ScreenRect rect = {0, 0, 0, 0};
+  if (redraw_all) {
+    rect = (ScreenRect){0, 0, renderer->width, renderer->height};
+    for (usize i = 0; i < scene->objects_len; ++i) {
+      SceneObject *object = &scene->objects[i];
+      object->drawn_rect = aabb_screen_rect(renderer, &world_to_camera, object->bounds);
+      object->redraw = false;
+    }
+  } else {
+    for (usize i = 0; i < scene->redraw_len; ++i) {
+      SceneObject *object = &scene->objects[scene->redraw[i]];
+      rect = screen_rect_union(rect, object->drawn_rect);
+      object->drawn_rect = aabb_screen_rect(renderer, &world_to_camera, object->bounds);
+      rect = screen_rect_union(rect, object->drawn_rect);
+      object->redraw = false;
+    }
+  }
+  scene->redraw_len = 0;
+  scene->drawn_cam = renderer->cam;
+  scene->drawn_width = renderer->width;
+  scene->drawn_height = renderer->height;
+  return rect;
+}
+
+/// `scene_cull` and `scene_cull_occluded` (if `occlusion` isn't `NULL`), counted in the renderer's statistics.
+static usize cull_scene(Renderer *renderer, Scene *scene, const OcclusionBuffer *occlusion) {
+  usize visible_len = scene_cull(scene, renderer);
+  RENDER_STATS_ADD(renderer, objects_culled, scene->objects_len - visible_len);
+  if (occlusion != NULL) {
+    usize occluded = scene_cull_occluded(scene, occlusion);
+    RENDER_STATS_ADD(renderer, objects_occluded, occluded);
+    visible_len -= occluded;
+  }
+  return visible_len;
+}
+
+void draw_scene(Renderer *renderer,
+                Scene *scene,
+                const OcclusionBuffer *occlusion,
+                rasterize_triangle_callback_t rasterize_triangle) {
+  TRACE_SCOPE("draw_scene");
+  usize visible_len = cull_scene(renderer, scene, occlusion);
+  const Mesh *mesh = NULL;
+  usize instances_len = 0;
+  for (usize i = 0; i < visible_len; ++i) {
+    SceneObject *object = &scene->objects[scene->visible[i]];
+    const Mesh *object_mesh = select_mesh(renderer, object);
+    if (object_mesh != mesh && instances_len != 0) {
+      draw_object_instanced(renderer, mesh, scene->instances, instances_len, rasterize_triangle);
+      instances_len = 0;
+    }
+    mesh = object_mesh;
+    scene->instances[instances_len++] = object->instance;
+  }
+  if (instances_len != 0)
+    draw_object_instanced(renderer, mesh, scene->instances, instances_len, rasterize_triangle);
+}
+
+void scene_record(Renderer *renderer, Scene *scene, const OcclusionBuffer *occlusion, CommandBuffer *cmdbuf) {
+  TRACE_SCOPE("scene_record");
+  usize visible_len = cull_scene(renderer, scene, occlusion);
+  for (usize i = 0; i < visible_len; ++i) {
+    SceneObject *object = &scene->objects[scene->visible[i]];
+    cmdbuf_draw(cmdbuf, select_mesh(renderer, object), object->instance);
+  }
+}
@@ -0,0 +1,163 @@
+#pragma once
+
+#include "cmdbuf.h"
+#include "common.h"
+#include "linear_alg.h"
+#include "lod.h"
+#include "mesh.h"
+#include "occlusion.h"
+#include "render.h"
+
+// A scene of objects (instances of meshes), culled against the screen as a whole before any per-triangle work.
+//
+// The objects are organized in a bounding volume hierarchy over their world-space bounding boxes. Moving an object
+// refits the boxes on the path from its leaf to the root, adding objects or moving many of them since the last build
+// rebuilds the hierarchy. This all happens lazily in `scene_update` (called by `scene_cull`), so moving an object many
+// times in a frame costs one refit, and static objects cost nothing per frame.
+//
+// The scene also keeps track of where on screen each object was drawn, so that a frame where little moved only needs
+// to redraw the pixels that changed (see `scene_dirty_rect`), on top of the previous frame.
+//
+// Example:
+//
+// ```
+// Scene scene = new_scene();
+// usize teapot_id = scene_add_object(&scene, &teapot_mesh, new_instance(&renderer, m));
+// while (...) {
+//   scene_set_transform(&scene, teapot_id, new_m);
+//   draw_scene(&renderer, &scene, NULL, gui_rasterize_triangle);
+// }
+// free_scene(scene);
+// ```
+
+/// Max number of objects in a leaf of the BVH.
+#define SCENE_MAX_LEAF_OBJECTS 4
+
+typedef struct scene_object {
+  /// Not owned. For objects with levels of detail, the finest level.
+  const Mesh *mesh;
+  /// Not owned, `NULL` for objects without levels of detail.
+  const LodChain *lods;
+  /// The level of detail the object was last drawn at, see `lod_select`.
+  usize lod;
+  Instance instance;
+  /// Bounding box of the mesh transformed by `instance.m`.
+  Aabb bounds;
+  /// Index of the leaf of the BVH containing this object.
+  u32 leaf;
+  /// Whether the object moved since the last `scene_update`.
+  bool dirty;
+  /// Whether the object moved since the BVH was last built.
+  bool moved;
+  /// Whether the object moved (or was added) since the last `scene_dirty_rect`.
+  bool redraw;
+  /// The pixels the object may have been drawn to, as of the last `scene_dirty_rect`, see `aabb_screen_rect`.
+  ScreenRect drawn_rect;
+} SceneObject;
+
+typedef struct bvh_node {
+  Aabb bounds;
+  /// For inner nodes, index of the first child (the second one is right after it). For leaves, index of the first
+  /// object in `Scene::order`.
+  u32 first;
+  /// Number of objects, 0 for inner nodes.
+  u32 count;
+  /// `UINT32_MAX` for the root.
+  u32 parent;
+} BvhNode;
+
+/// SAFETY: Only use new_scene to construct this.
+typedef struct scene {
+  /// LEN: objects_len, CAP: objects_capacity.
+  SceneObject *objects;
+  usize objects_len;
+  usize objects_capacity;
+  /// Object indices in the order of the leaves of the BVH.
+  /// LEN: objects_len if the BVH is built, CAP: objects_capacity.
+  u32 *order;
+  /// Root first, children after their parents.
+  /// LEN: nodes_len, CAP: 2 * objects_capacity.
+  BvhNode *nodes;
+  usize nodes_len;
+  /// Objects that moved since the last `scene_update`.
+  /// LEN: dirty_len, CAP: objects_capacity.
+  u32 *dirty;
+  usize dirty_len;
+  /// Number of objects that moved since the BVH was last built, refitting degrades the BVH so it's rebuilt once half of
+  /// the objects moved.
+  usize moved_since_build;
+  /// Objects were added since the BVH was last built.
+  bool needs_rebuild;
+  /// Result of `scene_cull`, in ascending order.
+  /// LEN: visible_len, CAP: objects_capacity.
+  u32 *visible;
+  usize visible_len;
+  /// Scratch for `draw_scene`.
+  /// CAP: objects_capacity.
+  Instance *instances;
+  /// Objects that moved (or were added) since the last `scene_dirty_rect`.
+  /// LEN: redraw_len, CAP: objects_capacity.
+  u32 *redraw;
+  usize redraw_len;
+  /// The camera and size of the screen as of the last `scene_dirty_rect`, which redraws everything if they changed.
+  Camera_ drawn_cam;
+  usize drawn_width;
+  usize drawn_height;
+} Scene;
+
+Scene new_scene();
+
+void free_scene(Scene scene);
+
+/// Returns the ID of the object, which is its index in `Scene::objects`.
+usize scene_add_object(Scene *scene, const Mesh *mesh, Instance instance);
+
+/// Like `scene_add_object`, but the object is drawn at the level of detail that fits its size on screen.
+usize scene_add_lod_object(Scene *scene, const LodChain *lods, Instance instance);
+
+/// Change the model matrix of an object.
+void scene_set_transform(Scene *scene, usize id, Mat4x4 m);
+
+/// Bring the BVH up to date with the objects, called by `scene_cull`.
+void scene_update(Scene *scene);
+
+/// Find the objects that may be visible, into `Scene::visible`. Returns their number. Objects outside the renderer's
+/// scissor count as not visible.
+usize scene_cull(Scene *scene, const Renderer *renderer);
+
+/// Remove the objects hidden behind the occluders from the result of `scene_cull`. Returns their number.
+usize scene_cull_occluded(Scene *scene, const OcclusionBuffer *occlusion);
+
+/// Draw the objects that may be visible, in the order they were added. Consecutive objects of the same mesh (and level
+/// of detail) are drawn with one `draw_object_instanced`.
+/// `occlusion` may be `NULL`, otherwise it must be finished (see `occlusion_finish`) for the renderer's current camera.
+/// `rasterize_triangle` is e.g. `rasterize_triangle_xxx` of `DEF_DRAW_FUNCTIONS`.
+void draw_scene(Renderer *renderer,
+                Scene *scene,
+                const OcclusionBuffer *occlusion,
+                rasterize_triangle_callback_t rasterize_triangle);
+
+/// The pixels whose content may have changed since the last call: where the objects that moved were drawn before, and
+/// where they are now. Everything if the camera or the size of the screen changed, or the first time. Other changes
+/// (e.g. the light, multisampling) are up to the caller.
+///
+/// To redraw only those, make it the renderer's scissor before `renderer_clear_frame` and drawing, and only clear that
+/// part of the frame buffer: the pixels outside keep the previous frame, exactly as drawing everything would have.
+///
+/// Example:
+///
+/// ```
+/// while (...) {
+///   scene_set_transform(&scene, spinning_id, new_m);
+///   renderer.scissor = scene_dirty_rect(&scene, &renderer);
+///   renderer_clear_frame(&renderer);
+///   if (!screen_rect_is_empty(renderer.scissor)) {
+///     // clear the scissor of the frame buffer...
+///     draw_scene(&renderer, &scene, NULL, gui_rasterize_triangle);
+///   }
+/// }
+/// ```
+ScreenRect scene_dirty_rect(Scene *scene, const Renderer *renderer);
+
+/// Like `draw_scene`, but appends the draws to a command buffer instead, to be submitted with `cmdbuf_submit`.
+void scene_record(Renderer *renderer, Scene *scene, const OcclusionBuffer *occlusion, CommandBuffer *cmdbuf);
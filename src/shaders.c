@@ -1,5 +1,6 @@
 #include "shaders.h"
 #include "math_helpers.h"
+#include "dispatch.h"
 
 void select_next_shader(ShaderKind *shader_kind) {
   if (*shader_kind == 4)
@@ -15,36 +16,53 @@ void select_prev_shader(ShaderKind *shader_kind) {
     *shader_kind -= 1;
 }
 
+const char *shader_name(ShaderKind shader_kind) {
+  switch (shader_kind) {
+  case SHADER_KIND_DEFAULT:
+    return "BORING";
+  case SHADER_KIND_HIGHLIGHTED:
+    return "HIGHLIGHTED";
+  case SHADER_KIND_DEBUG_DEPTH:
+    return "DEBUG DEPTH";
+  case SHADER_KIND_DEBUG_DEPTH_HIGHLIGHTED:
+    return "DEBUG DEPTH HIGHLIGHTED";
+  case SHADER_KIND_HIGHLIGHT_ONLY:
+    return "HIGHLIGHT ONLY";
+  }
+  return "UNKNOWN";
+}
+
 /// Apply shader onto one fragment.
 void apply_shader(ShaderKind shader_kind,
                   usize width,
                   usize height,
+                  usize stride,
                   usize x,
                   usize y,
                   u8 *fragment,
                   const f32 *depth_buffer) {
   switch (shader_kind) {
   case SHADER_KIND_DEFAULT:
-    *fragment = shader_boring(width, height, x, y, *fragment, depth_buffer);
+    *fragment = shader_boring(width, height, stride, x, y, *fragment, depth_buffer);
     break;
   case SHADER_KIND_HIGHLIGHTED:
-    *fragment = shader_highlighted(width, height, x, y, *fragment, depth_buffer);
+    *fragment = shader_highlighted(width, height, stride, x, y, *fragment, depth_buffer);
     break;
   case SHADER_KIND_DEBUG_DEPTH:
-    *fragment = shader_debug_depth(width, height, x, y, *fragment, depth_buffer);
+    *fragment = shader_debug_depth(width, height, stride, x, y, *fragment, depth_buffer);
     break;
   case SHADER_KIND_DEBUG_DEPTH_HIGHLIGHTED:
-    *fragment = shader_debug_depth_highlighted(width, height, x, y, *fragment, depth_buffer);
+    *fragment = shader_debug_depth_highlighted(width, height, stride, x, y, *fragment, depth_buffer);
     break;
   case SHADER_KIND_HIGHLIGHT_ONLY:
-    *fragment = shader_highlight_only(width, height, x, y, *fragment, depth_buffer);
+    *fragment = shader_highlight_only(width, height, stride, x, y, *fragment, depth_buffer);
     break;
   }
 }
 
-static inline u8 nabla_depth(usize width, usize height, usize x, usize y, const f32 *depth_buffer) {
-  const u8 radius = 4;
-  const u8 step_size = 2;
+u8 nabla_depth(usize width, usize height, usize stride, usize x, usize y, const f32 *depth_buffer) {
+  const u8 radius = NABLA_DEPTH_RADIUS;
+  const u8 step_size = NABLA_DEPTH_STEP;
   // Derivative with respect to x.
   f32 dx = 0;
   f32 dy = 0;
@@ -52,10 +70,10 @@ static inline u8 nabla_depth(usize width, usize height, usize x, usize y, const
     for (u8 x_eps = 0; x_eps < radius; x_eps += step_size) {
       f32 dist = sqrtf(pow2f(x_eps) + pow2f(y_eps));
       f32 factor = dist / (f32)radius;
-      dx += depth_buffer[y * width + (x - x_eps) % width] * factor;
-      dx -= depth_buffer[y * width + (x + x_eps) % width] * factor;
-      dy += depth_buffer[(y - y_eps) % height * width + x] * factor;
-      dy -= depth_buffer[(y + y_eps) % height * width + x] * factor;
+      dx += depth_buffer[y * stride + (x - x_eps) % width] * factor;
+      dx -= depth_buffer[y * stride + (x + x_eps) % width] * factor;
+      dy += depth_buffer[(y - y_eps) % height * stride + x] * factor;
+      dy -= depth_buffer[(y + y_eps) % height * stride + x] * factor;
     }
   }
   dx *= pow2f((f32)step_size);
@@ -66,36 +84,173 @@ static inline u8 nabla_depth(usize width, usize height, usize x, usize y, const
   return (u8)(nabla_depth * 255.f);
 }
 
-u8 shader_boring(usize width, usize height, usize x, usize y, u8 light_level, const f32 *depth_buffer) {
+u8 shader_boring(usize width, usize height, usize stride, usize x, usize y, u8 light_level, const f32 *depth_buffer) {
   return light_level;
 }
 
-u8 shader_highlighted(usize width, usize height, usize x, usize y, u8 light_level, const f32 *depth_buffer) {
-  u8 highlight = nabla_depth(width, height, x, y, depth_buffer) / 4;
+u8 shader_highlighted(usize width,
+                      usize height,
+                      usize stride,
+                      usize x,
+                      usize y,
+                      u8 light_level,
+                      const f32 *depth_buffer) {
+  u8 highlight = nabla_depth(width, height, stride, x, y, depth_buffer) / 4;
   return ((255 - light_level) < highlight) ? 255 : light_level + highlight;
 }
 
-u8 shader_debug_depth(usize width, usize height, usize x, usize y, u8 light_level, const f32 *depth_buffer) {
+u8 shader_debug_depth(usize width,
+                      usize height,
+                      usize stride,
+                      usize x,
+                      usize y,
+                      u8 light_level,
+                      const f32 *depth_buffer) {
   const f32 small = 1.0f;
-  f32 z = depth_buffer[y * height + x];
+  f32 z = depth_buffer[y * stride + x];
   f32 z_norm = logf(small + sigmoidf(z - 10.f)) / logf(1.f + small);
   return (u8)((1.f - z_norm) * 255.f);
 }
 
 u8 shader_debug_depth_highlighted(usize width,
                                   usize height,
+                                  usize stride,
                                   usize x,
                                   usize y,
                                   u8 _light_level,
                                   const f32 *depth_buffer) {
   const f32 small = 1.0f;
-  f32 z = depth_buffer[y * height + x];
+  f32 z = depth_buffer[y * stride + x];
   f32 z_norm = logf(small + sigmoidf(z - 10.f)) / logf(1.f + small);
   u8 light_level = (u8)((1.f - z_norm) * 255.f);
-  u8 highlight = nabla_depth(width, height, x, y, depth_buffer);
+  u8 highlight = nabla_depth(width, height, stride, x, y, depth_buffer);
   return ((255 - light_level) < highlight) ? 255 : light_level + highlight;
 }
 
-u8 shader_highlight_only(usize width, usize height, usize x, usize y, u8 light_level, const f32 *depth_buffer) {
-  return nabla_depth(width, height, x, y, depth_buffer);
+u8 shader_highlight_only(usize width,
+                         usize height,
+                         usize stride,
+                         usize x,
+                         usize y,
+                         u8 light_level,
+                         const f32 *depth_buffer) {
+  return nabla_depth(width, height, stride, x, y, depth_buffer);
+}
+
+/// Pixels shaded per call of the nabla depth kernel.
+#define SHADE_CHUNK_LEN 256
+
+void apply_shader_frame(ShaderKind shader_kind,
+                        usize width,
+                        usize height,
+                        u8 *frame_buffer,
+                        usize frame_stride,
+                        const f32 *depth_buffer,
+                        usize depth_stride) {
+  apply_shader_rect(shader_kind,
+                    width,
+                    height,
+                    (ScreenRect){0, 0, width, height},
+                    frame_buffer,
+                    frame_stride,
+                    depth_buffer,
+                    depth_stride,
+                    frame_buffer,
+                    frame_stride);
+}
+
+void apply_shader_rect(ShaderKind shader_kind,
+                       usize width,
+                       usize height,
+                       ScreenRect rect,
+                       const u8 *frame_buffer,
+                       usize frame_stride,
+                       const f32 *depth_buffer,
+                       usize depth_stride,
+                       u8 *out,
+                       usize out_stride) {
+  // `shader_boring` leaves the frame as it is.
+  if (shader_kind == SHADER_KIND_DEFAULT) {
+    for (usize y = rect.min_y; out != frame_buffer && y < rect.max_y; ++y) {
+      memcpy(&out[y * out_stride + rect.min_x], &frame_buffer[y * frame_stride + rect.min_x], rect.max_x - rect.min_x);
+    }
+    return;
+  }
+  u8 nablas[SHADE_CHUNK_LEN];
+  for (usize y = rect.min_y; y < rect.max_y; ++y) {
+    for (usize x0 = rect.min_x; x0 < rect.max_x; x0 += SHADE_CHUNK_LEN) {
+      usize x1 = minzu(x0 + SHADE_CHUNK_LEN, rect.max_x);
+      const u8 *fragments = &frame_buffer[y * frame_stride];
+      u8 *shaded = &out[y * out_stride];
+      if (shader_kind != SHADER_KIND_DEBUG_DEPTH)
+        kernels.nabla_depth_row(width, height, depth_stride, y, x0, x1, depth_buffer, nablas);
+      // Same as the shader functions, with `nabla_depth` taken from `nablas`.
+      switch (shader_kind) {
+      case SHADER_KIND_DEFAULT:
+        break;
+      case SHADER_KIND_HIGHLIGHTED:
+        for (usize x = x0; x < x1; ++x) {
+          u8 light_level = fragments[x];
+          u8 highlight = nablas[x - x0] / 4;
+          shaded[x] = ((255 - light_level) < highlight) ? 255 : light_level + highlight;
+        }
+        break;
+      case SHADER_KIND_DEBUG_DEPTH:
+        for (usize x = x0; x < x1; ++x) {
+          shaded[x] = shader_debug_depth(width, height, depth_stride, x, y, fragments[x], depth_buffer);
+        }
+        break;
+      case SHADER_KIND_DEBUG_DEPTH_HIGHLIGHTED:
+        for (usize x = x0; x < x1; ++x) {
+          u8 light_level = shader_debug_depth(width, height, depth_stride, x, y, fragments[x], depth_buffer);
+          u8 highlight = nablas[x - x0];
+          shaded[x] = ((255 - light_level) < highlight) ? 255 : light_level + highlight;
+        }
+        break;
+      case SHADER_KIND_HIGHLIGHT_ONLY:
+        memcpy(&shaded[x0], nablas, x1 - x0);
+        break;
+      }
+    }
+  }
+}
+
+/// Whether `nabla_depth` of pixel `p`, along an axis `len` pixels long, reads any of the pixels `min..max` of it.
+static bool nabla_depth_reads(usize len, usize p, usize min, usize max) {
+  for (usize eps = 0; eps < NABLA_DEPTH_RADIUS; eps += NABLA_DEPTH_STEP) {
+    // The same wrapping around as `nabla_depth`.
+    usize before = (p - eps) % len;
+    usize after = (p + eps) % len;
+    if ((before >= min && before < max) || (after >= min && after < max))
+      return true;
+  }
+  return false;
+}
+
+/// The pixels along an axis `len` pixels long whose `nabla_depth` reads any of the pixels `*min..*max`, into them.
+static void nabla_depth_reach(usize len, usize *min, usize *max) {
+  const usize reach = NABLA_DEPTH_RADIUS - NABLA_DEPTH_STEP;
+  usize reach_min = saturating_subzu(*min, reach);
+  usize reach_max = minzu(*max + reach, len);
+  // The pixels near the edges read around the other edge, or further for those reading before 0, which wraps from the
+  // end of `usize`.
+  for (usize p = 0; p < len; ++p) {
+    bool near_edge = p < reach || p + reach >= len;
+    if (near_edge && nabla_depth_reads(len, p, *min, *max)) {
+      reach_min = minzu(reach_min, p);
+      reach_max = maxzu(reach_max, p + 1);
+    }
+  }
+  *min = reach_min;
+  *max = reach_max;
+}
+
+ScreenRect shader_dirty_rect(ShaderKind shader_kind, usize width, usize height, ScreenRect rect) {
+  if (screen_rect_is_empty(rect) || shader_kind == SHADER_KIND_DEFAULT || shader_kind == SHADER_KIND_DEBUG_DEPTH)
+    return rect;
+  // `nabla_depth` of a pixel reads its row and column only, so the pixels that read the rectangle are within the
+  // columns that read its columns and the rows that read its rows.
+  nabla_depth_reach(width, &rect.min_x, &rect.max_x);
+  nabla_depth_reach(height, &rect.min_y, &rect.max_y);
+  return rect;
 }
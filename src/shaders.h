@@ -1,6 +1,7 @@
 #pragma once
 
 #include "common.h"
+#include "render.h"
 
 // There are no vertex shaders rn, only fragment shaders.
 
@@ -12,29 +13,89 @@ typedef enum shader_kind {
   SHADER_KIND_HIGHLIGHT_ONLY,
 } ShaderKind;
 
+/// Size of the neighbourhood `nabla_depth` samples, and the distance between the samples in it.
+/// It reads at most `NABLA_DEPTH_RADIUS - NABLA_DEPTH_STEP` pixels away from the pixel in each direction.
+#define NABLA_DEPTH_RADIUS 4
+#define NABLA_DEPTH_STEP 2
+
 void select_next_shader(ShaderKind *shader_kind);
 
 void select_prev_shader(ShaderKind *shader_kind);
 
-u8 shader_boring(usize width, usize height, usize x, usize y, u8 light_level, const f32 *depth_buffer);
+/// Human-readable name of a shader, e.g. for displaying in the GUI.
+const char *shader_name(ShaderKind shader_kind);
+
+/// Magnitude of the gradient of the depth buffer around a pixel, used for highlighting edges.
+/// In all the shaders, `stride` is the distance between the rows of `depth_buffer` (see `Renderer::stride`).
+u8 nabla_depth(usize width, usize height, usize stride, usize x, usize y, const f32 *depth_buffer);
+
+u8 shader_boring(usize width, usize height, usize stride, usize x, usize y, u8 light_level, const f32 *depth_buffer);
 
-u8 shader_highlighted(usize width, usize height, usize x, usize y, u8 light_level, const f32 *depth_buffer);
+u8 shader_highlighted(usize width,
+                      usize height,
+                      usize stride,
+                      usize x,
+                      usize y,
+                      u8 light_level,
+                      const f32 *depth_buffer);
 
-u8 shader_debug_depth(usize width, usize height, usize x, usize y, u8 light_level, const f32 *depth_buffer);
+u8 shader_debug_depth(usize width,
+                      usize height,
+                      usize stride,
+                      usize x,
+                      usize y,
+                      u8 light_level,
+                      const f32 *depth_buffer);
 
 u8 shader_debug_depth_highlighted(usize width,
                                   usize height,
+                                  usize stride,
                                   usize x,
                                   usize y,
                                   u8 _light_level,
                                   const f32 *depth_buffer);
 
-u8 shader_highlight_only(usize width, usize height, usize x, usize y, u8 light_level, const f32 *depth_buffer);
+u8 shader_highlight_only(usize width,
+                         usize height,
+                         usize stride,
+                         usize x,
+                         usize y,
+                         u8 light_level,
+                         const f32 *depth_buffer);
 
 void apply_shader(ShaderKind shader_kind,
                   usize width,
                   usize height,
+                  usize stride,
                   usize x,
                   usize y,
                   u8 *fragment,
                   const f32 *depth_buffer);
+
+/// Apply shader onto the whole frame, gives the same result as `apply_shader` on every pixel but faster.
+/// The strides are the distances between the rows of each buffer, in pixels.
+void apply_shader_frame(ShaderKind shader_kind,
+                        usize width,
+                        usize height,
+                        u8 *frame_buffer,
+                        usize frame_stride,
+                        const f32 *depth_buffer,
+                        usize depth_stride);
+
+/// Like `apply_shader_frame`, but only the pixels in `rect`, from `frame_buffer` into `out` (with its own stride),
+/// which may be the frame buffer itself. Shading into another buffer keeps the frame buffer unshaded, so that the
+/// pixels around a redrawn part of it can be shaded again.
+void apply_shader_rect(ShaderKind shader_kind,
+                       usize width,
+                       usize height,
+                       ScreenRect rect,
+                       const u8 *frame_buffer,
+                       usize frame_stride,
+                       const f32 *depth_buffer,
+                       usize depth_stride,
+                       u8 *out,
+                       usize out_stride);
+
+/// The pixels whose shading may change when the pixels in `rect` are redrawn: more than those for the shaders that
+/// read the depths around each pixel (see `nabla_depth`).
+ScreenRect shader_dirty_rect(ShaderKind shader_kind, usize width, usize height, ScreenRect rect);
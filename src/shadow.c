@@ -0,0 +1,176 @@
+#include "shadow.h"
+
+#include "trace.h"
+
+/// Texels left around the fitted bounds, for the taps of the filters at their edges.
+#define SHADOW_MARGIN_TEXELS 4
+
+/// The light's camera, before it's fitted to the scene: 90 degrees, so that its camera coords are the rotated world
+/// coords up to the depth.
+static Camera_ light_camera() {
+  return (Camera_){
+      .pos = {{0, 0, 0}},
+      .min_x = -1,
+      .min_y = -1,
+      .max_x = 1,
+      .max_y = 1,
+      .fov = to_rad(90.f),
+      .aspect_ratio = 1.f,
+      .near_clipping_dist = 0.1f,
+      .far_clipping_dist = INFINITY,
+  };
+}
+
+ShadowMap new_shadow_map(usize size) {
+  ShadowMap shadow = {
+      .renderer = new_renderer(size, size, light_camera(), (Vec3){{1, 0, 0}}),
+      .bias = 0,
+      .ambient = DEFAULT_AMBIENT_LIGHT_LEVEL,
+  };
+  // Set by `shadow_map_begin`.
+  shadow.light_rotation = mat4x4_id;
+  shadow.world_to_light = mat4x4_id;
+  return shadow;
+}
+
+void free_shadow_map(ShadowMap shadow) {
+  free_renderer(shadow.renderer);
+}
+
+static Vec3 normalize3(Vec3 v) {
+  f32 len = abs3(v);
+  return (Vec3){{v.get[0] / len, v.get[1] / len, v.get[2] / len}};
+}
+
+/// Rotates the direction towards the light, opposite to `light` (the direction it travels in), onto positive X.
+static Mat4x4 light_rotation(Vec3 light) {
+  Vec3 x = normalize3(sub3((Vec3){{0, 0, 0}}, light));
+  // Any axis that isn't too close to the light completes the basis.
+  Vec3 up = fabsf(x.get[2]) < 0.9f ? (Vec3){{0, 0, 1}} : (Vec3){{0, 1, 0}};
+  Vec3 y = normalize3(cross3(up, x));
+  Vec3 z = cross3(x, y);
+  return (Mat4x4){{
+      {x.get[0], x.get[1], x.get[2], 0},
+      {y.get[0], y.get[1], y.get[2], 0},
+      {z.get[0], z.get[1], z.get[2], 0},
+      {0, 0, 0, 1},
+  }};
+}
+
+void shadow_map_begin(ShadowMap *shadow, Vec3 light, Aabb bounds) {
+  ASSERT(abs3(light) > 0);
+  Renderer *renderer = &shadow->renderer;
+  shadow->light_rotation = light_rotation(light);
+  Aabb rotated = aabb_transform(shadow->light_rotation, bounds);
+  f32 size = abs3(sub3(rotated.max, rotated.min));
+  // Rotated Y and Z are the camera's X and Y, see `view_matrix`.
+  f32 margin_x = maxf(rotated.max.get[1] - rotated.min.get[1], 1e-3f) * SHADOW_MARGIN_TEXELS / (f32)renderer->width;
+  f32 margin_y = maxf(rotated.max.get[2] - rotated.min.get[2], 1e-3f) * SHADOW_MARGIN_TEXELS / (f32)renderer->height;
+  Camera_ cam = light_camera();
+  cam.pos = (Vec3){{rotated.max.get[0] + maxf(size, 1e-3f) * SHADOW_LIGHT_DISTANCE, 0, 0}};
+  cam.min_x = rotated.min.get[1] - margin_x;
+  cam.max_x = rotated.max.get[1] + margin_x;
+  cam.min_y = rotated.min.get[2] - margin_y;
+  cam.max_y = rotated.max.get[2] + margin_y;
+  renderer->cam = cam;
+  renderer->x_ratio = (cam.max_x - cam.min_x) / (f32)renderer->width;
+  renderer->y_ratio = (cam.max_y - cam.min_y) / (f32)renderer->height;
+  renderer->light = light;
+  shadow->world_to_light = mul4x4(world_to_camera_matrix(renderer), shadow->light_rotation);
+
+  // The depths a texel spans on a surface sloping away from the light by up to the bias, and the rounding of depths
+  // that far from the camera.
+  const f32 *depth_row = shadow->world_to_light.get[2];
+  f32 depth_scale = sqrtf(pow2f(depth_row[0]) + pow2f(depth_row[1]) + pow2f(depth_row[2]));
+  f32 far_depth = transform(shadow->world_to_light, bounds.min).get[2] + size * depth_scale;
+  shadow->bias = SHADOW_BIAS_TEXELS * maxf(renderer->x_ratio, renderer->y_ratio) * depth_scale + far_depth * 4e-6f;
+  renderer_clear_frame(renderer);
+}
+
+void shadow_map_add_caster(ShadowMap *shadow, const Mesh *mesh, Mat4x4 m) {
+  TRACE_SCOPE("shadow_map_add_caster");
+  Instance instance = new_instance(&shadow->renderer, mul4x4(shadow->light_rotation, m));
+  draw_object_depth_only(&shadow->renderer, mesh, &instance, 1);
+}
+
+/// Taps along each axis of the filters.
+static const usize filter_taps[] = {
+    [SHADOW_FILTER_HARD] = 1,
+    [SHADOW_FILTER_PCF_2X2] = 2,
+    [SHADOW_FILTER_PCF_3X3] = 3,
+    [SHADOW_FILTER_PCF_4X4] = 4,
+};
+
+/// Number of the `taps` x `taps` texels from texel `tx`, `ty` that the light reaches at depth `depth`. Those outside
+/// the shadow map are lit.
+static usize lit_taps(const ShadowMap *shadow, i64 tx, i64 ty, usize taps, f32 depth) {
+  const Renderer *light = &shadow->renderer;
+  usize lit = 0;
+  for (i64 y = ty; y < ty + (i64)taps; ++y) {
+    for (i64 x = tx; x < tx + (i64)taps; ++x) {
+      if (x < 0 || y < 0 || x >= (i64)light->width || y >= (i64)light->height) {
+        ++lit;
+        continue;
+      }
+      f32 occluder = light->depth_buffer[render_target_index(light->layout, light->stride, (usize)x, (usize)y)];
+      lit += !(depth > occluder);
+    }
+  }
+  return lit;
+}
+
+void shadow_map_resolve(const ShadowMap *shadow,
+                        const Renderer *renderer,
+                        ShadowFilter filter,
+                        u8 *frame_buffer,
+                        usize frame_stride,
+                        RenderLayout layout) {
+  TRACE_SCOPE("shadow_map_resolve");
+  const Renderer *light = &shadow->renderer;
+  usize taps = filter_taps[filter];
+  u32 taps_len = (u32)(taps * taps);
+  ASSERT(taps_len <= SHADOW_MAX_TAPS);
+  // Camera coords are linear in world coords (there is no perspective divide), so a pixel's camera coords map to the
+  // light's in one matrix.
+  Mat4x4 m = mul4x4(shadow->world_to_light, inverse_affine4x4(world_to_camera_matrix(renderer)));
+  // Texels of the shadow map as of `cam_to_screen_x` and `cam_to_screen_y`, minus half the taps, so that the taps
+  // around a pixel start at the floor of these.
+  f32 light_dy = light->cam.max_y - light->cam.min_y;
+  f32 half_taps = (f32)(taps - 1) / 2;
+  ScreenRect rect = renderer->scissor;
+  for (usize y = rect.min_y; y < rect.max_y; ++y) {
+    f32 y_cam = screen_to_cam_y(renderer, y);
+    for (usize x = rect.min_x; x < rect.max_x; ++x) {
+      f32 z = renderer->depth_buffer[render_target_index(renderer->layout, renderer->stride, x, y)];
+      if (z == INFINITY)
+        continue;
+      u8 *pixel = &frame_buffer[render_target_index(layout, frame_stride, x, y)];
+      if (*pixel <= shadow->ambient)
+        continue;
+      // As `screen_to_cam_x`.
+      Vec3 p = {{(f32)x * renderer->x_ratio + renderer->cam.min_x, y_cam, z}};
+      Vec3 q = transform(m, p);
+      f32 u = (q.get[0] - light->cam.min_x) / light->x_ratio - half_taps;
+      f32 v = (light_dy - (q.get[1] - light->cam.min_y)) / light->y_ratio - half_taps;
+      // Outside the shadow map (or NaN), nothing casts shadows there.
+      if (!(u > -(f32)taps && u < (f32)light->width && v > -(f32)taps && v < (f32)light->height))
+        continue;
+      u32 lit = (u32)lit_taps(shadow, (i64)floorf(u), (i64)floorf(v), taps, q.get[2] - shadow->bias);
+      *pixel = (u8)(shadow->ambient + (u32)(*pixel - shadow->ambient) * lit / taps_len);
+    }
+  }
+}
+
+const char *shadow_filter_name(ShadowFilter filter) {
+  switch (filter) {
+  case SHADOW_FILTER_HARD:
+    return "HARD";
+  case SHADOW_FILTER_PCF_2X2:
+    return "PCF 2X2";
+  case SHADOW_FILTER_PCF_3X3:
+    return "PCF 3X3";
+  case SHADOW_FILTER_PCF_4X4:
+    return "PCF 4X4";
+  }
+  return "UNKNOWN";
+}
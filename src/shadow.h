@@ -0,0 +1,98 @@
+#pragma once
+
+#include "common.h"
+#include "linear_alg.h"
+#include "mesh.h"
+#include "render.h"
+
+// Shadow maps: the depths of the scene seen from the light, for darkening the pixels the light doesn't reach.
+//
+// The light is directional (`Renderer::light` is the direction it travels in), and the view from it is drawn by a
+// renderer of its own, whose camera looks in negative X like any other: the shadow casters are rotated so that the
+// light travels along negative X, then drawn with `draw_object_depth_only`, which skips the lighting and the draw pixel
+// callback that make up much of the cost of drawing them for the screen. The light's camera is fitted to a bounding
+// box of the scene every frame, and placed far from it, so that the depths of large triangles (which the renderer
+// interpolates harmonically) are close to linear.
+//
+// The lookup is deferred, like texturing: once the frame is drawn, `shadow_map_resolve` maps each drawn pixel, from
+// its screen coords and depth, into the light's view and compares its depth there with the shadow map's.
+// Percentage-closer filtering reads a fixed number of texels around it (see `ShadowFilter`), the fraction of them that
+// see the pixel scales its light level down towards the ambient light level.
+//
+// Example:
+//
+// ```
+// ShadowMap shadow = new_shadow_map(1024);
+// while (...) {
+//   shadow_map_begin(&shadow, renderer.light, scene_bounds);
+//   shadow_map_add_caster(&shadow, &teapot_mesh, teapot_m);
+//   renderer_clear_frame(&renderer);
+//   // draw...
+//   shadow_map_resolve(&shadow, &renderer, SHADOW_FILTER_PCF_3X3, frame_buffer, stride, layout);
+// }
+// free_shadow_map(shadow);
+// ```
+
+/// Distance from the light's camera to the scene, in sizes of the scene (the diagonal of its bounding box). The further
+/// the closer to linear the depths are, but the fewer bits are left for them.
+#define SHADOW_LIGHT_DISTANCE 256.f
+
+/// Texels of the shadow map a surface may be off its own depth in it (e.g. when it slopes away from the light) and
+/// still be lit.
+#define SHADOW_BIAS_TEXELS 3.f
+
+/// Max texels read per pixel by `shadow_map_resolve`.
+#define SHADOW_MAX_TAPS 16
+
+/// How many texels of the shadow map are read per pixel, all with the same weight. Each step costs more and blurs the
+/// edges of the shadows more.
+typedef enum shadow_filter {
+  /// The texel the pixel falls in, hard edges.
+  SHADOW_FILTER_HARD,
+  /// The 2x2 texels around the pixel.
+  SHADOW_FILTER_PCF_2X2,
+  /// The 3x3 texels centered on the texel the pixel falls in.
+  SHADOW_FILTER_PCF_3X3,
+  /// The 4x4 texels around the pixel, `SHADOW_MAX_TAPS`.
+  SHADOW_FILTER_PCF_4X4,
+} ShadowFilter;
+
+/// SAFETY: Only use new_shadow_map to construct this.
+typedef struct shadow_map {
+  /// Depth-only renderer of the light's view, its depth buffer is the shadow map.
+  Renderer renderer;
+  /// Rotates world coords so that the light travels along negative X, the casters are drawn rotated by it.
+  Mat4x4 light_rotation;
+  /// Maps world coords to the camera coords of the light's camera.
+  Mat4x4 world_to_light;
+  /// Depth difference under which a pixel counts as the surface the shadow map saw, see `SHADOW_BIAS_TEXELS`.
+  f32 bias;
+  /// The light level of the pixels in full shadow, that of the surfaces facing away from the light.
+  u8 ambient;
+} ShadowMap;
+
+/// A shadow map of `size` x `size` texels.
+ShadowMap new_shadow_map(usize size);
+
+void free_shadow_map(ShadowMap shadow);
+
+/// Starts a frame: clears the shadow map, and fits the light's view to `bounds` (in world space), seen from the light
+/// `light` (see `Renderer::light`). Only what's inside `bounds` casts shadows.
+void shadow_map_begin(ShadowMap *shadow, Vec3 light, Aabb bounds);
+
+/// Draws the depths of a mesh transformed by `m` into the shadow map.
+void shadow_map_add_caster(ShadowMap *shadow, const Mesh *mesh, Mat4x4 m);
+
+/// Darkens the drawn pixels of the frame buffer that are in shadow, in the renderer's scissor, by the fraction of the
+/// taps of `filter` the light doesn't reach. `frame_buffer` holds light levels, has the size of the renderer, with
+/// `frame_stride` and `layout` (see `render_target_index`). Run it before the texture pass, which multiplies the light
+/// levels.
+void shadow_map_resolve(const ShadowMap *shadow,
+                        const Renderer *renderer,
+                        ShadowFilter filter,
+                        u8 *frame_buffer,
+                        usize frame_stride,
+                        RenderLayout layout);
+
+/// Name of a filter, for display.
+const char *shadow_filter_name(ShadowFilter filter);
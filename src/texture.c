@@ -0,0 +1,129 @@
+#include "texture.h"
+
+#include "dispatch.h"
+#include "trace.h"
+
+/// Number of pixels `texcoord_buffer_resolve` hands to the texture sample kernel at a time.
+#define RESOLVE_CHUNK_LEN 64
+
+static bool is_power_of_2(usize x) {
+  return x != 0 && (x & (x - 1)) == 0;
+}
+
+Texture new_texture(const u8 *texels, usize width, usize height) {
+  ASSERT(is_power_of_2(width) && is_power_of_2(height));
+  Texture texture = {.levels_len = 0};
+  usize len = 0;
+  for (usize w = width, h = height;; w = maxzu(w / 2, 1), h = maxzu(h / 2, 1)) {
+    ASSERT(texture.levels_len < TEXTURE_MAX_LEVELS);
+    usize level = texture.levels_len++;
+    texture.widths[level] = w;
+    texture.heights[level] = h;
+    texture.tiles_x[level] = (w + TEXTURE_TILE_SIZE - 1) / TEXTURE_TILE_SIZE;
+    texture.offsets[level] = len;
+    usize tiles_y = (h + TEXTURE_TILE_SIZE - 1) / TEXTURE_TILE_SIZE;
+    len += texture.tiles_x[level] * tiles_y * TEXTURE_TILE_SIZE * TEXTURE_TILE_SIZE;
+    if (w == 1 && h == 1)
+      break;
+  }
+  // The padding of the tiles of the small levels is never read, zero it anyway.
+  texture.texels = xalloc(u8, len);
+  memset(texture.texels, 0, len);
+  for (usize y = 0; y < height; ++y) {
+    for (usize x = 0; x < width; ++x) {
+      texture.texels[texture_texel_index(&texture, 0, x, y)] = texels[y * width + x];
+    }
+  }
+  for (usize level = 1; level < texture.levels_len; ++level) {
+    usize below_width = texture.widths[level - 1];
+    usize below_height = texture.heights[level - 1];
+    for (usize y = 0; y < texture.heights[level]; ++y) {
+      for (usize x = 0; x < texture.widths[level]; ++x) {
+        // Levels of width or height 1 average 2 texels twice.
+        usize x1 = minzu(x * 2 + 1, below_width - 1);
+        usize y1 = minzu(y * 2 + 1, below_height - 1);
+        u32 sum = (u32)texture.texels[texture_texel_index(&texture, level - 1, x * 2, y * 2)] +
+                  texture.texels[texture_texel_index(&texture, level - 1, x1, y * 2)] +
+                  texture.texels[texture_texel_index(&texture, level - 1, x * 2, y1)] +
+                  texture.texels[texture_texel_index(&texture, level - 1, x1, y1)];
+        texture.texels[texture_texel_index(&texture, level, x, y)] = (u8)((sum + 2) / 4);
+      }
+    }
+  }
+  return texture;
+}
+
+void free_texture(Texture texture) {
+  xfree(texture.texels);
+}
+
+f32 texture_lod(const Texture *texture, f32 dudx, f32 dvdx, f32 dudy, f32 dvdy) {
+  // The longer of the sides of the parallelogram a pixel covers in the texture, in texels of level 0.
+  f32 width = (f32)texture->widths[0];
+  f32 height = (f32)texture->heights[0];
+  f32 x = pow2f(dudx * width) + pow2f(dvdx * height);
+  f32 y = pow2f(dudy * width) + pow2f(dvdy * height);
+  // log2(sqrt(a)) = log2(a) / 2. NaN would mark the pixel as not textured in a `TexcoordBuffer`.
+  f32 lod = log2f(maxf(x, y)) / 2;
+  return isnan(lod) ? 0 : lod;
+}
+
+TexcoordBuffer new_texcoord_buffer(usize width, usize height) {
+  TexcoordBuffer texcoords = {
+      .width = width,
+      .height = height,
+      .us = xalloc(f32, width * height),
+      .vs = xalloc(f32, width * height),
+      .lods = xalloc(f32, width * height),
+  };
+  texcoord_buffer_clear(&texcoords);
+  return texcoords;
+}
+
+void free_texcoord_buffer(TexcoordBuffer texcoords) {
+  xfree(texcoords.us);
+  xfree(texcoords.vs);
+  xfree(texcoords.lods);
+}
+
+void texcoord_buffer_clear(TexcoordBuffer *texcoords) {
+  usize len = texcoords->width * texcoords->height;
+  for (usize i = 0; i < len; ++i) {
+    texcoords->lods[i] = NAN;
+  }
+}
+
+void texcoord_buffer_resolve(const TexcoordBuffer *texcoords,
+                             const Texture *texture,
+                             TextureFilter filter,
+                             u8 *frame_buffer,
+                             usize frame_stride,
+                             RenderLayout layout) {
+  TRACE_SCOPE("texcoord_buffer_resolve");
+  usize xs[RESOLVE_CHUNK_LEN];
+  f32 us[RESOLVE_CHUNK_LEN];
+  f32 vs[RESOLVE_CHUNK_LEN];
+  f32 lods[RESOLVE_CHUNK_LEN];
+  u8 samples[RESOLVE_CHUNK_LEN];
+  for (usize y = 0; y < texcoords->height; ++y) {
+    usize row = y * texcoords->width;
+    // The textured pixels of the row, a chunk at a time.
+    for (usize x = 0; x < texcoords->width;) {
+      usize len = 0;
+      for (; x < texcoords->width && len < RESOLVE_CHUNK_LEN; ++x) {
+        if (isnan(texcoords->lods[row + x]))
+          continue;
+        xs[len] = x;
+        us[len] = texcoords->us[row + x];
+        vs[len] = texcoords->vs[row + x];
+        lods[len] = texcoords->lods[row + x];
+        ++len;
+      }
+      kernels.texture_sample_row(texture, filter, us, vs, lods, len, samples);
+      for (usize i = 0; i < len; ++i) {
+        u8 *pixel = &frame_buffer[render_target_index(layout, frame_stride, xs[i], y)];
+        *pixel = (u8)((u32)*pixel * samples[i] / 255);
+      }
+    }
+  }
+}
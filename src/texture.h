@@ -0,0 +1,199 @@
+#pragma once
+
+#include "common.h"
+#include "math_helpers.h"
+#include "render.h"
+
+// Textures: 8-bit texels (like the frame buffer) with a precomputed mip chain, sampled by the texture coords the
+// rasterizer interpolates (see `Varyings`).
+//
+// Every level is stored in tiles of `TEXTURE_TILE_SIZE` x `TEXTURE_TILE_SIZE` texels, so that the texels a bilinear
+// sample (or a few neighbouring pixels) reads are in one or two cache lines whichever way the texture is oriented on
+// screen. The mip level of a pixel comes from the screen-space derivatives of its texture coords, so that a minified
+// texture is read from a level about as large as it is on screen instead of skipping through level 0.
+//
+// Sampling happens after the raster stage (deferred texturing): the draw pixel callback only records the texture
+// coords and mip level of each pixel in a `TexcoordBuffer`, and `texcoord_buffer_resolve` samples the texture once per
+// visible pixel, a row at a time with the texture sample kernel (see dispatch.h).
+//
+// Example:
+//
+// ```
+// Texture texture = new_texture(texels, 256, 256);
+// TexcoordBuffer texcoords = new_texcoord_buffer(width, height);
+// void my_draw_pixel_callback(...) {
+//   // ...
+//   texcoord_buffer_write(&cx->texcoords, &texture, x, y, z, varyings);
+// }
+// while (...) {
+//   texcoord_buffer_clear(&texcoords);
+//   // draw...
+//   texcoord_buffer_resolve(&texcoords, &texture, TEXTURE_FILTER_BILINEAR, frame_buffer, stride, layout);
+// }
+// free_texcoord_buffer(texcoords);
+// free_texture(texture);
+// ```
+
+/// Width and height of the tiles of the texels.
+#define TEXTURE_TILE_SIZE 4
+
+#define TEXTURE_MAX_LEVELS 16
+
+/// Texture coords are clamped to this many texels from 0, which keeps them exactly representable and convertible to
+/// `i32`, and is far beyond any texture size.
+#define TEXTURE_COORD_LIMIT 16777216.f
+
+typedef enum texture_filter {
+  /// The texel the sample falls in.
+  TEXTURE_FILTER_NEAREST,
+  /// The 4 texels around the sample, weighted by distance.
+  TEXTURE_FILTER_BILINEAR,
+} TextureFilter;
+
+/// SAFETY: Only use new_texture to construct this.
+typedef struct texture {
+  /// Level 0 is the full size, every level after it half the one before it (at least 1), down to 1x1. All are powers
+  /// of 2, texture coords wrap around.
+  usize widths[TEXTURE_MAX_LEVELS];
+  usize heights[TEXTURE_MAX_LEVELS];
+  /// Width in tiles of each level.
+  usize tiles_x[TEXTURE_MAX_LEVELS];
+  /// Index in `texels` of the first texel of each level.
+  usize offsets[TEXTURE_MAX_LEVELS];
+  usize levels_len;
+  /// The levels one after another, each made of whole tiles, row of tiles by row of tiles, with the texels of a tile
+  /// row by row.
+  u8 *texels;
+} Texture;
+
+/// A texture from `width` x `height` texels, row by row, both powers of 2. The mip chain is made by averaging 2x2
+/// texels, `texels` is copied.
+Texture new_texture(const u8 *texels, usize width, usize height);
+
+void free_texture(Texture texture);
+
+/// Index in `Texture::texels` of texel `x`, `y` of a level.
+static inline usize texture_texel_index(const Texture *texture, usize level, usize x, usize y) {
+  usize tile = (y / TEXTURE_TILE_SIZE) * texture->tiles_x[level] + x / TEXTURE_TILE_SIZE;
+  usize in_tile = (y % TEXTURE_TILE_SIZE) * TEXTURE_TILE_SIZE + x % TEXTURE_TILE_SIZE;
+  return texture->offsets[level] + tile * TEXTURE_TILE_SIZE * TEXTURE_TILE_SIZE + in_tile;
+}
+
+/// Texel `x`, `y` of a level, wrapping around.
+static inline u8 texture_texel(const Texture *texture, usize level, i32 x, i32 y) {
+  // The sizes are powers of 2, and the mask of the sign extended `i32` wraps negative coords too.
+  usize x_ = (usize)x & (texture->widths[level] - 1);
+  usize y_ = (usize)y & (texture->heights[level] - 1);
+  return texture->texels[texture_texel_index(texture, level, x_, y_)];
+}
+
+/// The mip level, fractional, of a pixel whose texture coords change by `dudx`, `dvdx` to the next pixel along X and
+/// by `dudy`, `dvdy` along Y (see `varyings_derivatives`): log2 of how many texels of level 0 a pixel spans.
+f32 texture_lod(const Texture *texture, f32 dudx, f32 dvdx, f32 dudy, f32 dvdy);
+
+/// The level sampled for a fractional mip level, the nearest one.
+static inline usize texture_level(const Texture *texture, f32 lod) {
+  // NaN ends up at level 0.
+  if (!(lod > 0.5f))
+    return 0;
+  return minzu((usize)minf(lod + 0.5f, (f32)TEXTURE_MAX_LEVELS), texture->levels_len - 1);
+}
+
+/// Clamps a texture coord in texels to `TEXTURE_COORD_LIMIT`, NaN to its negation. Keep it like this, the SIMD
+/// kernels do the same with VF_MAX and VF_MIN.
+static inline f32 texture_clamp_coord(f32 x) {
+  x = x > -TEXTURE_COORD_LIMIT ? x : -TEXTURE_COORD_LIMIT;
+  return x < TEXTURE_COORD_LIMIT ? x : TEXTURE_COORD_LIMIT;
+}
+
+/// Samples a level at texture coords `u`, `v` (0 to 1 over the texture), with `TEXTURE_FILTER_NEAREST`.
+static inline u8 texture_sample_nearest(const Texture *texture, usize level, f32 u, f32 v) {
+  f32 x = floorf(texture_clamp_coord(u * (f32)texture->widths[level]));
+  f32 y = floorf(texture_clamp_coord(v * (f32)texture->heights[level]));
+  return texture_texel(texture, level, (i32)x, (i32)y);
+}
+
+/// Samples a level at texture coords `u`, `v` (0 to 1 over the texture), with `TEXTURE_FILTER_BILINEAR`.
+static inline u8 texture_sample_bilinear(const Texture *texture, usize level, f32 u, f32 v) {
+  // Texel centers are at half coords.
+  f32 x = texture_clamp_coord(u * (f32)texture->widths[level] - 0.5f);
+  f32 y = texture_clamp_coord(v * (f32)texture->heights[level] - 0.5f);
+  f32 x0 = floorf(x);
+  f32 y0 = floorf(y);
+  f32 tx = x - x0;
+  f32 ty = y - y0;
+  i32 x0_ = (i32)x0;
+  i32 y0_ = (i32)y0;
+  f32 t00 = (f32)texture_texel(texture, level, x0_, y0_);
+  f32 t10 = (f32)texture_texel(texture, level, x0_ + 1, y0_);
+  f32 t01 = (f32)texture_texel(texture, level, x0_, y0_ + 1);
+  f32 t11 = (f32)texture_texel(texture, level, x0_ + 1, y0_ + 1);
+  f32 top = t00 + (t10 - t00) * tx;
+  f32 bottom = t01 + (t11 - t01) * tx;
+  return (u8)(i32)(top + (bottom - top) * ty + 0.5f);
+}
+
+/// `out[i]` is the sample at `us[i]`, `vs[i]` at the level of `lods[i]` (see `texture_level`), for `i` in `0..len`.
+///
+/// This is the scalar version of the texture sample kernel, see dispatch.h.
+static inline void texture_sample_row_scalar(const Texture *texture,
+                                             TextureFilter filter,
+                                             const f32 *us,
+                                             const f32 *vs,
+                                             const f32 *lods,
+                                             usize len,
+                                             u8 *out) {
+  for (usize i = 0; i < len; ++i) {
+    usize level = texture_level(texture, lods[i]);
+    out[i] = filter == TEXTURE_FILTER_NEAREST ? texture_sample_nearest(texture, level, us[i], vs[i])
+                                              : texture_sample_bilinear(texture, level, us[i], vs[i]);
+  }
+}
+
+/// The texture coords and mip level of every pixel of a frame, see the top of this file.
+/// SAFETY: Only use new_texcoord_buffer to construct this.
+typedef struct texcoord_buffer {
+  usize width;
+  usize height;
+  /// LEN: width * height each, row by row. `lods[i]` is NaN for the pixels that aren't textured.
+  f32 *us;
+  f32 *vs;
+  f32 *lods;
+} TexcoordBuffer;
+
+TexcoordBuffer new_texcoord_buffer(usize width, usize height);
+
+void free_texcoord_buffer(TexcoordBuffer texcoords);
+
+/// Marks every pixel as not textured, at the start of a frame.
+void texcoord_buffer_clear(TexcoordBuffer *texcoords);
+
+/// Records the texture coords of a pixel from its first two varyings, for the draw pixel callback. Only writes the
+/// pixel itself, so it's safe to call from threads drawing different pixels. Pixels of triangles without texture
+/// coords must go through `texcoord_buffer_skip` instead, as they may be drawn over textured ones.
+static inline void texcoord_buffer_write(
+    TexcoordBuffer *texcoords, const Texture *texture, usize x, usize y, f32 z, const Varyings *varyings) {
+  ASSERT(varyings->len >= 2);
+  f32 dudx, dudy, dvdx, dvdy;
+  varyings_derivatives(varyings, 0, z, &dudx, &dudy);
+  varyings_derivatives(varyings, 1, z, &dvdx, &dvdy);
+  usize i = y * texcoords->width + x;
+  texcoords->us[i] = varyings->get[0];
+  texcoords->vs[i] = varyings->get[1];
+  texcoords->lods[i] = texture_lod(texture, dudx, dvdx, dudy, dvdy);
+}
+
+/// Marks a pixel as not textured, for the draw pixel callback.
+static inline void texcoord_buffer_skip(TexcoordBuffer *texcoords, usize x, usize y) {
+  texcoords->lods[y * texcoords->width + x] = NAN;
+}
+
+/// Samples `texture` for every textured pixel, and multiplies the pixel in the frame buffer (its light level) by the
+/// sample. `frame_buffer` has the size of the texcoord buffer, with `frame_stride` and `layout` (see
+/// `render_target_index`).
+void texcoord_buffer_resolve(const TexcoordBuffer *texcoords,
+                             const Texture *texture,
+                             TextureFilter filter,
+                             u8 *frame_buffer,
+                             usize frame_stride,
+                             RenderLayout layout);
@@ -0,0 +1,118 @@
+#include "trace.h"
+#include "math_helpers.h"
+
+#ifdef RENDER_TRACE
+
+#include <stdatomic.h>
+#include <time.h>
+
+/// Number of events a thread can record before the oldest ones are overwritten.
+#define TRACE_RING_CAPACITY ((usize)1 << 16)
+
+typedef struct trace_event {
+  const char *name;
+  u64 begin_ns;
+  u64 end_ns;
+} TraceEvent;
+
+/// Written by its own thread only, read by whoever calls `trace_flush`.
+typedef struct trace_ring {
+  TraceEvent events[TRACE_RING_CAPACITY];
+  /// Total number of events ever written into this ring.
+  _Atomic u64 head;
+  /// Number of events that were already flushed.
+  u64 flushed;
+  u32 tid;
+  struct trace_ring *next;
+} TraceRing;
+
+static atomic_bool enabled = false;
+
+/// Linked list of the rings of all threads that ever recorded something.
+static _Atomic(TraceRing *) rings = NULL;
+
+static atomic_uint next_tid = 1;
+
+static _Thread_local TraceRing *thread_ring = NULL;
+
+static inline u64 now_ns() {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (u64)t.tv_sec * 1000000000 + (u64)t.tv_nsec;
+}
+
+static TraceRing *new_thread_ring() {
+  TraceRing *ring = xalloc(TraceRing, 1);
+  atomic_init(&ring->head, 0);
+  ring->flushed = 0;
+  ring->tid = atomic_fetch_add(&next_tid, 1);
+  ring->next = atomic_load(&rings);
+  while (!atomic_compare_exchange_weak(&rings, &ring->next, ring))
+    ;
+  return ring;
+}
+
+TraceScope trace_scope_begin_(const char *name) {
+  if (!atomic_load_explicit(&enabled, memory_order_relaxed))
+    return (TraceScope){.name = NULL, .begin_ns = 0};
+  return (TraceScope){.name = name, .begin_ns = now_ns()};
+}
+
+void trace_scope_end_(TraceScope *scope) {
+  if (scope->name == NULL)
+    return;
+  u64 end_ns = now_ns();
+  if (thread_ring == NULL)
+    thread_ring = new_thread_ring();
+  TraceRing *ring = thread_ring;
+  u64 head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+  ring->events[head % TRACE_RING_CAPACITY] = (TraceEvent){
+      .name = scope->name,
+      .begin_ns = scope->begin_ns,
+      .end_ns = end_ns,
+  };
+  atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+void trace_set_enabled(bool enabled_) {
+  atomic_store(&enabled, enabled_);
+}
+
+bool trace_is_enabled() {
+  return atomic_load(&enabled);
+}
+
+bool trace_flush(const char *path) {
+  FILE *file = fopen(path, "w");
+  if (file == NULL)
+    return false;
+  fprintf(file, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+  bool first = true;
+  for (TraceRing *ring = atomic_load(&rings); ring != NULL; ring = ring->next) {
+    u64 head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    u64 begin = maxzu(ring->flushed, head > TRACE_RING_CAPACITY ? head - TRACE_RING_CAPACITY : 0);
+    for (u64 i = begin; i < head; ++i) {
+      TraceEvent event = ring->events[i % TRACE_RING_CAPACITY];
+      // The owning thread may have lapped us while we were reading, in which case the event could be torn: it writes
+      // event `i + TRACE_RING_CAPACITY` into the same slot once `head` has reached it. The fence keeps the read of the
+      // event before the reload of `head`, which an acquire load alone doesn't.
+      atomic_thread_fence(memory_order_acquire);
+      u64 head_now = atomic_load_explicit(&ring->head, memory_order_relaxed);
+      if (head_now - i >= TRACE_RING_CAPACITY)
+        continue;
+      fprintf(file,
+              "%s{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %u, \"ts\": %.3f, \"dur\": %.3f}",
+              first ? "" : ",\n",
+              event.name,
+              ring->tid,
+              (f64)event.begin_ns / 1000.0,
+              (f64)(event.end_ns - event.begin_ns) / 1000.0);
+      first = false;
+    }
+    ring->flushed = head;
+  }
+  fprintf(file, "\n]}\n");
+  return fclose(file) == 0;
+}
+
+#endif
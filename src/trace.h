@@ -0,0 +1,70 @@
+#pragma once
+
+#include "common.h"
+
+// Timeline instrumentation, exported in Chrome's trace event format (open with chrome://tracing or ui.perfetto.dev).
+//
+// Only compiled in with `-DRENDER_TRACE` (on by default in debug builds, `make TRACE=1` for release builds), otherwise
+// everything here compiles to nothing. When compiled in, recording is still off until `trace_set_enabled(true)`, and
+// a disabled scope costs one relaxed atomic load.
+//
+// Each thread records into its own ring buffer (so the recording side needs no locks), the oldest events are
+// overwritten once a ring is full.
+//
+// Example:
+//
+// ```
+// void foo() {
+//   TRACE_SCOPE("foo");
+//   // ...
+// }
+// ```
+
+#ifdef RENDER_TRACE
+
+/// Don't use this directly, use `TRACE_SCOPE`.
+typedef struct trace_scope {
+  /// `NULL` if tracing was disabled when the scope began.
+  const char *name;
+  u64 begin_ns;
+} TraceScope;
+
+/// Don't use this directly, use `TRACE_SCOPE`.
+TraceScope trace_scope_begin_(const char *name);
+
+/// Don't use this directly, use `TRACE_SCOPE`.
+void trace_scope_end_(TraceScope *scope);
+
+#define TRACE_CONCAT_(X, Y) X##Y
+#define TRACE_CONCAT(X, Y) TRACE_CONCAT_(X, Y)
+
+/// Record the time from here to the end of the enclosing block as an event called `NAME`.
+/// `NAME` must be a string with static lifetime.
+#define TRACE_SCOPE(NAME)                                                                                              \
+  __attribute__((cleanup(trace_scope_end_))) TraceScope TRACE_CONCAT(trace_scope_, __LINE__) =                         \
+      trace_scope_begin_(NAME)
+
+/// Start or stop recording.
+void trace_set_enabled(bool enabled);
+
+bool trace_is_enabled();
+
+/// Write all recorded events that are still in the ring buffers to `path` as a Chrome trace JSON file, and forget about
+/// them. Returns `false` if the file cannot be written.
+bool trace_flush(const char *path);
+
+#else
+
+#define TRACE_SCOPE(NAME) ((void)0)
+
+static inline void trace_set_enabled(bool enabled) {}
+
+static inline bool trace_is_enabled() {
+  return false;
+}
+
+static inline bool trace_flush(const char *path) {
+  return false;
+}
+
+#endif
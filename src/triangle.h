@@ -0,0 +1,209 @@
+#pragma once
+
+#include "common.h"
+#include "linear_alg.h"
+#include "mesh.h"
+
+// Geometry of projected triangles, used by the rasterizer for every pixel it tests.
+// Kept in a header so that they are inlined into render.c and can still be benchmarked on their own (see microbench.c).
+
+/// Helper function used in `is_in_triangle`.
+static inline f32 sign(f32 x, f32 y, Vec3 p1, Vec3 p2) {
+  return (x - p2.get[0]) * (p1.get[1] - p2.get[1]) - (p1.get[0] - p2.get[0]) * (y - p2.get[1]);
+}
+
+/// The Z of p0, p1, p2 is ignored.
+static inline bool is_in_triangle(Vec3 p0, Vec3 p1, Vec3 p2, f32 x, f32 y) {
+  f32 d0 = sign(x, y, p0, p1);
+  f32 d1 = sign(x, y, p1, p2);
+  f32 d2 = sign(x, y, p2, p0);
+  bool has_neg = (d0 < 0) || (d1 < 0) || (d2 < 0);
+  bool has_pos = (d0 > 0) || (d1 > 0) || (d2 > 0);
+  return !(has_neg && has_pos);
+}
+
+/// From a projected triangle (calculated by `project_point` in render.c), calculate depth
+/// on (x, y). If outside triangle returns infinity.
+static inline f32 triangular_interpolate_z(Vec3 p0, Vec3 p1, Vec3 p2, f32 x, f32 y) {
+  if (!is_in_triangle(p0, p1, p2, x, y))
+    return INFINITY;
+
+  // reference: https://codeplea.com/triangular-interpolation
+
+  // Weights.
+  // w0 = ((y1 - y2)(px - x2) + (x2 - x1)(py - y2)) /
+  //      ((y1 - y2)(x0 - x2) + (x2 - x1)(y0 - y2))
+  // w1 = ((y2 - y1)(px - x2) + (x0 - x2)(py - y2)) /
+  //      ((y1 - y2)(x0 - x2) + (x2 - x1)(y0 - y2))
+  // w2 = 1 - w0 - w1
+  // ... where:
+  //    x0 ~ x2 => p{0~2}.get[0]
+  //    y0 ~ y2 => p{0~2}.get[1]
+  //    p{x|y}  => {x|y}
+
+  f32 w0 = ((p1.get[1] - p2.get[1]) * (x - p2.get[0]) + (p2.get[0] - p1.get[0]) * (y - p2.get[1])) /
+           ((p1.get[1] - p2.get[1]) * (p0.get[0] - p2.get[0]) + (p2.get[0] - p1.get[0]) * (p0.get[1] - p2.get[1]));
+  f32 w1 = ((p2.get[1] - p0.get[1]) * (x - p2.get[0]) + (p0.get[0] - p2.get[0]) * (y - p2.get[1])) /
+           ((p1.get[1] - p2.get[1]) * (p0.get[0] - p2.get[0]) + (p2.get[0] - p1.get[0]) * (p0.get[1] - p2.get[1]));
+  f32 w2 = 1 - w0 - w1;
+
+  // 1/z is linear to (x, y), z is not.
+  f32 z0 = 1 / p0.get[2];
+  f32 z1 = 1 / p1.get[2];
+  f32 z2 = 1 / p2.get[2];
+
+  f32 z_ = w0 * z0 + w1 * z1 + w2 * z2;
+
+  return 1 / z_;
+}
+
+/// Normal vector of a triangle.
+static inline Vec3 triangle_normal(Vec3 p0, Vec3 p1, Vec3 p2) {
+  return cross3(sub3(p2, p0), sub3(p1, p0));
+}
+
+/// The terms of `triangular_interpolate_z` that are the same for every pixel of a triangle, for evaluating it on many
+/// pixels at once. Evaluating with these gives exactly the same results, as the operations stay the same.
+typedef struct triangle_setup {
+  Vec3 p0, p1, p2;
+  /// p0.y - p1.y, p1.y - p2.y, p2.y - p0.y, for `sign` and the weights.
+  f32 dy01, dy12, dy20;
+  /// Denominator of the weights.
+  f32 denominator;
+  /// 1/z of the vertices.
+  f32 inv_z0, inv_z1, inv_z2;
+} TriangleSetup;
+
+/// The terms of `triangular_interpolate_z` that are the same for every pixel of a row of a triangle, and the mapping
+/// of pixel X to camera X (see `screen_to_cam_x`).
+typedef struct triangle_row {
+  const TriangleSetup *triangle;
+  f32 y;
+  /// Second terms of `sign` for d0, d1, d2.
+  f32 sign0, sign1, sign2;
+  /// Second terms of the numerators of w0 and w1.
+  f32 weight0, weight1;
+  f32 x_ratio;
+  f32 min_x;
+} TriangleRow;
+
+static inline TriangleSetup triangle_setup(Vec3 p0, Vec3 p1, Vec3 p2) {
+  return (TriangleSetup){
+      .p0 = p0,
+      .p1 = p1,
+      .p2 = p2,
+      .dy01 = p0.get[1] - p1.get[1],
+      .dy12 = p1.get[1] - p2.get[1],
+      .dy20 = p2.get[1] - p0.get[1],
+      .denominator =
+          (p1.get[1] - p2.get[1]) * (p0.get[0] - p2.get[0]) + (p2.get[0] - p1.get[0]) * (p0.get[1] - p2.get[1]),
+      .inv_z0 = 1 / p0.get[2],
+      .inv_z1 = 1 / p1.get[2],
+      .inv_z2 = 1 / p2.get[2],
+  };
+}
+
+static inline TriangleRow triangle_row(const TriangleSetup *t, f32 y, f32 x_ratio, f32 min_x) {
+  return (TriangleRow){
+      .triangle = t,
+      .y = y,
+      .sign0 = (t->p0.get[0] - t->p1.get[0]) * (y - t->p1.get[1]),
+      .sign1 = (t->p1.get[0] - t->p2.get[0]) * (y - t->p2.get[1]),
+      .sign2 = (t->p2.get[0] - t->p0.get[0]) * (y - t->p0.get[1]),
+      .weight0 = (t->p2.get[0] - t->p1.get[0]) * (y - t->p2.get[1]),
+      .weight1 = (t->p0.get[0] - t->p2.get[0]) * (y - t->p2.get[1]),
+      .x_ratio = x_ratio,
+      .min_x = min_x,
+  };
+}
+
+/// Depth-tests the pixels `x0..x1` of a row of a triangle against `depth_row` (the row of the depth buffer). Pixels
+/// that pass have their depth written to `depth_row`, and are appended to `xs` and `depths` (which must have room for
+/// `x1 - x0` pixels), in order of X. Adds the number of those that were not covered before to `covered`.
+/// Returns the number of pixels that passed.
+///
+/// This is the scalar version of the raster row kernel, see dispatch.h.
+static inline usize raster_row_scalar(
+    const TriangleRow *row, usize x0, usize x1, f32 *depth_row, usize *xs, f32 *depths, usize *covered) {
+  const TriangleSetup *t = row->triangle;
+  usize passed = 0;
+  for (usize x = x0; x < x1; ++x) {
+    f32 cam_x = (f32)x * row->x_ratio + row->min_x;
+    f32 depth = triangular_interpolate_z(t->p0, t->p1, t->p2, cam_x, row->y);
+    if (depth < depth_row[x]) {
+      *covered += depth_row[x] == INFINITY;
+      depth_row[x] = depth;
+      xs[passed] = x;
+      depths[passed] = depth;
+      ++passed;
+    }
+  }
+  return passed;
+}
+
+/// Plane equations of attribute/z of the vertex attributes of a triangle. Like 1/z, attribute/z is linear in camera
+/// coords, so the attributes of a pixel are the values of the planes times its depth: the reciprocal already taken for
+/// the depth is the only division per pixel, and the rest costs a multiply-add and a multiply per attribute.
+typedef struct varyings_setup {
+  usize len;
+  /// attribute/z at pixel X 0 of the current row (see `varyings_row`).
+  f32 row[MAX_VERTEX_ATTRIBUTES];
+  /// Change of attribute/z per pixel along X.
+  f32 step[MAX_VERTEX_ATTRIBUTES];
+  /// attribute/z at pixel X 0 and camera Y 0.
+  f32 origin[MAX_VERTEX_ATTRIBUTES];
+  /// Change of attribute/z per unit of camera Y.
+  f32 ddy[MAX_VERTEX_ATTRIBUTES];
+  /// Change of 1/z per pixel along X and per unit of camera Y, for the derivatives of the attributes.
+  f32 inv_z_step, inv_z_ddy;
+} VaryingsSetup;
+
+/// `attributes` are those of p0, p1, p2, `len` each. `x_ratio` and `min_x` map pixel X to camera X like in
+/// `triangle_row`.
+static inline VaryingsSetup varyings_setup(
+    const TriangleSetup *t, const f32 *const attributes[3], usize len, f32 x_ratio, f32 min_x) {
+  f32 x2 = t->p2.get[0];
+  f32 y2 = t->p2.get[1];
+  f32 z0 = t->inv_z0 - t->inv_z2;
+  f32 z1 = t->inv_z1 - t->inv_z2;
+  VaryingsSetup v = {
+      .len = len,
+      .inv_z_step = (t->dy12 * z0 + t->dy20 * z1) / t->denominator * x_ratio,
+      .inv_z_ddy = ((x2 - t->p1.get[0]) * z0 + (t->p0.get[0] - x2) * z1) / t->denominator,
+  };
+  for (usize i = 0; i < len; ++i) {
+    // With the weights of `triangular_interpolate_z`, q = q2 + w0 (q0 - q2) + w1 (q1 - q2).
+    f32 q2 = attributes[2][i] * t->inv_z2;
+    f32 d0 = attributes[0][i] * t->inv_z0 - q2;
+    f32 d1 = attributes[1][i] * t->inv_z1 - q2;
+    f32 ddx = (t->dy12 * d0 + t->dy20 * d1) / t->denominator;
+    f32 ddy = ((x2 - t->p1.get[0]) * d0 + (t->p0.get[0] - x2) * d1) / t->denominator;
+    v.step[i] = ddx * x_ratio;
+    v.origin[i] = q2 + ddx * (min_x - x2) - ddy * y2;
+    v.ddy[i] = ddy;
+    v.row[i] = v.origin[i];
+  }
+  return v;
+}
+
+/// Moves to the row at camera Y `y`.
+static inline void varyings_row(VaryingsSetup *v, f32 y) {
+  for (usize i = 0; i < v->len; ++i) {
+    v->row[i] = v->origin[i] + v->ddy[i] * y;
+  }
+}
+
+/// The attributes at pixel X `x` of the current row, whose depth is `depth`, into `out` (`len` of them).
+static inline void varyings_at(const VaryingsSetup *v, usize x, f32 depth, f32 *out) {
+  f32 x_ = (f32)x;
+  for (usize i = 0; i < v->len; ++i) {
+    out[i] = (v->row[i] + v->step[i] * x_) * depth;
+  }
+}
+
+/// Like `varyings_at`, at pixel X `x` (fractional) and camera Y `y` of any row, e.g. of a sample of a pixel.
+static inline void varyings_at_point(const VaryingsSetup *v, f32 x, f32 y, f32 depth, f32 *out) {
+  for (usize i = 0; i < v->len; ++i) {
+    out[i] = (v->origin[i] + v->ddy[i] * y + v->step[i] * x) * depth;
+  }
+}